@@ -67,6 +67,14 @@ namespace bkp {
         return fread(ptr, size, count, f_);
     }
     
+    size_t FileWrapper::Write(const void *ptr, size_t size, size_t count) {
+        return fwrite(ptr, size, count, f_);
+    }
+    
+    int FileWrapper::Seek(long offset, int origin) {
+        return fseek(f_, offset, origin);
+    }
+    
     int FileWrapper::Flush() {
         return fflush(f_);
     }
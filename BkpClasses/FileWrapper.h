@@ -49,6 +49,8 @@ namespace bkp {
         int Scanf(std::string format, ...);
         char* Gets(char* str, int num);
         size_t Read(void* ptr, size_t size, size_t count);
+        size_t Write(const void* ptr, size_t size, size_t count);
+        int Seek(long offset, int origin);
         int Flush();
         int Close();
         
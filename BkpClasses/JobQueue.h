@@ -13,6 +13,7 @@
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
+#include <cstddef>
 
 namespace bkp {
     
@@ -31,6 +32,17 @@ namespace bkp {
         // used to signal waiting pop requests to stop waiting
         std::condition_variable deque_cv_;
         
+        // Maximum number of jobs that may be waiting in deque_ at once,
+        // or 0 for no limit. When the queue is full, CopyBack/MoveBack
+        // block until a consumer pops something. This lets a fast producer
+        // be throttled to the speed of its consumers, so that it can't run
+        // arbitrarily far ahead (and use arbitrarily much memory).
+        const std::size_t capacity_;
+        
+        // used to signal producers blocked on a full queue that there's
+        // room for another job
+        std::condition_variable not_full_cv_;
+        
         // flag set by producer to signal that no more jobs will be
         // added. Calling PushBack after setting this flag is an error.
         // I think this has to be atomic to ensure synchronization
@@ -59,6 +71,9 @@ namespace bkp {
                 pop_success = true;
                 pop_result = std::move(deque_.front());
                 deque_.pop_front();
+                if (capacity_ != 0) {
+                    not_full_cv_.notify_one();
+                }
             }
             else if(is_adding_complete_) {
                 any_success = true;
@@ -71,11 +86,31 @@ namespace bkp {
             return result;
         }
         
+        // Block until deque_ has room for another job (see capacity_).
+        // NOTE: caller must pass a unique_lock that holds deque_mutex_
+        inline void WaitUntilNotFull(std::unique_lock<std::mutex>& deque_lock) {
+            if (capacity_ != 0) {
+                auto is_not_full = [this]() {
+                    return this->deque_.size() < this->capacity_;
+                };
+                not_full_cv_.wait(deque_lock, is_not_full);
+            }
+        }
+        
     public:
         
         JobQueue() :
         is_adding_complete_(false),
-        deque_mutex_()
+        deque_mutex_(),
+        capacity_(0)
+        { }
+        
+        // Create a bounded JobQueue that will hold at most 'capacity' jobs at a
+        // time (see capacity_). A capacity of 0 means unbounded.
+        explicit JobQueue(std::size_t capacity) :
+        is_adding_complete_(false),
+        deque_mutex_(),
+        capacity_(capacity)
         { }
         
         // Attempt to pop a value from the queue. If it succeeds, it will
@@ -120,10 +155,12 @@ namespace bkp {
         
         // Push an item onto the queue. This call contains an assertion to check
         // that CompleteAdding() has not been called. Barring that assertion failure
-        // however, this call will never fail.
+        // however, this call will never fail. If this is a bounded queue and it's
+        // full, this call will wait until there's room.
         void CopyBack(TJob job) {
             {
                 std::unique_lock<std::mutex> deque_lock(deque_mutex_);
+                WaitUntilNotFull(deque_lock);
                 assert(!is_adding_complete_); // calling PushBack after calling CompleteAdding is an error
                 deque_.push_back(job);
                 
@@ -135,10 +172,12 @@ namespace bkp {
         
         // Push an item onto the queue. This call contains an assertion to check
         // that CompleteAdding() has not been called. Barring that assertion failure
-        // however, this call will never fail.
+        // however, this call will never fail. If this is a bounded queue and it's
+        // full, this call will wait until there's room.
         void MoveBack(TJob&& job) {
             {
                 std::unique_lock<std::mutex> deque_lock(deque_mutex_);
+                WaitUntilNotFull(deque_lock);
                 assert(!is_adding_complete_); // calling PushBack after calling CompleteAdding is an error
                 deque_.push_back(std::move(job));
                 
@@ -175,6 +214,11 @@ namespace bkp {
             return is_adding_complete_;
         }
         
+        // Maximum number of jobs this queue will hold at once, or 0 if unbounded
+        std::size_t capacity() const {
+            return capacity_;
+        }
+        
         // Return true if CompleteAdding has been called, and this JobQueue is empty
         bool IsComplete() {
             std::unique_lock<std::mutex> deque_lock(deque_mutex_);
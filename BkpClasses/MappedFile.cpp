@@ -0,0 +1,124 @@
+//
+//  MappedFile.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "MappedFile.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace bkp {
+
+    MappedFile::MappedFile() :
+    data_(nullptr),
+    size_(0),
+    mapped_size_(0)
+    { }
+
+    MappedFile::~MappedFile() {
+        Close();
+    }
+
+    bool MappedFile::Open(const std::string& filename) {
+        Close();
+
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat s;
+        if (fstat(fd, &s) != 0) {
+            close(fd);
+            return false;
+        }
+
+        const std::size_t file_size = static_cast<std::size_t>(s.st_size);
+        const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+
+        // Reserve one byte more than the file needs, rounded up to a whole
+        // page. The reservation is anonymous memory (zero-filled), and then the
+        // file is mapped over the front of it. The bytes after the end of the
+        // file are therefore always '\0': either they are the zero-filled tail
+        // of the file's last page, or they are the first byte of the extra
+        // anonymous page.
+        const std::size_t mapped_size = ((file_size / page_size) + 1) * page_size;
+        void* base = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (base == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+
+        if (file_size > 0) {
+            void* file_base = mmap(base, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+            if (file_base == MAP_FAILED) {
+                munmap(base, mapped_size);
+                close(fd);
+                return false;
+            }
+
+            // We're going to read the file front-to-back exactly once, so tell
+            // the kernel it can read ahead aggressively.
+            madvise(base, file_size, MADV_SEQUENTIAL);
+        }
+
+        // the mapping stays valid after the descriptor is closed
+        close(fd);
+
+        data_ = static_cast<const char*>(base);
+        size_ = file_size;
+        mapped_size_ = mapped_size;
+        return true;
+    }
+
+    bool MappedFile::IsOpen() const {
+        return data_ != nullptr;
+    }
+
+    MappedFile::operator bool() const {
+        return data_ != nullptr;
+    }
+
+    void MappedFile::Close() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), mapped_size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        mapped_size_ = 0;
+    }
+
+    const char* MappedFile::data() const {
+        return data_;
+    }
+
+    std::size_t MappedFile::size() const {
+        return size_;
+    }
+
+    const char* MappedFile::end() const {
+        return data_ + size_;
+    }
+
+    void MappedFile::Discard(const char* begin, const char* end) {
+        if (data_ == nullptr) {
+            return;
+        }
+
+        // round begin up and end down to page boundaries (relative to the
+        // start of the mapping, which is page-aligned)
+        const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        const std::size_t first = ((begin - data_) + page_size - 1) / page_size * page_size;
+        const std::size_t last = ((end - data_) / page_size) * page_size;
+        if (last > first) {
+            madvise(const_cast<char*>(data_) + first, last - first, MADV_DONTNEED);
+        }
+    }
+}
@@ -0,0 +1,77 @@
+//
+//  MappedFile.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____MappedFile__
+#define __RandomForest____MappedFile__
+
+#include <cstddef>
+#include <string>
+
+namespace bkp {
+
+    // Read-only memory mapping of an entire file. This is the
+    // zero-copy counterpart to FileWrapper: instead of pulling
+    // bytes through stdio buffers, the file's pages are mapped
+    // straight into our address space and can be read like a
+    // big const char array.
+    //
+    // The mapping is always followed by at least one '\0' byte
+    // (i.e. data()[size()] == '\0'), even when the file size is
+    // an exact multiple of the page size. This means the contents
+    // can safely be handed to C string functions like strtod
+    // without first copying them into a NUL-terminated buffer.
+    //
+    // Like FileWrapper, the mapping is released automatically
+    // when the object is destroyed. Copying is disabled since
+    // two objects can't both own the same mapping.
+    class MappedFile {
+    private:
+        const char* data_;
+        std::size_t size_;
+
+        // total number of bytes mapped (file size, rounded up to
+        // make room for the trailing '\0')
+        std::size_t mapped_size_;
+
+    public:
+        MappedFile();
+        virtual ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Map the specified file. Returns false if the file could not be
+        // opened or mapped. Calling Open on an already-open MappedFile
+        // will Close the old mapping first.
+        bool Open(const std::string& filename);
+        bool IsOpen() const;
+        operator bool() const;
+
+        // Unmap the file. Safe to call on a MappedFile that isn't open.
+        void Close();
+
+        // Pointer to the first byte of the file, or nullptr if not open
+        const char* data() const;
+
+        // Size of the file in bytes (not counting the trailing '\0')
+        std::size_t size() const;
+
+        // Convenience: one-past-the-end of the file contents
+        const char* end() const;
+
+        // Tell the OS we won't be reading [begin, end) again, so the pages
+        // it occupies can be dropped from memory right away. Only whole pages
+        // inside the range are affected. Reading them again later is still
+        // allowed (they'll just be re-read from disk), so this is purely a
+        // hint for keeping memory use down when streaming through a big file.
+        void Discard(const char* begin, const char* end);
+    };
+
+}
+
+#endif /* defined(__RandomForest____MappedFile__) */
@@ -0,0 +1,239 @@
+//
+//  NumParse.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "NumParse.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+#include <climits>
+#include <vector>
+
+namespace bkp {
+
+    ////////// private stuff //////////
+
+    // Most significant digits we'll accumulate into a uint64_t. 10^19 < 2^64,
+    // so 19 digits can never overflow.
+    const int MAX_MANTISSA_DIGITS = 19;
+
+    // Largest integer that a double can represent exactly (2^53). Any integer
+    // up to this converts to double without rounding.
+    const std::uint64_t MAX_EXACT_MANTISSA = 1ULL << 53;
+
+    // Every power of ten up to 10^22 is exactly representable as a double
+    // (10^23 isn't), so multiplying or dividing by one of these rounds exactly
+    // once, which gives the correctly-rounded result. This is the "fast path"
+    // from Clinger's "How to Read Floating Point Numbers Accurately" (1990).
+    const int MAX_EXACT_POWER_OF_10 = 22;
+    const double EXACT_POWERS_OF_10[MAX_EXACT_POWER_OF_10 + 1] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // Cap on the parsed exponent, so that absurd exponents like "1e99999999999"
+    // can't overflow an int. Anything this big is inf or 0 anyway.
+    const int MAX_EXPONENT = 100000;
+
+    inline bool IsDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    // Slow path for numbers the fast path can't convert exactly: hand the
+    // already-validated text to strtod. strtod needs a '\0'-terminated string
+    // and uses the current locale's decimal point, so first copy the text,
+    // swapping '.' for whatever the locale wants. Short numbers are copied to
+    // the stack; only silly ones (hundreds of digits) need the heap.
+    double SlowParseDouble(const char* begin, const char* end) {
+        const std::size_t length = end - begin;
+        const char* decimal_point = std::localeconv()->decimal_point;
+        const std::size_t decimal_point_length = std::strlen(decimal_point);
+        const std::size_t buffer_size = length * decimal_point_length + 1;
+
+        const std::size_t STACK_BUFFER_SIZE = 128;
+        char stack_buffer[STACK_BUFFER_SIZE];
+        std::vector<char> heap_buffer;
+        char* buffer = stack_buffer;
+        if (buffer_size > STACK_BUFFER_SIZE) {
+            heap_buffer.resize(buffer_size);
+            buffer = heap_buffer.data();
+        }
+
+        char* out = buffer;
+        for (const char* p = begin; p != end; ++p) {
+            if (*p == '.') {
+                std::memcpy(out, decimal_point, decimal_point_length);
+                out += decimal_point_length;
+            }
+            else {
+                *out++ = *p;
+            }
+        }
+        *out = '\0';
+
+        return std::strtod(buffer, nullptr);
+    }
+
+    ////////// public stuff (from NumParse.h) //////////
+
+    ParseResult ParseDouble(const char* begin, const char* end, double& value) {
+        const char* p = begin;
+
+        bool negative = false;
+        if (p != end && (*p == '-' || *p == '+')) {
+            negative = (*p == '-');
+            ++p;
+        }
+
+        // Accumulate the significant digits into 'mantissa' and keep track of
+        // where the decimal point goes in 'exponent', so that the number is
+        // mantissa * 10^exponent. Digits past the 19th are dropped (which
+        // forces the slow path if any of them are non-zero).
+        std::uint64_t mantissa = 0;
+        int n_mantissa_digits = 0;
+        int exponent = 0;
+        bool any_digits = false;
+        bool dropped_digits = false;
+
+        for (; p != end && IsDigit(*p); ++p) {
+            any_digits = true;
+            const int digit = *p - '0';
+            if (mantissa == 0 && digit == 0) {
+                continue; // leading zero
+            }
+            if (n_mantissa_digits < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + digit;
+                ++n_mantissa_digits;
+            }
+            else {
+                ++exponent;
+                dropped_digits |= (digit != 0);
+            }
+        }
+
+        if (p != end && *p == '.') {
+            ++p;
+            for (; p != end && IsDigit(*p); ++p) {
+                any_digits = true;
+                const int digit = *p - '0';
+                if (mantissa == 0 && digit == 0) {
+                    --exponent; // leading zero after the decimal point
+                }
+                else if (n_mantissa_digits < MAX_MANTISSA_DIGITS) {
+                    mantissa = mantissa * 10 + digit;
+                    ++n_mantissa_digits;
+                    --exponent;
+                }
+                else {
+                    dropped_digits |= (digit != 0);
+                }
+            }
+        }
+
+        if (!any_digits) {
+            ParseResult failure = { begin, false };
+            return failure;
+        }
+
+        // Optional exponent. As with strtod, an 'e' that isn't followed by
+        // digits isn't part of the number (e.g. "1e" parses as 1 and stops
+        // at the 'e').
+        if (p != end && (*p == 'e' || *p == 'E')) {
+            const char* q = p + 1;
+            bool negative_exponent = false;
+            if (q != end && (*q == '-' || *q == '+')) {
+                negative_exponent = (*q == '-');
+                ++q;
+            }
+            if (q != end && IsDigit(*q)) {
+                int explicit_exponent = 0;
+                for (; q != end && IsDigit(*q); ++q) {
+                    if (explicit_exponent < MAX_EXPONENT) {
+                        explicit_exponent = explicit_exponent * 10 + (*q - '0');
+                    }
+                }
+                exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+                p = q;
+            }
+        }
+
+        double result;
+        if (mantissa == 0) {
+            result = 0.0;
+        }
+        else if (!dropped_digits &&
+                 mantissa <= MAX_EXACT_MANTISSA &&
+                 exponent >= -MAX_EXACT_POWER_OF_10 &&
+                 exponent <= MAX_EXACT_POWER_OF_10)
+        {
+            result = static_cast<double>(mantissa);
+            if (exponent < 0) {
+                result /= EXACT_POWERS_OF_10[-exponent];
+            }
+            else {
+                result *= EXACT_POWERS_OF_10[exponent];
+            }
+        }
+        else {
+            // SlowParseDouble handles the sign itself
+            value = SlowParseDouble(begin, p);
+            ParseResult success = { p, true };
+            return success;
+        }
+
+        value = negative ? -result : result;
+        ParseResult success = { p, true };
+        return success;
+    }
+
+    ParseResult ParseDouble(const char* begin,
+                            const char* end,
+                            double& value,
+                            double missing_value,
+                            double replacement)
+    {
+        ParseResult result = ParseDouble(begin, end, value);
+        if (result.ok_ && value == missing_value) {
+            value = replacement;
+        }
+        return result;
+    }
+
+    ParseResult ParseInt(const char* begin, const char* end, int& value) {
+        const char* p = begin;
+
+        bool negative = false;
+        if (p != end && (*p == '-' || *p == '+')) {
+            negative = (*p == '-');
+            ++p;
+        }
+
+        // accumulate in a long long, so that the magnitude of INT_MIN fits too
+        const long long limit = negative ? -static_cast<long long>(INT_MIN) : INT_MAX;
+        long long magnitude = 0;
+        bool any_digits = false;
+        for (; p != end && IsDigit(*p); ++p) {
+            any_digits = true;
+            magnitude = magnitude * 10 + (*p - '0');
+            if (magnitude > limit) {
+                ParseResult failure = { begin, false };
+                return failure;
+            }
+        }
+
+        if (!any_digits) {
+            ParseResult failure = { begin, false };
+            return failure;
+        }
+
+        value = static_cast<int>(negative ? -magnitude : magnitude);
+        ParseResult success = { p, true };
+        return success;
+    }
+}
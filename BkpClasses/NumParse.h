@@ -0,0 +1,50 @@
+//
+//  NumParse.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____NumParse__
+#define __RandomForest____NumParse__
+
+namespace bkp {
+
+    // Result of a ParseXxx call, modelled on C++17's std::from_chars_result.
+    // ptr_ points to the first character that was not part of the number.
+    // If ok_ is false, no number was found, ptr_ == begin and the output
+    // value is left untouched.
+    struct ParseResult {
+        const char* ptr_;
+        bool ok_;
+    };
+
+    // Parse a decimal floating point number from the front of [begin, end),
+    // e.g. "-12.5e3". Unlike strtod/std::stod this:
+    //     - works on a raw character range; it doesn't need a '\0' terminator
+    //       or a std::string, and never allocates
+    //     - ignores the current locale; the decimal point is always '.'
+    //     - doesn't skip leading whitespace or accept hex, "inf" or "nan"
+    //
+    // Numbers with at most 19 significant digits and a small enough exponent
+    // (which covers everything in the Higgs data) are converted exactly with
+    // a couple of floating point operations; anything else falls back to a
+    // slower, but still correctly-rounded, conversion. The result is always
+    // the same double that strtod would return.
+    ParseResult ParseDouble(const char* begin, const char* end, double& value);
+
+    // Same as above, but if the parsed number equals missing_value, store
+    // replacement instead (e.g. to turn a -999.0 "no data" marker into NaN).
+    ParseResult ParseDouble(const char* begin,
+                            const char* end,
+                            double& value,
+                            double missing_value,
+                            double replacement);
+
+    // Parse a decimal integer (with optional sign) from the front of [begin, end).
+    // Fails if there are no digits or the value doesn't fit in an int.
+    ParseResult ParseInt(const char* begin, const char* end, int& value);
+}
+
+#endif /* defined(__RandomForest____NumParse__) */
@@ -16,33 +16,76 @@ namespace bkp {
     
     namespace random {
         
-        // private, global random engine. Seed is applied to this generator,
-        // and then this generator is used to seed the thread-specific
-        // generators that are actually used by the public methods. This should
-        // only be used inside of Generator(), and the main_generator_mutex
-        // must be held before use.
-        static std::default_random_engine main_generator;
-        static std::mutex main_generator_mutex;
+        const std::uint64_t CounterEngine::GAMMA;
+        
+        // private, global seed state. Seed sets seed_key (a hash of the
+        // seed), and each new thread-specific generator, which is what the
+        // public methods actually use, is keyed by seed_key and the number of
+        // threads seeded before it. This should only be used inside of
+        // Generator() and Seed(), and the seed_mutex must be held before use.
+        static std::uint64_t seed_key = CounterEngine::Mix(0);
+        static std::uint64_t n_threads_seeded = 0;
+        static std::mutex seed_mutex;
+        
+        // The key of one of seed_key's streams. Threads' default streams and
+        // SeedStream's numbered streams hash different inputs (odd and even,
+        // respectively), and Mix is a bijection, so no two are the same.
+        std::uint64_t StreamKey(std::uint64_t seed_key, std::uint64_t hash_input) {
+            return CounterEngine::Mix(seed_key ^ CounterEngine::Mix(hash_input));
+        }
         
         // Return a reference to a random generator for use in other methods. This
         // method takes care of initialization requirements and thread-local requirements.
         // Callers must be sure to store the result as a reference not as a copy (e.g.
         // "auto result = Generator()" is a very easy bug, should be "auto&"), or the
-        // state of the global generator will not be updated and repeated calls will
+        // state of the thread's generator will not be updated and repeated calls will
         // produce the same results over and over.
-        std::default_random_engine& Generator() {
-            static boost::thread_specific_ptr<std::default_random_engine> thread_generator;
+        CounterEngine& Generator() {
+            static boost::thread_specific_ptr<CounterEngine> thread_generator;
             
             if (!thread_generator.get()) {
-                thread_generator.reset(new std::default_random_engine);
-                std::lock_guard<std::mutex> main_generator_lock(main_generator_mutex);
-                thread_generator->seed(main_generator());
-            } // release main_generator_lock
+                thread_generator.reset(new CounterEngine);
+                std::lock_guard<std::mutex> seed_lock(seed_mutex);
+                thread_generator->seed(StreamKey(seed_key, 2 * (n_threads_seeded++) + 1));
+            } // release seed_lock
             
             return *thread_generator;
         }
         
-        void Seed(int seed) { main_generator.seed(seed); }
+        void Seed(int seed) {
+            // Also re-seed the calling thread's generator (which may already
+            // exist), so that everything this thread does after Seed is
+            // repeatable. Other existing threads keep their current state.
+            CounterEngine& thread_generator = Generator();
+            
+            std::lock_guard<std::mutex> seed_lock(seed_mutex);
+            seed_key = CounterEngine::Mix(static_cast<std::uint64_t>(seed));
+            n_threads_seeded = 0;
+            thread_generator.seed(StreamKey(seed_key, 2 * (n_threads_seeded++) + 1));
+        }
+        
+        void SeedStream(std::uint64_t stream) {
+            CounterEngine& thread_generator = Generator();
+            
+            std::lock_guard<std::mutex> seed_lock(seed_mutex);
+            thread_generator.seed(StreamKey(seed_key, 2 * stream));
+        }
+        
+        ScopedStream::ScopedStream(std::uint64_t stream) :
+        saved_(Generator())
+        {
+            SeedStream(stream);
+        }
+        
+        ScopedStream::ScopedStream(const CounterEngine& engine) :
+        saved_(Generator())
+        {
+            Generator() = engine;
+        }
+        
+        ScopedStream::~ScopedStream() {
+            Generator() = saved_;
+        }
         
         int RandInt(int low, int high) {
             return std::uniform_int_distribution<int>(low, high)(Generator());
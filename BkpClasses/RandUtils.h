@@ -13,6 +13,8 @@
 #include <vector>
 #include <random>
 #include <array>
+#include <cstdint>
+#include <limits>
 
 namespace bkp {
     
@@ -21,24 +23,102 @@ namespace bkp {
     // in a namespace instead of a class because there's no non-static
     // state shared between the methods.
     //
-    // RandUtils maintains a static thread-local std::default_random_engine
+    // RandUtils maintains a static thread-local CounterEngine
     // that is used by all methods for improved randomness and so that
     // you don't have to see 100 different generators throughout your
-    // program. The engines provided by the standard library are assumed
-    // to not be thread-safe, so the thread-local allows us to side-step
-    // that issue without locks/mutexes.
+    // program. The engines are not thread-safe, so the thread-local allows
+    // us to side-step that issue without locks/mutexes.
     //
     // RandUtils must be seeded (via bkp::random::Seed) at program start,
     // but after that it will take care of seeing each new thread-local
     // instance as it is created.
+    //
+    // Which thread gets which of those seeds depends on the order threads
+    // happen to start in, so work that's spread over threads isn't
+    // repeatable by default. To make it repeatable, number the pieces of
+    // work and run each one in its own stream (see ScopedStream): a stream
+    // depends only on the Seed and its number, not on which thread runs it.
     namespace random {
         
+        // A counter-based random engine (the same outputs as SplitMix64):
+        // the nth number from a key is a hash of key + n * GAMMA, so an
+        // engine is just a key and a counter, and any key's numbers can
+        // be produced on any thread without stepping through another
+        // engine's. Meets the standard's UniformRandomBitGenerator
+        // requirements, so works with the std distributions.
+        class CounterEngine {
+        private:
+            std::uint64_t key_;
+            std::uint64_t counter_;
+            
+        public:
+            typedef std::uint64_t result_type;
+            static const std::uint64_t GAMMA = 0x9e3779b97f4a7c15ULL;
+            
+            static constexpr result_type min() { return 0; }
+            static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+            
+            explicit CounterEngine(std::uint64_t key=0) :
+            key_(key),
+            counter_(0)
+            { }
+            
+            void seed(std::uint64_t key) {
+                key_ = key;
+                counter_ = 0;
+            }
+            
+            result_type operator()() {
+                ++counter_;
+                return Mix(key_ + counter_ * GAMMA);
+            }
+            
+            // SplitMix64's finalizer: a bijection on 64-bit values that
+            // changes about half the output bits for any changed input bit
+            static std::uint64_t Mix(std::uint64_t z) {
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            }
+        };
+        
         // auto-initialized (but not seeded!) thread-local generator
-        std::default_random_engine& Generator();
+        CounterEngine& Generator();
         
-        // Set the seed that will be used for the internal generators
+        // Set the seed that will be used for the internal generators. The
+        // calling thread's generator is re-seeded immediately, so calling
+        // Seed again with the same value repeats the same random numbers.
         void Seed(int seed);
         
+        // Re-seed the calling thread's generator to the start of the given
+        // stream of the last Seed. Any thread that does this (after the same
+        // Seed) gets the same random numbers from then on. Different streams
+        // give independent numbers, and none of them overlap with the
+        // threads' own default seeds.
+        void SeedStream(std::uint64_t stream);
+        
+        // Switches the calling thread's generator to a stream (see
+        // SeedStream) for the lifetime of this object, then puts it back the
+        // way it was, so the thread's other random numbers are the same as
+        // if the stream had never been used. For example, TreeCreator trains
+        // each tree in its own stream, so that a forest comes out the same
+        // whichever threads train its trees.
+        //
+        // Or switches to a given engine instead, e.g. one of several made
+        // on one thread to hand out to tasks that may run on any thread.
+        class ScopedStream {
+        private:
+            const CounterEngine saved_;
+            
+        public:
+            explicit ScopedStream(std::uint64_t stream);
+            explicit ScopedStream(const CounterEngine& engine);
+            ~ScopedStream();
+            
+            ScopedStream(const ScopedStream&) = delete;
+            ScopedStream& operator=(const ScopedStream&) = delete;
+        };
+        
         // Return a random integer in the range low-high (inclusive-inclusive)
         int RandInt(int low, int high);
         
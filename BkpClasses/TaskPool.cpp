@@ -0,0 +1,158 @@
+//
+//  TaskPool.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <boost/thread.hpp>
+
+namespace bkp {
+
+    ////////// private stuff //////////
+
+    // Which pool (if any) the current thread is a worker of, and its index
+    struct WorkerId {
+        const TaskPool* pool_;
+        int index_;
+    };
+
+    boost::thread_specific_ptr<WorkerId>& CurrentWorker() {
+        static boost::thread_specific_ptr<WorkerId> current_worker;
+        return current_worker;
+    }
+
+    int TaskPool::HomeDeque() const {
+        const WorkerId* worker = CurrentWorker().get();
+        if (worker != nullptr && worker->pool_ == this) {
+            return worker->index_;
+        }
+        return static_cast<int>(deques_.size()) - 1;
+    }
+
+    void TaskPool::Push(Task task) {
+        TaskDeque& deque = *deques_[HomeDeque()];
+        {
+            std::lock_guard<std::mutex> deque_lock(deque.mutex_);
+            deque.tasks_.push_back(std::move(task));
+            ++n_queued_;
+        }
+        WakeAll();
+    }
+
+    bool TaskPool::TryPop(int home, Task& out) {
+        const int n_deques = static_cast<int>(deques_.size());
+        for (int offset=0; offset<n_deques; ++offset) {
+            TaskDeque& deque = *deques_[(home + offset) % n_deques];
+            std::lock_guard<std::mutex> deque_lock(deque.mutex_);
+            if (deque.tasks_.empty()) {
+                continue;
+            }
+            // newest of our own tasks, oldest of anyone else's
+            if (offset == 0) {
+                out = std::move(deque.tasks_.back());
+                deque.tasks_.pop_back();
+            }
+            else {
+                out = std::move(deque.tasks_.front());
+                deque.tasks_.pop_front();
+            }
+            --n_queued_;
+            return true;
+        }
+        return false;
+    }
+
+    void TaskPool::WakeAll() {
+        // Taking the lock (even briefly) means a thread that has just checked
+        // its wake condition is guaranteed to be waiting by the time we
+        // notify it, so the wakeup can't be lost
+        {
+            std::lock_guard<std::mutex> wake_lock(wake_mutex_);
+        }
+        wake_cv_.notify_all();
+    }
+
+    void TaskPool::RunUntil(const std::function<bool()>& done) {
+        const int home = HomeDeque();
+        Task task;
+        while (!done()) {
+            if (TryPop(home, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> wake_lock(wake_mutex_);
+            auto can_continue = [this, &done]() {
+                return this->n_queued_ > 0 || done();
+            };
+            wake_cv_.wait(wake_lock, can_continue);
+        }
+    }
+
+    void TaskPool::WorkerLoop(int index) {
+        CurrentWorker().reset(new WorkerId{ this, index });
+        RunUntil([this]() { return this->stopping_.load(); });
+        CurrentWorker().reset();
+    }
+
+    ////////// public stuff (from TaskPool.h) //////////
+
+    TaskPool::TaskPool(int n_threads) :
+    n_queued_(0),
+    stopping_(false)
+    {
+        n_threads = std::max(n_threads, 1);
+
+        // create every deque before any worker can look at them
+        for (int i=0; i<=n_threads; ++i) {
+            deques_.push_back(std::unique_ptr<TaskDeque>(new TaskDeque));
+        }
+        for (int i=0; i<n_threads; ++i) {
+            threads_.push_back(std::thread(&TaskPool::WorkerLoop, this, i));
+        }
+    }
+
+    TaskPool::~TaskPool() {
+        {
+            std::lock_guard<std::mutex> wake_lock(wake_mutex_);
+            stopping_ = true;
+        }
+        wake_cv_.notify_all();
+
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    TaskGroup::TaskGroup(TaskPool& pool) :
+    pool_(pool),
+    n_pending_(0)
+    { }
+
+    TaskGroup::~TaskGroup() {
+        Wait();
+    }
+
+    void TaskGroup::Run(TaskPool::Task task) {
+        ++n_pending_;
+        pool_.Push([this, task]() {
+            // once n_pending_ reaches 0, Wait may return and this TaskGroup
+            // may be destroyed, so don't touch any members after that
+            TaskPool& pool = this->pool_;
+            task();
+            if (--this->n_pending_ == 0) {
+                pool.WakeAll();
+            }
+        });
+    }
+
+    void TaskGroup::Wait() {
+        pool_.RunUntil([this]() { return this->n_pending_ == 0; });
+    }
+}
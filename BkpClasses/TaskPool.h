@@ -0,0 +1,118 @@
+//
+//  TaskPool.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____TaskPool__
+#define __RandomForest____TaskPool__
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace bkp {
+
+    // A pool of worker threads for fork-join work, where tasks may start
+    // more tasks of their own (e.g. recursively training both halves of a
+    // tree). Tasks are started and waited on through a TaskGroup.
+    //
+    // Each worker has its own deque of tasks. A worker pushes the tasks it
+    // starts onto the back of its own deque and pops from the back too, so it
+    // works depth-first on the tasks it started most recently. A worker that
+    // runs out steals from the front of another worker's deque, where the
+    // oldest (and, for recursive work, largest) tasks are. Tasks started from
+    // threads outside the pool go in a shared deque that every worker takes
+    // from.
+    class TaskPool {
+    public:
+        typedef std::function<void()> Task;
+
+    private:
+        friend class TaskGroup;
+
+        struct TaskDeque {
+            std::mutex mutex_;
+            std::deque<Task> tasks_;
+        };
+
+        // deques_[i] belongs to worker i; the last one is the shared deque
+        // for tasks started outside the pool
+        std::vector<std::unique_ptr<TaskDeque>> deques_;
+        std::vector<std::thread> threads_;
+
+        // number of tasks waiting in any deque
+        std::atomic<int> n_queued_;
+
+        // threads with nothing to run sleep on wake_cv_ until a task is
+        // queued (or whatever they're waiting for happens)
+        std::mutex wake_mutex_;
+        std::condition_variable wake_cv_;
+        std::atomic<bool> stopping_;
+
+        // index of the calling thread's deque: its own if it's one of this
+        // pool's workers, otherwise the shared one
+        int HomeDeque() const;
+
+        void Push(Task task);
+
+        // Take a task from the back of deque 'home', or failing that, from
+        // the front of any other deque. Returns false if there were none.
+        bool TryPop(int home, Task& out);
+
+        // Wake every sleeping thread, e.g. because a task was queued or a
+        // TaskGroup finished
+        void WakeAll();
+
+        // Run queued tasks (sleeping when there are none) until done()
+        // returns true. Used by both the workers (done when the pool is
+        // stopping) and threads waiting on a TaskGroup.
+        void RunUntil(const std::function<bool()>& done);
+
+        void WorkerLoop(int index);
+
+    public:
+        // n_threads worker threads (at least 1)
+        explicit TaskPool(int n_threads=std::thread::hardware_concurrency());
+
+        // Stop and join the workers. Every TaskGroup must have been waited
+        // on first.
+        ~TaskPool();
+
+        int size() const { return static_cast<int>(threads_.size()); }
+    };
+
+    // A set of tasks run on a TaskPool that can be waited on together.
+    //
+    // Usage: Run any number of tasks (from any thread, including from inside
+    // tasks), then Wait. A thread waiting on a TaskGroup runs queued tasks
+    // (from any group) while it waits, so tasks that wait on their own
+    // subtasks never leave a worker idle or deadlock the pool.
+    class TaskGroup {
+    private:
+        TaskPool& pool_;
+        std::atomic<int> n_pending_;
+
+    public:
+        explicit TaskGroup(TaskPool& pool);
+        ~TaskGroup(); // calls Wait()
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        // Queue 'task' to be run on the pool. It may run on any thread.
+        void Run(TaskPool::Task task);
+
+        // Return once every task started with Run has finished
+        void Wait();
+    };
+}
+
+#endif /* defined(__RandomForest____TaskPool__) */
@@ -89,4 +89,18 @@ TEST(FileWrapperTests, Gets) {
     
     EXPECT_EQ(contents_ptr, f.Gets(contents_ptr, size));
     EXPECT_STREQ("this is a test file.\n", contents_ptr);
+}
+
+TEST(FileWrapperTests, Seek) {
+    FileWrapper f;
+    ASSERT_EQ(true, f.Open("testfile.txt", "r"));
+    
+    char buffer[5] = {0};
+    EXPECT_EQ(0, f.Seek(10, SEEK_SET));
+    EXPECT_EQ(1, f.Read(buffer, 4, 1));
+    EXPECT_STREQ("test", buffer);
+    
+    EXPECT_EQ(0, f.Seek(-7, SEEK_END));
+    EXPECT_EQ(1, f.Read(buffer, 4, 1));
+    EXPECT_STREQ("line", buffer);
 }
\ No newline at end of file
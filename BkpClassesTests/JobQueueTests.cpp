@@ -254,3 +254,45 @@ TEST(JobQueueTests, RawPointers) {
         ASSERT_EQ(true, b);
     }
 }
+
+// Use sleep() calls to ensure that a bounded JobQueue makes the producer
+// wait when it's full, and lets it continue once a job has been popped
+TEST(JobQueueTests, BoundedQueueBlocksProducer) {
+    
+    const int CAPACITY = 3;
+    bkp::JobQueue<int> job_queue(CAPACITY);
+    EXPECT_EQ(CAPACITY, job_queue.capacity());
+    
+    std::atomic<int> n_pushed(0);
+    auto producer_fn = [&job_queue, &n_pushed]() {
+        for (int i=0; i<CAPACITY + 2; ++i) {
+            job_queue.CopyBack(i);
+            ++n_pushed;
+        }
+        job_queue.CompleteAdding();
+    };
+    
+    std::thread producer_thread(producer_fn);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    EXPECT_EQ(CAPACITY, n_pushed);
+    
+    // each pop makes room for one more push
+    auto first = job_queue.TryPopFront();
+    EXPECT_EQ(true, first.first);
+    EXPECT_EQ(0, first.second);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    EXPECT_EQ(CAPACITY + 1, n_pushed);
+    
+    // drain the rest; jobs should still come out in order
+    for (int i=1; i<CAPACITY + 2; ++i) {
+        auto result = job_queue.TryPopFront();
+        EXPECT_EQ(true, result.first);
+        EXPECT_EQ(i, result.second);
+    }
+    
+    producer_thread.join();
+    EXPECT_EQ(CAPACITY + 2, n_pushed);
+    EXPECT_EQ(true, job_queue.IsComplete());
+}
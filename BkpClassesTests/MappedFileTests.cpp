@@ -0,0 +1,57 @@
+//
+//  MappedFileTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <string>
+#include <cstdio>
+
+#include "MappedFile.h"
+#include "FileWrapper.h"
+
+using bkp::MappedFile;
+
+TEST(MappedFileTests, Read) {
+    MappedFile f;
+    ASSERT_EQ(true, f.Open("testfile.txt"));
+
+    std::string contents(f.data(), f.size());
+    EXPECT_EQ("this is a test file.\nline 2\n", contents);
+    EXPECT_EQ(f.data() + f.size(), f.end());
+}
+
+// The mapping should always be followed by a '\0', so that it
+// can be passed to strtod & co without copying
+TEST(MappedFileTests, NullTerminated) {
+    MappedFile f;
+    ASSERT_EQ(true, f.Open("testfile.txt"));
+    EXPECT_EQ('\0', f.data()[f.size()]);
+    EXPECT_STREQ("this is a test file.\nline 2\n", f.data());
+}
+
+TEST(MappedFileTests, MissingFile) {
+    MappedFile f;
+    EXPECT_EQ(false, f.Open("this_file_does_not_exist.txt"));
+    EXPECT_EQ(false, f.IsOpen());
+    EXPECT_EQ(nullptr, f.data());
+}
+
+TEST(MappedFileTests, EmptyFile) {
+    {
+        bkp::FileWrapper out;
+        ASSERT_EQ(true, out.Open("testfile_empty.txt", "w"));
+    } // close out
+
+    MappedFile f;
+    ASSERT_EQ(true, f.Open("testfile_empty.txt"));
+    EXPECT_EQ(0, f.size());
+    EXPECT_EQ('\0', f.data()[0]);
+
+    f.Close();
+    EXPECT_EQ(false, f.IsOpen());
+    remove("testfile_empty.txt");
+}
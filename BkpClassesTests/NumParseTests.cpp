@@ -0,0 +1,190 @@
+//
+//  NumParseTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <climits>
+#include <limits>
+
+#include "NumParse.h"
+
+// helper fn: ParseDouble a whole std::string, checking that all of it was used
+double ParseWhole(const std::string& s) {
+    double value = -1.0;
+    bkp::ParseResult result = bkp::ParseDouble(s.data(), s.data() + s.size(), value);
+    EXPECT_EQ(true, result.ok_) << s;
+    EXPECT_EQ(s.data() + s.size(), result.ptr_) << s;
+    return value;
+}
+
+// Results must be bit-for-bit identical to strtod
+TEST(NumParseTests, MatchesStrtod) {
+    const std::vector<std::string> inputs = {
+        "0", "-0", "0.0", "-0.0", "1", "-1", "+1", "138.47", "51.655", "-2.414",
+        "0.00265331133733", "2.23358448717", "-999.0", "-999", "100000",
+        "5.", ".5", "1e10", "1E-10", "1.5e+3", "-7.25e-2", "123456789012345678",
+        "9007199254740993",             // 2^53 + 1: needs rounding
+        "12345678901234567890123",      // more than 19 digits
+        "0.1234567890123456789012345",
+        "1e22", "1e23", "4.9e-324", "1.7976931348623157e308", "1e400", "1e-400",
+        "000123.4500", "0.000000000000000000000000001"
+    };
+    
+    for (const std::string& s : inputs) {
+        double expected = std::strtod(s.c_str(), nullptr);
+        double actual = ParseWhole(s);
+        EXPECT_EQ(0, std::memcmp(&expected, &actual, sizeof(double))) << s << ": " << expected << " vs " << actual;
+    }
+}
+
+// Same as MatchesStrtod, but with lots of random numbers in the kinds of
+// formats printf produces
+TEST(NumParseTests, MatchesStrtodRandom) {
+    std::mt19937_64 engine(42);
+    std::uniform_real_distribution<double> mantissa_dist(-1000.0, 1000.0);
+    std::uniform_int_distribution<int> exponent_dist(-30, 30);
+    const char* formats[] = { "%.3f", "%.6g", "%.12g", "%.17g", "%e" };
+    
+    char buffer[64];
+    for (int i=0; i<20000; ++i) {
+        double original = mantissa_dist(engine) * std::pow(10.0, exponent_dist(engine));
+        snprintf(buffer, sizeof(buffer), formats[i % 5], original);
+        
+        double expected = std::strtod(buffer, nullptr);
+        double actual = ParseWhole(buffer);
+        ASSERT_EQ(expected, actual) << buffer;
+    }
+}
+
+// Parsing stops at the end of the range, even if more digits follow it,
+// and at the first character that can't be part of the number
+TEST(NumParseTests, StopsAtEndOfRange) {
+    const char* text = "1.5999";
+    double value;
+    bkp::ParseResult result = bkp::ParseDouble(text, text + 3, value);
+    EXPECT_EQ(true, result.ok_);
+    EXPECT_EQ(text + 3, result.ptr_);
+    EXPECT_EQ(1.5, value);
+    
+    const char* text2 = "12abc";
+    result = bkp::ParseDouble(text2, text2 + 5, value);
+    EXPECT_EQ(true, result.ok_);
+    EXPECT_EQ(text2 + 2, result.ptr_);
+    EXPECT_EQ(12.0, value);
+    
+    // an 'e' without digits isn't an exponent
+    const char* text3 = "3e,";
+    result = bkp::ParseDouble(text3, text3 + 3, value);
+    EXPECT_EQ(true, result.ok_);
+    EXPECT_EQ(text3 + 1, result.ptr_);
+    EXPECT_EQ(3.0, value);
+}
+
+TEST(NumParseTests, Malformed) {
+    for (std::string s : { "", "-", "+", ".", "-.", "abc", "e5", " 1", "nan", "inf" }) {
+        double value = 123.0;
+        bkp::ParseResult result = bkp::ParseDouble(s.data(), s.data() + s.size(), value);
+        EXPECT_EQ(false, result.ok_) << s;
+        EXPECT_EQ(s.data(), result.ptr_) << s;
+        EXPECT_EQ(123.0, value) << s; // untouched
+    }
+}
+
+TEST(NumParseTests, MissingValue) {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    for (std::string s : { "-999.0", "-999", "-999.000", "-9.99e2" }) {
+        double value = 0.0;
+        bkp::ParseResult result = bkp::ParseDouble(s.data(), s.data() + s.size(), value, -999.0, NaN);
+        EXPECT_EQ(true, result.ok_);
+        EXPECT_TRUE(std::isnan(value)) << s;
+    }
+    
+    std::string s = "-999.5";
+    double value = 0.0;
+    bkp::ParseDouble(s.data(), s.data() + s.size(), value, -999.0, NaN);
+    EXPECT_EQ(-999.5, value);
+}
+
+TEST(NumParseTests, ParseInt) {
+    int value = 0;
+    std::string s = "350000,";
+    bkp::ParseResult result = bkp::ParseInt(s.data(), s.data() + s.size(), value);
+    EXPECT_EQ(true, result.ok_);
+    EXPECT_EQ(s.data() + 6, result.ptr_);
+    EXPECT_EQ(350000, value);
+    
+    s = "-2147483648";
+    result = bkp::ParseInt(s.data(), s.data() + s.size(), value);
+    EXPECT_EQ(true, result.ok_);
+    EXPECT_EQ(INT_MIN, value);
+    
+    value = 7;
+    for (std::string bad : { "", "-", "x1", "2147483648", "99999999999999999999" }) {
+        result = bkp::ParseInt(bad.data(), bad.data() + bad.size(), value);
+        EXPECT_EQ(false, result.ok_) << bad;
+        EXPECT_EQ(7, value);
+    }
+}
+
+// Microbenchmark: ParseDouble vs std::stod on the kind of fields found in
+// training.csv. Disabled by default since it's slow and doesn't check
+// anything; run with --gtest_also_run_disabled_tests to see the numbers.
+TEST(NumParseTests, DISABLED_BenchmarkVsStod) {
+    const int N_FIELDS = 5000000;
+    
+    std::mt19937 engine(1);
+    std::uniform_real_distribution<double> dist(-500.0, 500.0);
+    std::vector<std::string> fields;
+    fields.reserve(N_FIELDS);
+    char buffer[32];
+    for (int i=0; i<N_FIELDS; ++i) {
+        if (i % 7 == 0) {
+            fields.push_back("-999.0");
+        }
+        else {
+            snprintf(buffer, sizeof(buffer), "%.3f", dist(engine));
+            fields.push_back(buffer);
+        }
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    double stod_sum = 0.0;
+    for (const std::string& field : fields) {
+        double val = std::stod(field);
+        if (val != -999.0) {
+            stod_sum += val;
+        }
+    }
+    auto stod_end = std::chrono::steady_clock::now();
+    
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    double parse_sum = 0.0;
+    for (const std::string& field : fields) {
+        double val;
+        bkp::ParseDouble(field.data(), field.data() + field.size(), val, -999.0, NaN);
+        if (!std::isnan(val)) {
+            parse_sum += val;
+        }
+    }
+    auto parse_end = std::chrono::steady_clock::now();
+    
+    EXPECT_EQ(stod_sum, parse_sum);
+    
+    double stod_secs = std::chrono::duration<double>(stod_end - start).count();
+    double parse_secs = std::chrono::duration<double>(parse_end - stod_end).count();
+    printf("std::stod:        %.3fs (%.1f ns/field)\n", stod_secs, stod_secs * 1e9 / N_FIELDS);
+    printf("bkp::ParseDouble: %.3fs (%.1f ns/field)\n", parse_secs, parse_secs * 1e9 / N_FIELDS);
+    printf("speedup:          %.2fx\n", stod_secs / parse_secs);
+}
@@ -11,6 +11,8 @@
 #include <vector>
 #include "RandUtils.h"
 #include <limits.h>
+#include <array>
+#include <thread>
 
 TEST(RandUtilsTests, RandInt) {
     int randint;
@@ -146,4 +148,76 @@ TEST(RandUtilsTests, RandIntDifference) {
     for (int i=0; i<ARR_SIZE; ++i) {
         EXPECT_NE(a1[i], a2[i]);
     }
-}
\ No newline at end of file
+}
+
+// A stream gives the same numbers on any thread, different streams give
+// different numbers, and a ScopedStream leaves the thread's own numbers as
+// they would have been without it
+TEST(RandUtilsTests, Streams) {
+    
+    const int ARR_SIZE = 20;
+    
+    bkp::random::Seed(5);
+    bkp::random::SeedStream(3);
+    auto main_thread = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    
+    std::array<double, ARR_SIZE> other_thread;
+    std::thread thread([&other_thread]() {
+        bkp::random::RandInt(10); // use up some of this thread's own numbers
+        bkp::random::SeedStream(3);
+        other_thread = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    });
+    thread.join();
+    
+    bkp::random::SeedStream(4);
+    auto other_stream = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    for (int i=0; i<ARR_SIZE; ++i) {
+        EXPECT_EQ(main_thread[i], other_thread[i]);
+        EXPECT_NE(main_thread[i], other_stream[i]);
+    }
+    
+    bkp::random::Seed(5);
+    auto without_stream = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    bkp::random::Seed(5);
+    {
+        bkp::random::ScopedStream stream(3);
+        EXPECT_EQ(main_thread[0], bkp::random::RandDouble(0.0, 1.0));
+    }
+    auto with_stream = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    for (int i=0; i<ARR_SIZE; ++i) {
+        EXPECT_EQ(without_stream[i], with_stream[i]);
+    }
+}
+
+// A ScopedStream on an engine gives that engine's numbers on any thread,
+// then puts the thread's own generator back
+TEST(RandUtilsTests, EngineStream) {
+    
+    const int ARR_SIZE = 20;
+    
+    bkp::random::Seed(5);
+    const bkp::random::CounterEngine engine(bkp::random::Generator()());
+    auto without_stream = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    
+    bkp::random::Seed(5);
+    bkp::random::Generator()();
+    std::array<double, ARR_SIZE> main_thread;
+    {
+        bkp::random::ScopedStream stream(engine);
+        main_thread = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    }
+    auto with_stream = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    
+    std::array<double, ARR_SIZE> other_thread;
+    std::thread thread([&other_thread, &engine]() {
+        bkp::random::ScopedStream stream(engine);
+        other_thread = bkp::random::RandDouble<ARR_SIZE>(0.0, 1.0);
+    });
+    thread.join();
+    
+    for (int i=0; i<ARR_SIZE; ++i) {
+        EXPECT_EQ(without_stream[i], with_stream[i]);
+        EXPECT_EQ(main_thread[i], other_thread[i]);
+        EXPECT_NE(main_thread[i], without_stream[i]);
+    }
+}
@@ -0,0 +1,90 @@
+//
+//  TaskPoolTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+
+#include "TaskPool.h"
+
+// Every task run through a TaskGroup has finished by the time Wait returns
+TEST(TaskPoolTests, Basic) {
+
+    const int N_TASKS = 10000;
+
+    bkp::TaskPool pool(4);
+    std::vector<int> is_run(N_TASKS, 0);
+    std::atomic<int> run_count(0);
+
+    bkp::TaskGroup group(pool);
+    for (int i=0; i<N_TASKS; ++i) {
+        group.Run([i, &is_run, &run_count]() {
+            is_run[i] += 1;
+            ++run_count;
+        });
+    }
+    group.Wait();
+
+    EXPECT_EQ(N_TASKS, run_count);
+    for (int i=0; i<N_TASKS; ++i) {
+        EXPECT_EQ(1, is_run[i]);
+    }
+}
+
+// helper fn: sum the integers in [begin, end) by recursively splitting the
+// range in two, running one half as a task and the other on this thread
+long long RecursiveSum(bkp::TaskPool& pool, int begin, int end) {
+    if (end - begin <= 16) {
+        long long sum = 0;
+        for (int i=begin; i<end; ++i) {
+            sum += i;
+        }
+        return sum;
+    }
+
+    int middle = begin + (end - begin) / 2;
+    long long upper_sum = 0;
+    bkp::TaskGroup group(pool);
+    group.Run([&pool, &upper_sum, middle, end]() {
+        upper_sum = RecursiveSum(pool, middle, end);
+    });
+    long long lower_sum = RecursiveSum(pool, begin, middle);
+    group.Wait();
+
+    return lower_sum + upper_sum;
+}
+
+// Tasks that wait on their own subtasks must not deadlock, even with far
+// more nested groups than worker threads
+TEST(TaskPoolTests, Nested) {
+    const int N = 100000;
+    const long long expected = static_cast<long long>(N) * (N - 1) / 2;
+
+    for (int n_threads : { 1, 2, 8 }) {
+        bkp::TaskPool pool(n_threads);
+        EXPECT_EQ(n_threads, pool.size());
+        EXPECT_EQ(expected, RecursiveSum(pool, 0, N));
+    }
+}
+
+// An empty group doesn't wait for anything, and a group can be reused
+// after Wait
+TEST(TaskPoolTests, ReuseGroup) {
+    bkp::TaskPool pool(2);
+    bkp::TaskGroup group(pool);
+    group.Wait();
+
+    std::atomic<int> run_count(0);
+    for (int round=0; round<3; ++round) {
+        for (int i=0; i<100; ++i) {
+            group.Run([&run_count]() { ++run_count; });
+        }
+        group.Wait();
+        EXPECT_EQ((round + 1) * 100, run_count);
+    }
+}
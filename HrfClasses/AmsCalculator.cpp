@@ -12,27 +12,16 @@
 
 namespace hrf {
     
-    AmsCalculator::AmsCalculator(const bkp::MaskedVector<const HiggsTrainingCsvRow>& actual) :
-    nrows_(actual.size())
-    {
-        actual_signal_ = std::unique_ptr<bool[]>(new bool[nrows_]);
-        // actual_background_ = std::unique_ptr<bool[]>(new bool[nrows_]);
-        
+    template<class TWeights>
+    void AmsCalculator::ScaleWeights(const TWeights& weights) {
         double total_s = 0.0;
         double total_b = 0.0;
-        
         for (auto row_index = decltype(nrows_){0}; row_index<nrows_; ++row_index) {
-            auto& row = actual[row_index];
-            bool is_signal = row.Label_ == 's';
-            
-            actual_signal_[row_index] = is_signal;
-            // actual_background_[row_index] = !is_signal;
-            
-            if (is_signal) {
-                total_s += row.Weight_;
+            if (actual_signal_[row_index]) {
+                total_s += weights[row_index];
             }
             else {
-                total_b += row.Weight_;
+                total_b += weights[row_index];
             }
         }
         
@@ -41,9 +30,39 @@ namespace hrf {
         double b_scale_factor = TOTAL_B / total_b;
         for (auto row_index = decltype(nrows_){0}; row_index<nrows_; ++row_index) {
             double scale_factor = actual_signal_[row_index] ? s_scale_factor : b_scale_factor;
+            scaled_weights_.push_back(weights[row_index] * scale_factor);
+        }
+    }
+    
+    AmsCalculator::AmsCalculator(const bkp::MaskedVector<const HiggsTrainingCsvRow>& actual) :
+    nrows_(actual.size())
+    {
+        actual_signal_ = std::unique_ptr<bool[]>(new bool[nrows_]);
+        // actual_background_ = std::unique_ptr<bool[]>(new bool[nrows_]);
+        
+        std::vector<double> weights;
+        weights.reserve(nrows_);
+        for (auto row_index = decltype(nrows_){0}; row_index<nrows_; ++row_index) {
             auto& row = actual[row_index];
-            scaled_weights_.push_back(row.Weight_ * scale_factor);
+            actual_signal_[row_index] = row.Label_ == 's';
+            // actual_background_[row_index] = !is_signal;
+            weights.push_back(row.Weight_);
         }
+        
+        ScaleWeights(weights);
+    }
+    
+    AmsCalculator::AmsCalculator(const FeatureMatrix& actual) :
+    nrows_(actual.size())
+    {
+        actual_signal_ = std::unique_ptr<bool[]>(new bool[nrows_]);
+        
+        const unsigned char* is_signal = actual.IsSignal();
+        for (auto row_index = decltype(nrows_){0}; row_index<nrows_; ++row_index) {
+            actual_signal_[row_index] = is_signal[row_index] != 0;
+        }
+        
+        ScaleWeights(actual.Weights());
     }
     
     // formula from: https://www.kaggle.com/c/higgs-boson/details/evaluation
@@ -83,4 +102,10 @@ namespace hrf {
     {
         return AmsCalculator(actual).CalcAms(predicted);
     }
+    
+    double CalcAms(const std::vector<char>& predicted,
+                   const FeatureMatrix& actual)
+    {
+        return AmsCalculator(actual).CalcAms(predicted);
+    }
 }
\ No newline at end of file
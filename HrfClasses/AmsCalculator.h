@@ -15,6 +15,7 @@
 #include "MaskedVector.h"
 #include "HiggsCsvRow.h"
 #include "IScorer.h"
+#include "FeatureMatrix.h"
 
 namespace hrf {
     
@@ -65,8 +66,14 @@ namespace hrf {
         // store the scaled versions here for future use.
         std::vector<double> scaled_weights_;
         
+        // Populate scaled_weights_ from the nrows_ unscaled weights at
+        // 'weights' (assumes actual_signal_ is already populated)
+        template<class TWeights>
+        void ScaleWeights(const TWeights& weights);
+        
     public:
         AmsCalculator(const bkp::MaskedVector<const HiggsTrainingCsvRow>& actual);
+        AmsCalculator(const FeatureMatrix& actual); // actual must HasLabels()
         
         double CalcAms(const std::vector<char>& predicted);
         
@@ -74,6 +81,8 @@ namespace hrf {
     
     double CalcAms(const std::vector<char>& predicted,
                    const bkp::MaskedVector<const HiggsTrainingCsvRow>& actual);
+    double CalcAms(const std::vector<char>& predicted,
+                   const FeatureMatrix& actual);
 }
 
 #endif /* defined(__RandomForest____AmsCalculator__) */
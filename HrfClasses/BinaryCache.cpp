@@ -0,0 +1,501 @@
+//
+//  BinaryCache.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "BinaryCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "FileWrapper.h"
+
+namespace hrf {
+
+    ////////// private stuff //////////
+
+    const char MAGIC[8] = { 'H', 'R', 'F', 'B', 'I', 'N', '\0', '\0' };
+
+    // Round n up to the next multiple of 8
+    std::size_t Pad8(std::size_t n) {
+        return (n + 7) & ~static_cast<std::size_t>(7);
+    }
+
+    // Byte offsets (from the start of the file) of each column, given a row
+    // count. Shared by the reader and the writer so they can't disagree.
+    struct ColumnOffsets {
+        std::size_t event_ids_;
+        std::size_t features_;
+        std::size_t weights_;
+        std::size_t labels_;
+        std::size_t end_;
+
+        ColumnOffsets(std::size_t n_rows, bool has_labels) {
+            event_ids_ = sizeof(BinaryCacheHeader);
+            features_ = event_ids_ + Pad8(n_rows * sizeof(std::int32_t));
+            weights_ = features_ + n_rows * sizeof(double) * HiggsCsvRow::NUM_FEATURES;
+            if (has_labels) {
+                labels_ = weights_ + n_rows * sizeof(double);
+                end_ = labels_ + Pad8(n_rows * sizeof(char));
+            }
+            else {
+                labels_ = weights_;
+                end_ = weights_;
+            }
+        }
+    };
+
+    // Get the modification time and size of a file. Returns false if the
+    // file doesn't exist.
+    bool StatFile(const std::string& filename, time_t& mtime, std::uint64_t& size) {
+        struct stat s;
+        if (stat(filename.c_str(), &s) != 0) {
+            return false;
+        }
+        mtime = s.st_mtime;
+        size = static_cast<std::uint64_t>(s.st_size);
+        return true;
+    }
+
+    // Shared implementation of the two WriteBinaryCache overloads
+    template<class TRow>
+    bool WriteRows(const std::string& filename,
+                   const std::vector<const TRow>& rows,
+                   std::uint64_t source_size,
+                   bool has_labels)
+    {
+        BinaryCacheWriter writer;
+        if (!writer.Open(filename, rows.size(), has_labels, source_size)) {
+            return false;
+        }
+        for (const TRow& row : rows) {
+            if (!writer.Add(row)) {
+                return false;
+            }
+        }
+        return writer.Close();
+    }
+
+    // Pointers to the start of every feature column of a BinaryCacheFile,
+    // looked up once rather than once per row
+    typedef std::array<const double*, HiggsCsvRow::NUM_FEATURES> FeatureColumns;
+    FeatureColumns GetFeatureColumns(const BinaryCacheFile& cache) {
+        FeatureColumns result;
+        for (int dim=0; dim<HiggsCsvRow::NUM_FEATURES; ++dim) {
+            result[dim] = cache.Feature(dim);
+        }
+        return result;
+    }
+
+    ////////// public stuff (from BinaryCache.h) //////////
+
+    const std::uint32_t BinaryCacheHeader::FORMAT_VERSION;
+
+    std::uint64_t BinaryCacheChecksum(const char* data, std::size_t n_bytes) {
+        const std::uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+        return BinaryCacheChecksum(data, n_bytes, FNV_OFFSET_BASIS);
+    }
+
+    std::uint64_t BinaryCacheChecksum(const char* data, std::size_t n_bytes, std::uint64_t previous) {
+        assert(n_bytes % sizeof(std::uint64_t) == 0);
+
+        const std::uint64_t FNV_PRIME = 1099511628211ULL;
+
+        std::uint64_t hash = previous;
+        const std::size_t n_words = n_bytes / sizeof(std::uint64_t);
+        for (std::size_t i=0; i<n_words; ++i) {
+            // memcpy rather than a cast so this is safe whatever the alignment
+            std::uint64_t word;
+            std::memcpy(&word, data + i * sizeof(std::uint64_t), sizeof(word));
+            hash ^= word;
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    BinaryCacheFile::BinaryCacheFile() : header_(nullptr) { }
+
+    bool BinaryCacheFile::Open(const std::string& filename) {
+        Close();
+
+        if (!file_.Open(filename)) {
+            return false;
+        }
+        if (file_.size() < sizeof(BinaryCacheHeader)) {
+            Close();
+            return false;
+        }
+
+        const BinaryCacheHeader* header = reinterpret_cast<const BinaryCacheHeader*>(file_.data());
+        if (std::memcmp(header->magic_, MAGIC, sizeof(MAGIC)) != 0 ||
+            header->version_ != BinaryCacheHeader::FORMAT_VERSION ||
+            header->n_features_ != HiggsCsvRow::NUM_FEATURES)
+        {
+            Close();
+            return false;
+        }
+
+        const ColumnOffsets offsets(header->n_rows_, header->has_labels_ != 0);
+        if (file_.size() != offsets.end_) {
+            Close();
+            return false;
+        }
+
+        // checksum a piece at a time, dropping each piece from memory once
+        // it's been read, so that checking a file bigger than memory doesn't
+        // push everything else out of it
+        const std::size_t PIECE_BYTES = 64 << 20;
+        std::uint64_t checksum = BinaryCacheChecksum(nullptr, 0); // of nothing, so far
+        for (std::size_t pos=sizeof(BinaryCacheHeader); pos<offsets.end_; pos+=PIECE_BYTES) {
+            const std::size_t n_bytes = std::min(PIECE_BYTES, offsets.end_ - pos);
+            checksum = BinaryCacheChecksum(file_.data() + pos, n_bytes, checksum);
+            file_.Discard(file_.data() + pos, file_.data() + pos + n_bytes);
+        }
+        if (checksum != header->checksum_) {
+            Close();
+            return false;
+        }
+
+        header_ = header;
+        return true;
+    }
+
+    bool BinaryCacheFile::IsOpen() const {
+        return header_ != nullptr;
+    }
+
+    void BinaryCacheFile::Close() {
+        header_ = nullptr;
+        file_.Close();
+    }
+
+    std::size_t BinaryCacheFile::size() const {
+        assert(IsOpen());
+        return static_cast<std::size_t>(header_->n_rows_);
+    }
+
+    bool BinaryCacheFile::HasLabels() const {
+        assert(IsOpen());
+        return header_->has_labels_ != 0;
+    }
+
+    std::uint64_t BinaryCacheFile::SourceSize() const {
+        assert(IsOpen());
+        return header_->source_size_;
+    }
+
+    const std::int32_t* BinaryCacheFile::EventIds() const {
+        assert(IsOpen());
+        const ColumnOffsets offsets(size(), HasLabels());
+        return reinterpret_cast<const std::int32_t*>(file_.data() + offsets.event_ids_);
+    }
+
+    const double* BinaryCacheFile::Feature(int feature_index) const {
+        assert(IsOpen());
+        assert(feature_index >= 0 && feature_index < HiggsCsvRow::NUM_FEATURES);
+        const ColumnOffsets offsets(size(), HasLabels());
+        const double* features = reinterpret_cast<const double*>(file_.data() + offsets.features_);
+        return features + feature_index * size();
+    }
+
+    const double* BinaryCacheFile::Weights() const {
+        assert(IsOpen() && HasLabels());
+        const ColumnOffsets offsets(size(), HasLabels());
+        return reinterpret_cast<const double*>(file_.data() + offsets.weights_);
+    }
+
+    const char* BinaryCacheFile::Labels() const {
+        assert(IsOpen() && HasLabels());
+        const ColumnOffsets offsets(size(), HasLabels());
+        return file_.data() + offsets.labels_;
+    }
+
+    void BinaryCacheFile::Discard(std::size_t begin_row, std::size_t end_row) {
+        assert(IsOpen());
+        assert(begin_row <= end_row && end_row <= size());
+        const std::int32_t* event_ids = EventIds();
+        file_.Discard(reinterpret_cast<const char*>(event_ids + begin_row),
+                      reinterpret_cast<const char*>(event_ids + end_row));
+        for (int dim=0; dim<HiggsCsvRow::NUM_FEATURES; ++dim) {
+            const double* feature = Feature(dim);
+            file_.Discard(reinterpret_cast<const char*>(feature + begin_row),
+                          reinterpret_cast<const char*>(feature + end_row));
+        }
+        if (HasLabels()) {
+            const double* weights = Weights();
+            file_.Discard(reinterpret_cast<const char*>(weights + begin_row),
+                          reinterpret_cast<const char*>(weights + end_row));
+            file_.Discard(Labels() + begin_row, Labels() + end_row);
+        }
+    }
+
+    std::string BinaryCacheName(const std::string& csv_filename) {
+        return csv_filename + ".hrfbin";
+    }
+
+    bool IsBinaryCacheFresh(const std::string& csv_filename,
+                            const std::string& cache_filename)
+    {
+        time_t csv_mtime, cache_mtime;
+        std::uint64_t csv_size, cache_size;
+        if (!StatFile(csv_filename, csv_mtime, csv_size) ||
+            !StatFile(cache_filename, cache_mtime, cache_size))
+        {
+            return false;
+        }
+        return cache_mtime >= csv_mtime;
+    }
+
+    const std::size_t BinaryCacheWriter::DEFAULT_BLOCK_ROWS;
+
+    BinaryCacheWriter::BinaryCacheWriter() :
+    n_rows_(0),
+    has_labels_(false),
+    source_size_(0),
+    block_rows_(0),
+    n_written_(0),
+    n_buffered_(0)
+    { }
+
+    BinaryCacheWriter::~BinaryCacheWriter() {
+        if (file_.IsOpen()) {
+            Abandon();
+        }
+    }
+
+    bool BinaryCacheWriter::Open(const std::string& filename,
+                                 std::size_t n_rows,
+                                 bool has_labels,
+                                 std::uint64_t source_size,
+                                 std::size_t block_rows)
+    {
+        assert(block_rows > 0);
+        if (file_.IsOpen()) {
+            Abandon();
+        }
+        filename_ = filename;
+        n_rows_ = n_rows;
+        has_labels_ = has_labels;
+        source_size_ = source_size;
+        block_rows_ = block_rows;
+        n_written_ = 0;
+        n_buffered_ = 0;
+
+        event_ids_.resize(block_rows);
+        features_.resize(block_rows * HiggsCsvRow::NUM_FEATURES);
+        weights_.resize(has_labels ? block_rows : 0);
+        labels_.resize(has_labels ? block_rows : 0);
+
+        // "w+b" so the checksum can be read back from the same file
+        return file_.Open(filename_ + ".tmp", "w+b");
+    }
+
+    bool BinaryCacheWriter::WriteAt(std::size_t offset, const void* data, std::size_t n_bytes) {
+        return file_.Seek(static_cast<long>(offset), SEEK_SET) == 0 &&
+               file_.Write(data, 1, n_bytes) == n_bytes;
+    }
+
+    bool BinaryCacheWriter::WriteBlock() {
+        const ColumnOffsets offsets(n_rows_, has_labels_);
+        const std::size_t n = n_buffered_;
+        const std::size_t first = n_written_;
+        n_written_ += n;
+        n_buffered_ = 0;
+
+        if (!WriteAt(offsets.event_ids_ + first * sizeof(std::int32_t), event_ids_.data(), n * sizeof(std::int32_t))) {
+            return false;
+        }
+        for (int dim=0; dim<HiggsCsvRow::NUM_FEATURES; ++dim) {
+            const std::size_t column = offsets.features_ + dim * n_rows_ * sizeof(double);
+            if (!WriteAt(column + first * sizeof(double), features_.data() + dim * block_rows_, n * sizeof(double))) {
+                return false;
+            }
+        }
+        if (has_labels_) {
+            if (!WriteAt(offsets.weights_ + first * sizeof(double), weights_.data(), n * sizeof(double)) ||
+                !WriteAt(offsets.labels_ + first, labels_.data(), n))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void BinaryCacheWriter::Buffer(const HiggsCsvRow& row) {
+        event_ids_[n_buffered_] = row.EventId_;
+        for (int dim=0; dim<HiggsCsvRow::NUM_FEATURES; ++dim) {
+            features_[dim * block_rows_ + n_buffered_] = row.data_[dim];
+        }
+    }
+
+    void BinaryCacheWriter::Abandon() {
+        file_.Close();
+        remove((filename_ + ".tmp").c_str());
+    }
+
+    bool BinaryCacheWriter::Add(const HiggsTrainingCsvRow& row) {
+        assert(file_.IsOpen() && has_labels_);
+        if (n_written_ + n_buffered_ >= n_rows_) {
+            ++n_written_; // so that Close fails
+            return false;
+        }
+        Buffer(row);
+        weights_[n_buffered_] = row.Weight_;
+        labels_[n_buffered_] = row.Label_;
+        ++n_buffered_;
+        return n_buffered_ < block_rows_ || WriteBlock();
+    }
+
+    bool BinaryCacheWriter::Add(const HiggsCsvRow& row) {
+        assert(file_.IsOpen() && !has_labels_);
+        if (n_written_ + n_buffered_ >= n_rows_) {
+            ++n_written_; // so that Close fails
+            return false;
+        }
+        Buffer(row);
+        ++n_buffered_;
+        return n_buffered_ < block_rows_ || WriteBlock();
+    }
+
+    bool BinaryCacheWriter::Close() {
+        assert(file_.IsOpen());
+        if (n_buffered_ > 0 && !WriteBlock()) {
+            Abandon();
+            return false;
+        }
+        if (n_written_ != n_rows_) {
+            Abandon();
+            return false;
+        }
+
+        // zero the padding after the EventId and Label columns (which also
+        // makes the file its full length), so the padding bytes are
+        // deterministic
+        const ColumnOffsets offsets(n_rows_, has_labels_);
+        const char zeros[8] = { 0 };
+        const std::size_t event_ids_end = offsets.event_ids_ + n_rows_ * sizeof(std::int32_t);
+        const std::size_t labels_end = has_labels_ ? offsets.labels_ + n_rows_ : offsets.end_;
+        if (!WriteAt(event_ids_end, zeros, offsets.features_ - event_ids_end) ||
+            !WriteAt(labels_end, zeros, offsets.end_ - labels_end) ||
+            file_.Flush() != 0)
+        {
+            Abandon();
+            return false;
+        }
+
+        // the checksum has to be taken in file order, which the columns
+        // weren't written in, so read everything after the header back
+        std::vector<char> buffer(1 << 20);
+        std::uint64_t checksum = BinaryCacheChecksum(nullptr, 0); // of nothing, so far
+        if (file_.Seek(static_cast<long>(sizeof(BinaryCacheHeader)), SEEK_SET) != 0) {
+            Abandon();
+            return false;
+        }
+        for (std::size_t pos=sizeof(BinaryCacheHeader); pos<offsets.end_; pos+=buffer.size()) {
+            const std::size_t n_bytes = std::min(buffer.size(), offsets.end_ - pos);
+            if (file_.Read(buffer.data(), 1, n_bytes) != n_bytes) {
+                Abandon();
+                return false;
+            }
+            checksum = BinaryCacheChecksum(buffer.data(), n_bytes, checksum);
+        }
+
+        BinaryCacheHeader header;
+        std::memcpy(header.magic_, MAGIC, sizeof(MAGIC));
+        header.version_ = BinaryCacheHeader::FORMAT_VERSION;
+        header.has_labels_ = has_labels_ ? 1 : 0;
+        header.n_rows_ = n_rows_;
+        header.n_features_ = HiggsCsvRow::NUM_FEATURES;
+        header.reserved_ = 0;
+        header.source_size_ = source_size_;
+        header.checksum_ = checksum;
+        if (!WriteAt(0, &header, sizeof(header))) {
+            Abandon();
+            return false;
+        }
+
+        // rename the temporary file into place, so that readers never see a
+        // partially-written cache
+        const std::string temp_filename = filename_ + ".tmp";
+        if (file_.Close() != 0 || rename(temp_filename.c_str(), filename_.c_str()) != 0) {
+            remove(temp_filename.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool WriteBinaryCache(const std::string& filename,
+                          const std::vector<const HiggsTrainingCsvRow>& rows,
+                          std::uint64_t source_size)
+    {
+        return WriteRows(filename, rows, source_size, true);
+    }
+
+    bool WriteBinaryCache(const std::string& filename,
+                          const std::vector<const HiggsCsvRow>& rows,
+                          std::uint64_t source_size)
+    {
+        return WriteRows(filename, rows, source_size, false);
+    }
+
+    bool ReadBinaryCache(const std::string& filename,
+                         std::uint64_t source_size,
+                         std::vector<const HiggsTrainingCsvRow>& out)
+    {
+        out.clear();
+
+        BinaryCacheFile cache;
+        if (!cache.Open(filename) || !cache.HasLabels() || cache.SourceSize() != source_size) {
+            return false;
+        }
+
+        const std::size_t n_rows = cache.size();
+        const std::int32_t* event_ids = cache.EventIds();
+        const FeatureColumns features = GetFeatureColumns(cache);
+        const double* weights = cache.Weights();
+        const char* labels = cache.Labels();
+
+        out.reserve(n_rows);
+        for (std::size_t row=0; row<n_rows; ++row) {
+            std::array<double, HiggsCsvRow::NUM_FEATURES> data;
+            for (int dim=0; dim<HiggsCsvRow::NUM_FEATURES; ++dim) {
+                data[dim] = features[dim][row];
+            }
+            out.push_back(HiggsTrainingCsvRow(event_ids[row], std::move(data), weights[row], labels[row]));
+        }
+        return true;
+    }
+
+    bool ReadBinaryCache(const std::string& filename,
+                         std::uint64_t source_size,
+                         std::vector<const HiggsCsvRow>& out)
+    {
+        out.clear();
+
+        BinaryCacheFile cache;
+        if (!cache.Open(filename) || cache.SourceSize() != source_size) {
+            return false;
+        }
+
+        const std::size_t n_rows = cache.size();
+        const std::int32_t* event_ids = cache.EventIds();
+        const FeatureColumns features = GetFeatureColumns(cache);
+
+        out.reserve(n_rows);
+        for (std::size_t row=0; row<n_rows; ++row) {
+            std::array<double, HiggsCsvRow::NUM_FEATURES> data;
+            for (int dim=0; dim<HiggsCsvRow::NUM_FEATURES; ++dim) {
+                data[dim] = features[dim][row];
+            }
+            out.push_back(HiggsCsvRow(event_ids[row], std::move(data)));
+        }
+        return true;
+    }
+}
@@ -0,0 +1,206 @@
+//
+//  BinaryCache.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____BinaryCache__
+#define __RandomForest____BinaryCache__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FileWrapper.h"
+#include "MappedFile.h"
+#include "HiggsCsvRow.h"
+
+namespace hrf {
+
+    // On-disk layout of a .hrfbin file. A .hrfbin file is a binary copy
+    // of a parsed training.csv or test.csv, stored by column rather than
+    // by row:
+    //
+    //     BinaryCacheHeader
+    //     int32_t  EventId[n_rows]                  (padded to 8 bytes)
+    //     double   Feature[NUM_FEATURES][n_rows]    (-999.0 already NaN)
+    //     double   Weight[n_rows]                   (training files only)
+    //     char     Label[n_rows]                    (training files only)
+    //
+    // Every column starts on an 8-byte boundary, so the columns can be
+    // used in place straight out of a memory mapping.
+    struct BinaryCacheHeader {
+
+        // "HRFBIN" followed by two '\0's
+        char magic_[8];
+
+        // Bump FORMAT_VERSION whenever the layout changes; files with a
+        // different version are ignored (and overwritten).
+        static const std::uint32_t FORMAT_VERSION = 1;
+        std::uint32_t version_;
+
+        // 1 if the Weight and Label columns are present, 0 otherwise
+        std::uint32_t has_labels_;
+
+        std::uint64_t n_rows_;
+        std::uint32_t n_features_;
+        std::uint32_t reserved_;
+
+        // Size of the csv file this cache was made from. A cheap extra check
+        // that the cache still matches its csv file.
+        std::uint64_t source_size_;
+
+        // Checksum of everything after the header (see BinaryCacheChecksum)
+        std::uint64_t checksum_;
+    };
+
+    // 64-bit FNV-1a style checksum of a buffer, taken a word at a time
+    // rather than a byte at a time so that it's cheap enough to verify on
+    // every load. n_bytes must be a multiple of 8.
+    std::uint64_t BinaryCacheChecksum(const char* data, std::size_t n_bytes);
+
+    // The same checksum, continued from the checksum of the bytes before
+    // data, so that a buffer can be checksummed a piece at a time
+    std::uint64_t BinaryCacheChecksum(const char* data, std::size_t n_bytes, std::uint64_t previous);
+
+    // A memory-mapped, validated .hrfbin file. Column accessors return
+    // pointers straight into the mapping, so they are only valid for as
+    // long as the BinaryCacheFile is open.
+    class BinaryCacheFile {
+    private:
+        bkp::MappedFile file_;
+        const BinaryCacheHeader* header_;
+
+    public:
+        BinaryCacheFile();
+
+        // Map the specified file and check its header and checksum. Returns
+        // false (and leaves this object closed) if the file doesn't exist,
+        // is a different version, or is corrupt.
+        bool Open(const std::string& filename);
+        bool IsOpen() const;
+        void Close();
+
+        std::size_t size() const;
+        bool HasLabels() const;
+        std::uint64_t SourceSize() const;
+
+        const std::int32_t* EventIds() const;
+        const double* Feature(int feature_index) const;
+
+        // Only valid if HasLabels()
+        const double* Weights() const;
+        const char* Labels() const;
+
+        // Drop the pages holding rows [begin_row, end_row) of every column
+        // from memory (see bkp::MappedFile::Discard), e.g. once a chunk of a
+        // file too big to keep in memory has been read. They're re-read from
+        // disk if they're used again.
+        void Discard(std::size_t begin_row, std::size_t end_row);
+    };
+
+    // The name of the cache file that goes with the specified csv file
+    // (e.g. "data/training.csv" -> "data/training.csv.hrfbin")
+    std::string BinaryCacheName(const std::string& csv_filename);
+
+    // Returns true if cache_filename exists and was modified no earlier than
+    // csv_filename. Doesn't look inside either file.
+    bool IsBinaryCacheFresh(const std::string& csv_filename,
+                            const std::string& cache_filename);
+
+    // Writes a .hrfbin file a row at a time, so that a file can be made
+    // from more rows than fit in memory (e.g. for a StreamedTrainingSet).
+    // The number of rows has to be known up front, since it decides where
+    // each column starts. Rows are buffered a block at a time, and each
+    // block is written a column at a time; the checksum is taken by reading
+    // the file back once every row is in. As with WriteBinaryCache, the file
+    // is written under a temporary name, and only renamed into place by a
+    // successful Close.
+    class BinaryCacheWriter {
+    private:
+        bkp::FileWrapper file_;
+        std::string filename_;
+        std::size_t n_rows_;
+        bool has_labels_;
+        std::uint64_t source_size_;
+        std::size_t block_rows_;
+
+        // rows written to file_ so far, and rows waiting in the block
+        std::size_t n_written_;
+        std::size_t n_buffered_;
+
+        // the block, a column at a time (features_ holds NUM_FEATURES
+        // columns of block_rows_ each)
+        std::vector<std::int32_t> event_ids_;
+        std::vector<double> features_;
+        std::vector<double> weights_;
+        std::vector<char> labels_;
+
+        // Write n_bytes at the given offset of the file
+        bool WriteAt(std::size_t offset, const void* data, std::size_t n_bytes);
+
+        // Write the buffered rows to their place in each column
+        bool WriteBlock();
+
+        // Put a row's EventId and features in the block
+        void Buffer(const HiggsCsvRow& row);
+
+        // Close and delete the temporary file
+        void Abandon();
+
+    public:
+        static const std::size_t DEFAULT_BLOCK_ROWS = 1 << 16;
+
+        BinaryCacheWriter();
+        ~BinaryCacheWriter();
+
+        BinaryCacheWriter(const BinaryCacheWriter&) = delete;
+        BinaryCacheWriter& operator=(const BinaryCacheWriter&) = delete;
+
+        // Start writing a file of n_rows rows (with the Weight and Label
+        // columns if has_labels). Returns false if the temporary file can't
+        // be created.
+        bool Open(const std::string& filename,
+                  std::size_t n_rows,
+                  bool has_labels,
+                  std::uint64_t source_size,
+                  std::size_t block_rows=DEFAULT_BLOCK_ROWS);
+
+        // Add the next row: training rows if has_labels, otherwise test rows.
+        // Returns false if a block couldn't be written, or if there are
+        // already n_rows rows, in which case Close will fail too.
+        bool Add(const HiggsTrainingCsvRow& row);
+        bool Add(const HiggsCsvRow& row);
+
+        // Finish the file and rename it into place. Returns false (and
+        // leaves no file behind) if anything couldn't be written, or if
+        // fewer or more than n_rows rows were added. If a writer is
+        // destroyed without being closed, its file is discarded.
+        bool Close();
+    };
+
+    // Write rows to a .hrfbin file (with a BinaryCacheWriter). The file is
+    // written under a temporary name and then renamed, so a crash part-way
+    // through can never leave a truncated cache behind. Returns false if the
+    // file couldn't be written.
+    bool WriteBinaryCache(const std::string& filename,
+                          const std::vector<const HiggsTrainingCsvRow>& rows,
+                          std::uint64_t source_size);
+    bool WriteBinaryCache(const std::string& filename,
+                          const std::vector<const HiggsCsvRow>& rows,
+                          std::uint64_t source_size);
+
+    // Read every row of a .hrfbin file into 'out' (which is cleared first).
+    // Returns false if the file can't be opened, fails validation, doesn't
+    // match source_size, or (for training rows) has no labels.
+    bool ReadBinaryCache(const std::string& filename,
+                         std::uint64_t source_size,
+                         std::vector<const HiggsTrainingCsvRow>& out);
+    bool ReadBinaryCache(const std::string& filename,
+                         std::uint64_t source_size,
+                         std::vector<const HiggsCsvRow>& out);
+}
+
+#endif /* defined(__RandomForest____BinaryCache__) */
@@ -0,0 +1,123 @@
+//
+//  CsvRowView.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "CsvRowView.h"
+
+#include <cstring>
+#include <cassert>
+#include <limits>
+
+#include "NumParse.h"
+
+namespace hrf {
+
+    CsvRowView::CsvRowView() :
+    size_(0),
+    bad_field_(-1)
+    { }
+
+    bool CsvRowView::Parse(const char*& cursor, const char* end) {
+        if (cursor >= end) {
+            return false;
+        }
+
+        // find the end of this line with memchr; it's typically much faster
+        // than walking the characters ourselves
+        const char* line_begin = cursor;
+        const char* newline = static_cast<const char*>(std::memchr(line_begin, '\n', end - line_begin));
+        const char* line_end = (newline != nullptr) ? newline : end;
+        cursor = (newline != nullptr) ? newline + 1 : end;
+
+        if (line_end > line_begin && *(line_end - 1) == '\r') {
+            --line_end;
+        }
+
+        int n_fields = 0;
+        const char* field_begin = line_begin;
+        while (n_fields < MAX_FIELDS) {
+            const char* comma = static_cast<const char*>(std::memchr(field_begin, ',', line_end - field_begin));
+            const char* field_end = (comma != nullptr) ? comma : line_end;
+
+            begins_[n_fields] = field_begin;
+            ends_[n_fields] = field_end;
+            ++n_fields;
+
+            if (comma == nullptr) {
+                break;
+            }
+            field_begin = comma + 1;
+        }
+        size_ = n_fields;
+        bad_field_ = -1;
+
+        return true;
+    }
+
+    int CsvRowView::size() const {
+        return size_;
+    }
+
+    const char* CsvRowView::FieldBegin(int i) const {
+        assert(i >= 0 && i < size_);
+        return begins_[i];
+    }
+
+    const char* CsvRowView::FieldEnd(int i) const {
+        assert(i >= 0 && i < size_);
+        return ends_[i];
+    }
+
+    void CsvRowView::SetBadField(int i) const {
+        if (bad_field_ < 0) {
+            bad_field_ = i;
+        }
+    }
+
+    int CsvRowView::GetInt(int i) const {
+        assert(i >= 0 && i < size_);
+        int value = 0;
+        bkp::ParseResult result = bkp::ParseInt(begins_[i], ends_[i], value);
+        if (!result.ok_ || result.ptr_ != ends_[i]) {
+            SetBadField(i);
+            return 0;
+        }
+        return value;
+    }
+
+    double CsvRowView::GetDouble(int i) const {
+        assert(i >= 0 && i < size_);
+        double value = 0.0;
+        bkp::ParseResult result = bkp::ParseDouble(begins_[i], ends_[i], value);
+        if (!result.ok_ || result.ptr_ != ends_[i]) {
+            SetBadField(i);
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        return value;
+    }
+
+    double CsvRowView::GetDouble(int i, double missing_value) const {
+        assert(i >= 0 && i < size_);
+        const double NaN = std::numeric_limits<double>::quiet_NaN();
+        double value = 0.0;
+        bkp::ParseResult result = bkp::ParseDouble(begins_[i], ends_[i], value, missing_value, NaN);
+        if (!result.ok_ || result.ptr_ != ends_[i]) {
+            SetBadField(i);
+            return NaN;
+        }
+        return value;
+    }
+
+    char CsvRowView::GetChar(int i) const {
+        assert(i >= 0 && i < size_);
+        return begins_[i] < ends_[i] ? *begins_[i] : '\0';
+    }
+
+    int CsvRowView::BadField() const {
+        return bad_field_;
+    }
+}
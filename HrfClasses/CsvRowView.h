@@ -0,0 +1,88 @@
+//
+//  CsvRowView.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____CsvRowView__
+#define __RandomForest____CsvRowView__
+
+#include <array>
+
+namespace hrf {
+
+    // CsvRowView is a lightweight, non-owning replacement for csv_row.
+    // Instead of copying each field into its own std::string, it just
+    // records where each field begins and ends inside a buffer that is
+    // owned by someone else (typically a bkp::MappedFile). Tokenizing a
+    // row therefore does no heap allocation at all.
+    //
+    // The buffer being tokenized must stay alive as long as the view is in
+    // use. Numbers are converted straight from the buffer with bkp::ParseInt
+    // and bkp::ParseDouble, so no '\0' terminators are needed.
+    //
+    // A field that isn't a valid number doesn't stop the accessors; they
+    // return a placeholder value and remember the field, which the caller
+    // can then check with BadField() once it's done with the row. (Row
+    // constructors can't return an error code, so this lets them be used
+    // as-is and checked afterwards.)
+    //
+    // Quoted fields are not supported; the Higgs data never uses them.
+    class CsvRowView {
+    public:
+
+        // The widest row we ever need to read (training.csv: EventId,
+        // 30 features, Weight and Label). Extra fields are ignored.
+        static const int MAX_FIELDS = 33;
+
+    private:
+        std::array<const char*, MAX_FIELDS> begins_;
+        std::array<const char*, MAX_FIELDS> ends_;
+        int size_;
+        
+        // index of the first field that failed to convert since the last
+        // Parse, or -1. Mutable because the accessors that set it are const.
+        mutable int bad_field_;
+        
+        void SetBadField(int i) const;
+
+    public:
+        CsvRowView();
+
+        // Tokenize the line starting at 'cursor'. On return, 'cursor' will point
+        // to the start of the next line (or to 'end'). Returns false, without
+        // modifying this view, if there are no more lines to read. A trailing
+        // '\r' (Windows line endings) is not considered part of the last field.
+        bool Parse(const char*& cursor, const char* end);
+
+        // Number of fields found by the last call to Parse
+        int size() const;
+
+        // Raw [begin, end) character range of field i
+        const char* FieldBegin(int i) const;
+        const char* FieldEnd(int i) const;
+
+        // Interpret field i as an int/double/char. Numeric fields must be
+        // entirely numeric (e.g. "12abc" is an error). On error, GetInt returns
+        // 0, GetDouble returns NaN, and the field is recorded (see BadField).
+        // The values are the same as std::stoi/std::stod/string[0] give for
+        // the same text, so rows built from a CsvRowView are identical to
+        // rows built from a csv_row.
+        int GetInt(int i) const;
+        double GetDouble(int i) const;
+        char GetChar(int i) const;
+        
+        // Same as GetDouble, but returns NaN if the field's value is equal to
+        // missing_value (e.g. the -999.0 that the Higgs data uses for "no data")
+        double GetDouble(int i, double missing_value) const;
+        
+        // The first field that an accessor failed to convert since the last
+        // call to Parse, or -1 if there hasn't been one
+        int BadField() const;
+    };
+
+}
+
+#endif /* defined(__RandomForest____CsvRowView__) */
@@ -0,0 +1,589 @@
+//
+//  FeatureMatrix.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "FeatureMatrix.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+
+namespace hrf {
+
+    const int FeatureMatrix::NUM_FEATURES;
+    const std::uint16_t QuantizedColumnView::NAN_CODE;
+    const std::uint16_t QuantizedColumnView::MAX_CODE;
+    const std::uint8_t BinnedColumnView::NAN_CODE;
+    const int BinnedColumnView::NUM_CODES;
+
+    ////////// private stuff //////////
+
+    // Template for the FeatureMatrix version of HasNan, for each view type
+    template<class TView>
+    void OrNans(const FeatureMatrix& rows,
+                const std::vector<int>& cols,
+                unsigned char* has_nan)
+    {
+        const std::size_t nrows = rows.size();
+        for (int col : cols) {
+            const TView view = rows.View<TView>(col);
+            for (std::size_t i=0; i<nrows; ++i) {
+                has_nan[i] |= view.IsNan(view.data_[i]);
+            }
+        }
+    }
+
+    // column_slot_ of a FeatureMatrix that stores every feature
+    std::vector<int> AllColumnSlots() {
+        std::vector<int> result(FeatureMatrix::NUM_FEATURES);
+        for (int feature=0; feature<FeatureMatrix::NUM_FEATURES; ++feature) {
+            result[feature] = feature;
+        }
+        return result;
+    }
+
+    // dest[i] = source[rows[i]], reusing dest's storage
+    template<class T>
+    void GatherRows(const std::vector<T>& source,
+                    const std::vector<int>& rows,
+                    std::vector<T>& dest)
+    {
+        dest.resize(rows.size());
+        for (std::size_t i=0; i<rows.size(); ++i) {
+            dest[i] = source[rows[i]];
+        }
+    }
+
+    // Append, for each of source's columns starting at column_starts, the
+    // values of rows (in that order) to dest
+    template<class T>
+    void GatherColumns(const std::vector<T>& source,
+                       const std::vector<std::size_t>& column_starts,
+                       const std::vector<int>& rows,
+                       std::vector<T>& dest)
+    {
+        dest.resize(column_starts.size() * rows.size());
+        T* out = dest.data();
+        for (std::size_t start : column_starts) {
+            const T* column = source.data() + start;
+            for (int row : rows) {
+                *out++ = column[row];
+            }
+        }
+    }
+
+    // Set dest to columns' n_rows values each, one column after the other,
+    // converted by encode(slot, value) (slot being the column's position in
+    // columns), reusing dest's storage
+    template<class T, class TEncodeFn>
+    void EncodeColumnValues(const std::vector<const double*>& columns,
+                            std::size_t n_rows,
+                            std::vector<T>& dest,
+                            TEncodeFn encode)
+    {
+        dest.resize(columns.size() * n_rows);
+        T* out = dest.data();
+        for (std::size_t slot=0; slot<columns.size(); ++slot) {
+            const double* column = columns[slot];
+            for (std::size_t row_index=0; row_index<n_rows; ++row_index) {
+                *out++ = encode(slot, column[row_index]);
+            }
+        }
+    }
+
+    ////////// public stuff (from FeatureMatrix.h) //////////
+
+    std::uint16_t QuantizedColumnView::Encode(double v) const {
+        if (std::isnan(v)) {
+            return NAN_CODE;
+        }
+        if (scale_ == 0.0) {
+            return 1;
+        }
+        double code = std::floor((v - offset_) / scale_ + 0.5) + 1.0;
+        if (code < 1.0) {
+            return 1;
+        }
+        if (code > MAX_CODE) {
+            return MAX_CODE;
+        }
+        return static_cast<std::uint16_t>(code);
+    }
+
+    std::uint32_t QuantizedColumnView::Threshold(double split) const {
+        // every code decodes to >= offset_, so every non-NaN code is above
+        // the split
+        if (!(split > offset_)) {
+            return 1;
+        }
+        if (scale_ == 0.0) {
+            return MAX_CODE + 1;
+        }
+
+        // The smallest code that decodes to >= split. The division can be
+        // off by one either way due to rounding, so nudge the estimate until
+        // it's exactly right.
+        double estimate = std::ceil((split - offset_) / scale_) + 1.0;
+        if (estimate > MAX_CODE + 1.0) {
+            return MAX_CODE + 1;
+        }
+        std::uint32_t code = static_cast<std::uint32_t>(estimate);
+        while (code > 1 && Decode(static_cast<std::uint16_t>(code - 1)) >= split) {
+            --code;
+        }
+        while (code <= MAX_CODE && Decode(static_cast<std::uint16_t>(code)) < split) {
+            ++code;
+        }
+        return code;
+    }
+
+    std::uint8_t BinnedColumnView::Encode(double v) const {
+        if (std::isnan(v)) {
+            return NAN_CODE;
+        }
+        // the last bin whose lower bound is <= v (or bin 1, if v is below
+        // every bin)
+        const double* after = std::upper_bound(lower_bounds_ + 1, lower_bounds_ + NUM_CODES, v);
+        return static_cast<std::uint8_t>(std::max<std::ptrdiff_t>(after - lower_bounds_ - 1, 1));
+    }
+
+    std::uint32_t BinnedColumnView::Threshold(double split) const {
+        if (!(split > lower_bounds_[1])) {
+            return 1;
+        }
+        // the first bin that decodes to >= split (lower_bounds_ is sorted,
+        // including the +infinity padding)
+        const double* first = std::lower_bound(lower_bounds_ + 1, lower_bounds_ + NUM_CODES, split);
+        return static_cast<std::uint32_t>(first - lower_bounds_);
+    }
+
+    FeatureMatrix::FeatureMatrix() :
+    nrows_(0),
+    has_labels_(false),
+    storage_(DOUBLE_FEATURES),
+    column_slot_(AllColumnSlots())
+    { }
+
+    // Choose the bins of each column for BINNED8_FEATURES. If a column has
+    // few enough distinct values, each value gets its own bin, so binning it
+    // loses nothing. Otherwise the bins start at the column's quantiles, so
+    // that each bin holds about the same number of rows.
+    template<class TRow>
+    void FeatureMatrix::ChooseBins(const bkp::MaskedVector<const TRow>& rows) {
+        const int NUM_CODES = BinnedColumnView::NUM_CODES;
+        const int MAX_BINS = NUM_CODES - 1;
+
+        bin_lower_bounds_.assign(NUM_FEATURES * NUM_CODES, std::numeric_limits<double>::infinity());
+        bin_upper_bounds_.assign(NUM_FEATURES * NUM_CODES, std::numeric_limits<double>::infinity());
+
+        std::vector<double> vals;
+        std::vector<double> distinct;
+        vals.reserve(nrows_);
+        for (int dim=0; dim<NUM_FEATURES; ++dim) {
+            double* lower = bin_lower_bounds_.data() + dim * NUM_CODES;
+            double* upper = bin_upper_bounds_.data() + dim * NUM_CODES;
+            lower[BinnedColumnView::NAN_CODE] = std::numeric_limits<double>::quiet_NaN();
+            upper[BinnedColumnView::NAN_CODE] = std::numeric_limits<double>::quiet_NaN();
+
+            vals.clear();
+            for (std::size_t row_index=0; row_index<nrows_; ++row_index) {
+                double val = rows[row_index].data_[dim];
+                if (!std::isnan(val)) {
+                    vals.push_back(val);
+                }
+            }
+            if (vals.empty()) {
+                continue;
+            }
+            std::sort(vals.begin(), vals.end());
+
+            distinct.clear();
+            std::unique_copy(vals.begin(), vals.end(), std::back_inserter(distinct));
+
+            int n_bins = 0;
+            if (distinct.size() <= MAX_BINS) {
+                std::copy(distinct.begin(), distinct.end(), lower + 1);
+                n_bins = static_cast<int>(distinct.size());
+            }
+            else {
+                for (int bin=0; bin<MAX_BINS; ++bin) {
+                    double quantile = vals[vals.size() * bin / MAX_BINS];
+                    if (n_bins == 0 || quantile > lower[n_bins]) {
+                        lower[++n_bins] = quantile;
+                    }
+                }
+            }
+
+            // each bin's upper bound is the largest value below the next bin
+            for (int code=1; code<=n_bins; ++code) {
+                auto next_bin = (code < n_bins) ?
+                    std::lower_bound(vals.begin(), vals.end(), lower[code + 1]) :
+                    vals.end();
+                upper[code] = *(next_bin - 1);
+            }
+        }
+    }
+
+    // Copy the EventIds and features of 'rows' into our columns. Done one
+    // row at a time (rather than one column at a time) so that each row is
+    // only pulled into cache once.
+    template<class TRow>
+    void FeatureMatrix::CopyFeatures(const bkp::MaskedVector<const TRow>& rows) {
+        event_ids_.resize(nrows_);
+        for (std::size_t row_index=0; row_index<nrows_; ++row_index) {
+            event_ids_[row_index] = rows[row_index].EventId_;
+        }
+
+        switch (storage_) {
+            case DOUBLE_FEATURES: {
+                features_.resize(NUM_FEATURES * nrows_);
+                double* features = features_.data();
+                for (std::size_t row_index=0; row_index<nrows_; ++row_index) {
+                    const TRow& row = rows[row_index];
+                    for (int dim=0; dim<NUM_FEATURES; ++dim) {
+                        features[dim * nrows_ + row_index] = row.data_[dim];
+                    }
+                }
+                break;
+            }
+
+            case FLOAT_FEATURES: {
+                float_features_.resize(NUM_FEATURES * nrows_);
+                float* features = float_features_.data();
+                for (std::size_t row_index=0; row_index<nrows_; ++row_index) {
+                    const TRow& row = rows[row_index];
+                    for (int dim=0; dim<NUM_FEATURES; ++dim) {
+                        features[dim * nrows_ + row_index] = static_cast<float>(row.data_[dim]);
+                    }
+                }
+                break;
+            }
+
+            case QUANTIZED16_FEATURES: {
+                // first pass: find the range of each column (ignoring NaN),
+                // which sets each column's offset and scale
+                std::vector<double> mins(NUM_FEATURES, std::numeric_limits<double>::max());
+                std::vector<double> maxs(NUM_FEATURES, std::numeric_limits<double>::lowest());
+                for (std::size_t row_index=0; row_index<nrows_; ++row_index) {
+                    const TRow& row = rows[row_index];
+                    for (int dim=0; dim<NUM_FEATURES; ++dim) {
+                        double val = row.data_[dim];
+                        if (val < mins[dim]) {
+                            mins[dim] = val;
+                        }
+                        if (val > maxs[dim]) {
+                            maxs[dim] = val;
+                        }
+                    }
+                }
+
+                offsets_.resize(NUM_FEATURES);
+                scales_.resize(NUM_FEATURES);
+                std::vector<QuantizedColumnView> views(NUM_FEATURES);
+                for (int dim=0; dim<NUM_FEATURES; ++dim) {
+                    if (mins[dim] > maxs[dim]) { // all NaN (or no rows)
+                        mins[dim] = maxs[dim] = 0.0;
+                    }
+                    offsets_[dim] = mins[dim];
+                    scales_[dim] = (maxs[dim] - mins[dim]) / (QuantizedColumnView::MAX_CODE - 1);
+                    views[dim].offset_ = offsets_[dim];
+                    views[dim].scale_ = scales_[dim];
+                }
+
+                // second pass: encode
+                quantized_features_.resize(NUM_FEATURES * nrows_);
+                std::uint16_t* features = quantized_features_.data();
+                for (std::size_t row_index=0; row_index<nrows_; ++row_index) {
+                    const TRow& row = rows[row_index];
+                    for (int dim=0; dim<NUM_FEATURES; ++dim) {
+                        features[dim * nrows_ + row_index] = views[dim].Encode(row.data_[dim]);
+                    }
+                }
+                break;
+            }
+
+            case BINNED8_FEATURES: {
+                ChooseBins(rows);
+
+                binned_features_.resize(NUM_FEATURES * nrows_);
+                std::vector<BinnedColumnView> views;
+                for (int dim=0; dim<NUM_FEATURES; ++dim) {
+                    views.push_back(View<BinnedColumnView>(dim));
+                }
+                std::uint8_t* features = binned_features_.data();
+                for (std::size_t row_index=0; row_index<nrows_; ++row_index) {
+                    const TRow& row = rows[row_index];
+                    for (int dim=0; dim<NUM_FEATURES; ++dim) {
+                        features[dim * nrows_ + row_index] = views[dim].Encode(row.data_[dim]);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    FeatureMatrix::FeatureMatrix(const bkp::MaskedVector<const HiggsTrainingCsvRow>& rows,
+                                 FeatureStorage storage) :
+    nrows_(rows.size()),
+    has_labels_(true),
+    storage_(storage),
+    column_slot_(AllColumnSlots())
+    {
+        CopyFeatures(rows);
+
+        weights_.resize(nrows_);
+        labels_.resize(nrows_);
+        is_signal_.resize(nrows_);
+        for (std::size_t row_index=0; row_index<nrows_; ++row_index) {
+            const HiggsTrainingCsvRow& row = rows[row_index];
+            weights_[row_index] = row.Weight_;
+            labels_[row_index] = row.Label_;
+            is_signal_[row_index] = (row.Label_ == 's') ? 1 : 0;
+        }
+    }
+
+    FeatureMatrix::FeatureMatrix(const bkp::MaskedVector<const HiggsCsvRow>& rows,
+                                 FeatureStorage storage) :
+    nrows_(rows.size()),
+    has_labels_(false),
+    storage_(storage),
+    column_slot_(AllColumnSlots())
+    {
+        CopyFeatures(rows);
+    }
+
+    void FeatureMatrix::Project(const FeatureMatrix& source,
+                                const std::vector<int>& features,
+                                const std::vector<int>& rows)
+    {
+        assert(this != &source);
+        nrows_ = rows.size();
+        has_labels_ = source.has_labels_;
+        storage_ = source.storage_;
+
+        std::vector<std::size_t> column_starts;
+        column_starts.reserve(features.size());
+        column_slot_.assign(NUM_FEATURES, -1);
+        for (std::size_t slot=0; slot<features.size(); ++slot) {
+            assert(column_slot_[features[slot]] == -1); // no repeats
+            column_slot_[features[slot]] = static_cast<int>(slot);
+            column_starts.push_back(source.ColumnStart(features[slot]));
+        }
+
+        features_.clear();
+        float_features_.clear();
+        quantized_features_.clear();
+        binned_features_.clear();
+        switch (storage_) {
+            case DOUBLE_FEATURES:
+                GatherColumns(source.features_, column_starts, rows, features_);
+                break;
+            case FLOAT_FEATURES:
+                GatherColumns(source.float_features_, column_starts, rows, float_features_);
+                break;
+            case QUANTIZED16_FEATURES:
+                GatherColumns(source.quantized_features_, column_starts, rows, quantized_features_);
+                break;
+            case BINNED8_FEATURES:
+                GatherColumns(source.binned_features_, column_starts, rows, binned_features_);
+                break;
+        }
+        CopyEncoding(source, features);
+
+        GatherRows(source.event_ids_, rows, event_ids_);
+        if (has_labels_) {
+            GatherRows(source.weights_, rows, weights_);
+            GatherRows(source.labels_, rows, labels_);
+            GatherRows(source.is_signal_, rows, is_signal_);
+        }
+        else {
+            weights_.clear();
+            labels_.clear();
+            is_signal_.clear();
+        }
+    }
+
+    void FeatureMatrix::CopyEncoding(const FeatureMatrix& source, const std::vector<int>& features) {
+        storage_ = source.storage_;
+        offsets_ = source.offsets_;
+        scales_ = source.scales_;
+        if (storage_ != BINNED8_FEATURES) {
+            bin_lower_bounds_.clear();
+            bin_upper_bounds_.clear();
+            return;
+        }
+
+        // the storage is reused, so this only allocates the first time
+        const int NUM_CODES = BinnedColumnView::NUM_CODES;
+        bin_lower_bounds_.resize(source.bin_lower_bounds_.size());
+        bin_upper_bounds_.resize(source.bin_upper_bounds_.size());
+        for (int feature : features) {
+            const std::size_t begin = feature * NUM_CODES;
+            std::copy(source.bin_lower_bounds_.begin() + begin,
+                      source.bin_lower_bounds_.begin() + begin + NUM_CODES,
+                      bin_lower_bounds_.begin() + begin);
+            std::copy(source.bin_upper_bounds_.begin() + begin,
+                      source.bin_upper_bounds_.begin() + begin + NUM_CODES,
+                      bin_upper_bounds_.begin() + begin);
+        }
+    }
+
+    void FeatureMatrix::ResetColumns(const FeatureMatrix& encoding,
+                                     const std::vector<int>& features,
+                                     std::size_t n_rows,
+                                     const int* event_ids,
+                                     const double* weights,
+                                     const char* labels)
+    {
+        assert(this != &encoding);
+        assert((weights == nullptr) == (labels == nullptr));
+        nrows_ = n_rows;
+        has_labels_ = (labels != nullptr);
+        CopyEncoding(encoding, features);
+
+        column_slot_.assign(NUM_FEATURES, -1);
+        for (std::size_t slot=0; slot<features.size(); ++slot) {
+            assert(column_slot_[features[slot]] == -1); // no repeats
+            column_slot_[features[slot]] = static_cast<int>(slot);
+        }
+
+        features_.clear();
+        float_features_.clear();
+        quantized_features_.clear();
+        binned_features_.clear();
+
+        event_ids_.assign(event_ids, event_ids + n_rows);
+        if (has_labels_) {
+            weights_.assign(weights, weights + n_rows);
+            labels_.assign(labels, labels + n_rows);
+            is_signal_.resize(n_rows);
+            for (std::size_t row_index=0; row_index<n_rows; ++row_index) {
+                is_signal_[row_index] = (labels[row_index] == 's') ? 1 : 0;
+            }
+        }
+        else {
+            weights_.clear();
+            labels_.clear();
+            is_signal_.clear();
+        }
+    }
+
+    void FeatureMatrix::EncodeColumns(const FeatureMatrix& encoding,
+                                      const std::vector<int>& features,
+                                      const std::vector<const double*>& feature_columns,
+                                      std::size_t n_rows,
+                                      const int* event_ids,
+                                      const double* weights,
+                                      const char* labels)
+    {
+        assert(features.size() == feature_columns.size());
+        ResetColumns(encoding, features, n_rows, event_ids, weights, labels);
+
+        switch (storage_) {
+            case DOUBLE_FEATURES:
+                EncodeColumnValues(feature_columns, n_rows, features_,
+                                   [](std::size_t, double v) { return v; });
+                break;
+            case FLOAT_FEATURES:
+                EncodeColumnValues(feature_columns, n_rows, float_features_,
+                                   [](std::size_t, double v) { return static_cast<float>(v); });
+                break;
+            case QUANTIZED16_FEATURES: {
+                std::vector<QuantizedColumnView> views(features.size());
+                for (std::size_t slot=0; slot<features.size(); ++slot) {
+                    views[slot].offset_ = offsets_[features[slot]];
+                    views[slot].scale_ = scales_[features[slot]];
+                }
+                EncodeColumnValues(feature_columns, n_rows, quantized_features_,
+                                   [&views](std::size_t slot, double v) { return views[slot].Encode(v); });
+                break;
+            }
+            case BINNED8_FEATURES: {
+                const int NUM_CODES = BinnedColumnView::NUM_CODES;
+                std::vector<BinnedColumnView> views(features.size());
+                for (std::size_t slot=0; slot<features.size(); ++slot) {
+                    views[slot].lower_bounds_ = bin_lower_bounds_.data() + features[slot] * NUM_CODES;
+                    views[slot].upper_bounds_ = bin_upper_bounds_.data() + features[slot] * NUM_CODES;
+                }
+                EncodeColumnValues(feature_columns, n_rows, binned_features_,
+                                   [&views](std::size_t slot, double v) { return views[slot].Encode(v); });
+                break;
+            }
+        }
+    }
+
+    void FeatureMatrix::EncodeColumns(const FeatureMatrix& encoding,
+                                      const std::vector<int>& features,
+                                      const std::vector<const std::uint8_t*>& binned_columns,
+                                      std::size_t n_rows,
+                                      const int* event_ids,
+                                      const double* weights,
+                                      const char* labels)
+    {
+        assert(encoding.storage_ == BINNED8_FEATURES);
+        assert(features.size() == binned_columns.size());
+        ResetColumns(encoding, features, n_rows, event_ids, weights, labels);
+
+        binned_features_.resize(features.size() * n_rows);
+        std::uint8_t* out = binned_features_.data();
+        for (const std::uint8_t* column : binned_columns) {
+            out = std::copy(column, column + n_rows, out);
+        }
+    }
+
+    std::size_t FeatureMatrix::FeatureBytes() const {
+        return features_.size() * sizeof(double) +
+               float_features_.size() * sizeof(float) +
+               quantized_features_.size() * sizeof(std::uint16_t) +
+               binned_features_.size() * sizeof(std::uint8_t);
+    }
+
+    double FeatureMatrix::Get(std::size_t row, int feature) const {
+        assert(row < nrows_);
+        switch (storage_) {
+            case DOUBLE_FEATURES:
+                return Column(feature)[row];
+            case FLOAT_FEATURES:
+                return View<FloatColumnView>(feature).data_[row];
+            case QUANTIZED16_FEATURES: {
+                const QuantizedColumnView view = View<QuantizedColumnView>(feature);
+                return view.Decode(view.data_[row]);
+            }
+            case BINNED8_FEATURES: {
+                const BinnedColumnView view = View<BinnedColumnView>(feature);
+                return view.Decode(view.data_[row]);
+            }
+        }
+        return std::numeric_limits<double>::quiet_NaN(); // unreachable
+    }
+
+    std::vector<bool>
+    HasNan(const FeatureMatrix& rows, const std::vector<int>& cols)
+    {
+        // OR together one column at a time, so each pass is a sequential scan.
+        // (Use a char buffer rather than writing to the vector<bool> directly,
+        // since bit-packed writes are slow and can't be vectorized.)
+        std::vector<unsigned char> has_nan(rows.size(), 0);
+        switch (rows.Storage()) {
+            case DOUBLE_FEATURES:
+                OrNans<DoubleColumnView>(rows, cols, has_nan.data());
+                break;
+            case FLOAT_FEATURES:
+                OrNans<FloatColumnView>(rows, cols, has_nan.data());
+                break;
+            case QUANTIZED16_FEATURES:
+                OrNans<QuantizedColumnView>(rows, cols, has_nan.data());
+                break;
+            case BINNED8_FEATURES:
+                OrNans<BinnedColumnView>(rows, cols, has_nan.data());
+                break;
+        }
+
+        return std::vector<bool>(has_nan.begin(), has_nan.end());
+    }
+}
@@ -0,0 +1,356 @@
+//
+//  FeatureMatrix.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____FeatureMatrix__
+#define __RandomForest____FeatureMatrix__
+
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+#include "MaskedVector.h"
+#include "HiggsCsvRow.h"
+
+namespace hrf {
+
+    // The ways a FeatureMatrix can store its feature values. The Higgs
+    // features don't need anywhere near double precision to pick split
+    // points, and the smaller types pack 2-4x as many rows into each cache
+    // line (and each byte of memory bandwidth).
+    //
+    // BINNED8_FEATURES is meant for training only: it's the storage that
+    // the histogram split search works on (see trainer::FindBestSplit). Its
+    // bins are chosen from the data itself, so a FeatureMatrix of test rows
+    // would get different bins; score those with one of the other storages.
+    enum FeatureStorage {
+        DOUBLE_FEATURES,      // 8 bytes/value, exact
+        FLOAT_FEATURES,       // 4 bytes/value, rounded to the nearest float
+        QUANTIZED16_FEATURES, // 2 bytes/value, rounded to one of 65535 evenly spaced levels per column
+        BINNED8_FEATURES      // 1 byte/value, one of up to 255 bins per column, split at the column's quantiles
+    };
+
+    // Read-only views of a single FeatureMatrix column, one for each
+    // FeatureStorage. They all have the same interface, so that code that
+    // scans columns can be written once as a template on the view type:
+    //     value_type       the type of the stored values
+    //     threshold_type   the type returned by Threshold()
+    //     data_            the column's values, one per row
+    //     Decode(v)        stored value v as a double (NaN if it's missing)
+    //     IsNan(v)         same as std::isnan(Decode(v))
+    //     Threshold(split) a value t such that (v >= t) == (Decode(v) >= split)
+    //                      for every v, so that rows can be compared to a
+    //                      split without decoding them
+    struct DoubleColumnView {
+        typedef double value_type;
+        typedef double threshold_type;
+
+        const double* data_;
+
+        double Decode(double v) const { return v; }
+        bool IsNan(double v) const { return std::isnan(v); }
+        double Threshold(double split) const { return split; }
+    };
+
+    struct FloatColumnView {
+        typedef float value_type;
+        typedef float threshold_type;
+
+        const float* data_;
+
+        double Decode(float v) const { return v; }
+        bool IsNan(float v) const { return std::isnan(v); }
+
+        // the smallest float >= split (comparing floats to a float, rather
+        // than promoting each of them to double, keeps the comparisons
+        // twice as wide when vectorized)
+        float Threshold(double split) const {
+            float result = static_cast<float>(split);
+            if (result < split) {
+                result = std::nextafter(result, std::numeric_limits<float>::infinity());
+            }
+            return result;
+        }
+    };
+
+    // Quantized values are stored as codes: code 0 means NaN, and code c > 0
+    // means offset_ + (c-1)*scale_. NaN is 0 (rather than the largest code) so
+    // that, as with doubles, a NaN is never >= any threshold.
+    struct QuantizedColumnView {
+        typedef std::uint16_t value_type;
+        typedef std::uint32_t threshold_type; // may need to be 1 more than the largest code
+
+        static const std::uint16_t NAN_CODE = 0;
+        static const std::uint16_t MAX_CODE = 0xffff;
+
+        const std::uint16_t* data_;
+        double offset_;
+        double scale_;
+
+        double Decode(std::uint16_t v) const {
+            return (v == NAN_CODE) ? std::numeric_limits<double>::quiet_NaN() : offset_ + (v - 1) * scale_;
+        }
+        bool IsNan(std::uint16_t v) const { return v == NAN_CODE; }
+        std::uint16_t Encode(double v) const;
+        std::uint32_t Threshold(double split) const;
+    };
+
+    // Binned values are stored as bin numbers ("codes"): code 0 means NaN,
+    // and codes 1, 2, ... are the column's bins in increasing order. Bin c
+    // holds the training values from lower_bounds_[c] to upper_bounds_[c]
+    // (both of which are actual training values), and decodes to
+    // lower_bounds_[c]. Codes past the last bin have bounds of +infinity.
+    struct BinnedColumnView {
+        typedef std::uint8_t value_type;
+        typedef std::uint32_t threshold_type; // may need to be 1 more than the largest code
+
+        static const std::uint8_t NAN_CODE = 0;
+        static const int NUM_CODES = 256; // including NAN_CODE
+
+        const std::uint8_t* data_;
+        const double* lower_bounds_; // NUM_CODES of each
+        const double* upper_bounds_;
+
+        double Decode(std::uint8_t v) const { return lower_bounds_[v]; }
+        bool IsNan(std::uint8_t v) const { return v == NAN_CODE; }
+        std::uint8_t Encode(double v) const;
+        std::uint32_t Threshold(double split) const;
+
+        // The split value that separates bin c from bin c-1 (c >= 2): halfway
+        // between the largest value in c-1 and the smallest value in c, so
+        // that unseen values are split the way their nearest neighbours were.
+        double SplitBelow(int c) const {
+            return 0.5 * (upper_bounds_[c - 1] + lower_bounds_[c]);
+        }
+    };
+
+    // A column-major ("structure of arrays") copy of a set of Higgs rows.
+    //
+    // A MaskedVector of rows stores each row's 30 features together, so a
+    // loop over a single feature has to hop from row to row (via a pointer
+    // each time) and pulls a whole row into cache for every value it reads.
+    // The tree-training code does almost nothing but scan a single feature
+    // over many rows, so a FeatureMatrix instead stores every feature as its
+    // own contiguous array, along with contiguous EventId, Weight and label
+    // columns. Column scans then read memory sequentially and can be
+    // vectorized by the compiler.
+    //
+    // FeatureMatrix can be built implicitly from a MaskedVector of rows, so
+    // functions that take a const FeatureMatrix& can still be passed rows
+    // (the rows are copied into a temporary FeatureMatrix). Code that makes
+    // many calls on the same data should build the FeatureMatrix once up front.
+    //
+    // By default features are stored as doubles, but they can also be stored
+    // at reduced precision (see FeatureStorage). Column() only works for
+    // DOUBLE_FEATURES; code that should work with any storage should use
+    // View<TView>() (usually from a template, after switching on Storage())
+    // or Get().
+    class FeatureMatrix {
+    public:
+        static const int NUM_FEATURES = HiggsCsvRow::NUM_FEATURES;
+
+    private:
+        std::size_t nrows_;
+        bool has_labels_;
+        FeatureStorage storage_;
+
+        // Columns of nrows_ values each, one after the other; feature f of
+        // row r is features_[column_slot_[f] * nrows_ + r]. Only the vector
+        // that matches storage_ is populated.
+        std::vector<double> features_;
+        std::vector<float> float_features_;
+        std::vector<std::uint16_t> quantized_features_;
+
+        std::vector<std::uint8_t> binned_features_;
+
+        // Position of each feature's column in the vectors above, or -1 if
+        // it isn't stored (see Project). f for every feature, except in
+        // projections.
+        std::vector<int> column_slot_;
+
+        // Start of the specified feature's column in the vectors above
+        std::size_t ColumnStart(int feature) const {
+            assert(feature >= 0 && feature < NUM_FEATURES);
+            assert(column_slot_[feature] >= 0);
+            return column_slot_[feature] * nrows_;
+        }
+
+        // QUANTIZED16_FEATURES only: the QuantizedColumnView offset_ and
+        // scale_ of each column
+        std::vector<double> offsets_;
+        std::vector<double> scales_;
+
+        // BINNED8_FEATURES only: the BinnedColumnView bounds of each column,
+        // BinnedColumnView::NUM_CODES per column (only set for the stored
+        // columns; see CopyEncoding)
+        std::vector<double> bin_lower_bounds_;
+        std::vector<double> bin_upper_bounds_;
+
+        template<class TRow>
+        void ChooseBins(const bkp::MaskedVector<const TRow>& rows);
+
+        std::vector<int> event_ids_;
+
+        // only populated if has_labels_
+        std::vector<double> weights_;
+        std::vector<char> labels_;
+
+        // 1 if the row's label is 's', 0 otherwise. Redundant with labels_, but
+        // a 0/1 column lets signal counts be a plain (vectorizable) sum.
+        std::vector<unsigned char> is_signal_;
+
+        template<class TRow>
+        void CopyFeatures(const bkp::MaskedVector<const TRow>& rows);
+
+        // Make this encode the given features the same way as source does:
+        // same Storage(), quantization levels and bins. Only the given
+        // features' bins are copied (the others are left unset), since
+        // copying every feature's would cost a projection of a few columns
+        // more than its rows do.
+        void CopyEncoding(const FeatureMatrix& source, const std::vector<int>& features);
+
+        // Everything EncodeColumns does but fill in the feature values
+        void ResetColumns(const FeatureMatrix& encoding,
+                          const std::vector<int>& features,
+                          std::size_t n_rows,
+                          const int* event_ids,
+                          const double* weights,
+                          const char* labels);
+
+    public:
+        FeatureMatrix();
+
+        // Conversion constructors: copy the (unmasked) rows of 'rows', in order
+        FeatureMatrix(const bkp::MaskedVector<const HiggsTrainingCsvRow>& rows,
+                      FeatureStorage storage=DOUBLE_FEATURES);
+        FeatureMatrix(const bkp::MaskedVector<const HiggsCsvRow>& rows,
+                      FeatureStorage storage=DOUBLE_FEATURES);
+
+        // Make this a "projection" of source: a copy of just the given
+        // features, for the given rows (which may repeat; row i of this is
+        // row rows[i] of source), with their labels. Only those features
+        // can be read from it. Feature numbers and each column's encoding
+        // (Storage(), quantization levels, bins) stay the same as source's,
+        // so a Tree trained on a projection can score source's rows.
+        //
+        // A Tree only ever reads its target_features_, so training it on a
+        // projection of its own features (and training rows) reads a small
+        // contiguous copy instead of gathering from the full matrix.
+        //
+        // This FeatureMatrix's storage is reused, so projecting into the
+        // same FeatureMatrix again and again only allocates when it grows.
+        void Project(const FeatureMatrix& source,
+                     const std::vector<int>& features,
+                     const std::vector<int>& rows);
+
+        // Make this a copy of n_rows rows that are given column by column
+        // (e.g. straight out of a BinaryCacheFile), encoded the same way as
+        // encoding: same Storage(), quantization levels and bins. As with
+        // Project, only the given features are stored (feature_columns[i]
+        // holds the values of features[i]), and this FeatureMatrix's storage
+        // is reused. weights and labels are null if the rows have none.
+        //
+        // This is how a training set too big to fit in memory is read a
+        // chunk at a time (see StreamedTrainingSet): every chunk is encoded
+        // with the same bins, chosen once from a sample of the rows.
+        void EncodeColumns(const FeatureMatrix& encoding,
+                           const std::vector<int>& features,
+                           const std::vector<const double*>& feature_columns,
+                           std::size_t n_rows,
+                           const int* event_ids,
+                           const double* weights,
+                           const char* labels);
+
+        // Same as above, for BINNED8_FEATURES encodings only, but the columns
+        // are already codes in encoding's bins (as written out from the
+        // View<BinnedColumnView>s of an earlier chunk), so they're copied
+        // as-is
+        void EncodeColumns(const FeatureMatrix& encoding,
+                           const std::vector<int>& features,
+                           const std::vector<const std::uint8_t*>& binned_columns,
+                           std::size_t n_rows,
+                           const int* event_ids,
+                           const double* weights,
+                           const char* labels);
+
+        std::size_t size() const { return nrows_; }
+        bool HasLabels() const { return has_labels_; }
+        FeatureStorage Storage() const { return storage_; }
+
+        // Bytes used by the feature columns (not counting EventIds, weights
+        // or labels)
+        std::size_t FeatureBytes() const;
+
+        // Pointer to the nrows_ values of the specified feature (an index into
+        // HiggsCsvRow.data_). Only valid for DOUBLE_FEATURES.
+        const double* Column(int feature) const {
+            assert(storage_ == DOUBLE_FEATURES);
+            return features_.data() + ColumnStart(feature);
+        }
+
+        // View of the specified feature. TView must match Storage()
+        // (DoubleColumnView for DOUBLE_FEATURES, etc.)
+        template<class TView>
+        TView View(int feature) const;
+
+        // Value of one feature of one row, decoded to a double. Works for any
+        // Storage(), but is slower than scanning a View.
+        double Get(std::size_t row, int feature) const;
+
+        const int* EventIds() const { return event_ids_.data(); }
+
+        // Only valid if HasLabels()
+        const double* Weights() const { assert(has_labels_); return weights_.data(); }
+        const char* Labels() const { assert(has_labels_); return labels_.data(); }
+        const unsigned char* IsSignal() const { assert(has_labels_); return is_signal_.data(); }
+    };
+
+    template<>
+    inline DoubleColumnView FeatureMatrix::View<DoubleColumnView>(int feature) const {
+        DoubleColumnView result = { Column(feature) };
+        return result;
+    }
+
+    template<>
+    inline FloatColumnView FeatureMatrix::View<FloatColumnView>(int feature) const {
+        assert(storage_ == FLOAT_FEATURES);
+        FloatColumnView result = { float_features_.data() + ColumnStart(feature) };
+        return result;
+    }
+
+    template<>
+    inline QuantizedColumnView FeatureMatrix::View<QuantizedColumnView>(int feature) const {
+        assert(storage_ == QUANTIZED16_FEATURES);
+        QuantizedColumnView result = {
+            quantized_features_.data() + ColumnStart(feature),
+            offsets_[feature],
+            scales_[feature]
+        };
+        return result;
+    }
+
+    template<>
+    inline BinnedColumnView FeatureMatrix::View<BinnedColumnView>(int feature) const {
+        assert(storage_ == BINNED8_FEATURES);
+        BinnedColumnView result = {
+            binned_features_.data() + ColumnStart(feature),
+            bin_lower_bounds_.data() + feature * BinnedColumnView::NUM_CODES,
+            bin_upper_bounds_.data() + feature * BinnedColumnView::NUM_CODES
+        };
+        return result;
+    }
+
+    // FeatureMatrix version of HasNan (see HiggsCsvRow.h): result[i] is true
+    // iff row i has a NaN in at least one of the specified columns
+    std::vector<bool>
+    HasNan(const FeatureMatrix& rows, const std::vector<int>& cols);
+}
+
+#endif /* defined(__RandomForest____FeatureMatrix__) */
@@ -9,22 +9,54 @@
 #include <string>
 #include <cmath>
 #include <limits>
+#include <stdexcept>
 
 #include "HiggsCsvRow.h"
+#include "NumParse.h"
 
 namespace hrf {
     
+    // definitions for static constants, required if they are ever odr-used
+    // (e.g. bound to a const reference)
+    const int HiggsCsvRow::NUM_FEATURES;
+    const int HiggsCsvRow::NUM_CSV_COLUMNS;
+    const int HiggsTrainingCsvRow::NUM_CSV_COLUMNS;
+    const double HiggsCsvRow::MISSING_VALUE = -999.0;
+    
+    // Parse a whole csv_row field as a double with bkp::ParseDouble, turning
+    // missing_value into NaN. Throws std::invalid_argument on a malformed field,
+    // the same as the std::stod call this replaced.
+    static double ParseCsvField(const std::string& field, double missing_value) {
+        const char* begin = field.data();
+        const char* end = begin + field.size();
+        double value;
+        bkp::ParseResult result = bkp::ParseDouble(begin,
+                                                   end,
+                                                   value,
+                                                   missing_value,
+                                                   std::numeric_limits<double>::quiet_NaN());
+        if (!result.ok_ || result.ptr_ != end) {
+            throw std::invalid_argument("Malformed csv field: '" + field + "'");
+        }
+        return value;
+    }
+    
     // csv-row constructor
     HiggsCsvRow::HiggsCsvRow(const csv_row& row) :
     EventId_(std::stoi(row[0]))
     {
-        const double NaN = std::numeric_limits<double>::quiet_NaN();
         for (int i=0; i<data_.size(); i++) {
-            double val = std::stod(row[i+1]); // +1 to shift past EventId
-            if (val == -999.0) {
-                val = NaN;
-            }
-            data_[i] = val;
+            data_[i] = ParseCsvField(row[i+1], MISSING_VALUE); // +1 to shift past EventId
+        }
+    }
+    
+    // CsvRowView constructor; same logic as the csv_row constructor above.
+    // Malformed fields come out as NaN, and are reported by row.BadField()
+    HiggsCsvRow::HiggsCsvRow(const CsvRowView& row) :
+    EventId_(row.GetInt(0))
+    {
+        for (std::size_t i=0; i<data_.size(); i++) {
+            data_[i] = row.GetDouble(i+1, MISSING_VALUE); // +1 to shift past EventId
         }
     }
     
@@ -43,10 +75,17 @@ namespace hrf {
     // csv-row constructor
     HiggsTrainingCsvRow::HiggsTrainingCsvRow(const csv_row& row) :
     HiggsCsvRow(row),
-    Weight_(std::stod(row[31])),
+    Weight_(ParseCsvField(row[31], std::numeric_limits<double>::quiet_NaN())), // NaN never == anything, so no sentinel
     Label_(row[32][0])
     { }
     
+    // CsvRowView constructor
+    HiggsTrainingCsvRow::HiggsTrainingCsvRow(const CsvRowView& row) :
+    HiggsCsvRow(row),
+    Weight_(row.GetDouble(31)),
+    Label_(row.GetChar(32))
+    { }
+    
     // pass-anything constructor
     HiggsTrainingCsvRow::HiggsTrainingCsvRow(int event_id,
                                              std::array<double, HiggsCsvRow::NUM_FEATURES>&& data,
@@ -77,7 +116,7 @@ namespace hrf {
             
             auto dim_index = ndims;
             while (dim_index--) {
-                row_has_nan &= std::isnan(row.data_[dim_index]);
+                row_has_nan |= std::isnan(row.data_[cols[dim_index]]);
             }
             
             result[row_index] = row_has_nan;
@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "libs/libcsv_parser.h"
+#include "CsvRowView.h"
 #include "MaskedVector.h"
 
 namespace hrf {
@@ -37,9 +38,21 @@ namespace hrf {
         static const int NUM_FEATURES = 30;
         std::array<double, NUM_FEATURES> data_;
         
+        // Number of columns in a test.csv row (EventId + features)
+        static const int NUM_CSV_COLUMNS = NUM_FEATURES + 1;
+        
+        // Value used in the csv files to mean "no data". It's turned into NaN
+        // as the row is parsed.
+        static const double MISSING_VALUE;
+        
         // Construct a HiggsCsvRow from the output of our csv-parser library
         HiggsCsvRow(const csv_row& row);
         
+        // Construct a HiggsCsvRow directly from a tokenized (but unparsed)
+        // row of a memory-mapped file. Produces the same row as the csv_row
+        // constructor, without any intermediate strings.
+        HiggsCsvRow(const CsvRowView& row);
+        
         // pass-anything constructor. Should probably only be used for mocking purposes
         HiggsCsvRow(int event_id, std::array<double, NUM_FEATURES>&& data);
         
@@ -62,9 +75,15 @@ namespace hrf {
         // Either 'b' or 's' representing signal or background.
         const char Label_;
         
+        // Number of columns in a training.csv row (EventId + features + Weight + Label)
+        static const int NUM_CSV_COLUMNS = HiggsCsvRow::NUM_FEATURES + 3;
+        
         // Construct from the output of our csv-parser library
         HiggsTrainingCsvRow(const csv_row& row);
         
+        // Construct from a tokenized row of a memory-mapped file
+        HiggsTrainingCsvRow(const CsvRowView& row);
+        
         // pass-anything constructor. Should probably only be used for mocking purposes
         HiggsTrainingCsvRow(int event_id,
                             std::array<double, HiggsCsvRow::NUM_FEATURES>&& data,
@@ -7,91 +7,557 @@
 //
 
 #include <vector>
-#include <deque>
 #include <memory>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+#include <cassert>
 
 #include "Parser.h"
 #include "FileWrapper.h"
+#include "MappedFile.h"
+#include "CsvRowView.h"
+#include "BinaryCache.h"
+#include "PredictionWriter.h"
+#include "RandUtils.h"
 
 namespace hrf {
     
     ////////// private stuff //////////
     
-    // Return true if the specified file exists
-    inline bool FileExists (const std::string& name) {
-        if (FILE *file = fopen(name.c_str(), "r")) {
-            fclose(file);
-            return true;
-        } else {
-            return false;
-        }   
-    }
+    // When parsing in parallel, the file is split into roughly this many
+    // chunks per core. Having more chunks than cores lets threads that
+    // finish early pick up extra work.
+    const int CHUNKS_PER_CORE = 4;
+    
+    // Don't bother splitting the file into chunks smaller than this;
+    // the thread overhead isn't worth it for tiny files.
+    const std::size_t MIN_CHUNK_BYTES = 64 * 1024;
+    
+    // ...but don't make them much bigger than this either, since every chunk
+    // that's being parsed holds its rows in a second, temporary vector.
+    const std::size_t MAX_CHUNK_BYTES = 1024 * 1024;
     
-    // Stop the program if the specified file does not exist.
+    // What was wrong with a malformed row: either it had too few columns,
+    // or one of its fields wasn't a valid number.
+    struct RowError {
+        int n_columns_;
+        int bad_field_; // -1 if the problem was the number of columns
+    };
+    
+    // Stop the program, reporting which line of the file was malformed.
     // Note: this does not use an assert statement, and so will
     // continue to stop the program even if, say, NDEBUG is #defined
-    inline void AssertFileExists(const std::string& filename) {
-        if (!FileExists(filename)) {
-            printf("Failed to open file '%s'\n", filename.c_str());
-            exit(-1);
+    void ExitMalformedRow(const std::string& filename,
+                          std::size_t row_index,
+                          int expected_columns,
+                          const RowError& error)
+    {
+        const int line_number = static_cast<int>(row_index) + 2; // +1 for header, +1 for 1-based line numbers
+        if (error.bad_field_ < 0) {
+            printf("Malformed row %d in file '%s' (expected %d columns, found %d)\n",
+                   line_number,
+                   filename.c_str(),
+                   expected_columns,
+                   error.n_columns_);
+        }
+        else {
+            printf("Malformed row %d in file '%s' (column %d is not a number)\n",
+                   line_number,
+                   filename.c_str(),
+                   error.bad_field_ + 1);
+        }
+        exit(-1);
+    }
+    
+    // Parse every line in [begin, end) into a TRow and append it to 'out'.
+    // Returns true on success. If a row doesn't have enough columns or has
+    // a field that isn't a number, stops and returns false; in that case
+    // out.size() is the index of the bad row (relative to begin) and 'error'
+    // says what was wrong with it.
+    template<class TRow, class TContainer>
+    bool ParseRows(const char* begin, const char* end, TContainer& out, RowError& error) {
+        const char* cursor = begin;
+        CsvRowView row;
+        while (row.Parse(cursor, end)) {
+            if (row.size() < TRow::NUM_CSV_COLUMNS) {
+                error.n_columns_ = row.size();
+                error.bad_field_ = -1;
+                return false;
+            }
+            
+            TRow parsed(row);
+            if (row.BadField() >= 0) {
+                error.n_columns_ = row.size();
+                error.bad_field_ = row.BadField();
+                return false;
+            }
+            out.push_back(parsed);
+        }
+        return true;
+    }
+    
+    // Split [begin, end) into at most n_chunks pieces of about equal size.
+    // Every boundary is placed just after a '\n', so no line is split between
+    // two chunks. The returned vector holds the chunk boundaries, i.e. chunk
+    // i is [result[i], result[i+1]).
+    std::vector<const char*> SplitAtNewlines(const char* begin, const char* end, int n_chunks) {
+        std::vector<const char*> result;
+        result.push_back(begin);
+        
+        const std::size_t total_bytes = end - begin;
+        for (int i=1; i<n_chunks; ++i) {
+            const char* guess = begin + (total_bytes * i) / n_chunks;
+            if (guess <= result.back()) {
+                continue;
+            }
+            const char* newline = static_cast<const char*>(std::memchr(guess, '\n', end - guess));
+            if (newline == nullptr) {
+                break;
+            }
+            result.push_back(newline + 1);
+        }
+        
+        result.push_back(end);
+        return result;
+    }
+    
+    // The type of the vector that backs the MaskedVector LoadRows returns.
+    // Rows are parsed straight into one of these (rather than into some
+    // temporary container that then gets copied), so that only one copy of
+    // the data exists at a time.
+    template<class TRow>
+    using RowVector = std::vector<const TRow>;
+    
+    // Count the lines in [begin, end), including a final line with no '\n'.
+    // This is just a memchr scan, which is much faster than parsing, so it's
+    // worth doing up front to size the row vectors exactly.
+    std::size_t CountLines(const char* begin, const char* end) {
+        std::size_t n_lines = 0;
+        const char* cursor = begin;
+        while (cursor < end) {
+            const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+            ++n_lines;
+            cursor = (newline != nullptr) ? newline + 1 : end;
+        }
+        return n_lines;
+    }
+    
+    // Serial implementation of LoadRows: parse the whole body on the calling
+    // thread, directly into a vector of the right size.
+    template<class TRow>
+    RowVector<TRow> ParseSerial(const std::string& filename, const char* begin, const char* end) {
+        RowVector<TRow> result;
+        result.reserve(CountLines(begin, end));
+        
+        RowError error;
+        if (!ParseRows<TRow>(begin, end, result, error)) {
+            ExitMalformedRow(filename, result.size(), TRow::NUM_CSV_COLUMNS, error);
+        }
+        return result;
+    }
+    
+    // Parallel implementation of LoadRows: split the body into newline-aligned
+    // chunks and parse the chunks on a pool of threads (each into its own
+    // vector). Meanwhile the calling thread appends the finished chunks to the
+    // result in file order, so the row order is exactly the same as
+    // ParseSerial's.
+    //
+    // Each chunk is freed as soon as it has been appended, and the workers
+    // never get more than a few chunks ahead of the calling thread, so at
+    // peak there's only one full copy of the data plus a few chunks' worth.
+    template<class TRow>
+    RowVector<TRow> ParseParallel(const std::string& filename, const char* begin, const char* end) {
+        
+        const int N_CORES = std::max(1u, std::thread::hardware_concurrency());
+        const std::size_t total_bytes = end - begin;
+        const std::size_t wanted_chunks = std::max<std::size_t>(N_CORES * CHUNKS_PER_CORE,
+                                                                total_bytes / MAX_CHUNK_BYTES + 1);
+        const int max_chunks = static_cast<int>(std::min<std::size_t>(wanted_chunks,
+                                                                      total_bytes / MIN_CHUNK_BYTES + 1));
+        
+        const std::vector<const char*> boundaries = SplitAtNewlines(begin, end, max_chunks);
+        const int n_chunks = static_cast<int>(boundaries.size()) - 1;
+        const int n_threads = std::min(N_CORES, n_chunks);
+        const int max_chunks_ahead = 2 * n_threads;
+        
+        // results for each chunk. Everything here (and next_chunk and
+        // n_appended) is guarded by 'mutex'; 'chunk_changed' is signalled
+        // whenever a chunk is finished or appended.
+        std::vector<RowVector<TRow>> chunk_rows(n_chunks);
+        std::unique_ptr<bool[]> chunk_done(new bool[n_chunks]());
+        std::unique_ptr<bool[]> chunk_ok(new bool[n_chunks]());
+        std::unique_ptr<RowError[]> chunk_errors(new RowError[n_chunks]);
+        int next_chunk = 0;
+        int n_appended = 0;
+        std::mutex mutex;
+        std::condition_variable chunk_changed;
+        
+        auto parse_chunks = [&]() {
+            while (true) {
+                int chunk_index;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    chunk_changed.wait(lock, [&]() {
+                        return next_chunk >= n_chunks || next_chunk < n_appended + max_chunks_ahead;
+                    });
+                    if (next_chunk >= n_chunks) {
+                        return;
+                    }
+                    chunk_index = next_chunk++;
+                }
+                
+                const char* chunk_begin = boundaries[chunk_index];
+                const char* chunk_end = boundaries[chunk_index + 1];
+                RowVector<TRow> rows;
+                rows.reserve(CountLines(chunk_begin, chunk_end));
+                RowError error;
+                bool ok = ParseRows<TRow>(chunk_begin, chunk_end, rows, error);
+                
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    chunk_rows[chunk_index] = std::move(rows);
+                    chunk_ok[chunk_index] = ok;
+                    chunk_errors[chunk_index] = error;
+                    chunk_done[chunk_index] = true;
+                }
+                chunk_changed.notify_all();
+            }
+        };
+        
+        std::vector<std::thread> threads;
+        for (int i=0; i<n_threads; ++i) {
+            threads.push_back(std::thread(parse_chunks));
+        }
+        
+        RowVector<TRow> result;
+        result.reserve(CountLines(begin, end));
+        int bad_chunk = -1;
+        for (int i=0; i<n_chunks; ++i) {
+            RowVector<TRow> rows;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                chunk_changed.wait(lock, [&]() { return chunk_done[i]; });
+                rows = std::move(chunk_rows[i]);
+                
+                if (!chunk_ok[i]) {
+                    // stop handing out chunks, so the workers finish quickly
+                    bad_chunk = i;
+                    next_chunk = n_chunks;
+                }
+            }
+            if (bad_chunk >= 0) {
+                chunk_changed.notify_all();
+                for (std::thread& thread : threads) {
+                    thread.join();
+                }
+                ExitMalformedRow(filename,
+                                 result.size() + rows.size(),
+                                 TRow::NUM_CSV_COLUMNS,
+                                 chunk_errors[i]);
+            }
+            
+            // Note: rows have const members and so aren't assignable, which
+            // rules out vector::insert; push them onto the end instead.
+            std::copy(rows.begin(), rows.end(), std::back_inserter(result));
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++n_appended;
+            }
+            chunk_changed.notify_all();
+        }
+        
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        return result;
+    }
+    
+    // Whether TRow has a Label_ to stratify on
+    template<class TRow>
+    struct RowHasLabel { static const bool value = false; };
+    
+    template<>
+    struct RowHasLabel<HiggsTrainingCsvRow> { static const bool value = true; };
+    
+    // The Label_ of each row (for stratified sampling)
+    std::vector<char> RowLabels(const RowVector<HiggsTrainingCsvRow>& rows) {
+        std::vector<char> result;
+        result.reserve(rows.size());
+        for (const HiggsTrainingCsvRow& row : rows) {
+            result.push_back(row.Label_);
+        }
+        return result;
+    }
+    
+    std::vector<char> RowLabels(const RowVector<HiggsCsvRow>&) {
+        return std::vector<char>(); // test rows have no labels
+    }
+    
+    // Find the start of every line in [begin, end), without tokenizing them.
+    // If 'labels' isn't null, also store the first character of each line's
+    // last field (the Label column of training.csv) there.
+    void IndexLines(const char* begin,
+                    const char* end,
+                    std::vector<const char*>& line_begins, // assumed to be empty
+                    std::vector<char>* labels) // assumed to be empty
+    {
+        const char* cursor = begin;
+        while (cursor < end) {
+            const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+            const char* line_end = (newline != nullptr) ? newline : end;
+            
+            line_begins.push_back(cursor);
+            if (labels != nullptr) {
+                const char* last_field = line_end;
+                while (last_field > cursor && *(last_field - 1) != ',') {
+                    --last_field;
+                }
+                labels->push_back(last_field < line_end ? *last_field : '\0');
+            }
+            
+            cursor = (newline != nullptr) ? newline + 1 : end;
+        }
+    }
+    
+    // Decide which of n_rows rows to keep, according to options. 'labels' is
+    // either empty or has one entry per row, in which case each label is
+    // sampled separately.
+    //
+    // Uses selection sampling (Knuth's Algorithm S) within each label: a row
+    // is kept with probability (rows still needed)/(rows left), which picks
+    // exactly the requested number of rows, uniformly at random, in a single
+    // pass. Draws one random number per row (none if sample_fraction_ is 1.0),
+    // so the result only depends on the bkp::random seed and the labels.
+    std::vector<bool> SelectRows(std::size_t n_rows,
+                                 const std::vector<char>& labels,
+                                 const LoadOptions& options)
+    {
+        assert(labels.empty() || labels.size() == n_rows);
+        const bool stratify = !labels.empty();
+        const bool sample = options.sample_fraction_ < 1.0;
+        
+        // rows left and rows still needed, per label (everything is in
+        // stratum 0 if we're not stratifying)
+        const int N_STRATA = 256;
+        std::vector<std::size_t> remaining(N_STRATA, 0);
+        std::vector<std::size_t> needed(N_STRATA, 0);
+        if (stratify) {
+            for (char label : labels) {
+                ++remaining[static_cast<unsigned char>(label)];
+            }
+        }
+        else {
+            remaining[0] = n_rows;
+        }
+        for (int stratum=0; stratum<N_STRATA; ++stratum) {
+            needed[stratum] = sample ?
+                static_cast<std::size_t>(std::floor(options.sample_fraction_ * remaining[stratum] + 0.5)) :
+                remaining[stratum];
+        }
+        
+        std::vector<bool> keep(n_rows, false);
+        std::size_t n_kept = 0;
+        for (std::size_t row_index=0; row_index<n_rows; ++row_index) {
+            if (options.max_rows_ > 0 && n_kept >= options.max_rows_) {
+                break;
+            }
+            
+            const int stratum = stratify ? static_cast<unsigned char>(labels[row_index]) : 0;
+            bool keep_row = !sample ||
+                bkp::random::RandDouble(0.0, 1.0) * remaining[stratum] < needed[stratum];
+            if (keep_row && needed[stratum] > 0) {
+                keep[row_index] = true;
+                --needed[stratum];
+                ++n_kept;
+            }
+            --remaining[stratum];
+        }
+        return keep;
+    }
+    
+    // Sampled implementation of LoadRows: parse only the lines whose entry
+    // in 'keep' is true. line_begins comes from IndexLines, and end is the
+    // end of the file.
+    template<class TRow>
+    RowVector<TRow> ParseSelected(const std::string& filename,
+                                    const std::vector<const char*>& line_begins,
+                                    const std::vector<bool>& keep,
+                                    const char* end)
+    {
+        RowVector<TRow> result;
+        result.reserve(std::count(keep.begin(), keep.end(), true));
+        
+        RowError error;
+        const std::size_t n_lines = line_begins.size();
+        for (std::size_t line_index=0; line_index<n_lines; ++line_index) {
+            if (!keep[line_index]) {
+                continue;
+            }
+            const char* line_end = (line_index + 1 < n_lines) ? line_begins[line_index + 1] : end;
+            if (!ParseRows<TRow>(line_begins[line_index], line_end, result, error)) {
+                ExitMalformedRow(filename, line_index, TRow::NUM_CSV_COLUMNS, error);
+            }
+        }
+        return result;
+    }
+    
+    // Keep only the rows whose entry in 'keep' is true
+    template<class TRow>
+    RowVector<TRow> FilterRows(const RowVector<TRow>& rows, const std::vector<bool>& keep) {
+        RowVector<TRow> result;
+        result.reserve(std::count(keep.begin(), keep.end(), true));
+        for (std::size_t row_index=0; row_index<rows.size(); ++row_index) {
+            if (keep[row_index]) {
+                result.push_back(rows[row_index]);
+            }
         }
+        return result;
     }
     
     // Load csv rows from the specified file into a masked vector
-    // of TRows. This uses the libcsv library to parse the csv.
-    // The class TRow is expected to have a constructor that takes
-    // a single csv_row parameter (preferably const csv_row&)
+    // of TRows. The file is memory-mapped and each line is tokenized
+    // in place (see CsvRowView), so no per-field strings are ever
+    // allocated. The class TRow is expected to have a constructor that
+    // takes a single const CsvRowView& parameter, and a static
+    // NUM_CSV_COLUMNS member giving the number of fields it needs.
+    //
+    // If options.parallel_ is true the file is parsed on all available cores.
+    // Either way, the rows come back in the same order as in the file.
+    //
+    // If options.use_cache_ is true, the rows are read from the file's binary
+    // cache (see BinaryCache.h) instead when there is an up-to-date one.
+    // Otherwise, after parsing, a new cache is written for next time.
+    //
+    // If options.IsSampled(), only the selected rows are kept. When parsing
+    // the csv file, the lines are indexed first (just finding newlines and
+    // labels) and only the selected ones are parsed.
     template<class TRow>
-    bkp::MaskedVector<const TRow> LoadRows(std::string filename) {
+    bkp::MaskedVector<const TRow> LoadRows(const std::string& filename, const LoadOptions& options) {
         
         // If the csv file doesn't exist, we may as well just stop now.
         // Nothing in our program will be able to run if our data doesn't
         // load.
-        AssertFileExists(filename);
-        
-        // set up the csv_parser...
-        csv_parser file_parser;
-        file_parser.set_skip_lines(1);
-        file_parser.set_enclosed_char('"', ENCLOSURE_OPTIONAL);
-        file_parser.set_field_term_char(',');
-        file_parser.set_line_term_char('\n');
-        file_parser.init(filename.c_str());
-        
-        // Use a deque for initial load - we (theoretically) don't
-        // know how much data we'll be loading and this grows more easily
-        // than a vector (no big copy operations when we go over capacity).
-        // We'll copy to a vector later, which has better read operations.
-        std::deque<TRow> insert_deque;
-        while (file_parser.has_more_rows()) {
-            csv_row row = file_parser.get_row();
-            
-            insert_deque.push_back(TRow(row));
+        // Note: this does not use an assert statement, and so will
+        // continue to stop the program even if, say, NDEBUG is #defined
+        bkp::MappedFile file;
+        if (!file.Open(filename)) {
+            printf("Failed to open file '%s'\n", filename.c_str());
+            exit(-1);
         }
         
-        // Create a vector that will serve as the backing store for our
-        // MaskedVector. We could do this manually and try to use move
-        // operations to save ourselves from copying all the data, but since
-        // our rows are nearly POD objects, move semantics wouldn't really
-        // be able to save us anything.
-        std::vector<const TRow> allData(insert_deque.begin(), insert_deque.end());
+        const bool stratify = options.stratify_ && RowHasLabel<TRow>::value;
+        const std::string cache_filename = BinaryCacheName(filename);
+        RowVector<TRow> rows;
+        bool from_cache = options.use_cache_ &&
+            IsBinaryCacheFresh(filename, cache_filename) &&
+            ReadBinaryCache(cache_filename, file.size(), rows);
+        
+        if (from_cache) {
+            if (options.IsSampled()) {
+                std::vector<char> labels;
+                if (stratify) {
+                    labels = RowLabels(rows);
+                }
+                rows = FilterRows(rows, SelectRows(rows.size(), labels, options));
+            }
+        }
+        else {
+            // skip the header line
+            const char* begin = file.data();
+            const char* end = file.end();
+            CsvRowView header;
+            header.Parse(begin, end);
+            
+            if (options.IsSampled()) {
+                std::vector<const char*> line_begins;
+                std::vector<char> labels;
+                IndexLines(begin, end, line_begins, stratify ? &labels : nullptr);
+                
+                std::vector<bool> keep = SelectRows(line_begins.size(), labels, options);
+                rows = ParseSelected<TRow>(filename, line_begins, keep, end);
+            }
+            else {
+                rows = options.parallel_ ?
+                    ParseParallel<TRow>(filename, begin, end) :
+                    ParseSerial<TRow>(filename, begin, end);
+                
+                // Failing to write the cache isn't an error (the data directory
+                // may be read-only, for instance), it just means we'll have to
+                // parse the csv file again next time.
+                if (options.use_cache_) {
+                    WriteBinaryCache(cache_filename, rows, file.size());
+                }
+            }
+        }
         
-        // Move the vector into a MaskedVector and return.
-        return bkp::MaskedVector<const TRow>(std::move(allData));
+        // 'rows' already is the MaskedVector's backing store; hand it over
+        // without copying.
+        return bkp::MaskedVector<const TRow>(std::move(rows));
     }
     
     ////////// public stuff (from Parser.h) //////////
     
+    LoadOptions::LoadOptions() :
+    parallel_(false),
+    use_cache_(true),
+    sample_fraction_(1.0),
+    stratify_(false),
+    max_rows_(0)
+    { }
+    
+    bool LoadOptions::IsSampled() const {
+        return sample_fraction_ < 1.0 || max_rows_ > 0;
+    }
+    
     // LoadTrainingData; specify filename and delegate to LoadRows<T>
-    bkp::MaskedVector<const HiggsTrainingCsvRow> LoadTrainingData() {
-        return LoadRows<HiggsTrainingCsvRow>("data/training.csv");
+    bkp::MaskedVector<const HiggsTrainingCsvRow> LoadTrainingData(bool parallel) {
+        return LoadTrainingData("data/training.csv", parallel, true);
+    }
+    
+    bkp::MaskedVector<const HiggsTrainingCsvRow> LoadTrainingData(const std::string& filename,
+                                                                  bool parallel,
+                                                                  bool use_cache)
+    {
+        LoadOptions options;
+        options.parallel_ = parallel;
+        options.use_cache_ = use_cache;
+        return LoadRows<HiggsTrainingCsvRow>(filename, options);
+    }
+    
+    bkp::MaskedVector<const HiggsTrainingCsvRow> LoadTrainingData(const std::string& filename,
+                                                                  const LoadOptions& options)
+    {
+        return LoadRows<HiggsTrainingCsvRow>(filename, options);
     }
     
     // LoadTestData; specify filename and delegate to LoadRows<T>
-    bkp::MaskedVector<const HiggsCsvRow> LoadTestData() {
-        return LoadRows<HiggsCsvRow>("data/test.csv");
+    bkp::MaskedVector<const HiggsCsvRow> LoadTestData(bool parallel) {
+        return LoadTestData("data/test.csv", parallel, true);
+    }
+    
+    bkp::MaskedVector<const HiggsCsvRow> LoadTestData(const std::string& filename,
+                                                      bool parallel,
+                                                      bool use_cache)
+    {
+        LoadOptions options;
+        options.parallel_ = parallel;
+        options.use_cache_ = use_cache;
+        return LoadRows<HiggsCsvRow>(filename, options);
+    }
+    
+    bkp::MaskedVector<const HiggsCsvRow> LoadTestData(const std::string& filename,
+                                                      const LoadOptions& options)
+    {
+        return LoadRows<HiggsCsvRow>(filename, options);
     }
     
     // Write predictions to the specified file. Return false if we
@@ -99,29 +565,21 @@ namespace hrf {
     bool WritePredictions(std::string filename,
                           const bkp::MaskedVector<const HiggsCsvRow>& rows,
                           const std::vector<char>& predictions,
-                          const std::vector<int>& confidences)
+                          const std::vector<int>& confidences,
+                          bool background)
     {
-        bkp::FileWrapper f;
-        if (!f.Open(filename, "w")) {
-            return false;
-        }
-        
-        if (f.Printf("EventId,RankOrder,Class\n") < 0) {
+        PredictionWriter writer;
+        if (!writer.Open(filename, background)) {
             return false;
         }
         
         const auto size = rows.size();
         for (auto i = decltype(size){0}; i<size; ++i) {
-            int chars_printed = f.Printf("%d,%d,%c\n",
-                                         rows[i].EventId_,
-                                         confidences[i],
-                                         predictions[i]);
-            if (chars_printed < 0) {
+            if (!writer.Write(rows[i].EventId_, confidences[i], predictions[i])) {
                 return false;
             }
         }
         
-        // f will auto-close when it exits scope
-        return true;
+        return writer.Close();
     }
 }
@@ -10,33 +10,103 @@
 #define __RandomForest____Parser__
 
 #include <string>
+#include <cstddef>
 
 #include "MaskedVector.h"
 #include "HiggsCsvRow.h"
 
 namespace hrf {
     
+    // Settings for LoadTrainingData/LoadTestData. The defaults load every row
+    // of the file; the sampling settings are meant for quick experiments
+    // (e.g. smoke-testing a hyperparameter change on 10% of the data).
+    struct LoadOptions {
+        
+        // Parse on all available cores. Only applies when loading every row;
+        // sampled loads only parse the selected rows, on the calling thread.
+        bool parallel_;
+        
+        // Read the binary cache if it's fresh, and write one after parsing a
+        // full load (see BinaryCache.h). Sampled loads never write a cache.
+        bool use_cache_;
+        
+        // Fraction of the rows to keep, chosen at random. 1.0 keeps every row.
+        // Exactly round(sample_fraction_ * n) of the file's n rows are kept,
+        // in file order.
+        double sample_fraction_;
+        
+        // If true, sample each Label separately, so that the sample has
+        // exactly the same mix of 's' and 'b' as the file (to within
+        // rounding). Ignored for test data, which has no labels.
+        bool stratify_;
+        
+        // Stop after this many rows have been kept (after sampling), or 0
+        // for no limit.
+        std::size_t max_rows_;
+        
+        LoadOptions();
+        
+        // True if these options load only some of the rows
+        bool IsSampled() const;
+    };
+    
     // Read in training data from training.csv and convert to a MaskedVector
     // of HiggsTrainingCsvRow. This method assumes that training.csv will be
     // available in a directory called "data/" next to the location of the executable.
     // Copying this file there should be taken care of by the build process.
-    bkp::MaskedVector<const HiggsTrainingCsvRow> LoadTrainingData();
+    //
+    // If 'parallel' is true, the file is split into chunks that are parsed
+    // on all available cores. Row order is the same either way.
+    //
+    // The parsed rows are also saved to a binary cache next to the csv file
+    // (data/training.csv.hrfbin, see BinaryCache.h). As long as the cache is
+    // newer than the csv file, later calls load the cache instead of parsing.
+    bkp::MaskedVector<const HiggsTrainingCsvRow> LoadTrainingData(bool parallel=false);
+    
+    // Same as above, but read from the specified file instead of data/training.csv.
+    // If use_cache is false the binary cache is neither read nor written.
+    bkp::MaskedVector<const HiggsTrainingCsvRow> LoadTrainingData(const std::string& filename,
+                                                                  bool parallel,
+                                                                  bool use_cache=true);
+    
+    // Same as above, but with the given options. Unselected rows are skipped
+    // while reading, without being converted to HiggsTrainingCsvRow. The
+    // random choices come from bkp::random, so the same seed always gives
+    // the same sample (whether or not it's read from the binary cache).
+    bkp::MaskedVector<const HiggsTrainingCsvRow> LoadTrainingData(const std::string& filename,
+                                                                  const LoadOptions& options);
     
     // Read in test data from test.csv and convert to a MaskedVector
     // of HiggsCsvRow. This method assumes that test.csv will be
     // available in a directory called "data/" next to the location of the executable.
     // Copying this file there should be taken care of by the build process.
-    bkp::MaskedVector<const HiggsCsvRow> LoadTestData();
+    //
+    // 'parallel' and the binary cache work the same way as in LoadTrainingData
+    bkp::MaskedVector<const HiggsCsvRow> LoadTestData(bool parallel=false);
+    
+    // Same as above, but read from the specified file instead of data/test.csv
+    bkp::MaskedVector<const HiggsCsvRow> LoadTestData(const std::string& filename,
+                                                      bool parallel,
+                                                      bool use_cache=true);
+    
+    // Same as above, but with the given options (see LoadTrainingData)
+    bkp::MaskedVector<const HiggsCsvRow> LoadTestData(const std::string& filename,
+                                                      const LoadOptions& options);
     
     // Write our predictions to the specified file, in the format specified by
     // the competition (3-column csv, see here:
     // https://www.kaggle.com/c/higgs-boson/details/evaluation ).
     // Return value signifies success: 'true' if all went well, and 'false' if
     // we failed to open the specified file or something else went wrong.
+    //
+    // The file is written by a PredictionWriter; if 'background' is true, the
+    // actual disk writes happen on a separate thread while the rows are being
+    // formatted.
     bool WritePredictions(std::string filename,
                           const bkp::MaskedVector<const HiggsCsvRow>& rows,
                           const std::vector<char>& predictions,
-                          const std::vector<int>& confidences);
+                          const std::vector<int>& confidences,
+                          bool background=false);
     
 }
 
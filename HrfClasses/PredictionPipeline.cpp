@@ -0,0 +1,211 @@
+//
+//  PredictionPipeline.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "PredictionPipeline.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cassert>
+
+#include "MappedFile.h"
+#include "PredictionWriter.h"
+#include "JobQueue.h"
+#include "CsvRowView.h"
+#include "HiggsCsvRow.h"
+#include "MaskedVector.h"
+
+namespace hrf {
+
+    ////////// private stuff //////////
+
+    // A batch of parsed rows on its way from the parse stage to the score stage
+    struct RowBatch {
+        // index (in the input file, not counting the header) of rows_[0]
+        std::size_t first_row_;
+        std::unique_ptr<bkp::MaskedVector<const HiggsCsvRow>> rows_;
+    };
+
+    // A batch of predictions on its way from the score stage to the write stage
+    struct PredictionBatch {
+        std::size_t first_row_;
+        std::vector<int> event_ids_;
+        std::vector<char> predictions_;
+    };
+
+    // Parse stage: read the file batch_size rows at a time and push each
+    // batch onto out_queue, then CompleteAdding. Pages of the file are
+    // released as soon as they've been parsed, so that the mapping doesn't
+    // slowly pull the whole file into memory.
+    void ParseStage(const std::string& filename,
+                    std::size_t batch_size,
+                    bkp::JobQueue<RowBatch>& out_queue)
+    {
+        // Note: this does not use an assert statement, and so will
+        // continue to stop the program even if, say, NDEBUG is #defined
+        bkp::MappedFile file;
+        if (!file.Open(filename)) {
+            printf("Failed to open file '%s'\n", filename.c_str());
+            exit(-1);
+        }
+
+        const char* cursor = file.data();
+        const char* end = file.end();
+        CsvRowView row;
+        row.Parse(cursor, end); // skip the header line
+
+        std::size_t row_index = 0;
+        while (cursor < end) {
+            const char* batch_begin = cursor;
+
+            std::vector<HiggsCsvRow> parsed;
+            parsed.reserve(batch_size);
+            while (parsed.size() < batch_size && row.Parse(cursor, end)) {
+                if (row.size() < HiggsCsvRow::NUM_CSV_COLUMNS) {
+                    printf("Malformed row %d in file '%s' (expected %d columns, found %d)\n",
+                           static_cast<int>(row_index + parsed.size()) + 2, // +1 for header, +1 for 1-based line numbers
+                           filename.c_str(),
+                           HiggsCsvRow::NUM_CSV_COLUMNS,
+                           row.size());
+                    exit(-1);
+                }
+                parsed.push_back(HiggsCsvRow(row));
+                if (row.BadField() >= 0) {
+                    printf("Malformed row %d in file '%s' (column %d is not a number)\n",
+                           static_cast<int>(row_index + parsed.size()) + 1, // +1 for header (parsed.size() is already 1-based)
+                           filename.c_str(),
+                           row.BadField() + 1);
+                    exit(-1);
+                }
+            }
+            file.Discard(batch_begin, cursor);
+
+            if (parsed.empty()) {
+                break;
+            }
+
+            RowBatch batch;
+            batch.first_row_ = row_index;
+            batch.rows_.reset(new bkp::MaskedVector<const HiggsCsvRow>(
+                std::vector<const HiggsCsvRow>(parsed.begin(), parsed.end())
+            ));
+            row_index += parsed.size();
+
+            // blocks while the score stage is behind
+            out_queue.MoveBack(std::move(batch));
+        }
+
+        out_queue.CompleteAdding();
+    }
+
+    // Write stage: write every batch from in_queue to writer. Keeps draining
+    // in_queue even after a write fails, so that the stages feeding it never
+    // block forever; write_failed reports the failure back to the caller.
+    void WriteStage(PredictionWriter& writer,
+                    bkp::JobQueue<PredictionBatch>& in_queue,
+                    std::atomic<bool>& write_failed)
+    {
+        PredictionBatch batch;
+        bool success;
+        auto tied_result = std::tie(success, batch);
+
+        while (!in_queue.IsComplete()) {
+            tied_result = in_queue.TryPopFront();
+            if (!success || write_failed) {
+                continue;
+            }
+
+            const auto size = batch.predictions_.size();
+            for (auto i = decltype(size){0}; i<size; ++i) {
+                if (!writer.Write(batch.event_ids_[i],
+                                  static_cast<int>(batch.first_row_ + i),
+                                  batch.predictions_[i]))
+                {
+                    write_failed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    ////////// public stuff (from PredictionPipeline.h) //////////
+
+    PipelineOptions::PipelineOptions() :
+    batch_size_(16384),
+    queue_capacity_(4),
+    parallel_(true)
+    { }
+
+    bool StreamPredictions(Classifier& classifier,
+                           const std::string& test_filename,
+                           const std::string& out_filename,
+                           const PipelineOptions& options)
+    {
+        assert(options.batch_size_ > 0);
+        assert(options.queue_capacity_ > 0);
+
+        // the write stage already has its own thread, so the writer doesn't
+        // need a background thread of its own
+        PredictionWriter writer;
+        if (!writer.Open(out_filename)) {
+            return false;
+        }
+
+        bkp::JobQueue<RowBatch> row_queue(options.queue_capacity_);
+        bkp::JobQueue<PredictionBatch> prediction_queue(options.queue_capacity_);
+        std::atomic<bool> write_failed(false);
+
+        std::thread parse_thread(ParseStage,
+                                 std::cref(test_filename),
+                                 options.batch_size_,
+                                 std::ref(row_queue));
+        std::thread write_thread(WriteStage,
+                                 std::ref(writer),
+                                 std::ref(prediction_queue),
+                                 std::ref(write_failed));
+
+        // Score stage: runs in this thread. Classify may itself use all of
+        // our cores (if options.parallel_ is set) while the other two stages
+        // mostly wait on I/O.
+        RowBatch row_batch;
+        bool success;
+        auto tied_result = std::tie(success, row_batch);
+
+        while (!row_queue.IsComplete()) {
+            tied_result = row_queue.TryPopFront();
+            if (!success) {
+                continue;
+            }
+
+            const bkp::MaskedVector<const HiggsCsvRow>& rows = *row_batch.rows_;
+
+            PredictionBatch prediction_batch;
+            prediction_batch.first_row_ = row_batch.first_row_;
+            prediction_batch.predictions_ = classifier.Classify(rows, options.parallel_);
+            prediction_batch.event_ids_.reserve(rows.size());
+            for (const HiggsCsvRow& row : rows) {
+                prediction_batch.event_ids_.push_back(row.EventId_);
+            }
+
+            // free the rows before (possibly) blocking on the write stage
+            row_batch.rows_.reset();
+
+            prediction_queue.MoveBack(std::move(prediction_batch));
+        }
+        prediction_queue.CompleteAdding();
+
+        parse_thread.join();
+        write_thread.join();
+
+        bool close_ok = writer.Close();
+        return close_ok && !write_failed;
+    }
+}
@@ -0,0 +1,59 @@
+//
+//  PredictionPipeline.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____PredictionPipeline__
+#define __RandomForest____PredictionPipeline__
+
+#include <cstddef>
+#include <string>
+
+#include "Classifier.h"
+
+namespace hrf {
+
+    // Settings for StreamPredictions. The defaults are reasonable for the
+    // Higgs test set; they only need changing for testing or tuning.
+    struct PipelineOptions {
+
+        // Number of rows parsed, scored and written together
+        std::size_t batch_size_;
+
+        // Number of finished batches that may be waiting between two stages.
+        // Together with batch_size_, this puts a hard limit on memory use:
+        // at most about (2 * queue_capacity_ + 3) * batch_size_ rows are alive
+        // at once, however big the input file is.
+        std::size_t queue_capacity_;
+
+        // Passed through to Classifier::Classify for each batch
+        bool parallel_;
+
+        PipelineOptions();
+    };
+
+    // Classify every row of a test.csv-style file and write the predictions
+    // to out_filename, in the same format as WritePredictions. RankOrder
+    // is the row's 0-based position in the input file, which matches what
+    // main.cpp passes to WritePredictions as its confidences.
+    //
+    // Unlike LoadTestData + Classify + WritePredictions, the input is never
+    // loaded all at once. Instead it runs as a three-stage pipeline:
+    //
+    //     parse thread --> [queue] --> score (calling thread) --> [queue] --> write thread
+    //
+    // Each stage works on batch_size_ rows at a time and the queues are
+    // bounded, so the stages overlap but memory use stays flat.
+    //
+    // Returns false if the output file couldn't be written. Like LoadTestData,
+    // a missing or malformed input file stops the program.
+    bool StreamPredictions(Classifier& classifier,
+                           const std::string& test_filename,
+                           const std::string& out_filename,
+                           const PipelineOptions& options=PipelineOptions());
+}
+
+#endif /* defined(__RandomForest____PredictionPipeline__) */
@@ -0,0 +1,172 @@
+//
+//  PredictionWriter.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "PredictionWriter.h"
+
+#include <cstring>
+#include <cassert>
+
+namespace hrf {
+
+    const std::size_t PredictionWriter::DEFAULT_BUFFER_SIZE;
+
+    ////////// private stuff //////////
+
+    const char HEADER[] = "EventId,RankOrder,Class\n";
+
+    // Longest row we can write: two ints of up to 11 characters each
+    // ("-2147483648"), two commas, the prediction and a newline.
+    const std::size_t MAX_ROW_LENGTH = 11 + 1 + 11 + 1 + 1 + 1;
+
+    // Write the decimal representation of value to out (no '\0'), and return
+    // a pointer to the character after the last one written.
+    inline char* FormatInt(int value, char* out) {
+        // work with the magnitude as an unsigned number, so that INT_MIN
+        // doesn't overflow
+        unsigned int magnitude = static_cast<unsigned int>(value);
+        if (value < 0) {
+            *out++ = '-';
+            magnitude = 0u - magnitude;
+        }
+
+        // digits come out backwards, so write them to a scratch buffer first
+        char digits[10];
+        int n_digits = 0;
+        do {
+            digits[n_digits++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+
+        while (n_digits > 0) {
+            *out++ = digits[--n_digits];
+        }
+        return out;
+    }
+
+    bool PredictionWriter::FlushBuffer() {
+        if (used_ == 0) {
+            return !failed_;
+        }
+
+        if (background_) {
+            buffer_.resize(used_);
+            full_buffers_.MoveBack(std::move(buffer_));
+            buffer_ = std::vector<char>(buffer_size_);
+        }
+        else if (f_.Write(buffer_.data(), 1, used_) != used_) {
+            failed_ = true;
+        }
+        used_ = 0;
+
+        return !failed_;
+    }
+
+    void PredictionWriter::WriteBuffers() {
+        std::vector<char> buffer;
+        bool success;
+        auto tied_result = std::tie(success, buffer);
+
+        // Keep draining full_buffers_ even after a failure, so that Write
+        // never blocks forever on a full queue
+        while (!full_buffers_.IsComplete()) {
+            tied_result = full_buffers_.TryPopFront();
+            if (!success || failed_) {
+                continue;
+            }
+            if (f_.Write(buffer.data(), 1, buffer.size()) != buffer.size()) {
+                failed_ = true;
+            }
+        }
+    }
+
+    ////////// public stuff (from PredictionWriter.h) //////////
+
+    PredictionWriter::PredictionWriter() :
+    used_(0),
+    buffer_size_(0),
+    background_(false),
+    full_buffers_(2), // one being written, one waiting
+    failed_(false)
+    { }
+
+    PredictionWriter::~PredictionWriter() {
+        if (f_.IsOpen()) {
+            Close();
+        }
+    }
+
+    bool PredictionWriter::Open(const std::string& filename,
+                                bool background,
+                                std::size_t buffer_size)
+    {
+        assert(!f_.IsOpen());
+        assert(buffer_size >= sizeof(HEADER) && buffer_size >= MAX_ROW_LENGTH);
+
+        if (!f_.Open(filename, "w")) {
+            return false;
+        }
+
+        buffer_size_ = buffer_size;
+        buffer_ = std::vector<char>(buffer_size_);
+        used_ = 0;
+        failed_ = false;
+
+        std::memcpy(buffer_.data(), HEADER, sizeof(HEADER) - 1);
+        used_ = sizeof(HEADER) - 1;
+
+        // Write the header right away, so that a file we can't write to is
+        // reported by Open rather than by some later Write
+        if (!FlushBuffer() || f_.Flush() != 0) {
+            failed_ = true;
+            return false;
+        }
+
+        background_ = background;
+        if (background_) {
+            write_thread_ = std::thread(&PredictionWriter::WriteBuffers, this);
+        }
+        return true;
+    }
+
+    bool PredictionWriter::Write(int event_id, int rank_order, char prediction) {
+        if (used_ + MAX_ROW_LENGTH > buffer_size_) {
+            if (!FlushBuffer()) {
+                return false;
+            }
+        }
+
+        char* out = buffer_.data() + used_;
+        out = FormatInt(event_id, out);
+        *out++ = ',';
+        out = FormatInt(rank_order, out);
+        *out++ = ',';
+        *out++ = prediction;
+        *out++ = '\n';
+        used_ = out - buffer_.data();
+
+        return !failed_;
+    }
+
+    bool PredictionWriter::Close() {
+        if (!f_.IsOpen()) {
+            return false;
+        }
+
+        FlushBuffer();
+        if (background_) {
+            full_buffers_.CompleteAdding();
+            write_thread_.join();
+            background_ = false;
+        }
+
+        if (f_.Close() != 0) {
+            failed_ = true;
+        }
+        return !failed_;
+    }
+}
@@ -0,0 +1,88 @@
+//
+//  PredictionWriter.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____PredictionWriter__
+#define __RandomForest____PredictionWriter__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "FileWrapper.h"
+#include "JobQueue.h"
+
+namespace hrf {
+
+    // Writes a submission file (the 3-column csv that WritePredictions
+    // describes) as fast as possible.
+    //
+    // Calling Printf once per row makes vfprintf parse the same format
+    // string hundreds of thousands of times. PredictionWriter formats each
+    // row by hand into a large buffer instead, and only writes to the file
+    // when the buffer fills up. Optionally, those writes can happen on a
+    // background thread, so that the caller can keep formatting (or scoring)
+    // while the previous buffer is written to disk.
+    //
+    // Usage: Open, Write once per row, then Close. Every method returns
+    // false once anything has gone wrong (including a failed write on the
+    // background thread), so checking Close's return value is enough to
+    // know whether the whole file was written.
+    class PredictionWriter {
+    public:
+        static const std::size_t DEFAULT_BUFFER_SIZE = 1 << 20; // 1MB
+
+    private:
+        bkp::FileWrapper f_;
+
+        // rows are formatted into buffer_ until it's nearly full, then it's
+        // written (or handed to the background thread)
+        std::vector<char> buffer_;
+        std::size_t used_;
+        std::size_t buffer_size_;
+
+        // background mode only: full buffers waiting to be written, and the
+        // thread that writes them
+        bool background_;
+        bkp::JobQueue<std::vector<char>> full_buffers_;
+        std::thread write_thread_;
+
+        std::atomic<bool> failed_;
+
+        // Write used_ bytes of buffer_ to the file (or hand them to the
+        // background thread), leaving buffer_ empty
+        bool FlushBuffer();
+
+        // background thread: write every buffer from full_buffers_
+        void WriteBuffers();
+
+    public:
+        PredictionWriter();
+        ~PredictionWriter(); // calls Close() if necessary
+
+        // Create filename and write the header row. If background is true,
+        // the file writes happen on a separate thread. Returns false if the
+        // file couldn't be opened or the header couldn't be written.
+        //
+        // Note: each PredictionWriter can only be opened once.
+        bool Open(const std::string& filename,
+                  bool background=false,
+                  std::size_t buffer_size=DEFAULT_BUFFER_SIZE);
+
+        // Append a row. The actual file write may happen later.
+        bool Write(int event_id, int rank_order, char prediction);
+
+        // Write any buffered rows, wait for the background thread (if any)
+        // and close the file. Returns false if any part of the file failed
+        // to be written.
+        bool Close();
+    };
+}
+
+#endif /* defined(__RandomForest____PredictionWriter__) */
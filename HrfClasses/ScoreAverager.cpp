@@ -8,40 +8,63 @@
 
 #include <cmath>
 #include <thread>
-#include <limits>
 
 #include "ScoreAverager.h"
 #include "JobQueue.h"
 
 namespace hrf {
     
-    const static double NaN = std::numeric_limits<double>::quiet_NaN();
+    ScoreSums::ScoreSums() :
+    n_models_(0)
+    { }
+    
+    ScoreResult ScoreSums::Mean() const {
+        const auto n_rows = s_sums_.size();
+        
+        std::vector<double> s_scores, b_scores;
+        s_scores.reserve(n_rows);
+        b_scores.reserve(n_rows);
+        
+        for (auto row_index = decltype(n_rows){0}; row_index<n_rows; ++row_index) {
+            s_scores.push_back(std::exp(s_sums_[row_index] / s_counts_[row_index]));
+        }
+        for (auto row_index = decltype(n_rows){0}; row_index<n_rows; ++row_index) {
+            b_scores.push_back(std::exp(b_sums_[row_index] / b_counts_[row_index]));
+        }
+        
+        return ScoreResult(std::move(s_scores), std::move(b_scores));
+    }
     
-    ScoreAverager::ScoreAverager(IScorerVector&& sub_models) :
-    sub_models_(std::move(sub_models))
+    ScoreAverager::ScoreAverager()
     { }
     
-    ScoreResult ScoreAverager::GMeanSerial(const bkp::MaskedVector<const HiggsCsvRow>& data) {
+    ScoreAverager::ScoreAverager(IScorerVector&& sub_models) {
+        AddModels(std::move(sub_models));
+    }
+    
+    void ScoreAverager::AddModels(IScorerVector&& sub_models) {
+        for (const std::unique_ptr<hrf::IScorer>& model_ptr : *sub_models) {
+            sub_models_.push_back(model_ptr.get());
+        }
+        sub_model_batches_.push_back(std::move(sub_models));
+    }
+    
+    void ScoreAverager::SumLogsSerial(const bkp::MaskedVector<const HiggsCsvRow>& data, ScoreSums& sums) {
         
         // NOTE: calculate gmean using equivalent sum of logarithms, for numeric
         // stability (avoids over/underflows). Formula here:
         // http://en.wikipedia.org/wiki/Geometric_mean#Relationship_with_arithmetic_mean_of_logarithms
         
         const auto n_rows = data.size();
-        const auto n_models = sub_models_->size();
-        
-        std::vector<double> s_sums_v(n_rows, 0.0);
-        std::vector<double> b_sums_v(n_rows, 0.0);
-        std::vector<int> s_counts_v(n_rows, 0);
-        std::vector<int> b_counts_v(n_rows, 0);
+        const auto n_models = sub_models_.size();
         
-        double* s_sums = s_sums_v.data();
-        double* b_sums = b_sums_v.data();
-        int* s_counts = s_counts_v.data();
-        int* b_counts = b_counts_v.data();
+        double* s_sums = sums.s_sums_.data();
+        double* b_sums = sums.b_sums_.data();
+        int* s_counts = sums.s_counts_.data();
+        int* b_counts = sums.b_counts_.data();
         
-        for (auto model_index = decltype(n_models){0}; model_index<n_models; ++model_index) {
-            auto score = (*sub_models_)[model_index]->Score(data, false); // note: if we're here, parallel=false was passed to our Score method
+        for (auto model_index = sums.n_models_; model_index<n_models; ++model_index) {
+            auto score = sub_models_[model_index]->Score(data, false); // note: if we're here, parallel=false was passed to Accumulate
             assert(score.size() == n_rows);
             
             for (auto row_index = decltype(n_rows){0}; row_index<n_rows; ++row_index) {
@@ -60,19 +83,6 @@ namespace hrf {
                 }
             }
         }
-        
-        std::vector<double> s_scores, b_scores;
-        s_scores.reserve(n_rows);
-        b_scores.reserve(n_rows);
-        
-        for (auto row_index = decltype(n_rows){0}; row_index<n_rows; ++row_index) {
-            s_scores.push_back(std::exp(s_sums[row_index] / s_counts[row_index]));
-        }
-        for (auto row_index = decltype(n_rows){0}; row_index<n_rows; ++row_index) {
-            b_scores.push_back(std::exp(b_sums[row_index] / b_counts[row_index]));
-        }
-        
-        return ScoreResult(std::move(s_scores), std::move(b_scores));
     }
     
     std::vector<std::thread> StartThreads(const std::function<void()>& fn, int how_many) {
@@ -97,7 +107,7 @@ namespace hrf {
         return std::unique_ptr<T>(new T(std::move(src)));
     }
     
-    ScoreResult ScoreAverager::GMeanParallel(const bkp::MaskedVector<const HiggsCsvRow>& data) {
+    void ScoreAverager::SumLogsParallel(const bkp::MaskedVector<const HiggsCsvRow>& data, ScoreSums& sums) {
         
         // NOTE: calculate gmean using equivalent sum of logarithms, for numeric
         // stability (avoids over/underflows). Formula here:
@@ -105,11 +115,10 @@ namespace hrf {
         
         const auto N_ROWS = data.size();
         
-        // Put all sub_models in a JobQueue
+        // Put the sub_models that sums doesn't include yet in a JobQueue
         bkp::JobQueue<hrf::IScorer*> scorer_queue;
-        for (const std::unique_ptr<hrf::IScorer>& model_ptr : *sub_models_) {
-            hrf::IScorer* raw = model_ptr.get();
-            scorer_queue.CopyBack(raw);
+        for (auto model_index = sums.n_models_; model_index<sub_models_.size(); ++model_index) {
+            scorer_queue.CopyBack(sub_models_[model_index]);
         }
         scorer_queue.CompleteAdding();
         
@@ -125,30 +134,19 @@ namespace hrf {
             while (!scorer_queue.IsComplete()) {
                 tied_result = scorer_queue.TryPopFront();
                 if (success) {
-                    auto score_result = scorer->Score(data, true); // note: if we're in this method, parallel=true was passed to our Score method
+                    auto score_result = scorer->Score(data, true); // note: if we're in this method, parallel=true was passed to Accumulate
                     s_scores_queue.MoveBack(MoveToUniquePtr(std::move(score_result.s_scores_)));
                     b_scores_queue.MoveBack(MoveToUniquePtr(std::move(score_result.b_scores_)));
                 }
             }
         };
         
-        // Threads to process sums/counts for s/b results. There will only
+        // Threads to add to the sums/counts for s/b results. There will only
         // be two of these, and they will each own one double[] and one int[]
-        std::unique_ptr<double[]> s_sums(new double[N_ROWS]);
-        std::unique_ptr<double[]> b_sums(new double[N_ROWS]);
-        std::unique_ptr<int[]> s_counts(new int[N_ROWS]);
-        std::unique_ptr<int[]> b_counts(new int[N_ROWS]);
         auto sum_and_counter =
         [N_ROWS]
         (bkp::JobQueue<std::unique_ptr<std::vector<double>>>& scores_queue, double* sums, int* counts)
         {
-            for (int i=0; i<N_ROWS; ++i) {
-                sums[i] = 0.0;
-            }
-            for (int i=0; i<N_ROWS; ++i) {
-                counts[i] = 0;
-            }
-            
             std::unique_ptr<std::vector<double>> scores_ptr;
             bool success;
             auto tied_result = std::tie(success, scores_ptr);
@@ -172,13 +170,13 @@ namespace hrf {
         const int N_CORES = std::thread::hardware_concurrency();
         
         // raw pointers for convenience and speed
-        // (main thread still owns these, but sum_and_counter threads
+        // (sums still owns these, but sum_and_counter threads
         // are going to need to borrow references for part of the
         // lifespan).
-        double* s_sums_raw = s_sums.get();
-        double* b_sums_raw = b_sums.get();
-        int* s_counts_raw = s_counts.get();
-        int* b_counts_raw = b_counts.get();
+        double* s_sums_raw = sums.s_sums_.data();
+        double* b_sums_raw = sums.b_sums_.data();
+        int* s_counts_raw = sums.s_counts_.data();
+        int* b_counts_raw = sums.b_counts_.data();
         
         // We'll have N_CORES+2 threads running. It's a little inefficient to
         // have more threads than cores, but the 2 extra sum_and_counter
@@ -206,31 +204,36 @@ namespace hrf {
         // work and return.
         s_accumulator.join();
         b_accumulator.join();
+    }
+    
+    void ScoreAverager::Accumulate(const bkp::MaskedVector<const HiggsCsvRow>& data,
+                                   ScoreSums& sums,
+                                   bool parallel)
+    {
+        const auto n_rows = data.size();
+        if (sums.n_models_ == 0) {
+            sums.s_sums_.assign(n_rows, 0.0);
+            sums.b_sums_.assign(n_rows, 0.0);
+            sums.s_counts_.assign(n_rows, 0);
+            sums.b_counts_.assign(n_rows, 0);
+        }
+        assert(sums.s_sums_.size() == n_rows);
+        assert(sums.n_models_ <= sub_models_.size());
         
-        // finally consolidate sums and counts from accumulator
-        // (sum_and_count) threads into a single score. This should
-        // be a reasonably fast once-through so we'll do it single-
-        // threaded in the main thread.
-        std::vector<double> s_scores(N_ROWS, NaN);
-        std::vector<double> b_scores(N_ROWS, NaN);
-        for (int i=0; i<N_ROWS; ++i) {
-            s_scores[i] = std::exp(s_sums_raw[i] / s_counts_raw[i]);
+        if (parallel) {
+            SumLogsParallel(data, sums);
         }
-        for (int i=0; i<N_ROWS; ++i) {
-            b_scores[i] = std::exp(b_sums_raw[i] / b_counts_raw[i]);
+        else {
+            SumLogsSerial(data, sums);
         }
-        
-        return ScoreResult(std::move(s_scores), std::move(b_scores));
+        sums.n_models_ = sub_models_.size();
     }
     
     ScoreResult ScoreAverager::Score(const bkp::MaskedVector<const HiggsCsvRow>& data,
                                      bool parallel)
     {
-        if (parallel) {
-            return GMeanParallel(data);
-        }
-        else {
-            return GMeanSerial(data);
-        }
+        ScoreSums sums;
+        Accumulate(data, sums, parallel);
+        return sums.Mean();
     }
 }
\ No newline at end of file
@@ -18,6 +18,26 @@
 
 namespace hrf {
     
+    // Running sums of the log scores of some of a ScoreAverager's
+    // sub-models, for each row of one data set (see
+    // ScoreAverager::Accumulate). Scores of NaN aren't summed, so each row
+    // has its own count of summed scores.
+    struct ScoreSums {
+        std::vector<double> s_sums_;
+        std::vector<double> b_sums_;
+        std::vector<int> s_counts_;
+        std::vector<int> b_counts_;
+        
+        // how many sub-models have been summed: always the first n_models_
+        std::size_t n_models_;
+        
+        ScoreSums();
+        
+        // The geometric means of the summed scores (what ScoreAverager::Score
+        // returns once every sub-model has been summed)
+        ScoreResult Mean() const;
+    };
+    
     // ScoreAverager is an IScorerImplementation that wraps a (probably
     // large) set of other IScoreres. The score it calculates is the
     // geometric mean of the scores calculated by the internal IScorers,
@@ -32,6 +52,12 @@ namespace hrf {
     // because its already implemented and as far as I can tell there's
     // no real advantage (or disadvantage) to switching to a different
     // mean.
+    //
+    // A ScoreAverager can be grown after it's built (AddModels), e.g. to
+    // see how a forest does with more trees without retraining the ones it
+    // already has. Keeping a ScoreSums for a data set that's scored again
+    // and again (e.g. the validation set) means only the new sub-models
+    // have to score it each time.
     class ScoreAverager : public IScorer {
     public:
         
@@ -42,18 +68,34 @@ namespace hrf {
         typedef std::unique_ptr<const std::vector<std::unique_ptr<hrf::IScorer>>> IScorerVector;
         
     private:
-        IScorerVector sub_models_;
+        // every IScorerVector passed to the constructor or AddModels, and
+        // all of their sub-models in one list, in the order they were added
+        std::vector<IScorerVector> sub_model_batches_;
+        std::vector<hrf::IScorer*> sub_models_;
         
-        // helper method: single-threaded implementation of geometric mean calculation
-        ScoreResult GMeanSerial(const bkp::MaskedVector<const HiggsCsvRow>& data);
+        // helper method: single-threaded implementation of Accumulate
+        void SumLogsSerial(const bkp::MaskedVector<const HiggsCsvRow>& data, ScoreSums& sums);
         
-        // helper method: multi-threaded implementation of geometric mean calculation
-        ScoreResult GMeanParallel(const bkp::MaskedVector<const HiggsCsvRow>& data);
+        // helper method: multi-threaded implementation of Accumulate
+        void SumLogsParallel(const bkp::MaskedVector<const HiggsCsvRow>& data, ScoreSums& sums);
         
     public:
         
+        ScoreAverager();
         ScoreAverager(IScorerVector&& sub_models);
         
+        // Add more sub-models, after the ones already there
+        void AddModels(IScorerVector&& sub_models);
+        
+        // number of sub-models
+        std::size_t size() const { return sub_models_.size(); }
+        
+        // Add the log scores of the sub-models that sums doesn't include yet
+        // (those after its first n_models_) to sums. sums must be empty (as
+        // constructed), or only ever have been passed to Accumulate with the
+        // same data and this ScoreAverager.
+        void Accumulate(const bkp::MaskedVector<const HiggsCsvRow>& data, ScoreSums& sums, bool parallel=false);
+        
         virtual ScoreResult Score(const bkp::MaskedVector<const HiggsCsvRow>& data, bool parallel=false);
         
     };
@@ -0,0 +1,294 @@
+//
+//  SplitKernels.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "SplitKernels.h"
+
+#include <cassert>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HRF_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace hrf {
+namespace trainer {
+
+    ////////// private stuff //////////
+
+    template<class TValue, class TThreshold>
+    void CountAboveScalar(const TValue* vals,
+                          const unsigned char* is_signal,
+                          std::size_t n,
+                          TThreshold threshold,
+                          int& n_above,
+                          int& s_above)
+    {
+        int n_count = 0;
+        int s_count = 0;
+        for (std::size_t i=0; i<n; ++i) {
+            const int above = (vals[i] >= threshold);
+            n_count += above;
+            s_count += above & is_signal[i];
+        }
+        n_above = n_count;
+        s_above = s_count;
+    }
+
+#ifdef HRF_X86_KERNELS
+
+    // The SIMD kernels work on blocks of 64 rows. The values are compared to
+    // the threshold a vector at a time, and the results are gathered into a
+    // 64-bit mask with one bit per row. The signal flags are turned into a
+    // mask the same way. The block's counts are then just two popcounts.
+    // Rows left over after the last full block go to the scalar kernel.
+    const std::size_t BLOCK_ROWS = 64;
+
+    // AVX2: movemask turns each vector of comparison results into bits
+
+    __attribute__((target("avx2,popcnt")))
+    inline std::uint64_t SignalBitsAvx2(const unsigned char* is_signal) {
+        // shift each 0/1 byte's value into its top bit, which is what
+        // movemask_epi8 collects
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(is_signal));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(is_signal + 32));
+        const std::uint32_t lo_bits = _mm256_movemask_epi8(_mm256_slli_epi16(lo, 7));
+        const std::uint32_t hi_bits = _mm256_movemask_epi8(_mm256_slli_epi16(hi, 7));
+        return lo_bits | (static_cast<std::uint64_t>(hi_bits) << 32);
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    inline std::uint64_t AboveBitsAvx2(const double* vals, double threshold) {
+        const __m256d t = _mm256_set1_pd(threshold);
+        std::uint64_t bits = 0;
+        for (int k=0; k<16; ++k) {
+            // ordered comparison, so NaN >= t is false
+            const __m256d above = _mm256_cmp_pd(_mm256_loadu_pd(vals + 4 * k), t, _CMP_GE_OQ);
+            bits |= static_cast<std::uint64_t>(_mm256_movemask_pd(above)) << (4 * k);
+        }
+        return bits;
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    inline std::uint64_t AboveBitsAvx2(const float* vals, float threshold) {
+        const __m256 t = _mm256_set1_ps(threshold);
+        std::uint64_t bits = 0;
+        for (int k=0; k<8; ++k) {
+            const __m256 above = _mm256_cmp_ps(_mm256_loadu_ps(vals + 8 * k), t, _CMP_GE_OQ);
+            bits |= static_cast<std::uint64_t>(_mm256_movemask_ps(above)) << (8 * k);
+        }
+        return bits;
+    }
+
+    // threshold must fit in 16 bits
+    __attribute__((target("avx2,popcnt")))
+    inline std::uint64_t AboveBitsAvx2(const std::uint16_t* vals, std::uint32_t threshold) {
+        const __m256i t = _mm256_set1_epi16(static_cast<short>(threshold));
+        std::uint64_t bits = 0;
+        for (int k=0; k<2; ++k) {
+            // there's no unsigned >= for 16-bit lanes, but v >= t iff max(v, t) == v
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vals + 32 * k));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vals + 32 * k + 16));
+            const __m256i a_above = _mm256_cmpeq_epi16(_mm256_max_epu16(a, t), a);
+            const __m256i b_above = _mm256_cmpeq_epi16(_mm256_max_epu16(b, t), b);
+
+            // pack to one byte per row; packs works within 128-bit lanes, so
+            // put the 64-bit quarters back in row order afterwards
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(a_above, b_above), 0xd8);
+            bits |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(packed))) << (32 * k);
+        }
+        return bits;
+    }
+
+    template<class TValue, class TThreshold>
+    __attribute__((target("avx2,popcnt")))
+    void CountAboveAvx2(const TValue* vals,
+                        const unsigned char* is_signal,
+                        std::size_t n,
+                        TThreshold threshold,
+                        int& n_above,
+                        int& s_above)
+    {
+        const std::size_t n_blocks = n / BLOCK_ROWS;
+        int n_count = 0;
+        int s_count = 0;
+        for (std::size_t block=0; block<n_blocks; ++block) {
+            const std::size_t offset = block * BLOCK_ROWS;
+            const std::uint64_t above = AboveBitsAvx2(vals + offset, threshold);
+            const std::uint64_t signal = SignalBitsAvx2(is_signal + offset);
+            n_count += __builtin_popcountll(above);
+            s_count += __builtin_popcountll(above & signal);
+        }
+
+        const std::size_t done = n_blocks * BLOCK_ROWS;
+        CountAboveScalar(vals + done, is_signal + done, n - done, threshold, n_above, s_above);
+        n_above += n_count;
+        s_above += s_count;
+    }
+
+    // AVX-512: comparisons produce bit masks directly
+
+    __attribute__((target("avx512f,avx512bw,popcnt")))
+    inline std::uint64_t SignalBitsAvx512(const unsigned char* is_signal) {
+        const __m512i flags = _mm512_loadu_si512(is_signal);
+        return _mm512_test_epi8_mask(flags, flags);
+    }
+
+    __attribute__((target("avx512f,avx512bw,popcnt")))
+    inline std::uint64_t AboveBitsAvx512(const double* vals, double threshold) {
+        const __m512d t = _mm512_set1_pd(threshold);
+        std::uint64_t bits = 0;
+        for (int k=0; k<8; ++k) {
+            const __mmask8 above = _mm512_cmp_pd_mask(_mm512_loadu_pd(vals + 8 * k), t, _CMP_GE_OQ);
+            bits |= static_cast<std::uint64_t>(above) << (8 * k);
+        }
+        return bits;
+    }
+
+    __attribute__((target("avx512f,avx512bw,popcnt")))
+    inline std::uint64_t AboveBitsAvx512(const float* vals, float threshold) {
+        const __m512 t = _mm512_set1_ps(threshold);
+        std::uint64_t bits = 0;
+        for (int k=0; k<4; ++k) {
+            const __mmask16 above = _mm512_cmp_ps_mask(_mm512_loadu_ps(vals + 16 * k), t, _CMP_GE_OQ);
+            bits |= static_cast<std::uint64_t>(above) << (16 * k);
+        }
+        return bits;
+    }
+
+    // threshold must fit in 16 bits
+    __attribute__((target("avx512f,avx512bw,popcnt")))
+    inline std::uint64_t AboveBitsAvx512(const std::uint16_t* vals, std::uint32_t threshold) {
+        const __m512i t = _mm512_set1_epi16(static_cast<short>(threshold));
+        const __mmask32 lo = _mm512_cmpge_epu16_mask(_mm512_loadu_si512(vals), t);
+        const __mmask32 hi = _mm512_cmpge_epu16_mask(_mm512_loadu_si512(vals + 32), t);
+        return static_cast<std::uint64_t>(lo) | (static_cast<std::uint64_t>(hi) << 32);
+    }
+
+    template<class TValue, class TThreshold>
+    __attribute__((target("avx512f,avx512bw,popcnt")))
+    void CountAboveAvx512(const TValue* vals,
+                          const unsigned char* is_signal,
+                          std::size_t n,
+                          TThreshold threshold,
+                          int& n_above,
+                          int& s_above)
+    {
+        const std::size_t n_blocks = n / BLOCK_ROWS;
+        int n_count = 0;
+        int s_count = 0;
+        for (std::size_t block=0; block<n_blocks; ++block) {
+            const std::size_t offset = block * BLOCK_ROWS;
+            const std::uint64_t above = AboveBitsAvx512(vals + offset, threshold);
+            const std::uint64_t signal = SignalBitsAvx512(is_signal + offset);
+            n_count += __builtin_popcountll(above);
+            s_count += __builtin_popcountll(above & signal);
+        }
+
+        const std::size_t done = n_blocks * BLOCK_ROWS;
+        CountAboveScalar(vals + done, is_signal + done, n - done, threshold, n_above, s_above);
+        n_above += n_count;
+        s_above += s_count;
+    }
+
+#endif // HRF_X86_KERNELS
+
+    // Shared implementation of the public CountAbove overloads: run the
+    // requested kernel
+    template<class TValue, class TThreshold>
+    void Dispatch(const TValue* vals,
+                  const unsigned char* is_signal,
+                  std::size_t n,
+                  TThreshold threshold,
+                  int& n_above,
+                  int& s_above,
+                  CountAboveKernel kernel)
+    {
+        assert(IsKernelSupported(kernel));
+        switch (kernel) {
+#ifdef HRF_X86_KERNELS
+            case AVX2_KERNEL:
+                CountAboveAvx2(vals, is_signal, n, threshold, n_above, s_above);
+                return;
+            case AVX512_KERNEL:
+                CountAboveAvx512(vals, is_signal, n, threshold, n_above, s_above);
+                return;
+#endif
+            default:
+                CountAboveScalar(vals, is_signal, n, threshold, n_above, s_above);
+                return;
+        }
+    }
+
+    ////////// public stuff (from SplitKernels.h) //////////
+
+    bool IsKernelSupported(CountAboveKernel kernel) {
+        switch (kernel) {
+            case SCALAR_KERNEL:
+                return true;
+#ifdef HRF_X86_KERNELS
+            case AVX2_KERNEL:
+                return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+            case AVX512_KERNEL:
+                return __builtin_cpu_supports("avx512f") &&
+                       __builtin_cpu_supports("avx512bw") &&
+                       __builtin_cpu_supports("popcnt");
+#endif
+            default:
+                return false;
+        }
+    }
+
+    CountAboveKernel BestCountAboveKernel() {
+        static const CountAboveKernel best =
+            IsKernelSupported(AVX512_KERNEL) ? AVX512_KERNEL :
+            IsKernelSupported(AVX2_KERNEL) ? AVX2_KERNEL :
+            SCALAR_KERNEL;
+        return best;
+    }
+
+    void CountAbove(const double* vals,
+                    const unsigned char* is_signal,
+                    std::size_t n,
+                    double threshold,
+                    int& n_above,
+                    int& s_above,
+                    CountAboveKernel kernel)
+    {
+        Dispatch(vals, is_signal, n, threshold, n_above, s_above, kernel);
+    }
+
+    void CountAbove(const float* vals,
+                    const unsigned char* is_signal,
+                    std::size_t n,
+                    float threshold,
+                    int& n_above,
+                    int& s_above,
+                    CountAboveKernel kernel)
+    {
+        Dispatch(vals, is_signal, n, threshold, n_above, s_above, kernel);
+    }
+
+    void CountAbove(const std::uint16_t* vals,
+                    const unsigned char* is_signal,
+                    std::size_t n,
+                    std::uint32_t threshold,
+                    int& n_above,
+                    int& s_above,
+                    CountAboveKernel kernel)
+    {
+        // no 16-bit value is >= a larger threshold (and the SIMD kernels
+        // need the threshold to fit in 16 bits)
+        if (threshold > 0xffff) {
+            n_above = 0;
+            s_above = 0;
+            return;
+        }
+        Dispatch(vals, is_signal, n, threshold, n_above, s_above, kernel);
+    }
+}
+}
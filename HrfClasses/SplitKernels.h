@@ -0,0 +1,64 @@
+//
+//  SplitKernels.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____SplitKernels__
+#define __RandomForest____SplitKernels__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hrf {
+namespace trainer {
+
+    // The implementations of CountAbove. The SIMD kernels are compiled in on
+    // x86 builds, but only used if the CPU running the program supports them
+    // (checked once, at runtime).
+    enum CountAboveKernel {
+        SCALAR_KERNEL,
+        AVX2_KERNEL,
+        AVX512_KERNEL // needs AVX-512F and AVX-512BW
+    };
+
+    // True if 'kernel' can be used on this machine
+    bool IsKernelSupported(CountAboveKernel kernel);
+
+    // The fastest kernel supported on this machine
+    CountAboveKernel BestCountAboveKernel();
+
+    // Count the values in vals[0..n) that are >= threshold (n_above), and how
+    // many of those rows have is_signal[i] == 1 (s_above). NaNs are never >=
+    // the threshold. is_signal must only hold 0s and 1s.
+    //
+    // This is the inner loop of FindBestSplit. Every kernel gives exactly the
+    // same counts; passing one explicitly is mostly for tests and benchmarks,
+    // and the kernel must be supported.
+    void CountAbove(const double* vals,
+                    const unsigned char* is_signal,
+                    std::size_t n,
+                    double threshold,
+                    int& n_above,
+                    int& s_above,
+                    CountAboveKernel kernel=BestCountAboveKernel());
+    void CountAbove(const float* vals,
+                    const unsigned char* is_signal,
+                    std::size_t n,
+                    float threshold,
+                    int& n_above,
+                    int& s_above,
+                    CountAboveKernel kernel=BestCountAboveKernel());
+    void CountAbove(const std::uint16_t* vals,
+                    const unsigned char* is_signal,
+                    std::size_t n,
+                    std::uint32_t threshold,
+                    int& n_above,
+                    int& s_above,
+                    CountAboveKernel kernel=BestCountAboveKernel());
+}
+}
+
+#endif /* defined(__RandomForest____SplitKernels__) */
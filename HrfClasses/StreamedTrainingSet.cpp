@@ -0,0 +1,179 @@
+//
+//  StreamedTrainingSet.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include "StreamedTrainingSet.h"
+
+#include <array>
+#include <cassert>
+#include <algorithm>
+#include <cstdio>
+
+namespace hrf {
+
+    ////////// private stuff //////////
+
+    // Every nth row of cache, so that there are at most max_rows of them.
+    // Unless n is in the hundreds, that reads every page of the file, so
+    // the pages are dropped from memory as the sample passes them.
+    static std::vector<const HiggsTrainingCsvRow> SampleRows(BinaryCacheFile& cache,
+                                                             std::size_t max_rows)
+    {
+        const std::size_t DISCARD_ROWS = 1 << 20;
+        const std::size_t n_rows = cache.size();
+        const std::size_t step = std::max<std::size_t>((n_rows + max_rows - 1) / max_rows, 1);
+        const std::int32_t* event_ids = cache.EventIds();
+        const double* weights = cache.Weights();
+        const char* labels = cache.Labels();
+
+        std::vector<const HiggsTrainingCsvRow> result;
+        result.reserve(n_rows / step + 1);
+        std::size_t discarded = 0; // rows before this one have been dropped
+        for (std::size_t row=0; row<n_rows; row+=step) {
+            std::array<double, HiggsCsvRow::NUM_FEATURES> data;
+            for (int dim=0; dim<HiggsCsvRow::NUM_FEATURES; ++dim) {
+                data[dim] = cache.Feature(dim)[row];
+            }
+            result.push_back(HiggsTrainingCsvRow(event_ids[row], std::move(data), weights[row], labels[row]));
+            if (row + 1 - discarded >= DISCARD_ROWS) {
+                cache.Discard(discarded, row + 1);
+                discarded = row + 1;
+            }
+        }
+        cache.Discard(discarded, n_rows);
+        return result;
+    }
+
+    std::size_t StreamedTrainingSet::ChunkBegin(std::size_t chunk) const {
+        return chunk * chunk_rows_;
+    }
+
+    std::size_t StreamedTrainingSet::ChunkEnd(std::size_t chunk) const {
+        return std::min(ChunkBegin(chunk) + chunk_rows_, size());
+    }
+
+    void StreamedTrainingSet::EncodeChunk(std::size_t chunk,
+                                          const std::vector<int>& features,
+                                          FeatureMatrix& out)
+    {
+        const std::size_t begin = ChunkBegin(chunk);
+        const std::size_t end = ChunkEnd(chunk);
+
+        std::vector<const double*> feature_columns;
+        feature_columns.reserve(features.size());
+        for (int feature : features) {
+            feature_columns.push_back(file_.Feature(feature) + begin);
+        }
+        out.EncodeColumns(encoding_,
+                          features,
+                          feature_columns,
+                          end - begin,
+                          file_.EventIds() + begin,
+                          file_.Weights() + begin,
+                          file_.Labels() + begin);
+        file_.Discard(begin, end);
+    }
+
+    ////////// public stuff (from StreamedTrainingSet.h) //////////
+
+    const std::size_t StreamedTrainingSet::DEFAULT_CHUNK_ROWS;
+    const std::size_t StreamedTrainingSet::DEFAULT_BIN_SAMPLE_ROWS;
+
+    StreamedTrainingSet::StreamedTrainingSet() :
+    chunk_rows_(DEFAULT_CHUNK_ROWS)
+    { }
+
+    bool StreamedTrainingSet::Open(const std::string& filename,
+                                   std::size_t chunk_rows,
+                                   std::size_t bin_sample_rows)
+    {
+        assert(chunk_rows > 0 && bin_sample_rows > 0);
+        if (codes_.IsOpen()) {
+            codes_.Close();
+        }
+        if (!file_.Open(filename) || !file_.HasLabels()) {
+            file_.Close();
+            return false;
+        }
+        chunk_rows_ = chunk_rows;
+
+        FeatureMatrix sample(bkp::MaskedVector<const HiggsTrainingCsvRow>(SampleRows(file_, bin_sample_rows)),
+                             BINNED8_FEATURES);
+
+        std::vector<int> all_features(FeatureMatrix::NUM_FEATURES);
+        for (int feature=0; feature<FeatureMatrix::NUM_FEATURES; ++feature) {
+            all_features[feature] = feature;
+        }
+        encoding_.Project(sample, all_features, std::vector<int>());
+
+        // still readable and writable through codes_ once it's removed
+        const std::string codes_filename = filename + ".codes";
+        if (!codes_.Open(codes_filename, "w+b")) {
+            file_.Close();
+            return false;
+        }
+        std::remove(codes_filename.c_str());
+
+        FeatureMatrix binned_chunk;
+        for (std::size_t chunk=0; chunk<NumChunks(); ++chunk) {
+            EncodeChunk(chunk, all_features, binned_chunk);
+            for (int feature : all_features) {
+                const std::uint8_t* codes = binned_chunk.View<BinnedColumnView>(feature).data_;
+                if (codes_.Write(codes, 1, binned_chunk.size()) != binned_chunk.size()) {
+                    codes_.Close();
+                    file_.Close();
+                    return false;
+                }
+            }
+        }
+        if (codes_.Flush() != 0) {
+            codes_.Close();
+            file_.Close();
+            return false;
+        }
+        return true;
+    }
+
+    std::size_t StreamedTrainingSet::size() const {
+        return file_.size();
+    }
+
+    std::size_t StreamedTrainingSet::NumChunks() const {
+        return (size() + chunk_rows_ - 1) / chunk_rows_;
+    }
+
+    bool StreamedTrainingSet::LoadChunk(std::size_t chunk,
+                                        const std::vector<int>& features,
+                                        FeatureMatrix& out)
+    {
+        assert(chunk < NumChunks());
+        const std::size_t begin = ChunkBegin(chunk);
+        const std::size_t n_rows = ChunkEnd(chunk) - begin;
+
+        // chunk's bins start at begin * NUM_FEATURES, since every chunk
+        // before it is a full one
+        chunk_codes_.resize(features.size() * n_rows);
+        std::vector<const std::uint8_t*> columns(features.size());
+        for (std::size_t slot=0; slot<features.size(); ++slot) {
+            std::uint8_t* column = chunk_codes_.data() + slot * n_rows;
+            const long offset = static_cast<long>(begin * FeatureMatrix::NUM_FEATURES + features[slot] * n_rows);
+            if (codes_.Seek(offset, SEEK_SET) != 0 || codes_.Read(column, 1, n_rows) != n_rows) {
+                return false;
+            }
+            columns[slot] = column;
+        }
+        out.EncodeColumns(encoding_,
+                          features,
+                          columns,
+                          n_rows,
+                          file_.EventIds() + begin,
+                          file_.Weights() + begin,
+                          file_.Labels() + begin);
+        file_.Discard(begin, ChunkEnd(chunk));
+        return true;
+    }
+}
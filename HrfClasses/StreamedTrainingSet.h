@@ -0,0 +1,98 @@
+//
+//  StreamedTrainingSet.h
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#ifndef __RandomForest____StreamedTrainingSet__
+#define __RandomForest____StreamedTrainingSet__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BinaryCache.h"
+#include "FeatureMatrix.h"
+#include "FileWrapper.h"
+
+namespace hrf {
+
+    // A training set that's read from a .hrfbin file (see BinaryCache.h) a
+    // chunk of rows at a time, for training on more rows than fit in memory
+    // (see trainer::TrainBestDimStreamed). The file is memory-mapped, and
+    // each chunk's pages are dropped from memory as soon as it's been read,
+    // so only the chunk being used is ever in memory.
+    //
+    // Chunks are always read as BINNED8_FEATURES, with the same bins for
+    // every chunk. The bins are chosen when the file is opened, from an
+    // evenly spaced sample of its rows (every row, if there are no more
+    // than bin_sample_rows): the quantiles of a million rows or so are as
+    // good as those of all of them.
+    //
+    // Open then bins every row once, and writes the bins to a scratch file
+    // next to the .hrfbin (its name plus ".codes"), 1 byte per feature per
+    // row. Training reads each chunk many times (once per tree level), and
+    // reading its bins back is much faster than reading and re-binning its
+    // doubles every time. The scratch file is deleted as soon as it's
+    // created, so it's gone when the StreamedTrainingSet is, however the
+    // program exits.
+    class StreamedTrainingSet {
+    private:
+        BinaryCacheFile file_;
+        std::size_t chunk_rows_;
+
+        // no rows, but the bins of every feature (see Encoding())
+        FeatureMatrix encoding_;
+
+        // the scratch file: each chunk's bins in turn, a column per feature
+        bkp::FileWrapper codes_;
+
+        // the columns LoadChunk is reading, before they're copied into its out
+        std::vector<std::uint8_t> chunk_codes_;
+
+        // Read the specified chunk's rows from file_, and bin them
+        void EncodeChunk(std::size_t chunk,
+                         const std::vector<int>& features,
+                         FeatureMatrix& out);
+
+    public:
+        static const std::size_t DEFAULT_CHUNK_ROWS = 1 << 20;
+        static const std::size_t DEFAULT_BIN_SAMPLE_ROWS = 1 << 20;
+
+        StreamedTrainingSet();
+
+        // Open the specified .hrfbin file, choose its bins and bin it. Returns
+        // false if the file can't be opened, fails validation, or has no
+        // labels, or if the scratch file can't be written.
+        bool Open(const std::string& filename,
+                  std::size_t chunk_rows=DEFAULT_CHUNK_ROWS,
+                  std::size_t bin_sample_rows=DEFAULT_BIN_SAMPLE_ROWS);
+
+        std::size_t size() const;
+        std::size_t NumChunks() const;
+
+        // The index of the specified chunk's first row, and of the row after
+        // its last
+        std::size_t ChunkBegin(std::size_t chunk) const;
+        std::size_t ChunkEnd(std::size_t chunk) const;
+
+        // A FeatureMatrix with no rows, encoded the same way as every chunk
+        // (so its views have the bins, but no data)
+        const FeatureMatrix& Encoding() const { return encoding_; }
+
+        // Read the rows of the specified chunk (chunk * chunk_rows up to the
+        // next chunk's first row) into out, with just the given features (see
+        // FeatureMatrix::EncodeColumns). out's storage is reused, so reading
+        // every chunk into the same FeatureMatrix only allocates once.
+        // Returns false (leaving out as it was) if the chunk's bins can't be
+        // read back from the scratch file.
+        bool LoadChunk(std::size_t chunk,
+                       const std::vector<int>& features,
+                       FeatureMatrix& out);
+    };
+}
+
+#endif /* defined(__RandomForest____StreamedTrainingSet__) */
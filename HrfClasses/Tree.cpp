@@ -153,6 +153,115 @@ namespace hrf {
         return hrf::ScoreResult(std::move(s_scores), std::move(b_scores));
     }
     
+    // A Tree node, flattened for Score(const FeatureMatrix&): the split's
+    // column and threshold are looked up once per call, instead of once per
+    // row per node. Leaves have upper_ == -1.
+    template<class TView>
+    struct ScoreNode {
+        const typename TView::value_type* column_;
+        typename TView::threshold_type threshold_;
+        int upper_;
+        int lower_;
+        double sdensity_;
+        double bdensity_;
+    };
+    
+    // helper for Score(const FeatureMatrix&): append node and its descendants
+    // to nodes (parents before children), and return node's index. views[i]
+    // is the view of the tree's local dimension i.
+    template<class TView>
+    int FlattenNodes(const Tree& node,
+                     const std::vector<TView>& views,
+                     std::vector<ScoreNode<TView>>& nodes)
+    {
+        const int index = static_cast<int>(nodes.size());
+        nodes.push_back(ScoreNode<TView>());
+        if (node.children_.size() > 0) {
+            const TView& view = views[node.split_dim_];
+            nodes[index].column_ = view.data_;
+            nodes[index].threshold_ = view.Threshold(node.split_val_);
+            
+            // (don't hold a reference to nodes[index] across these, they may
+            // reallocate nodes)
+            const int upper = FlattenNodes(node.children_[0], views, nodes);
+            const int lower = FlattenNodes(node.children_[1], views, nodes);
+            nodes[index].upper_ = upper;
+            nodes[index].lower_ = lower;
+        }
+        else {
+            nodes[index].column_ = nullptr;
+            nodes[index].upper_ = -1;
+            nodes[index].lower_ = -1;
+        }
+        nodes[index].sdensity_ = node.SDensity();
+        nodes[index].bdensity_ = node.BDensity();
+        return index;
+    }
+    
+    // helper for Score(const FeatureMatrix&): walk each of the rows of data
+    // that don't have a NaN down to its leaf, for each type of column view
+    template<class TView>
+    void ScoreRows(const Tree& root,
+                   const FeatureMatrix& data,
+                   const std::vector<bool>& has_nan,
+                   std::vector<double>& s_scores,
+                   std::vector<double>& b_scores)
+    {
+        std::vector<TView> views;
+        views.reserve(root.target_features_->size());
+        for (int global_dim : *root.target_features_) {
+            views.push_back(data.View<TView>(global_dim));
+        }
+        
+        std::vector<ScoreNode<TView>> nodes;
+        FlattenNodes(root, views, nodes);
+        
+        const auto data_size = data.size();
+        for (decltype(data.size()) row_index=0; row_index<data_size; ++row_index) {
+            if (has_nan[row_index]) {
+                continue;
+            }
+            
+            const ScoreNode<TView>* node = &nodes[0];
+            while (node->upper_ >= 0) {
+                node = (node->column_[row_index] >= node->threshold_) ?
+                    &nodes[node->upper_] :
+                    &nodes[node->lower_];
+            }
+            s_scores[row_index] = node->sdensity_;
+            b_scores[row_index] = node->bdensity_;
+        }
+    }
+    
+    // Note: ignore parallel paramter, only applies to other IScorers
+    ScoreResult Tree::Score(const FeatureMatrix& data, bool /*parallel*/) {
+        
+        const auto data_size = data.size();
+        std::vector<double> s_scores(data_size, std::numeric_limits<double>::quiet_NaN());
+        std::vector<double> b_scores(data_size, std::numeric_limits<double>::quiet_NaN());
+        
+        // rows with a NaN in one of our target_features_ are left as NaN (they
+        // will be handled by other trees)
+        std::vector<bool> has_nan = HasNan(data, *target_features_);
+        
+        switch (data.Storage()) {
+            case DOUBLE_FEATURES:
+                ScoreRows<DoubleColumnView>(*this, data, has_nan, s_scores, b_scores);
+                break;
+            case FLOAT_FEATURES:
+                ScoreRows<FloatColumnView>(*this, data, has_nan, s_scores, b_scores);
+                break;
+            case QUANTIZED16_FEATURES:
+                ScoreRows<QuantizedColumnView>(*this, data, has_nan, s_scores, b_scores);
+                break;
+            case BINNED8_FEATURES:
+                ScoreRows<BinnedColumnView>(*this, data, has_nan, s_scores, b_scores);
+                break;
+        }
+        
+        return hrf::ScoreResult(std::move(s_scores), std::move(b_scores));
+    }
+    
     void Tree::ScoreHelper(
         const bkp::MaskedVector<const HiggsCsvRow>& data,
         bkp::MaskedVector<int>::Slice&& return_indices,
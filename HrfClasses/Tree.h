@@ -15,6 +15,7 @@
 #include "HiggsCsvRow.h"
 #include "IScorer.h"
 #include "MaskedVector.h"
+#include "FeatureMatrix.h"
 
 namespace hrf {
     
@@ -121,6 +122,8 @@ namespace hrf {
         void Split(int feature_index, double split_value);
         
         void SetScore(double s_density, double b_density);
+        double SDensity() const { return sdensity_; }
+        double BDensity() const { return bdensity_; }
         
         // from IScorer:
         // For each point in data, find the leaf child that that point falls into.
@@ -132,6 +135,12 @@ namespace hrf {
             const bkp::MaskedVector<const HiggsCsvRow>& data,
             bool parallel=false
         );
+        
+        // Same as above, but for data that's already in column-major form
+        // (with any FeatureStorage). Walks each row down the tree on its own
+        // instead of partitioning index lists at every node, so no per-node
+        // allocations are needed.
+        ScoreResult Score(const FeatureMatrix& data, bool parallel=false);
     };
 }
 
@@ -8,6 +8,9 @@
 
 #include <limits>
 #include <thread>
+#include <algorithm>
+#include <cmath>
+#include <boost/thread.hpp>
 
 #include "TreeCreator.h"
 #include "RandUtils.h"
@@ -15,50 +18,234 @@
 
 namespace hrf {
     
-    void GetGlobalExtrema(const bkp::MaskedVector<const hrf::HiggsTrainingCsvRow>& data,
+    void GetGlobalExtrema(const FeatureMatrix& data,
                           std::vector<double>& out_mins, // assumed to be empty
                           std::vector<double>& out_maxs) // assumed to be empty
     {
         auto nrows = data.size();
-        const auto ndims = hrf::HiggsTrainingCsvRow::NUM_FEATURES;
+        const auto ndims = FeatureMatrix::NUM_FEATURES;
         
         out_mins = std::vector<double>(ndims, std::numeric_limits<double>::max());
         out_maxs = std::vector<double>(ndims, std::numeric_limits<double>::lowest());
         
-        for (decltype(nrows) row_index=0; row_index<nrows; ++row_index) {
-            auto& row = data[row_index];
-            for (auto dim_index = decltype(ndims){0}; dim_index<ndims; ++dim_index) {
-                double val = row.data_[dim_index];
-                if (val < out_mins[dim_index]) {
-                    out_mins[dim_index] = val;
+        for (auto dim_index = decltype(ndims){0}; dim_index<ndims; ++dim_index) {
+            double dim_min = out_mins[dim_index];
+            double dim_max = out_maxs[dim_index];
+            for (decltype(nrows) row_index=0; row_index<nrows; ++row_index) {
+                double val = data.Get(row_index, dim_index);
+                if (val < dim_min) {
+                    dim_min = val;
                 }
-                if (val > out_maxs[dim_index]) {
-                    out_maxs[dim_index] = val;
+                if (val > dim_max) {
+                    dim_max = val;
                 }
             }
+            out_mins[dim_index] = dim_min;
+            out_maxs[dim_index] = dim_max;
         }
     }
     
-    TreeCreator::TreeCreator(const bkp::MaskedVector<const hrf::HiggsTrainingCsvRow>& data,
+    // GetGlobalExtrema for a BINNED8_FEATURES FeatureMatrix, from its bins
+    // alone (so it works on one with no rows, e.g. a StreamedTrainingSet's
+    // Encoding()): the lower bounds of each column's first and last bins,
+    // which is what GetGlobalExtrema gives on the rows they were chosen from
+    void GetBinExtrema(const FeatureMatrix& data,
+                       std::vector<double>& out_mins, // assumed to be empty
+                       std::vector<double>& out_maxs) // assumed to be empty
+    {
+        const auto ndims = FeatureMatrix::NUM_FEATURES;
+        
+        out_mins = std::vector<double>(ndims, std::numeric_limits<double>::max());
+        out_maxs = std::vector<double>(ndims, std::numeric_limits<double>::lowest());
+        
+        for (auto dim_index = decltype(ndims){0}; dim_index<ndims; ++dim_index) {
+            const double* lower_bounds = data.View<BinnedColumnView>(dim_index).lower_bounds_;
+            for (int code=1; code<BinnedColumnView::NUM_CODES && !std::isinf(lower_bounds[code]); ++code) {
+                out_mins[dim_index] = std::min(out_mins[dim_index], lower_bounds[code]);
+                out_maxs[dim_index] = std::max(out_maxs[dim_index], lower_bounds[code]);
+            }
+        }
+    }
+    
+    // The calling thread's buffer for TreeCreator::MakeTree's projections.
+    // Trees are made one at a time on each thread, so one buffer per thread
+    // is enough, and it only reallocates when a tree needs more than any
+    // earlier tree on that thread.
+    boost::thread_specific_ptr<FeatureMatrix>& ProjectionBuffer() {
+        static boost::thread_specific_ptr<FeatureMatrix> projection_buffer;
+        if (projection_buffer.get() == nullptr) {
+            projection_buffer.reset(new FeatureMatrix);
+        }
+        return projection_buffer;
+    }
+    
+    // MakeTree only projects samples of at most this fraction of the rows.
+    // Gathering a tree's columns through its row indices only costs more
+    // than a projection's copy when the sample is sparse and the columns
+    // are wide. On the Higgs training set, with 3 columns per tree (copy
+    // included):
+    //  - DOUBLE_FEATURES trees were 12-17% faster on 0.1-0.3 subsamples,
+    //    but only 3-6% on 0.5
+    //  - FLOAT_FEATURES trees were 6-9% faster on 0.1-0.2 subsamples, and
+    //    no faster on 0.5
+    //  - QUANTIZED16_FEATURES and BINNED8_FEATURES trees were 0-9% slower
+    //    on every subsample from 0.1 to 0.5
+    // On every row (or a bootstrap sample, which is nearly every row, in
+    // order) the copy is pure overhead.
+    double MaxProjectedFraction(FeatureStorage storage) {
+        switch (storage) {
+            case DOUBLE_FEATURES:
+                return 0.3;
+            case FLOAT_FEATURES:
+                return 0.2;
+            case QUANTIZED16_FEATURES:
+            case BINNED8_FEATURES:
+                return 0.0;
+        }
+        assert(false);
+        return 0.0;
+    }
+    
+    TreeSampleOptions::TreeSampleOptions() :
+    method_(ALL_ROWS),
+    sample_fraction_(1.0),
+    stratify_(false)
+    { }
+    
+    TreeCreator::TreeCreator(FeatureMatrix data,
                              const hrf::trainer::TrainerFn& trainer,
                              int cols_per_tree):
     trainer_(trainer),
-    data_(data),
-    cols_per_tree_(cols_per_tree)
+    data_(std::move(data)),
+    cols_per_tree_(cols_per_tree),
+    stream_base_(bkp::random::Generator()()),
+    n_trees_made_(0)
+    {
+        global_min_corner_ = std::make_shared<std::vector<double>>();
+        global_max_corner_ = std::make_shared<std::vector<double>>();
+        GetGlobalExtrema(data_, *global_min_corner_, *global_max_corner_);
+    }
+    
+    TreeCreator::TreeCreator(FeatureMatrix data,
+                             const hrf::trainer::SampleTrainerFn& trainer,
+                             int cols_per_tree,
+                             const TreeSampleOptions& sample_options):
+    sample_trainer_(trainer),
+    data_(std::move(data)),
+    cols_per_tree_(cols_per_tree),
+    sample_options_(sample_options),
+    stream_base_(bkp::random::Generator()()),
+    n_trees_made_(0)
     {
+        assert(sample_options_.method_ == ALL_ROWS || sample_options_.sample_fraction_ > 0.0);
+        
         global_min_corner_ = std::make_shared<std::vector<double>>();
         global_max_corner_ = std::make_shared<std::vector<double>>();
-        GetGlobalExtrema(data, *global_min_corner_, *global_max_corner_);
+        GetGlobalExtrema(data_, *global_min_corner_, *global_max_corner_);
+        
+        const bool stratify = sample_options_.stratify_ && data_.HasLabels();
+        strata_.resize(stratify ? 2 : 1);
+        for (std::size_t row_index=0; row_index<data_.size(); ++row_index) {
+            const int stratum = stratify ? data_.IsSignal()[row_index] : 0;
+            strata_[stratum].push_back(static_cast<int>(row_index));
+        }
     }
     
-    std::unique_ptr<Tree> TreeCreator::MakeTree() {
+    hrf::trainer::RowIndices TreeCreator::DrawSample() const {
+        const std::size_t n_rows = data_.size();
+        if (sample_options_.method_ == ALL_ROWS) {
+            hrf::trainer::RowIndices result(n_rows);
+            for (std::size_t row_index=0; row_index<n_rows; ++row_index) {
+                result[row_index] = static_cast<int>(row_index);
+            }
+            return result;
+        }
+        
+        // the number of times each row is drawn; counting draws, rather than
+        // sorting them, puts the sample in order in time linear in n_rows
+        std::vector<int> n_draws(n_rows, 0);
+        std::size_t sample_size = 0;
+        auto& gen = bkp::random::Generator();
+        std::uniform_real_distribution<double> unit_dist(0.0, 1.0);
+        for (const hrf::trainer::RowIndices& stratum : strata_) {
+            const std::size_t stratum_size = stratum.size();
+            if (stratum_size == 0) {
+                continue; // e.g. no 's' rows, with stratify_
+            }
+            const std::size_t needed = static_cast<std::size_t>(
+                std::floor(sample_options_.sample_fraction_ * stratum_size + 0.5));
+            sample_size += needed;
+            
+            if (sample_options_.method_ == BOOTSTRAP) {
+                std::uniform_int_distribution<int> row_dist(0, static_cast<int>(stratum_size) - 1);
+                for (std::size_t i=0; i<needed; ++i) {
+                    ++n_draws[stratum[row_dist(gen)]];
+                }
+            }
+            else {
+                // selection sampling, as in Parser's SelectRows: keep each
+                // row with probability (rows still needed)/(rows left)
+                assert(needed <= stratum_size);
+                std::size_t still_needed = needed;
+                for (std::size_t i=0; i<stratum_size && still_needed>0; ++i) {
+                    if (unit_dist(gen) * (stratum_size - i) < still_needed) {
+                        ++n_draws[stratum[i]];
+                        --still_needed;
+                    }
+                }
+            }
+        }
+        
+        hrf::trainer::RowIndices result;
+        result.reserve(sample_size);
+        for (std::size_t row_index=0; row_index<n_rows; ++row_index) {
+            result.insert(result.end(), n_draws[row_index], static_cast<int>(row_index));
+        }
+        return result;
+    }
+    
+    std::uint64_t TreeCreator::TakeStreams(int n) {
+        const std::uint64_t first_stream = stream_base_ + n_trees_made_;
+        n_trees_made_ += n;
+        return first_stream;
+    }
+    
+    std::unique_ptr<Tree> TreeCreator::NewTree() {
         auto cols = bkp::random::Choice(hrf::HiggsCsvRow::NUM_FEATURES, cols_per_tree_);
         
-        std::unique_ptr<Tree> result(new Tree(std::move(cols),
+        return std::unique_ptr<Tree>(new Tree(std::move(cols),
                                               global_min_corner_,
                                               global_max_corner_));
+    }
+    
+    std::unique_ptr<Tree> TreeCreator::MakeTree(std::uint64_t stream, std::vector<bool>& out_in_bag) {
+        bkp::random::ScopedStream tree_stream(stream);
+        std::unique_ptr<Tree> result = NewTree();
+        if (!sample_trainer_) {
+            trainer_(*result, data_);
+            return result;
+        }
+        
+        hrf::trainer::RowIndices sample = DrawSample();
+        if (sample_options_.method_ != ALL_ROWS) {
+            out_in_bag.assign(data_.size(), false);
+            for (int row_index : sample) {
+                out_in_bag[row_index] = true;
+            }
+        }
+        if (sample.size() > MaxProjectedFraction(data_.Storage()) * data_.size()) {
+            sample_trainer_(*result, data_, std::move(sample));
+            return result;
+        }
         
-        trainer_(*result, data_);
+        // row i of the projection is row sample[i] of data_, so the
+        // projection's sample is every one of its rows, in order
+        FeatureMatrix& projection = *ProjectionBuffer();
+        projection.Project(data_, *result->target_features_, sample);
+        for (std::size_t i=0; i<sample.size(); ++i) {
+            sample[i] = static_cast<int>(i);
+        }
+        sample_trainer_(*result, projection, std::move(sample));
         return result;
     }
     
@@ -68,9 +255,43 @@ namespace hrf {
         
         std::vector<std::unique_ptr<hrf::IScorer>>* raw_result = new std::vector<std::unique_ptr<hrf::IScorer>>;
         raw_result->reserve(n);
+        in_bag_.assign(n, std::vector<bool>());
         
+        const std::uint64_t first_stream = TakeStreams(n);
         for (int i=0; i<n; ++i) {
-            raw_result->push_back(MakeTree());
+            raw_result->push_back(MakeTree(first_stream + i, in_bag_[i]));
+        }
+        
+        return std::unique_ptr<const std::vector<std::unique_ptr<hrf::IScorer>>>(raw_result);
+    }
+    
+    hrf::ScoreAverager::IScorerVector TreeCreator::MakeTreesBatched(int n,
+                                                                     const hrf::trainer::BatchTrainerFn& batch_trainer,
+                                                                     int trees_per_batch)
+    {
+        assert(n >= 0);
+        assert(trees_per_batch > 0);
+        assert(sample_options_.method_ == ALL_ROWS);
+        
+        std::vector<std::unique_ptr<hrf::IScorer>>* raw_result = new std::vector<std::unique_ptr<hrf::IScorer>>;
+        raw_result->reserve(n);
+        in_bag_.assign(n, std::vector<bool>());
+        
+        // the trees pick their columns in their own streams, as in
+        // MakeTree, but they're trained in this thread's (see
+        // TrainRandDimBatch)
+        const std::uint64_t first_stream = TakeStreams(n);
+        std::vector<Tree*> batch;
+        for (int batch_start=0; batch_start<n; batch_start+=trees_per_batch) {
+            const int batch_end = std::min(batch_start + trees_per_batch, n);
+            batch.clear();
+            for (int i=batch_start; i<batch_end; ++i) {
+                bkp::random::ScopedStream tree_stream(first_stream + i);
+                std::unique_ptr<Tree> tree = NewTree();
+                batch.push_back(tree.get());
+                raw_result->push_back(std::move(tree));
+            }
+            batch_trainer(batch, data_);
         }
         
         return std::unique_ptr<const std::vector<std::unique_ptr<hrf::IScorer>>>(raw_result);
@@ -79,10 +300,18 @@ namespace hrf {
     class TreeCreator::MakeTreesJob {
     public:
         typedef std::vector<std::unique_ptr<hrf::IScorer>>::iterator iterator;
+        typedef std::vector<std::vector<bool>>::iterator in_bag_iterator;
         iterator begin_;
         iterator end_;
+        in_bag_iterator in_bag_begin_; // in_bag_ entry of the tree at begin_
+        std::uint64_t stream_begin_;   // bkp::random stream of the tree at begin_
         
-        MakeTreesJob(iterator begin, iterator end) : begin_(begin), end_(end) { }
+        MakeTreesJob(iterator begin, iterator end, in_bag_iterator in_bag_begin, std::uint64_t stream_begin) :
+        begin_(begin),
+        end_(end),
+        in_bag_begin_(in_bag_begin),
+        stream_begin_(stream_begin)
+        { }
     };
     
     void TreeCreator::MakeTreesParallelHelper(bkp::JobQueue<std::unique_ptr<MakeTreesJob>>& job_queue)
@@ -97,9 +326,13 @@ namespace hrf {
                 
                 auto iter = job->begin_;
                 auto end = job->end_;
+                auto in_bag_iter = job->in_bag_begin_;
+                auto stream = job->stream_begin_;
                 while (iter != end) {
-                    *iter = MakeTree();
+                    *iter = MakeTree(stream, *in_bag_iter);
                     ++iter;
+                    ++in_bag_iter;
+                    ++stream;
                 }
                 
             }
@@ -112,9 +345,12 @@ namespace hrf {
         const int N_CORES = std::thread::hardware_concurrency();
         
         // approx 10 jobs/core, to allow work stealing if one core gets left behind
-        const int TREES_PER_JOB = n / (N_CORES * 10); // integer division intentional
+        // (but at least one tree per job, if there are fewer trees than that)
+        const int TREES_PER_JOB = std::max(n / (N_CORES * 10), 1); // integer division intentional
         
         std::vector<std::unique_ptr<hrf::IScorer>>* raw_result = new std::vector<std::unique_ptr<hrf::IScorer>>(n);
+        in_bag_.assign(n, std::vector<bool>());
+        const std::uint64_t first_stream = TakeStreams(n);
         bkp::JobQueue<std::unique_ptr<MakeTreesJob>> job_queue;
         
         std::vector<std::thread> consumer_threads;
@@ -133,10 +369,18 @@ namespace hrf {
             iter += TREES_PER_JOB;
             auto end = iter;
             
-            job_queue.MoveBack(std::unique_ptr<MakeTreesJob>(new MakeTreesJob(begin, end)));
+            auto tree_index = begin - raw_result->begin();
+            job_queue.MoveBack(std::unique_ptr<MakeTreesJob>(new MakeTreesJob(begin,
+                                                                              end,
+                                                                              in_bag_.begin() + tree_index,
+                                                                              first_stream + tree_index)));
         }
         if (full_batches * TREES_PER_JOB < n) {
-            job_queue.MoveBack(std::unique_ptr<MakeTreesJob>(new MakeTreesJob(iter, raw_result->end())));
+            auto tree_index = iter - raw_result->begin();
+            job_queue.MoveBack(std::unique_ptr<MakeTreesJob>(new MakeTreesJob(iter,
+                                                                              raw_result->end(),
+                                                                              in_bag_.begin() + tree_index,
+                                                                              first_stream + tree_index)));
         }
         job_queue.CompleteAdding();
         
@@ -146,4 +390,45 @@ namespace hrf {
         
         return std::unique_ptr<const std::vector<std::unique_ptr<hrf::IScorer>>>(raw_result);
     }
+    
+    hrf::ScoreAverager::IScorerVector MakeTreesStreamed(StreamedTrainingSet& training_rows,
+                                                        const hrf::trainer::StreamedTrainerFn& trainer,
+                                                        int cols_per_tree,
+                                                        int n,
+                                                        int trees_per_pass)
+    {
+        assert(n >= 0);
+        assert(trees_per_pass > 0);
+        
+        auto global_min_corner = std::make_shared<std::vector<double>>();
+        auto global_max_corner = std::make_shared<std::vector<double>>();
+        GetBinExtrema(training_rows.Encoding(), *global_min_corner, *global_max_corner);
+        
+        std::vector<std::unique_ptr<hrf::IScorer>>* raw_result = new std::vector<std::unique_ptr<hrf::IScorer>>;
+        raw_result->reserve(n);
+        
+        // as in TreeCreator::MakeTreesBatched, the trees pick their columns
+        // in their own streams, but they're trained in this thread's
+        const std::uint64_t first_stream = bkp::random::Generator()();
+        std::vector<Tree*> batch;
+        for (int batch_start=0; batch_start<n; batch_start+=trees_per_pass) {
+            const int batch_end = std::min(batch_start + trees_per_pass, n);
+            batch.clear();
+            for (int i=batch_start; i<batch_end; ++i) {
+                bkp::random::ScopedStream tree_stream(first_stream + i);
+                auto cols = bkp::random::Choice(hrf::HiggsCsvRow::NUM_FEATURES, cols_per_tree);
+                std::unique_ptr<Tree> tree(new Tree(std::move(cols),
+                                                    global_min_corner,
+                                                    global_max_corner));
+                batch.push_back(tree.get());
+                raw_result->push_back(std::move(tree));
+            }
+            if (!trainer(batch, training_rows)) {
+                delete raw_result;
+                return nullptr;
+            }
+        }
+        
+        return std::unique_ptr<const std::vector<std::unique_ptr<hrf::IScorer>>>(raw_result);
+    }
 }
\ No newline at end of file
@@ -12,48 +12,162 @@
 #include <vector>
 #include <array>
 #include <memory>
+#include <cstdint>
 
 #include "MaskedVector.h"
 #include "HiggsCsvRow.h"
 #include "Tree.h"
 #include "TreeTrainer.h"
+#include "FeatureMatrix.h"
+#include "StreamedTrainingSet.h"
 #include "ScoreAverager.h"
 #include "JobQueue.h"
 
 namespace hrf {
     
+    // Which rows each of a TreeCreator's trees is trained on
+    enum SampleMethod {
+        ALL_ROWS,  // every row, every time
+        BOOTSTRAP, // sample_fraction_ * n rows drawn at random with replacement
+        SUBSAMPLE  // sample_fraction_ * n rows drawn at random without replacement
+    };
+    
+    struct TreeSampleOptions {
+        
+        SampleMethod method_;
+        
+        // Size of each tree's sample, as a fraction of the training rows.
+        // Ignored for ALL_ROWS. 1.0 with BOOTSTRAP is the classic bootstrap
+        // sample (about 63% of the rows, some of them more than once).
+        double sample_fraction_;
+        
+        // If true, sample each Label separately, so that every tree's sample
+        // has the same mix of 's' and 'b' as the training rows (to within
+        // rounding)
+        bool stratify_;
+        
+        TreeSampleOptions();
+    };
+    
     // Simple utility class for making Trees.
     //
-    // TreeCreator instances store an hrf::trainer::TrainerFn& that they
+    // TreeCreator instances store an hrf::trainer::TrainerFn that they
     // use in most/all tree-creation methods. Returned trees
     // have been 'trained' (passed to that method) unless
     // otherwise specified.
+    //
+    // The training data is copied into a FeatureMatrix once, up front,
+    // and every tree is trained on that same copy.
+    //
+    // Alternatively, a TreeCreator can store an hrf::trainer::SampleTrainerFn
+    // and a TreeSampleOptions, in which case each tree is trained on its own
+    // random sample of the rows. A tree with a small sample (at most 30% of
+    // the rows with DOUBLE_FEATURES, or 20% with FLOAT_FEATURES) is trained
+    // on a projection of the copy onto just its own columns and sample rows
+    // (see FeatureMatrix::Project), so that the trainer reads a few short
+    // contiguous columns instead of gathering scattered rows from all of
+    // them. Each thread projects into a buffer that's reused for every tree
+    // it makes. Narrower storages are cheap enough to gather that they're
+    // never projected.
+    //
+    // Each tree is made (its columns picked, its sample drawn, and then
+    // trained) in its own bkp::random stream, numbered in the order the trees
+    // are made, starting from a number drawn from the constructing thread's
+    // generator. So for a given Seed, the serial and parallel MakeTrees
+    // methods make exactly the same forest, on any number of cores.
     class TreeCreator {
     private:
         class MakeTreesJob;
         
-        const hrf::trainer::TrainerFn& trainer_;
+        // only one of these is set, depending on the constructor
+        const hrf::trainer::TrainerFn trainer_;
+        const hrf::trainer::SampleTrainerFn sample_trainer_;
         
-        const bkp::MaskedVector<const hrf::HiggsTrainingCsvRow>& data_;
+        const FeatureMatrix data_;
         const int cols_per_tree_;
+        const TreeSampleOptions sample_options_;
+        
+        // the rows of data_ that samples are drawn from: one list per Label
+        // if sample_options_.stratify_, otherwise a single list of every row
+        std::vector<hrf::trainer::RowIndices> strata_;
+        
+        // see InBag()
+        std::vector<std::vector<bool>> in_bag_;
         
         std::shared_ptr<std::vector<double>> global_min_corner_;
         std::shared_ptr<std::vector<double>> global_max_corner_;
         
-        std::unique_ptr<Tree> MakeTree();
+        // the bkp::random stream of the first tree made, and the number of
+        // trees made so far (tree i's stream is stream_base_ + i)
+        const std::uint64_t stream_base_;
+        std::uint64_t n_trees_made_;
+        
+        // Reserve streams for the next n trees, and return the first one
+        std::uint64_t TakeStreams(int n);
+        
+        // an untrained Tree over cols_per_tree_ random columns
+        std::unique_ptr<Tree> NewTree();
+        
+        // Draw one tree's sample of data_ (see TrainXDimSample)
+        hrf::trainer::RowIndices DrawSample() const;
+        
+        // Make and train one tree in the given bkp::random stream, and set
+        // out_in_bag to its sample's rows
+        std::unique_ptr<Tree> MakeTree(std::uint64_t stream, std::vector<bool>& out_in_bag);
         
         void MakeTreesParallelHelper(bkp::JobQueue<std::unique_ptr<MakeTreesJob>>& job_queue);
     
     public:
-        TreeCreator(const bkp::MaskedVector<const hrf::HiggsTrainingCsvRow>& data,
+        TreeCreator(FeatureMatrix data,
                     const hrf::trainer::TrainerFn& trainer,
                     int cols_per_tree);
+        TreeCreator(FeatureMatrix data,
+                    const hrf::trainer::SampleTrainerFn& trainer,
+                    int cols_per_tree,
+                    const TreeSampleOptions& sample_options);
         
         hrf::ScoreAverager::IScorerVector MakeTrees(int n);
         
         hrf::ScoreAverager::IScorerVector MakeTreesParallel(int n);
+        
+        // Make n trees, trained trees_per_batch at a time by batch_trainer
+        // (e.g. hrf::trainer::TrainRandDimBatch) instead of one at a time by
+        // this TreeCreator's TrainerFn. Every tree is trained on every row,
+        // so the TreeSampleOptions must be ALL_ROWS.
+        hrf::ScoreAverager::IScorerVector MakeTreesBatched(int n,
+                                                           const hrf::trainer::BatchTrainerFn& batch_trainer,
+                                                           int trees_per_batch=hrf::trainer::DEFAULT_BATCH_TREES);
+        
+        // For each tree made by the last MakeTrees* call (in the same order),
+        // which of the training rows were in its sample. The rows that
+        // weren't are that tree's "out of bag" rows, which can be used to
+        // validate it. A tree's entry is empty if it was trained on every
+        // row.
+        //
+        // (Only membership is kept, rather than each sample's row indices,
+        // so that a forest's samples take 1 bit per row per tree.)
+        const std::vector<std::vector<bool>>& InBag() const { return in_bag_; }
     };
     
+    // Make n trees on a training set that's too big to fit in memory,
+    // trained trees_per_pass at a time by trainer (e.g.
+    // hrf::trainer::TrainRandDimStreamed). Every pass over the rows reads
+    // them from disk, so more trees per pass means fewer passes per tree, at
+    // the cost of more memory per row (see TrainBestDimStreamed).
+    //
+    // As with a TreeCreator, each tree picks its columns in its own
+    // bkp::random stream. The trees' corners are the range of training_rows'
+    // bins, which is what a TreeCreator with a BINNED8_FEATURES FeatureMatrix
+    // of the same rows would use.
+    //
+    // Returns null if trainer fails (e.g. a chunk of training_rows couldn't
+    // be read).
+    hrf::ScoreAverager::IScorerVector MakeTreesStreamed(StreamedTrainingSet& training_rows,
+                                                        const hrf::trainer::StreamedTrainerFn& trainer,
+                                                        int cols_per_tree,
+                                                        int n,
+                                                        int trees_per_pass=hrf::trainer::DEFAULT_STREAMED_TREES);
+    
 }
 
 #endif /* defined(__RandomForest____TreeCreator__) */
@@ -8,15 +8,37 @@
 
 #include <cmath>
 #include <limits>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <atomic>
 
 #include "TreeTrainer.h"
 #include "RandUtils.h"
+#include "SplitKernels.h"
 
 namespace hrf {
 namespace trainer {
 
     const double NaN = std::numeric_limits<double>::quiet_NaN();
     
+    // TrainStats counters (see GetTrainStats)
+    std::atomic<long long> stats_nodes(0);
+    std::atomic<long long> stats_node_rows(0);
+    std::atomic<long long> stats_label_rows_saved(0);
+    
+    // The split-finding functions used while training take the node's label
+    // counts (so they don't count them again for every dimension) and also
+    // return the label counts above the split they pick (so the children
+    // don't have to count theirs). The public versions count the node's
+    // labels themselves and discard the split's.
+    std::tuple<SplitErrorCode, double, double> FindBestSplit(const FeatureMatrix& training_rows,
+                                                             RowRange indices,
+                                                             int global_dim_index,
+                                                             int n_splits,
+                                                             LabelCounts node_counts,
+                                                             LabelCounts& out_upper);
+    
     double CalcEntropy(int count_a, int count_b) {
         if (count_a == 0 || count_b == 0) {
             return 0.0;
@@ -37,34 +59,101 @@ namespace trainer {
         return -((prob_a * logprob_a) + (prob_b * logprob_b));
     }
     
-    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree,
-                                                     const TrainingRows& training_rows)
+    // The FindBestSplitDim result from each local dimension's FindBestSplit
+    // result (and the label counts above its split): the first dimension
+    // with the most expected information, if any has more than 0.0
+    std::tuple<int, double, double> BestDimSplit(const std::vector<std::tuple<SplitErrorCode, double, double>>& dim_results,
+                                                 const std::vector<LabelCounts>& dim_uppers,
+                                                 LabelCounts& out_upper)
     {
         int best_local_dim_index = -1;
         double max_expected_info = 0.0;
         double best_split = NaN;
         
-        for (int dim=0; dim<tree.ndim_; ++dim) {
-            int global_dim = (*tree.target_features_)[dim];
-            
+        for (std::size_t dim=0; dim<dim_results.size(); ++dim) {
             SplitErrorCode error;
             double dim_expected_info, dim_best_split;
-            std::tie(error, dim_best_split, dim_expected_info) = FindBestSplit(training_rows, global_dim);
+            std::tie(error, dim_best_split, dim_expected_info) = dim_results[dim];
             
             // Note: ignore error; if it fails it will return dim_expected_info==0.0 which will
             // never be > max_expected_info
             if (dim_expected_info > max_expected_info) {
-                best_local_dim_index = dim;
+                best_local_dim_index = static_cast<int>(dim);
                 max_expected_info = dim_expected_info;
                 best_split = dim_best_split;
+                out_upper = dim_uppers[dim];
             }
         }
         
         return std::make_tuple(best_local_dim_index, best_split, max_expected_info);
     }
     
+    // The pool to split up the work on a node with n_rows rows between
+    // (pool, if it's worth it), or null to do it all on this thread
+    bkp::TaskPool* NodePool(bkp::TaskPool* pool, int min_task_rows, std::size_t n_rows) {
+        return n_rows > static_cast<std::size_t>(min_task_rows) ? pool : nullptr;
+    }
+    
+    // One random engine for each dimension of a FindBestSplitDim search, so
+    // each dimension draws its candidate splits from its own stream (see
+    // bkp::random::ScopedStream), whichever thread searches it. The engines'
+    // keys come from a single number of the calling thread's generator, so
+    // the search is still repeatable for a given Seed.
+    std::vector<bkp::random::CounterEngine> DimEngines(int ndim) {
+        const std::uint64_t key = bkp::random::Generator()();
+        std::vector<bkp::random::CounterEngine> engines;
+        engines.reserve(ndim);
+        for (int dim=0; dim<ndim; ++dim) {
+            engines.emplace_back(bkp::random::CounterEngine::Mix(key + static_cast<std::uint64_t>(dim)));
+        }
+        return engines;
+    }
+    
+    // FindBestSplitDim over a pool's threads: each dimension's whole search
+    // is its own task
+    std::tuple<int, double, double> FindBestSplitDimParallel(const hrf::Tree& tree,
+                                                             const FeatureMatrix& training_rows,
+                                                             RowRange indices,
+                                                             LabelCounts node_counts,
+                                                             LabelCounts& out_upper,
+                                                             bkp::TaskPool& pool);
+    
+    // The split finders used while training also take a pool: if it isn't
+    // null, the node is big enough to be worth splitting up the search
+    // between its threads.
+    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree,
+                                                     const FeatureMatrix& training_rows,
+                                                     RowRange indices,
+                                                     LabelCounts node_counts,
+                                                     LabelCounts& out_upper,
+                                                     bkp::TaskPool* pool)
+    {
+        if (pool != nullptr) {
+            return FindBestSplitDimParallel(tree, training_rows, indices, node_counts, out_upper, *pool);
+        }
+        
+        const std::vector<bkp::random::CounterEngine> dim_engines = DimEngines(tree.ndim_);
+        std::vector<std::tuple<SplitErrorCode, double, double>> dim_results(tree.ndim_);
+        std::vector<LabelCounts> dim_uppers(tree.ndim_);
+        for (int dim=0; dim<tree.ndim_; ++dim) {
+            bkp::random::ScopedStream dim_stream(dim_engines[dim]);
+            int global_dim = (*tree.target_features_)[dim];
+            dim_results[dim] = FindBestSplit(training_rows,
+                                             indices,
+                                             global_dim,
+                                             DEFAULT_N_SPLITS,
+                                             node_counts,
+                                             dim_uppers[dim]);
+        }
+        return BestDimSplit(dim_results, dim_uppers, out_upper);
+    }
+    
     std::tuple<int, double, double> FindBestRandomSplit(const hrf::Tree& tree,
-                                                        const TrainingRows& training_rows)
+                                                        const FeatureMatrix& training_rows,
+                                                        RowRange indices,
+                                                        LabelCounts node_counts,
+                                                        LabelCounts& out_upper,
+                                                        bkp::TaskPool*) // pool: unused, searches one dimension at a time
     {
         int local_dim_index;
         SplitErrorCode error;
@@ -89,44 +178,177 @@ namespace trainer {
         do {
             local_dim_index = bkp::random::RandInt(tree.ndim_ - 1);
             int global_dim_index = (*tree.target_features_)[local_dim_index];
-            std::tie(error, split, expected_info) = FindBestSplit(training_rows, global_dim_index);
+            std::tie(error, split, expected_info) = FindBestSplit(training_rows,
+                                                                  indices,
+                                                                  global_dim_index,
+                                                                  DEFAULT_N_SPLITS,
+                                                                  node_counts,
+                                                                  out_upper);
         } while (error == SplitErrorCode::ZERO_WIDTH_DIM && (++tries) < MAX_TRIES);
         
         return std::make_tuple(local_dim_index, split, expected_info);
     }
     
-    // helper function: count how many times a label appears in the given rows
-    int CountLabel(const TrainingRows& rows, char label) {
-        auto i = rows.size();
-        int count = 0;
-        while (i--) {
-            if (rows[i].Label_ == label) {
-                ++count;
+    // helper function: count the signal ('s') and background rows among the
+    // given rows
+    LabelCounts CountLabels(const FeatureMatrix& rows, RowRange indices) {
+        const unsigned char* is_signal = rows.IsSignal();
+        int s_count = 0;
+        for (int row_index : indices) {
+            s_count += is_signal[row_index];
+        }
+        LabelCounts result;
+        result.s_ = s_count;
+        result.b_ = static_cast<int>(indices.size()) - s_count;
+        return result;
+    }
+    
+    // A threshold that no stored value is >= to, for padding sorted threshold
+    // arrays: NaN for floating-point thresholds (comparisons with NaN are
+    // always false), and otherwise the largest value, which is never a code.
+    template<class TThreshold>
+    TThreshold PaddingThreshold() {
+        return std::numeric_limits<TThreshold>::has_quiet_NaN ?
+            std::numeric_limits<TThreshold>::quiet_NaN() :
+            std::numeric_limits<TThreshold>::max();
+    }
+    
+    // Up to this many candidate splits, FindBestSplit counts the rows above
+    // each one with a separate (vectorized) pass. Beyond it, a single
+    // bucketing pass for all of them is cheaper.
+    const int MAX_COUNTING_SPLITS = 16;
+    
+    // Set n_above[k] to the number of vals >= splits[k], and s_above[k] to
+    // how many of those are signal, with one CountAbove pass per split.
+    template<class TView>
+    void CountAboveSplits(const TView& view,
+                          const typename TView::value_type* vals,
+                          const unsigned char* is_signal,
+                          std::size_t size,
+                          const std::vector<double>& splits,
+                          std::vector<int>& n_above,
+                          std::vector<int>& s_above)
+    {
+        for (std::size_t k=0; k<splits.size(); ++k) {
+            CountAbove(vals, is_signal, size, view.Threshold(splits[k]), n_above[k], s_above[k]);
+        }
+    }
+    
+    // Same as CountAboveSplits, but evaluates all the splits in a single pass
+    // over the rows, so its cost hardly depends on the number of splits.
+    template<class TView>
+    void BucketAboveSplits(const TView& view,
+                           const typename TView::value_type* vals,
+                           const unsigned char* is_signal,
+                           std::size_t size,
+                           const std::vector<double>& splits,
+                           std::vector<int>& n_above,
+                           std::vector<int>& s_above)
+    {
+        typedef typename TView::value_type value_type;
+        typedef typename TView::threshold_type threshold_type;
+        
+        const int n_splits = static_cast<int>(splits.size());
+        
+        // Sort the thresholds (remembering where each one's split came from),
+        // and pad them up to a power of two greater than n_splits with
+        // thresholds that nothing is >= to.
+        std::vector<int> order(n_splits);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return splits[a] < splits[b]; });
+        
+        int n_padded = 1;
+        while (n_padded <= n_splits) {
+            n_padded *= 2;
+        }
+        std::vector<threshold_type> thresholds(n_padded, PaddingThreshold<threshold_type>());
+        for (int k=0; k<n_splits; ++k) {
+            thresholds[k] = view.Threshold(splits[order[k]]);
+        }
+        
+        // One pass over the rows: put each value in a bucket according to
+        // how many thresholds it's >= to (found with a branch-free binary
+        // search over the sorted thresholds), and count the rows and signal
+        // rows in each bucket. NaNs are never >= anything, so go in bucket 0.
+        std::vector<int> n_bucket(n_padded, 0);
+        std::vector<int> s_bucket(n_padded, 0);
+        const threshold_type* thresholds_ptr = thresholds.data();
+        for (std::size_t i=0; i<size; ++i) {
+            const value_type val = vals[i];
+            int bucket = 0;
+            for (int step=n_padded/2; step>0; step/=2) {
+                bucket += (val >= thresholds_ptr[bucket + step - 1]) ? step : 0;
             }
+            ++n_bucket[bucket];
+            s_bucket[bucket] += is_signal[i];
+        }
+        
+        // Suffix sums: the rows above sorted threshold k are the ones in
+        // buckets k+1 and up
+        int n_suffix = 0;
+        int s_suffix = 0;
+        for (int bucket=n_splits; bucket>0; --bucket) {
+            n_suffix += n_bucket[bucket];
+            s_suffix += s_bucket[bucket];
+            n_above[order[bucket - 1]] = n_suffix;
+            s_above[order[bucket - 1]] = s_suffix;
         }
-        return count;
     }
     
-    std::tuple<SplitErrorCode, double, double> FindBestSplit(const TrainingRows& training_rows,
-                                             int global_dim_index,
-                                             const int n_splits)
+    // FindBestSplit implementation, for each type of column view (see
+    // FeatureStorage).
+    template<class TView>
+    std::tuple<SplitErrorCode, double, double> FindBestSplit(const FeatureMatrix& training_rows,
+                                                             const TView& view,
+                                                             RowRange indices,
+                                                             const int n_splits,
+                                                             LabelCounts node_counts,
+                                                             LabelCounts& out_upper)
     {
-        int s_count = CountLabel(training_rows, 's');
-        int b_count = static_cast<int>(training_rows.size()) - s_count;
+        typedef typename TView::value_type value_type;
+        
+        const auto size = indices.size();
+        const unsigned char* is_signal = training_rows.IsSignal();
+        
+        // The candidate splits depend on the min/max, so the signal flags and
+        // column values have to be scanned a second time once they're known.
+        // Gather the ones we need into contiguous arrays first; the min/max
+        // fall out of the same pass. Values are kept in
+        // their stored (possibly reduced-precision) form, so smaller types
+        // mean less memory traffic.
+        std::unique_ptr<unsigned char[]> is_signal_owner(new unsigned char[size]);
+        std::unique_ptr<value_type[]> vals_owner(new value_type[size]);
+        unsigned char* is_signal_raw = is_signal_owner.get();
+        value_type* vals_raw = vals_owner.get();
+        
+        bool any_vals = false;
+        value_type min_val = std::numeric_limits<value_type>::max();
+        value_type max_val = std::numeric_limits<value_type>::lowest();
+        for (std::size_t i=0; i<size; ++i) {
+            const int row_index = indices[i];
+            const value_type val = view.data_[row_index];
+            is_signal_raw[i] = is_signal[row_index];
+            vals_raw[i] = val;
+            if (view.IsNan(val)) {
+                continue;
+            }
+            any_vals = true;
+            if (val < min_val) {
+                min_val = val;
+            }
+            if (val > max_val) {
+                max_val = val;
+            }
+        }
+        int s_count = node_counts.s_;
+        int b_count = node_counts.b_;
         double total_entropy = CalcEntropy(s_count, b_count);
         
-        const auto size = training_rows.size();
         double dim_min = std::numeric_limits<double>::max();
         double dim_max = std::numeric_limits<double>::lowest();
-        auto i = size;
-        while (i--) {
-            double val = training_rows[i].data_[global_dim_index];
-            if (val < dim_min) {
-                dim_min = val;
-            }
-            if (val > dim_max) {
-                dim_max = val;
-            }
+        if (any_vals) {
+            dim_min = view.Decode(min_val);
+            dim_max = view.Decode(max_val);
         }
         
         if (dim_max - dim_min == 0.0) {
@@ -134,50 +356,116 @@ namespace trainer {
         }
         
         auto splits = bkp::random::RandDoubles(n_splits, dim_min, dim_max);
-        auto splits_ptr = splits.data(); // because speed?
+        
+        // n_above[k] rows are >= split k, s_above[k] of which are signal.
+        // Everything else can be derived from s_count and b_count.
+        std::vector<int> n_above(n_splits);
+        std::vector<int> s_above(n_splits);
+        if (n_splits <= MAX_COUNTING_SPLITS) {
+            CountAboveSplits(view, vals_raw, is_signal_raw, size, splits, n_above, s_above);
+        }
+        else {
+            BucketAboveSplits(view, vals_raw, is_signal_raw, size, splits, n_above, s_above);
+        }
         
         double max_expected_info = 0.0;
         double best_split = NaN;
         
-        // We'll be accessing the signal flag and a single column from
-        // the row repeatedly (n_splits times). It turns out that it's
-        // significantly faster to copy all the values we'll need to
-        // a contiguous array first, to improve our chances of cache
-        // hits later.
-        std::unique_ptr<bool[]> is_signal_owner(new bool[size]);
-        std::unique_ptr<double[]> vals_owner(new double[size]);
-        bool* is_signal_raw = is_signal_owner.get();
-        double* vals_raw = vals_owner.get();
-        auto row_index = size;
-        while (row_index--) {
-            auto& row = training_rows[row_index];
-            is_signal_raw[row_index] = row.Label_ == 's';
-            vals_raw[row_index] = row.data_[global_dim_index];
-        }
-        
         for (int split_index=0; split_index<n_splits; ++split_index) {
-            double split = splits_ptr[split_index];
+            double split = splits[split_index];
             
-            int s_above, b_above;
-            int s_below, b_below;
-            s_above = b_above = s_below = b_below = 0;
+            int n_split_above = n_above[split_index];
+            int s_split_above = s_above[split_index];
+            int b_split_above = n_split_above - s_split_above;
+            int s_below = s_count - s_split_above;
+            int b_below = b_count - b_split_above;
+            int n_below = s_below + b_below;
             
-            auto row_index = size;
-            while (row_index--) {
-                
-                if (vals_raw[row_index] >= split) {
-                    if (is_signal_raw[row_index]) { ++s_above; } else { ++b_above; }
-                }
-                else {
-                    if (is_signal_raw[row_index]) { ++s_below; } else { ++b_below; }
-                }
-            }
+            double prob_above = static_cast<double>(n_split_above) / size;
+            double prob_below = static_cast<double>(n_below) / size; // == 1.0 - prob_above
             
-            int n_above = s_above + b_above;
+            double entropy_above = CalcEntropy(s_split_above, b_split_above);
+            double entropy_below = CalcEntropy(s_below, b_below);
+            
+            double expected_info = total_entropy - ((prob_above*entropy_above) + (prob_below*entropy_below));
+            
+            if (expected_info > max_expected_info) {
+                max_expected_info = expected_info;
+                best_split = split;
+                out_upper.s_ = s_split_above;
+                out_upper.b_ = b_split_above;
+            }
+        }
+        
+        return std::make_tuple(SplitErrorCode::NO_ERROR, best_split, max_expected_info);
+    }
+    
+    // Count the given rows into histograms over the viewed column's bins:
+    // n_hist[code] rows in each bin, s_hist[code] of which are signal. Both
+    // are assumed to be zeroed, with BinnedColumnView::NUM_CODES entries.
+    void BuildHistogram(const BinnedColumnView& view,
+                        const unsigned char* is_signal,
+                        RowRange indices,
+                        int* n_hist,
+                        int* s_hist)
+    {
+        for (int row_index : indices) {
+            const std::uint8_t code = view.data_[row_index];
+            ++n_hist[code];
+            s_hist[code] += is_signal[row_index];
+        }
+    }
+    
+    // Find the best split of a node from its histograms over one column's
+    // bins: sweep down through the bins, trying every boundary between two
+    // occupied bins as a split. Same return value as FindBestSplit, and sets
+    // out_upper to the label counts above the split.
+    std::tuple<SplitErrorCode, double, double> BestHistogramSplit(const BinnedColumnView& view,
+                                                                  const int* n_hist,
+                                                                  const int* s_hist,
+                                                                  LabelCounts& out_upper)
+    {
+        const int NUM_CODES = BinnedColumnView::NUM_CODES;
+        
+        int size = 0;
+        int s_count = 0;
+        int min_code = NUM_CODES;
+        int max_code = 0;
+        for (int code=0; code<NUM_CODES; ++code) {
+            size += n_hist[code];
+            s_count += s_hist[code];
+            if (code != BinnedColumnView::NAN_CODE && n_hist[code] > 0) {
+                min_code = std::min(min_code, code);
+                max_code = code;
+            }
+        }
+        int b_count = size - s_count;
+        double total_entropy = CalcEntropy(s_count, b_count);
+        
+        if (max_code <= min_code) { // all in one bin (or all NaN)
+            return std::make_tuple(SplitErrorCode::ZERO_WIDTH_DIM, NaN, 0.0);
+        }
+        
+        double max_expected_info = 0.0;
+        double best_split = NaN;
+        
+        // rows in bins >= code are above the split, everything else
+        // (including NaNs) is below it
+        int n_above = 0;
+        int s_above = 0;
+        for (int code=max_code; code>min_code; --code) {
+            n_above += n_hist[code];
+            s_above += s_hist[code];
+            if (n_hist[code] == 0) {
+                continue; // same split as the next occupied bin up
+            }
+            int b_above = n_above - s_above;
+            int s_below = s_count - s_above;
+            int b_below = b_count - b_above;
             int n_below = s_below + b_below;
             
             double prob_above = static_cast<double>(n_above) / size;
-            double prob_below = static_cast<double>(n_below) / size; // == 1.0 - prob_above
+            double prob_below = static_cast<double>(n_below) / size;
             
             double entropy_above = CalcEntropy(s_above, b_above);
             double entropy_below = CalcEntropy(s_below, b_below);
@@ -186,19 +474,176 @@ namespace trainer {
             
             if (expected_info > max_expected_info) {
                 max_expected_info = expected_info;
-                best_split = split;
+                best_split = view.SplitBelow(code);
+                out_upper.s_ = s_above;
+                out_upper.b_ = b_above;
             }
         }
         
         return std::make_tuple(SplitErrorCode::NO_ERROR, best_split, max_expected_info);
     }
     
-    int DefaultMaxDepth(const TrainingRows& rows) {
-        return static_cast<int>(floor(sqrt(rows.size())));
+    // FindBestSplit implementation for BINNED8_FEATURES: instead of trying
+    // n_splits random thresholds, build signal/background histograms of the
+    // node's rows over the column's bins (one pass), and try every boundary.
+    std::tuple<SplitErrorCode, double, double> FindBestSplit(const FeatureMatrix& training_rows,
+                                                             const BinnedColumnView& view,
+                                                             RowRange indices,
+                                                             const int, // n_splits: unused
+                                                             LabelCounts, // node_counts: unused
+                                                             LabelCounts& out_upper)
+    {
+        int n_hist[BinnedColumnView::NUM_CODES] = { 0 };
+        int s_hist[BinnedColumnView::NUM_CODES] = { 0 };
+        BuildHistogram(view, training_rows.IsSignal(), indices, n_hist, s_hist);
+        return BestHistogramSplit(view, n_hist, s_hist, out_upper);
     }
     
-    int DefaultMinPts(const TrainingRows& rows) {
-        return static_cast<int>(floor(sqrt(rows.size())));
+    std::tuple<SplitErrorCode, double, double> FindBestSplit(const FeatureMatrix& training_rows,
+                                                             RowRange indices,
+                                                             int global_dim_index,
+                                                             int n_splits,
+                                                             LabelCounts node_counts,
+                                                             LabelCounts& out_upper)
+    {
+        switch (training_rows.Storage()) {
+            case DOUBLE_FEATURES:
+                return FindBestSplit(training_rows,
+                                     training_rows.View<DoubleColumnView>(global_dim_index),
+                                     indices,
+                                     n_splits,
+                                     node_counts,
+                                     out_upper);
+            case FLOAT_FEATURES:
+                return FindBestSplit(training_rows,
+                                     training_rows.View<FloatColumnView>(global_dim_index),
+                                     indices,
+                                     n_splits,
+                                     node_counts,
+                                     out_upper);
+            case QUANTIZED16_FEATURES:
+                return FindBestSplit(training_rows,
+                                     training_rows.View<QuantizedColumnView>(global_dim_index),
+                                     indices,
+                                     n_splits,
+                                     node_counts,
+                                     out_upper);
+            case BINNED8_FEATURES:
+                return FindBestSplit(training_rows,
+                                     training_rows.View<BinnedColumnView>(global_dim_index),
+                                     indices,
+                                     n_splits,
+                                     node_counts,
+                                     out_upper);
+        }
+        return std::make_tuple(SplitErrorCode::NO_ERROR, NaN, 0.0); // unreachable
+    }
+    
+    std::tuple<int, double, double> FindBestSplitDimParallel(const hrf::Tree& tree,
+                                                             const FeatureMatrix& training_rows,
+                                                             RowRange indices,
+                                                             LabelCounts node_counts,
+                                                             LabelCounts& out_upper,
+                                                             bkp::TaskPool& pool)
+    {
+        const std::vector<bkp::random::CounterEngine> dim_engines = DimEngines(tree.ndim_);
+        std::vector<std::tuple<SplitErrorCode, double, double>> dim_results(tree.ndim_);
+        std::vector<LabelCounts> dim_uppers(tree.ndim_);
+        bkp::TaskGroup group(pool);
+        for (int dim=0; dim<tree.ndim_; ++dim) {
+            group.Run([&, dim]() {
+                bkp::random::ScopedStream dim_stream(dim_engines[dim]);
+                int global_dim = (*tree.target_features_)[dim];
+                dim_results[dim] = FindBestSplit(training_rows,
+                                                 indices,
+                                                 global_dim,
+                                                 DEFAULT_N_SPLITS,
+                                                 node_counts,
+                                                 dim_uppers[dim]);
+            });
+        }
+        group.Wait();
+        return BestDimSplit(dim_results, dim_uppers, out_upper);
+    }
+    
+    // helper function: indices of every row in rows (0, 1, ..., size-1)
+    RowIndices AllRows(const FeatureMatrix& rows) {
+        RowIndices result(rows.size());
+        std::iota(result.begin(), result.end(), 0);
+        return result;
+    }
+    
+    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree,
+                                                     const FeatureMatrix& training_rows,
+                                                     RowRange indices)
+    {
+        LabelCounts upper;
+        return FindBestSplitDim(tree, training_rows, indices, CountLabels(training_rows, indices), upper, nullptr);
+    }
+    
+    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree,
+                                                     const FeatureMatrix& training_rows,
+                                                     RowRange indices,
+                                                     bkp::TaskPool& pool,
+                                                     int min_task_rows)
+    {
+        LabelCounts upper;
+        return FindBestSplitDim(tree,
+                                training_rows,
+                                indices,
+                                CountLabels(training_rows, indices),
+                                upper,
+                                NodePool(&pool, min_task_rows, indices.size()));
+    }
+    
+    std::tuple<int, double, double> FindBestRandomSplit(const hrf::Tree& tree,
+                                                        const FeatureMatrix& training_rows,
+                                                        RowRange indices)
+    {
+        LabelCounts upper;
+        return FindBestRandomSplit(tree, training_rows, indices, CountLabels(training_rows, indices), upper, nullptr);
+    }
+    
+    std::tuple<SplitErrorCode, double, double> FindBestSplit(const FeatureMatrix& training_rows,
+                                                             RowRange indices,
+                                                             int global_dim_index,
+                                                             int n_splits)
+    {
+        LabelCounts upper;
+        return FindBestSplit(training_rows,
+                             indices,
+                             global_dim_index,
+                             n_splits,
+                             CountLabels(training_rows, indices),
+                             upper);
+    }
+    
+    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree,
+                                                     const FeatureMatrix& training_rows)
+    {
+        return FindBestSplitDim(tree, training_rows, AllRows(training_rows));
+    }
+    
+    std::tuple<int, double, double> FindBestRandomSplit(const hrf::Tree& tree,
+                                                        const FeatureMatrix& training_rows)
+    {
+        return FindBestRandomSplit(tree, training_rows, AllRows(training_rows));
+    }
+    
+    std::tuple<SplitErrorCode, double, double> FindBestSplit(const FeatureMatrix& training_rows,
+                                                             int global_dim_index,
+                                                             const int n_splits)
+    {
+        return FindBestSplit(training_rows, AllRows(training_rows), global_dim_index, n_splits);
+    }
+    
+    // Training limits for a tree trained on n_rows rows
+    int DefaultMaxDepth(std::size_t n_rows) {
+        return static_cast<int>(floor(sqrt(n_rows)));
+    }
+    
+    int DefaultMinPts(std::size_t n_rows) {
+        return static_cast<int>(floor(sqrt(n_rows)));
     }
     
     void TrainHelperLeaf(hrf::Tree& tree,
@@ -212,17 +657,108 @@ namespace trainer {
         tree.SetScore(s_density, b_density);
     }
     
+    // Partition the rows in [begin, end) in place, so that the ones that are
+    // >= split in the viewed column come first, and return where the rest
+    // start. The partition is stable, so each side's indices stay in
+    // increasing order and its column reads stay sequential. scratch must
+    // have room for end - begin indices; the lower rows are gathered there
+    // before being copied back after the upper ones.
+    template<class TView>
+    int* PartitionRows(const TView& view,
+                       double split,
+                       int* begin,
+                       int* end,
+                       int* scratch)
+    {
+        const typename TView::threshold_type threshold = view.Threshold(split);
+        int* upper_end = begin;
+        int* lower_end = scratch;
+        for (const int* row=begin; row!=end; ++row) {
+            // branch-free: the split is unpredictable, so write each index to
+            // both sides and only advance the side it belongs to (upper_end
+            // never passes row, so this can't overwrite an unread index)
+            const int row_index = *row;
+            const bool is_upper = view.data_[row_index] >= threshold;
+            *upper_end = row_index;
+            *lower_end = row_index;
+            upper_end += is_upper;
+            lower_end += !is_upper;
+        }
+        std::copy(scratch, lower_end, upper_end);
+        return upper_end;
+    }
+    
+    // Train a node's two children, by calling train_upper and train_lower.
+    // If pool isn't null and the node has more than min_task_rows rows, the
+    // upper child is trained as a separate task (so an idle worker can take
+    // it) while this thread trains the lower one. Otherwise they're trained
+    // one after the other on this thread.
+    void TrainChildren(bkp::TaskPool* pool,
+                       int min_task_rows,
+                       std::size_t n_rows,
+                       const std::function<void()>& train_upper,
+                       const std::function<void()>& train_lower)
+    {
+        if (pool == nullptr || n_rows <= static_cast<std::size_t>(min_task_rows)) {
+            train_upper();
+            train_lower();
+            return;
+        }
+        bkp::TaskGroup group(*pool);
+        group.Run(train_upper);
+        train_lower();
+        group.Wait();
+    }
+    
+    typedef std::tuple<int, double, double> (*SplitFinder)(const hrf::Tree&,
+                                                           const FeatureMatrix&,
+                                                           RowRange,
+                                                           LabelCounts,
+                                                           LabelCounts&,
+                                                           bkp::TaskPool*);
+        
+    // Update the TrainStats counters for a node with n_rows rows
+    void RecordNode(std::size_t n_rows) {
+        ++stats_nodes;
+        stats_node_rows += n_rows;
+    }
+    
+    // The label counts below a split, from the node's and those above it
+    LabelCounts LowerCounts(LabelCounts node_counts, LabelCounts upper_counts) {
+        LabelCounts result;
+        result.s_ = node_counts.s_ - upper_counts.s_;
+        result.b_ = node_counts.b_ - upper_counts.b_;
+        return result;
+    }
+    
+    // Train tree on the rows in [begin, end). Those are partitioned in place
+    // between the children, so each child's rows are a subrange of its
+    // parent's, and the whole tree shares one index array (plus a scratch
+    // array of the same size, whose matching range PartitionRows may use).
+    // The children's ranges don't overlap, so they can be trained in
+    // parallel.
+    //
+    // counts are the node's label counts. Only the root's are counted from
+    // its rows; every other node's come from its parent's split.
     void TrainHelper(hrf::Tree& tree,
-                     const TrainingRows& training_rows,
-                     std::tuple<int, double, double> (*split_finder)(const hrf::Tree&, const TrainingRows&),
+                     const FeatureMatrix& training_rows,
+                     int* begin,
+                     int* end,
+                     int* scratch,
+                     LabelCounts counts,
+                     SplitFinder split_finder,
                      int max_depth,
-                     int min_pts)
+                     int min_pts,
+                     bkp::TaskPool* pool,
+                     int min_task_rows)
     {
-        int s_count = CountLabel(training_rows, 's');
-        int b_count = static_cast<int>(training_rows.size()) - s_count;
+        const RowRange indices(begin, end);
+        RecordNode(indices.size());
+        int s_count = counts.s_;
+        int b_count = counts.b_;
         
         if (max_depth <= 0 ||
-            training_rows.size() <= min_pts ||
+            indices.size() <= min_pts ||
             s_count == 0 ||
             b_count == 0)
         {
@@ -232,7 +768,13 @@ namespace trainer {
         
         double split, expected_info;
         int local_dim_index;
-        std::tie(local_dim_index, split, expected_info) = split_finder(tree, training_rows);
+        LabelCounts upper_counts;
+        std::tie(local_dim_index, split, expected_info) = split_finder(tree,
+                                                                       training_rows,
+                                                                       indices,
+                                                                       counts,
+                                                                       upper_counts,
+                                                                       NodePool(pool, min_task_rows, indices.size()));
         if (local_dim_index == -1 || std::isnan(split) || expected_info <= 0.0) {
             TrainHelperLeaf(tree, s_count, b_count);
             return;
@@ -249,49 +791,1263 @@ namespace trainer {
         if (tree.children_.size() == 0) { return; }
         assert(tree.children_.size() == 2);
         
-        std::vector<bool> filter(training_rows.size());
-        std::transform(training_rows.begin(),
-                       training_rows.end(),
-                       filter.begin(),
-                       [global_index, split](const HiggsTrainingCsvRow& row) {
-                           return row.data_[global_index] >= split;
-                       });
+        int* middle = end;
+        switch (training_rows.Storage()) {
+            case DOUBLE_FEATURES:
+                middle = PartitionRows(training_rows.View<DoubleColumnView>(global_index),
+                                       split, begin, end, scratch);
+                break;
+            case FLOAT_FEATURES:
+                middle = PartitionRows(training_rows.View<FloatColumnView>(global_index),
+                                       split, begin, end, scratch);
+                break;
+            case QUANTIZED16_FEATURES:
+                middle = PartitionRows(training_rows.View<QuantizedColumnView>(global_index),
+                                       split, begin, end, scratch);
+                break;
+            case BINNED8_FEATURES:
+                middle = PartitionRows(training_rows.View<BinnedColumnView>(global_index),
+                                       split, begin, end, scratch);
+                break;
+        }
         
-        TrainHelper(tree.children_[0],
-                    training_rows.Filter(filter),
-                    split_finder,
-                    max_depth-1,
-                    min_pts);
+        // the split finder compared the same stored values to the same
+        // threshold as PartitionRows, so its counts are exact
+        assert(middle - begin == upper_counts.s_ + upper_counts.b_);
+        const LabelCounts lower_counts = LowerCounts(counts, upper_counts);
+        stats_label_rows_saved += indices.size();
         
-        // filter = !filter
-        filter.flip();
+        auto train_upper = [&]() {
+            TrainHelper(tree.children_[0],
+                        training_rows,
+                        begin,
+                        middle,
+                        scratch,
+                        upper_counts,
+                        split_finder,
+                        max_depth-1,
+                        min_pts,
+                        pool,
+                        min_task_rows);
+        };
+        auto train_lower = [&]() {
+            TrainHelper(tree.children_[1],
+                        training_rows,
+                        middle,
+                        end,
+                        scratch + (middle - begin),
+                        lower_counts,
+                        split_finder,
+                        max_depth-1,
+                        min_pts,
+                        pool,
+                        min_task_rows);
+        };
+        TrainChildren(pool, min_task_rows, indices.size(), train_upper, train_lower);
+    }
+    
+    // Histograms of a node's rows over the bins of each of a tree's
+    // target_features_ (BINNED8_FEATURES only). N(dim)[code] rows of the node
+    // fall in each bin of local dimension dim, S(dim)[code] of them signal.
+    class NodeHistograms {
+    private:
+        std::vector<int> n_;
+        std::vector<int> s_;
         
-        TrainHelper(tree.children_[1],
-                    training_rows.Filter(filter),
-                    split_finder,
-                    max_depth-1,
-                    min_pts);
+    public:
+        // Count 'indices' into histograms for each of tree's target_features_.
+        // If pool isn't null, each dimension is counted as a separate task.
+        NodeHistograms(const hrf::Tree& tree,
+                       const FeatureMatrix& training_rows,
+                       RowRange indices,
+                       bkp::TaskPool* pool) :
+        n_(tree.ndim_ * BinnedColumnView::NUM_CODES, 0),
+        s_(tree.ndim_ * BinnedColumnView::NUM_CODES, 0)
+        {
+            auto count_dim = [&](int dim) {
+                int global_dim = (*tree.target_features_)[dim];
+                BuildHistogram(training_rows.View<BinnedColumnView>(global_dim),
+                               training_rows.IsSignal(),
+                               indices,
+                               N(dim),
+                               S(dim));
+            };
+            if (pool == nullptr) {
+                for (int dim=0; dim<tree.ndim_; ++dim) {
+                    count_dim(dim);
+                }
+                return;
+            }
+            bkp::TaskGroup group(*pool);
+            for (int dim=0; dim<tree.ndim_; ++dim) {
+                group.Run([&count_dim, dim]() { count_dim(dim); });
+            }
+            group.Wait();
+        }
+        
+        // Empty (all zero) histograms for each of tree's target_features_
+        explicit NodeHistograms(const hrf::Tree& tree) :
+        n_(tree.ndim_ * BinnedColumnView::NUM_CODES, 0),
+        s_(tree.ndim_ * BinnedColumnView::NUM_CODES, 0)
+        { }
+        
+        int* N(int dim) { return n_.data() + dim * BinnedColumnView::NUM_CODES; }
+        int* S(int dim) { return s_.data() + dim * BinnedColumnView::NUM_CODES; }
+        const int* N(int dim) const { return n_.data() + dim * BinnedColumnView::NUM_CODES; }
+        const int* S(int dim) const { return s_.data() + dim * BinnedColumnView::NUM_CODES; }
+        
+        // Turn a parent's histograms into one child's, given the other
+        // child's: every row of the parent is in exactly one child, so this
+        // is just a subtraction, with no need to look at any rows.
+        void Subtract(const NodeHistograms& sibling) {
+            for (std::size_t i=0; i<n_.size(); ++i) {
+                n_[i] -= sibling.n_[i];
+                s_[i] -= sibling.s_[i];
+            }
+        }
+    };
+    
+    // FindBestSplitDim, but from a node's histograms rather than its rows
+    std::tuple<int, double, double> HistogramSplitDim(const hrf::Tree& tree,
+                                                      const FeatureMatrix& training_rows,
+                                                      const NodeHistograms& histograms,
+                                                      LabelCounts& out_upper)
+    {
+        int best_local_dim_index = -1;
+        double max_expected_info = 0.0;
+        double best_split = NaN;
+        
+        for (int dim=0; dim<tree.ndim_; ++dim) {
+            int global_dim = (*tree.target_features_)[dim];
+            
+            SplitErrorCode error;
+            double dim_expected_info, dim_best_split;
+            LabelCounts dim_upper;
+            std::tie(error, dim_best_split, dim_expected_info) =
+                BestHistogramSplit(training_rows.View<BinnedColumnView>(global_dim),
+                                   histograms.N(dim),
+                                   histograms.S(dim),
+                                   dim_upper);
+            
+            if (dim_expected_info > max_expected_info) {
+                best_local_dim_index = dim;
+                max_expected_info = dim_expected_info;
+                best_split = dim_best_split;
+                out_upper = dim_upper;
+            }
+        }
         
+        return std::make_tuple(best_local_dim_index, best_split, max_expected_info);
     }
     
-    void TrainBestDim(hrf::Tree& tree,
-                      const TrainingRows& training_rows)
+    // FindBestRandomSplit, but from a node's histograms rather than its rows
+    // (picks dimensions the same way, so it gives the same splits)
+    std::tuple<int, double, double> HistogramRandomSplit(const hrf::Tree& tree,
+                                                         const FeatureMatrix& training_rows,
+                                                         const NodeHistograms& histograms,
+                                                         LabelCounts& out_upper)
+    {
+        int local_dim_index;
+        SplitErrorCode error;
+        double expected_info, split;
+        const int MAX_TRIES = tree.ndim_ * 2;
+        int tries = 0;
+        
+        do {
+            local_dim_index = bkp::random::RandInt(tree.ndim_ - 1);
+            int global_dim_index = (*tree.target_features_)[local_dim_index];
+            std::tie(error, split, expected_info) =
+                BestHistogramSplit(training_rows.View<BinnedColumnView>(global_dim_index),
+                                   histograms.N(local_dim_index),
+                                   histograms.S(local_dim_index),
+                                   out_upper);
+        } while (error == SplitErrorCode::ZERO_WIDTH_DIM && (++tries) < MAX_TRIES);
+        
+        return std::make_tuple(local_dim_index, split, expected_info);
+    }
+    
+    typedef std::tuple<int, double, double> (*HistogramSplitFinder)(const hrf::Tree&,
+                                                                    const FeatureMatrix&,
+                                                                    const NodeHistograms&,
+                                                                    LabelCounts&);
+    
+    // TrainHelper for BINNED8_FEATURES. Each node is passed its histograms
+    // along with its rows, so finding its split doesn't need to look at the
+    // rows at all. After splitting, only the smaller child's rows are counted
+    // into new histograms; the larger child's are the parent's minus the
+    // smaller child's. Each level of the tree therefore scans at most half
+    // of its rows (the parent's histograms are reused for the larger child).
+    void HistogramTrainHelper(hrf::Tree& tree,
+                              const FeatureMatrix& training_rows,
+                              int* begin,
+                              int* end,
+                              int* scratch,
+                              LabelCounts counts,
+                              NodeHistograms&& histograms,
+                              HistogramSplitFinder split_finder,
+                              int max_depth,
+                              int min_pts,
+                              bkp::TaskPool* pool,
+                              int min_task_rows)
     {
+        const RowRange indices(begin, end);
+        RecordNode(indices.size());
+        int s_count = counts.s_;
+        int b_count = counts.b_;
+        
+        if (max_depth <= 0 ||
+            indices.size() <= static_cast<std::size_t>(min_pts) ||
+            s_count == 0 ||
+            b_count == 0)
+        {
+            TrainHelperLeaf(tree, s_count, b_count);
+            return;
+        }
+        
+        double split, expected_info;
+        int local_dim_index;
+        LabelCounts upper_counts;
+        std::tie(local_dim_index, split, expected_info) = split_finder(tree,
+                                                                       training_rows,
+                                                                       histograms,
+                                                                       upper_counts);
+        if (local_dim_index == -1 || std::isnan(split) || expected_info <= 0.0) {
+            TrainHelperLeaf(tree, s_count, b_count);
+            return;
+        }
+        int global_index = (*tree.target_features_)[local_dim_index];
+        
+        tree.Split(global_index, split);
+        if (tree.children_.size() == 0) { return; }
+        assert(tree.children_.size() == 2);
+        
+        int* middle = PartitionRows(training_rows.View<BinnedColumnView>(global_index),
+                                    split, begin, end, scratch);
+        const RowRange upper_indices(begin, middle);
+        const RowRange lower_indices(middle, end);
+        assert(upper_indices.size() == static_cast<std::size_t>(upper_counts.s_ + upper_counts.b_));
+        const LabelCounts lower_counts = LowerCounts(counts, upper_counts);
+        
+        // histograms becomes the larger child's
+        const bool upper_is_smaller = upper_indices.size() < lower_indices.size();
+        const RowRange smaller_indices = upper_is_smaller ? upper_indices : lower_indices;
+        NodeHistograms smaller_histograms(tree,
+                                          training_rows,
+                                          smaller_indices,
+                                          NodePool(pool, min_task_rows, smaller_indices.size()));
+        histograms.Subtract(smaller_histograms);
+        NodeHistograms& upper_histograms = upper_is_smaller ? smaller_histograms : histograms;
+        NodeHistograms& lower_histograms = upper_is_smaller ? histograms : smaller_histograms;
+        
+        auto train_upper = [&]() {
+            HistogramTrainHelper(tree.children_[0],
+                                 training_rows,
+                                 begin,
+                                 middle,
+                                 scratch,
+                                 upper_counts,
+                                 std::move(upper_histograms),
+                                 split_finder,
+                                 max_depth-1,
+                                 min_pts,
+                                 pool,
+                                 min_task_rows);
+        };
+        auto train_lower = [&]() {
+            HistogramTrainHelper(tree.children_[1],
+                                 training_rows,
+                                 middle,
+                                 end,
+                                 scratch + (middle - begin),
+                                 lower_counts,
+                                 std::move(lower_histograms),
+                                 split_finder,
+                                 max_depth-1,
+                                 min_pts,
+                                 pool,
+                                 min_task_rows);
+        };
+        TrainChildren(pool, min_task_rows, indices.size(), train_upper, train_lower);
+    }
+    
+    // Shared implementation of the TrainXDim functions: train tree with
+    // split_finder, or with histogram_split_finder for BINNED8_FEATURES.
+    // indices are the rows to train on (usually all of them), and become
+    // the tree's one index array.
+    void Train(hrf::Tree& tree,
+               const FeatureMatrix& training_rows,
+               RowIndices&& indices,
+               SplitFinder split_finder,
+               HistogramSplitFinder histogram_split_finder,
+               bkp::TaskPool* pool,
+               int min_task_rows)
+    {
+        // the scratch space PartitionRows needs to partition indices
+        RowIndices scratch(indices.size());
+        int* begin = indices.data();
+        int* end = indices.data() + indices.size();
+        
+        // the only label count taken from the rows; every other node's
+        // comes from its parent's split
+        const LabelCounts counts = CountLabels(training_rows, indices);
+        
+        if (training_rows.Storage() == BINNED8_FEATURES) {
+            HistogramTrainHelper(tree,
+                                 training_rows,
+                                 begin,
+                                 end,
+                                 scratch.data(),
+                                 counts,
+                                 NodeHistograms(tree,
+                                                training_rows,
+                                                indices,
+                                                NodePool(pool, min_task_rows, indices.size())),
+                                 histogram_split_finder,
+                                 DefaultMaxDepth(indices.size()),
+                                 DefaultMinPts(indices.size()),
+                                 pool,
+                                 min_task_rows);
+            return;
+        }
         TrainHelper(tree,
                     training_rows,
-                    FindBestSplitDim,
-                    DefaultMaxDepth(training_rows),
-                    DefaultMinPts(training_rows));
+                    begin,
+                    end,
+                    scratch.data(),
+                    counts,
+                    split_finder,
+                    DefaultMaxDepth(indices.size()),
+                    DefaultMinPts(indices.size()),
+                    pool,
+                    min_task_rows);
     }
     
-    void TrainRandDim(hrf::Tree& tree,
-                      const TrainingRows& training_rows)
+    // Start training a node that's just been created with n_rows rows: record
+    // it, and if it's too deep, small or pure to split, make it a leaf.
+    // Returns true if it's a leaf (the same test TrainHelper starts with).
+    bool StartNode(hrf::Tree& tree,
+                   std::size_t n_rows,
+                   LabelCounts counts,
+                   int max_depth,
+                   int min_pts)
     {
-        TrainHelper(tree,
+        RecordNode(n_rows);
+        if (max_depth <= 0 ||
+            n_rows <= static_cast<std::size_t>(min_pts) ||
+            counts.s_ == 0 ||
+            counts.b_ == 0)
+        {
+            TrainHelperLeaf(tree, counts.s_, counts.b_);
+            return true;
+        }
+        return false;
+    }
+    
+    // Sort every row of the viewed column by value into out (see
+    // FeatureOrders::Rows)
+    template<class TView>
+    void SortRows(const TView& view, std::size_t n_rows, int* out) {
+        std::iota(out, out + n_rows, 0);
+        std::stable_sort(out, out + n_rows, [&view](int a, int b) {
+            const typename TView::value_type val_a = view.data_[a];
+            const typename TView::value_type val_b = view.data_[b];
+            if (view.IsNan(val_a)) {
+                return !view.IsNan(val_b);
+            }
+            return !view.IsNan(val_b) && val_a < val_b;
+        });
+    }
+    
+    // The split between two neighbouring stored values of a column (lower <
+    // upper): halfway between them, or upper itself if no double is strictly
+    // between them, so that only upper is >= it
+    template<class TView>
+    double SplitBetween(const TView& view,
+                        typename TView::value_type lower,
+                        typename TView::value_type upper)
+    {
+        const double lower_val = view.Decode(lower);
+        const double upper_val = view.Decode(upper);
+        const double split = 0.5 * (lower_val + upper_val);
+        return (split > lower_val) ? split : upper_val;
+    }
+    
+    // bins come with their own splits, which the histogram search uses too
+    double SplitBetween(const BinnedColumnView& view,
+                        std::uint8_t, // lower: unused
+                        std::uint8_t upper)
+    {
+        return view.SplitBelow(upper);
+    }
+    
+    // FindBestSplit for a node whose rows are sorted by the viewed column (see
+    // TrainExact): sweep down through the rows from the largest value, moving
+    // each one above the split in turn, and try the split between every pair
+    // of neighbouring distinct values. Same return value as FindBestSplit, and
+    // sets out_upper to the label counts above the split.
+    template<class TView>
+    std::tuple<SplitErrorCode, double, double> BestSortedSplit(const TView& view,
+                                                               const unsigned char* is_signal,
+                                                               RowRange sorted_rows,
+                                                               LabelCounts node_counts,
+                                                               LabelCounts& out_upper)
+    {
+        typedef typename TView::value_type value_type;
+        
+        const std::size_t size = sorted_rows.size();
+        int s_count = node_counts.s_;
+        int b_count = node_counts.b_;
+        double total_entropy = CalcEntropy(s_count, b_count);
+        
+        bool any_splits = false;
+        double max_expected_info = 0.0;
+        double best_split = NaN;
+        
+        // once row i-1 has been moved, rows [i-1, size) are above the split,
+        // and everything else (including the NaNs, which sort first) is
+        // below it
+        int n_above = 0;
+        int s_above = 0;
+        for (std::size_t i=size; i>1; --i) {
+            const int row_index = sorted_rows[i - 1];
+            const value_type val = view.data_[row_index];
+            const value_type below = view.data_[sorted_rows[i - 2]];
+            ++n_above;
+            s_above += is_signal[row_index];
+            if (view.IsNan(below)) {
+                break; // so is everything further down
+            }
+            if (!(below < val)) {
+                continue; // equal values can't be split
+            }
+            any_splits = true;
+            
+            int b_above = n_above - s_above;
+            int s_below = s_count - s_above;
+            int b_below = b_count - b_above;
+            int n_below = s_below + b_below;
+            
+            double prob_above = static_cast<double>(n_above) / size;
+            double prob_below = static_cast<double>(n_below) / size;
+            
+            double entropy_above = CalcEntropy(s_above, b_above);
+            double entropy_below = CalcEntropy(s_below, b_below);
+            
+            double expected_info = total_entropy - ((prob_above*entropy_above) + (prob_below*entropy_below));
+            
+            if (expected_info > max_expected_info) {
+                max_expected_info = expected_info;
+                best_split = SplitBetween(view, below, val);
+                out_upper.s_ = s_above;
+                out_upper.b_ = b_above;
+            }
+        }
+        
+        if (!any_splits) { // all one value (or all NaN)
+            return std::make_tuple(SplitErrorCode::ZERO_WIDTH_DIM, NaN, 0.0);
+        }
+        return std::make_tuple(SplitErrorCode::NO_ERROR, best_split, max_expected_info);
+    }
+    
+    std::tuple<SplitErrorCode, double, double> FindBestSortedSplit(const FeatureMatrix& training_rows,
+                                                                   int global_dim_index,
+                                                                   RowRange sorted_rows,
+                                                                   LabelCounts node_counts,
+                                                                   LabelCounts& out_upper)
+    {
+        const unsigned char* is_signal = training_rows.IsSignal();
+        switch (training_rows.Storage()) {
+            case DOUBLE_FEATURES:
+                return BestSortedSplit(training_rows.View<DoubleColumnView>(global_dim_index),
+                                       is_signal, sorted_rows, node_counts, out_upper);
+            case FLOAT_FEATURES:
+                return BestSortedSplit(training_rows.View<FloatColumnView>(global_dim_index),
+                                       is_signal, sorted_rows, node_counts, out_upper);
+            case QUANTIZED16_FEATURES:
+                return BestSortedSplit(training_rows.View<QuantizedColumnView>(global_dim_index),
+                                       is_signal, sorted_rows, node_counts, out_upper);
+            case BINNED8_FEATURES:
+                return BestSortedSplit(training_rows.View<BinnedColumnView>(global_dim_index),
+                                       is_signal, sorted_rows, node_counts, out_upper);
+        }
+        return std::make_tuple(SplitErrorCode::NO_ERROR, NaN, 0.0); // unreachable
+    }
+    
+    // A node's rows, sorted by each of its tree's target_features_ (see
+    // TrainExact). Every dimension's order is a separate array of the same
+    // size, and the node's rows are the same subrange of each of them.
+    struct SortedNode {
+        int* begin_;         // the node's first row in local dimension 0's order
+        std::size_t size_;
+        std::size_t stride_; // from one dimension's order to the next
+        
+        int* Begin(int dim) const { return begin_ + dim * stride_; }
+        RowRange Rows(int dim) const { return RowRange(Begin(dim), Begin(dim) + size_); }
+    };
+    
+    // FindBestSplitDim, but from a node's sorted rows
+    std::tuple<int, double, double> SortedSplitDim(const hrf::Tree& tree,
+                                                   const FeatureMatrix& training_rows,
+                                                   const SortedNode& node,
+                                                   LabelCounts node_counts,
+                                                   LabelCounts& out_upper)
+    {
+        std::vector<std::tuple<SplitErrorCode, double, double>> dim_results(tree.ndim_);
+        std::vector<LabelCounts> dim_uppers(tree.ndim_);
+        for (int dim=0; dim<tree.ndim_; ++dim) {
+            int global_dim = (*tree.target_features_)[dim];
+            dim_results[dim] = FindBestSortedSplit(training_rows,
+                                                   global_dim,
+                                                   node.Rows(dim),
+                                                   node_counts,
+                                                   dim_uppers[dim]);
+        }
+        return BestDimSplit(dim_results, dim_uppers, out_upper);
+    }
+    
+    // FindBestRandomSplit, but from a node's sorted rows (picks dimensions
+    // the same way)
+    std::tuple<int, double, double> SortedRandomSplit(const hrf::Tree& tree,
+                                                      const FeatureMatrix& training_rows,
+                                                      const SortedNode& node,
+                                                      LabelCounts node_counts,
+                                                      LabelCounts& out_upper)
+    {
+        int local_dim_index;
+        SplitErrorCode error;
+        double expected_info, split;
+        const int MAX_TRIES = tree.ndim_ * 2;
+        int tries = 0;
+        
+        do {
+            local_dim_index = bkp::random::RandInt(tree.ndim_ - 1);
+            int global_dim_index = (*tree.target_features_)[local_dim_index];
+            std::tie(error, split, expected_info) = FindBestSortedSplit(training_rows,
+                                                                        global_dim_index,
+                                                                        node.Rows(local_dim_index),
+                                                                        node_counts,
+                                                                        out_upper);
+        } while (error == SplitErrorCode::ZERO_WIDTH_DIM && (++tries) < MAX_TRIES);
+        
+        return std::make_tuple(local_dim_index, split, expected_info);
+    }
+    
+    typedef std::tuple<int, double, double> (*SortedSplitFinder)(const hrf::Tree&,
+                                                                 const FeatureMatrix&,
+                                                                 const SortedNode&,
+                                                                 LabelCounts,
+                                                                 LabelCounts&);
+    
+    // PartitionRows each of node's dimensions in turn (stably, so each side
+    // stays sorted), and return how many rows are above the split
+    template<class TView>
+    std::size_t PartitionSortedNode(const TView& view,
+                                    double split,
+                                    int ndim,
+                                    const SortedNode& node,
+                                    int* scratch)
+    {
+        std::size_t n_upper = 0;
+        for (int dim=0; dim<ndim; ++dim) {
+            int* begin = node.Begin(dim);
+            n_upper = PartitionRows(view, split, begin, begin + node.size_, scratch) - begin;
+        }
+        return n_upper;
+    }
+    
+    // TrainHelper for the exact split search: node's rows are sorted by every
+    // one of tree's dimensions, and are partitioned between its children in
+    // each of them. scratch has room for the root's rows (it's only used by
+    // PartitionRows, one node at a time).
+    void ExactTrainHelper(hrf::Tree& tree,
+                          const FeatureMatrix& training_rows,
+                          const SortedNode& node,
+                          int* scratch,
+                          LabelCounts counts,
+                          SortedSplitFinder split_finder,
+                          int max_depth,
+                          int min_pts)
+    {
+        if (StartNode(tree, node.size_, counts, max_depth, min_pts)) {
+            return;
+        }
+        
+        double split, expected_info;
+        int local_dim_index;
+        LabelCounts upper_counts;
+        std::tie(local_dim_index, split, expected_info) = split_finder(tree,
+                                                                       training_rows,
+                                                                       node,
+                                                                       counts,
+                                                                       upper_counts);
+        if (local_dim_index == -1 || std::isnan(split) || expected_info <= 0.0) {
+            TrainHelperLeaf(tree, counts.s_, counts.b_);
+            return;
+        }
+        int global_index = (*tree.target_features_)[local_dim_index];
+        
+        tree.Split(global_index, split);
+        if (tree.children_.size() == 0) { return; }
+        assert(tree.children_.size() == 2);
+        
+        std::size_t n_upper = 0;
+        switch (training_rows.Storage()) {
+            case DOUBLE_FEATURES:
+                n_upper = PartitionSortedNode(training_rows.View<DoubleColumnView>(global_index),
+                                              split, tree.ndim_, node, scratch);
+                break;
+            case FLOAT_FEATURES:
+                n_upper = PartitionSortedNode(training_rows.View<FloatColumnView>(global_index),
+                                              split, tree.ndim_, node, scratch);
+                break;
+            case QUANTIZED16_FEATURES:
+                n_upper = PartitionSortedNode(training_rows.View<QuantizedColumnView>(global_index),
+                                              split, tree.ndim_, node, scratch);
+                break;
+            case BINNED8_FEATURES:
+                n_upper = PartitionSortedNode(training_rows.View<BinnedColumnView>(global_index),
+                                              split, tree.ndim_, node, scratch);
+                break;
+        }
+        assert(n_upper == static_cast<std::size_t>(upper_counts.s_ + upper_counts.b_));
+        const LabelCounts lower_counts = LowerCounts(counts, upper_counts);
+        stats_label_rows_saved += node.size_;
+        
+        const SortedNode upper_node = { node.begin_, n_upper, node.stride_ };
+        const SortedNode lower_node = { node.begin_ + n_upper, node.size_ - n_upper, node.stride_ };
+        ExactTrainHelper(tree.children_[0],
+                         training_rows,
+                         upper_node,
+                         scratch,
+                         upper_counts,
+                         split_finder,
+                         max_depth-1,
+                         min_pts);
+        ExactTrainHelper(tree.children_[1],
+                         training_rows,
+                         lower_node,
+                         scratch,
+                         lower_counts,
+                         split_finder,
+                         max_depth-1,
+                         min_pts);
+    }
+    
+    // Shared implementation of the TrainXDimExact functions
+    void TrainExact(hrf::Tree& tree,
+                    const FeatureMatrix& training_rows,
+                    const FeatureOrders& orders,
+                    SortedSplitFinder split_finder)
+    {
+        assert(orders.size() == training_rows.size());
+        const std::size_t n_rows = training_rows.size();
+        
+        // this tree's own copy of its dimensions' orders, for
+        // ExactTrainHelper to partition
+        RowIndices sorted_rows(tree.ndim_ * n_rows);
+        for (int dim=0; dim<tree.ndim_; ++dim) {
+            const RowRange dim_rows = orders.Rows((*tree.target_features_)[dim]);
+            std::copy(dim_rows.begin(), dim_rows.end(), sorted_rows.begin() + dim * n_rows);
+        }
+        RowIndices scratch(n_rows);
+        const SortedNode root = { sorted_rows.data(), n_rows, n_rows };
+        
+        ExactTrainHelper(tree,
+                         training_rows,
+                         root,
+                         scratch.data(),
+                         CountLabels(training_rows, root.Rows(0)),
+                         split_finder,
+                         DefaultMaxDepth(n_rows),
+                         DefaultMinPts(n_rows));
+    }
+    
+    // A node on the frontier of a batch of trees being trained level by
+    // level (see TrainBatch)
+    struct FrontierNode {
+        hrf::Tree* tree_;
+        std::size_t n_rows_;
+        LabelCounts counts_;
+        int max_depth_;
+        
+        // false for a leaf that's only on the frontier so that its
+        // histograms can be subtracted from its sibling's
+        bool trainable_;
+        
+        // If sibling_ is -1, histograms_ start empty and the node's rows
+        // are counted into them. Otherwise they start as the parent's, and
+        // the histograms of frontier node sibling_ are subtracted from them
+        // once the rows have been counted.
+        NodeHistograms histograms_;
+        int sibling_;
+        
+        // The node's rows, in increasing order, once the level's pass has
+        // routed them to it. Only trainable nodes keep them, and a root
+        // doesn't either: all_rows_ says that it has every training row.
+        RowIndices rows_;
+        bool all_rows_;
+        
+        FrontierNode(hrf::Tree* tree,
+                     std::size_t n_rows,
+                     LabelCounts counts,
+                     int max_depth,
+                     bool trainable,
+                     NodeHistograms&& histograms,
+                     int sibling,
+                     bool all_rows) :
+        tree_(tree),
+        n_rows_(n_rows),
+        counts_(counts),
+        max_depth_(max_depth),
+        trainable_(trainable),
+        histograms_(std::move(histograms)),
+        sibling_(sibling),
+        rows_(),
+        all_rows_(all_rows)
+        { }
+    };
+    
+    // How the rows of a node on the last level get to its children on the
+    // frontier: the ones whose code in column feature_ is >= threshold_ go
+    // to the upper child, and the rest to the lower one. As in
+    // HistogramTrainHelper, only the smaller child's rows are counted; the
+    // larger child's histograms come from subtraction, and its rows are
+    // written over the parent's as they're read, so they're never copied.
+    // smaller_ and larger_ are the children's indices on the frontier;
+    // larger_ is -1 if the larger child is a leaf that's not on it (so its
+    // rows are dropped).
+    //
+    // A root is "split" off a parent with every row and a threshold_ of 0,
+    // so that every row is routed to (and counted into) it.
+    struct NodeSplit {
+        // the parent's n_rows_ rows in increasing order, unless all_rows_
+        // (in which case rows_ just has room for the larger child's, plus
+        // one spare for RouteRows to write to)
+        RowIndices rows_;
+        bool all_rows_;
+        std::size_t n_rows_;
+        
+        int feature_;
+        std::uint32_t threshold_;
+        bool smaller_is_upper_;
+        int smaller_;
+        int larger_;
+        bool keep_smaller_rows_;
+        
+        // How far the level's pass has got: the parent's first next_ rows
+        // have been routed, and n_larger_ of them went to the larger child
+        // (so are in rows_[0, n_larger_)).
+        std::size_t next_;
+        std::size_t n_larger_;
+        
+        // Whether any of the parent's rows before end_row are still to be
+        // routed
+        bool HasRowsBefore(std::size_t end_row) const {
+            if (next_ == n_rows_) {
+                return false;
+            }
+            return all_rows_ ? next_ < end_row : static_cast<std::size_t>(rows_[next_]) < end_row;
+        }
+    };
+    
+    // Put each of trees' roots on the frontier, with the NodeSplit that
+    // routes every row to it, unless the root is a leaf already
+    void StartFrontier(const std::vector<hrf::Tree*>& trees,
+                       std::size_t n_rows,
+                       LabelCounts root_counts,
+                       int max_depth,
+                       int min_pts,
+                       std::vector<FrontierNode>& frontier,
+                       std::vector<NodeSplit>& splits)
+    {
+        for (hrf::Tree* tree : trees) {
+            if (StartNode(*tree, n_rows, root_counts, max_depth, min_pts)) {
+                continue;
+            }
+            NodeSplit split;
+            split.all_rows_ = true;
+            split.n_rows_ = n_rows;
+            split.feature_ = (*tree->target_features_)[0];
+            split.threshold_ = 0;
+            split.smaller_is_upper_ = true;
+            split.smaller_ = static_cast<int>(frontier.size());
+            split.larger_ = -1;
+            split.keep_smaller_rows_ = false;
+            split.next_ = 0;
+            split.n_larger_ = 0;
+            splits.push_back(std::move(split));
+            
+            frontier.push_back(FrontierNode(tree,
+                                            n_rows,
+                                            root_counts,
+                                            max_depth,
+                                            true,
+                                            NodeHistograms(*tree),
+                                            -1,
+                                            true));
+        }
+    }
+    
+    // RouteAndCountRows's loop over one split's parent's rows: route the
+    // parent's rows [split.next_, end), which are in the range of the
+    // training set that starts at first_row and that column is part of. The
+    // smaller child's rows go in smaller_rows (relative to first_row).
+    template<bool ALL_ROWS>
+    void RouteRows(NodeSplit& split,
+                   std::size_t end,
+                   const std::uint8_t* column,
+                   int first_row,
+                   RowIndices& smaller_rows)
+    {
+        smaller_rows.resize(end - split.next_);
+        int* smaller_end = smaller_rows.data();
+        
+        // a leaf's rows are all written to the same dummy int instead
+        int dummy;
+        const bool keep_larger = (split.larger_ != -1);
+        int* larger_begin = keep_larger ? split.rows_.data() : &dummy;
+        std::size_t n_larger = split.n_larger_;
+        
+        const std::uint32_t threshold = split.threshold_;
+        const bool smaller_is_upper = split.smaller_is_upper_;
+        const int* parent_rows = split.rows_.data();
+        for (std::size_t i=split.next_; i<end; ++i) {
+            // branch-free, as in PartitionRows (n_larger never passes i, so
+            // this can't overwrite an unread row)
+            const int row = ALL_ROWS ? static_cast<int>(i) : parent_rows[i];
+            const bool is_smaller = ((column[row - first_row] >= threshold) == smaller_is_upper);
+            *smaller_end = row - first_row;
+            larger_begin[n_larger] = row;
+            smaller_end += is_smaller;
+            n_larger += !is_smaller && keep_larger;
+        }
+        smaller_rows.resize(smaller_end - smaller_rows.data());
+        split.next_ = end;
+        split.n_larger_ = n_larger;
+    }
+    
+    // Part of the pass over the training rows that each level of TrainBatch
+    // takes: route the training set's rows [first_row, first_row +
+    // rows.size()), which are rows' rows 0, 1, ..., through each of splits,
+    // and count the ones that go to a smaller child into its histograms.
+    // Each split reads its parent's rows in order, so a level's calls must
+    // cover the training set's rows in order. scratch is just reused memory.
+    void RouteAndCountRows(const FeatureMatrix& rows,
+                           std::size_t first_row,
+                           std::vector<NodeSplit>& splits,
+                           std::vector<FrontierNode>& frontier,
+                           RowIndices& scratch)
+    {
+        const std::size_t end_row = first_row + rows.size();
+        for (NodeSplit& split : splits) {
+            const std::uint8_t* column = rows.View<BinnedColumnView>(split.feature_).data_;
+            
+            // the smaller child's rows go in scratch (as rows' indices), for
+            // counting a column at a time, like any other node's
+            if (split.all_rows_) {
+                RouteRows<true>(split, std::min(end_row, split.n_rows_), column, static_cast<int>(first_row), scratch);
+            }
+            else {
+                const std::size_t end = std::lower_bound(split.rows_.begin() + split.next_,
+                                                         split.rows_.begin() + split.n_rows_,
+                                                         static_cast<int>(end_row)) - split.rows_.begin();
+                RouteRows<false>(split, end, column, static_cast<int>(first_row), scratch);
+            }
+            
+            FrontierNode& smaller = frontier[split.smaller_];
+            const hrf::Tree& tree = *smaller.tree_;
+            for (int dim=0; dim<tree.ndim_; ++dim) {
+                BuildHistogram(rows.View<BinnedColumnView>((*tree.target_features_)[dim]),
+                               rows.IsSignal(),
+                               scratch,
+                               smaller.histograms_.N(dim),
+                               smaller.histograms_.S(dim));
+            }
+            if (split.keep_smaller_rows_) {
+                for (int chunk_row : scratch) {
+                    smaller.rows_.push_back(chunk_row + static_cast<int>(first_row));
+                }
+            }
+        }
+    }
+    
+    // Once RouteAndCountRows has seen every row: give each larger child the
+    // rows that were written over its parent's, and subtract its sibling's
+    // histograms from its parent's
+    void FinishLevel(std::vector<NodeSplit>& splits,
+                     std::vector<FrontierNode>& frontier)
+    {
+        for (NodeSplit& split : splits) {
+            assert(split.next_ == split.n_rows_);
+            assert(!split.keep_smaller_rows_ || frontier[split.smaller_].rows_.size() == frontier[split.smaller_].n_rows_);
+            if (split.larger_ == -1) {
+                continue;
+            }
+            FrontierNode& larger = frontier[split.larger_];
+            assert(split.n_larger_ == larger.n_rows_);
+            split.rows_.resize(split.n_larger_);
+            if (split.rows_.size() < split.rows_.capacity() / 2) {
+                split.rows_.shrink_to_fit();
+            }
+            larger.rows_ = std::move(split.rows_);
+        }
+        splits.clear();
+        
+        for (FrontierNode& node : frontier) {
+            if (node.sibling_ != -1) {
+                node.histograms_.Subtract(frontier[node.sibling_].histograms_);
+            }
+        }
+    }
+    
+    // Split a frontier node whose histograms are complete, the same way
+    // HistogramTrainHelper would. Its children go on next_frontier if they
+    // still need training, or if their histograms are needed for their
+    // sibling's, and the NodeSplit that routes the node's rows to them goes
+    // on next_splits (taking the node's rows).
+    void SplitFrontierNode(const FeatureMatrix& training_rows,
+                           HistogramSplitFinder split_finder,
+                           int min_pts,
+                           FrontierNode& node,
+                           std::vector<FrontierNode>& next_frontier,
+                           std::vector<NodeSplit>& next_splits)
+    {
+        if (!node.trainable_) {
+            return;
+        }
+        hrf::Tree& tree = *node.tree_;
+        
+        double split, expected_info;
+        int local_dim_index;
+        LabelCounts upper_counts;
+        std::tie(local_dim_index, split, expected_info) = split_finder(tree,
+                                                                       training_rows,
+                                                                       node.histograms_,
+                                                                       upper_counts);
+        if (local_dim_index == -1 || std::isnan(split) || expected_info <= 0.0) {
+            TrainHelperLeaf(tree, node.counts_.s_, node.counts_.b_);
+            return;
+        }
+        int global_index = (*tree.target_features_)[local_dim_index];
+        
+        tree.Split(global_index, split);
+        if (tree.children_.size() == 0) { return; }
+        assert(tree.children_.size() == 2);
+        
+        const LabelCounts lower_counts = LowerCounts(node.counts_, upper_counts);
+        const std::size_t n_upper = upper_counts.s_ + upper_counts.b_;
+        const std::size_t n_lower = node.n_rows_ - n_upper;
+        const bool upper_is_leaf = StartNode(tree.children_[0], n_upper, upper_counts, node.max_depth_-1, min_pts);
+        const bool lower_is_leaf = StartNode(tree.children_[1], n_lower, lower_counts, node.max_depth_-1, min_pts);
+        if (upper_is_leaf && lower_is_leaf) {
+            return;
+        }
+        
+        // As in HistogramTrainHelper, the smaller child's rows are counted
+        // and the larger child gets the parent's histograms minus the
+        // smaller child's. If the larger child is a leaf it doesn't need
+        // any histograms (and isn't added).
+        const bool upper_is_smaller = n_upper < n_lower;
+        const std::size_t n_smaller = upper_is_smaller ? n_upper : n_lower;
+        const std::size_t n_larger = upper_is_smaller ? n_lower : n_upper;
+        const bool smaller_is_leaf = upper_is_smaller ? upper_is_leaf : lower_is_leaf;
+        const bool larger_is_leaf = upper_is_smaller ? lower_is_leaf : upper_is_leaf;
+        hrf::Tree* smaller = &tree.children_[upper_is_smaller ? 0 : 1];
+        hrf::Tree* larger = &tree.children_[upper_is_smaller ? 1 : 0];
+        
+        NodeSplit route;
+        route.rows_ = std::move(node.rows_);
+        route.all_rows_ = node.all_rows_;
+        route.n_rows_ = node.n_rows_;
+        route.feature_ = global_index;
+        route.threshold_ = training_rows.View<BinnedColumnView>(global_index).Threshold(split);
+        route.smaller_is_upper_ = upper_is_smaller;
+        route.smaller_ = static_cast<int>(next_frontier.size());
+        route.larger_ = -1;
+        route.keep_smaller_rows_ = !smaller_is_leaf;
+        route.next_ = 0;
+        route.n_larger_ = 0;
+        
+        next_frontier.push_back(FrontierNode(smaller,
+                                             n_smaller,
+                                             upper_is_smaller ? upper_counts : lower_counts,
+                                             node.max_depth_-1,
+                                             !smaller_is_leaf,
+                                             NodeHistograms(*smaller),
+                                             -1,
+                                             false));
+        if (!smaller_is_leaf) {
+            next_frontier.back().rows_.reserve(n_smaller);
+        }
+        if (!larger_is_leaf) {
+            route.larger_ = static_cast<int>(next_frontier.size());
+            if (route.all_rows_) {
+                route.rows_.resize(n_larger + 1);
+            }
+            next_frontier.push_back(FrontierNode(larger,
+                                                 n_larger,
+                                                 upper_is_smaller ? lower_counts : upper_counts,
+                                                 node.max_depth_-1,
+                                                 true,
+                                                 std::move(node.histograms_),
+                                                 route.smaller_,
+                                                 false));
+        }
+        next_splits.push_back(std::move(route));
+    }
+    
+    // Makes a level's pass over the training rows for TrainLevels: calls
+    // RouteAndCountRows on the given splits and frontier for every row, a
+    // range of rows at a time, in order (skipping ranges none of the splits
+    // has rows in, if it likes). Returns false if the rows couldn't be read.
+    typedef std::function<bool(std::vector<NodeSplit>&, std::vector<FrontierNode>&)> LevelPassFn;
+    
+    // Shared level loop of TrainBatch and TrainStreamed: train trees one
+    // level at a time, with split_finder searching the histograms that
+    // level_pass counts. training_rows only needs the bins of the rows (it
+    // may have no rows at all). Returns false as soon as a pass fails.
+    bool TrainLevels(const std::vector<hrf::Tree*>& trees,
+                     const FeatureMatrix& training_rows,
+                     std::size_t n_rows,
+                     LabelCounts root_counts,
+                     HistogramSplitFinder split_finder,
+                     const LevelPassFn& level_pass)
+    {
+        const int min_pts = DefaultMinPts(n_rows);
+        std::vector<FrontierNode> frontier;
+        std::vector<NodeSplit> splits;
+        StartFrontier(trees, n_rows, root_counts, DefaultMaxDepth(n_rows), min_pts, frontier, splits);
+        
+        while (!frontier.empty()) {
+            if (!level_pass(splits, frontier)) {
+                return false;
+            }
+            FinishLevel(splits, frontier);
+            
+            std::vector<FrontierNode> next_frontier;
+            for (FrontierNode& node : frontier) {
+                SplitFrontierNode(training_rows,
+                                  split_finder,
+                                  min_pts,
+                                  node,
+                                  next_frontier,
+                                  splits);
+            }
+            frontier = std::move(next_frontier);
+        }
+        return true;
+    }
+    
+    // Shared implementation of the TrainXDimBatch functions: train every tree
+    // in trees with split_finder, or level by level with
+    // histogram_split_finder for BINNED8_FEATURES
+    void TrainBatch(const std::vector<hrf::Tree*>& trees,
+                    const FeatureMatrix& training_rows,
+                    SplitFinder split_finder,
+                    HistogramSplitFinder histogram_split_finder)
+    {
+        if (training_rows.Storage() != BINNED8_FEATURES) {
+            for (hrf::Tree* tree : trees) {
+                Train(*tree, training_rows, AllRows(training_rows), split_finder, histogram_split_finder, nullptr, 0);
+            }
+            return;
+        }
+        
+        // every row is in memory, so each pass is a single range
+        RowIndices scratch;
+        TrainLevels(trees,
                     training_rows,
-                    FindBestRandomSplit,
-                    DefaultMaxDepth(training_rows),
-                    DefaultMinPts(training_rows));
+                    training_rows.size(),
+                    CountLabels(training_rows, AllRows(training_rows)),
+                    histogram_split_finder,
+                    [&](std::vector<NodeSplit>& splits, std::vector<FrontierNode>& frontier) {
+                        RouteAndCountRows(training_rows, 0, splits, frontier, scratch);
+                        return true;
+                    });
+    }
+    
+    // Shared implementation of the TrainXDimStreamed functions: TrainBatch,
+    // except that each level's pass over the rows reads them a chunk at a
+    // time. A chunk none of whose rows are still routed anywhere isn't read.
+    // Returns false as soon as a chunk can't be read.
+    bool TrainStreamed(const std::vector<hrf::Tree*>& trees,
+                       StreamedTrainingSet& training_rows,
+                       HistogramSplitFinder split_finder)
+    {
+        if (trees.empty()) {
+            return true;
+        }
+        
+        // every column the batch reads, which is all a chunk needs to hold
+        std::vector<int> features;
+        for (hrf::Tree* tree : trees) {
+            features.insert(features.end(), tree->target_features_->begin(), tree->target_features_->end());
+        }
+        std::sort(features.begin(), features.end());
+        features.erase(std::unique(features.begin(), features.end()), features.end());
+        
+        // the root's label counts take a pass of their own (over just the
+        // labels)
+        FeatureMatrix chunk;
+        LabelCounts root_counts = { 0, 0 };
+        for (std::size_t c=0; c<training_rows.NumChunks(); ++c) {
+            if (!training_rows.LoadChunk(c, std::vector<int>(), chunk)) {
+                return false;
+            }
+            const LabelCounts chunk_counts = CountLabels(chunk, AllRows(chunk));
+            root_counts.s_ += chunk_counts.s_;
+            root_counts.b_ += chunk_counts.b_;
+        }
+        
+        // the split finders only need the bins, not the rows
+        RowIndices scratch;
+        return TrainLevels(trees,
+                           training_rows.Encoding(),
+                           training_rows.size(),
+                           root_counts,
+                           split_finder,
+                           [&](std::vector<NodeSplit>& splits, std::vector<FrontierNode>& frontier) {
+                               for (std::size_t c=0; c<training_rows.NumChunks(); ++c) {
+                                   const std::size_t chunk_end = training_rows.ChunkEnd(c);
+                                   bool is_needed = false;
+                                   for (const NodeSplit& split : splits) {
+                                       is_needed = is_needed || split.HasRowsBefore(chunk_end);
+                                   }
+                                   if (!is_needed) {
+                                       continue;
+                                   }
+                                   if (!training_rows.LoadChunk(c, features, chunk)) {
+                                       return false;
+                                   }
+                                   RouteAndCountRows(chunk, training_rows.ChunkBegin(c), splits, frontier, scratch);
+                               }
+                               return true;
+                           });
+    }
+    
+    void TrainBestDim(hrf::Tree& tree,
+                      const FeatureMatrix& training_rows)
+    {
+        Train(tree, training_rows, AllRows(training_rows), FindBestSplitDim, HistogramSplitDim, nullptr, 0);
+    }
+    
+    void TrainRandDim(hrf::Tree& tree,
+                      const FeatureMatrix& training_rows)
+    {
+        Train(tree, training_rows, AllRows(training_rows), FindBestRandomSplit, HistogramRandomSplit, nullptr, 0);
+    }
+    
+    void TrainBestDimParallel(hrf::Tree& tree,
+                              const FeatureMatrix& training_rows,
+                              bkp::TaskPool& pool,
+                              int min_task_rows)
+    {
+        Train(tree, training_rows, AllRows(training_rows), FindBestSplitDim, HistogramSplitDim, &pool, min_task_rows);
+    }
+    
+    void TrainRandDimParallel(hrf::Tree& tree,
+                              const FeatureMatrix& training_rows,
+                              bkp::TaskPool& pool,
+                              int min_task_rows)
+    {
+        Train(tree, training_rows, AllRows(training_rows), FindBestRandomSplit, HistogramRandomSplit, &pool, min_task_rows);
+    }
+    
+    void TrainBestDimSample(hrf::Tree& tree,
+                            const FeatureMatrix& training_rows,
+                            RowIndices sample)
+    {
+        assert(std::is_sorted(sample.begin(), sample.end()));
+        Train(tree, training_rows, std::move(sample), FindBestSplitDim, HistogramSplitDim, nullptr, 0);
+    }
+    
+    void TrainRandDimSample(hrf::Tree& tree,
+                            const FeatureMatrix& training_rows,
+                            RowIndices sample)
+    {
+        assert(std::is_sorted(sample.begin(), sample.end()));
+        Train(tree, training_rows, std::move(sample), FindBestRandomSplit, HistogramRandomSplit, nullptr, 0);
+    }
+    
+    FeatureOrders::FeatureOrders(const FeatureMatrix& training_rows) :
+    n_rows_(training_rows.size()),
+    rows_(FeatureMatrix::NUM_FEATURES * training_rows.size())
+    {
+        for (int feature=0; feature<FeatureMatrix::NUM_FEATURES; ++feature) {
+            int* out = rows_.data() + feature * n_rows_;
+            switch (training_rows.Storage()) {
+                case DOUBLE_FEATURES:
+                    SortRows(training_rows.View<DoubleColumnView>(feature), n_rows_, out);
+                    break;
+                case FLOAT_FEATURES:
+                    SortRows(training_rows.View<FloatColumnView>(feature), n_rows_, out);
+                    break;
+                case QUANTIZED16_FEATURES:
+                    SortRows(training_rows.View<QuantizedColumnView>(feature), n_rows_, out);
+                    break;
+                case BINNED8_FEATURES:
+                    SortRows(training_rows.View<BinnedColumnView>(feature), n_rows_, out);
+                    break;
+            }
+        }
+    }
+    
+    RowRange FeatureOrders::Rows(int feature) const {
+        assert(feature >= 0 && feature < FeatureMatrix::NUM_FEATURES);
+        const int* begin = rows_.data() + feature * n_rows_;
+        return RowRange(begin, begin + n_rows_);
+    }
+    
+    void TrainBestDimExact(hrf::Tree& tree,
+                           const FeatureMatrix& training_rows,
+                           const FeatureOrders& orders)
+    {
+        TrainExact(tree, training_rows, orders, SortedSplitDim);
+    }
+    
+    void TrainRandDimExact(hrf::Tree& tree,
+                           const FeatureMatrix& training_rows,
+                           const FeatureOrders& orders)
+    {
+        TrainExact(tree, training_rows, orders, SortedRandomSplit);
+    }
+    
+    void TrainBestDimBatch(const std::vector<hrf::Tree*>& trees,
+                           const FeatureMatrix& training_rows)
+    {
+        TrainBatch(trees, training_rows, FindBestSplitDim, HistogramSplitDim);
+    }
+    
+    void TrainRandDimBatch(const std::vector<hrf::Tree*>& trees,
+                           const FeatureMatrix& training_rows)
+    {
+        TrainBatch(trees, training_rows, FindBestRandomSplit, HistogramRandomSplit);
+    }
+    
+    bool TrainBestDimStreamed(const std::vector<hrf::Tree*>& trees,
+                              StreamedTrainingSet& training_rows)
+    {
+        return TrainStreamed(trees, training_rows, HistogramSplitDim);
+    }
+    
+    bool TrainRandDimStreamed(const std::vector<hrf::Tree*>& trees,
+                              StreamedTrainingSet& training_rows)
+    {
+        return TrainStreamed(trees, training_rows, HistogramRandomSplit);
+    }
+    
+    TrainStats GetTrainStats() {
+        TrainStats result;
+        result.nodes_ = stats_nodes;
+        result.node_rows_ = stats_node_rows;
+        result.label_rows_saved_ = stats_label_rows_saved;
+        return result;
+    }
+    
+    void ResetTrainStats() {
+        stats_nodes = 0;
+        stats_node_rows = 0;
+        stats_label_rows_saved = 0;
     }
 }
 }
\ No newline at end of file
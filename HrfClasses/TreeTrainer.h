@@ -10,17 +10,68 @@
 #define __RandomForest____TreeTrainer__
 
 #include <vector>
+#include <functional>
+#include <tuple>
+
 #include "Tree.h"
+#include "FeatureMatrix.h"
+#include "StreamedTrainingSet.h"
+#include "TaskPool.h"
 
 namespace hrf {
     
 // Namespace containing collection of methods implementing Tree-training algorithms.
+//
+// All of these work on a FeatureMatrix (column-major copy of the training
+// rows), so that scanning one feature over many rows reads memory
+// sequentially. A FeatureMatrix can be implicitly constructed from
+// TrainingRows, so it's still possible to pass rows directly, but that
+// copies the rows on every call; callers that train many trees on the same
+// data (e.g. TreeCreator) should build the FeatureMatrix once.
 namespace trainer {
     
     double CalcEntropy(int count_a, int count_b);
     
     typedef bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> TrainingRows;
-    typedef std::function<void(hrf::Tree&, const TrainingRows&)> TrainerFn;
+    typedef std::function<void(hrf::Tree&, const FeatureMatrix&)> TrainerFn;
+    
+    // The training points that fall inside a single Tree node, as row indices
+    // into a FeatureMatrix (in increasing order)
+    typedef std::vector<int> RowIndices;
+    
+    // A read-only view of a node's row indices: a [begin, end) range of ints,
+    // which is all the split-finding functions need. While training, every
+    // node's range is part of a single index array for the whole tree (see
+    // TrainHelper), so nodes don't need their own copies. A RowIndices
+    // converts to a RowRange implicitly (the RowIndices must outlive it).
+    class RowRange {
+    private:
+        const int* begin_;
+        const int* end_;
+        
+    public:
+        RowRange(const int* begin, const int* end) :
+        begin_(begin),
+        end_(end)
+        { }
+        
+        RowRange(const RowIndices& indices) :
+        begin_(indices.data()),
+        end_(indices.data() + indices.size())
+        { }
+        
+        const int* begin() const { return begin_; }
+        const int* end() const { return end_; }
+        std::size_t size() const { return end_ - begin_; }
+        int operator[](std::size_t i) const { return begin_[i]; }
+    };
+    
+    // The number of signal and background rows in a node (or on one side of
+    // a split)
+    struct LabelCounts {
+        int s_;
+        int b_;
+    };
     
     // Various error codes that can be returned from the various
     // split methods
@@ -29,6 +80,9 @@ namespace trainer {
         ZERO_WIDTH_DIM // signifies that dim_max-dim_min==0.0
     };
     
+    // Number of random split points FindBestSplit tries on a dimension
+    const int DEFAULT_N_SPLITS = 5;
+    
     // FindBestSplitDim searches all of target_features_ for the best point on the
     // best dimension to split on (reduces entropy the most). FindBestRandomSplit
     // returns a similar result (drop-in replacement) but simply chooses a dimension
@@ -39,14 +93,35 @@ namespace trainer {
     // These are not intended to be used directly, instead it is probably easier to
     // use the TrainXDim methods which will call these repeatedly/recursively. These
     // are mostly exposed for unit testing purposes.
-    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree, const TrainingRows& training_rows);
-    std::tuple<int, double, double> FindBestRandomSplit(const hrf::Tree& tree, const TrainingRows& training_rows);
-    std::tuple<SplitErrorCode, double, double> FindBestSplit(const TrainingRows& training_rows, int global_dim_index, int n_splits=5);
+    //
+    // The versions that take a RowRange only consider those rows of
+    // training_rows; the others consider every row.
+    //
+    // If training_rows uses BINNED8_FEATURES, FindBestSplit ignores n_splits and
+    // does a histogram search instead: it counts the signal and background rows
+    // in each bin, and tries every boundary between two bins as a split. The
+    // TrainXDim methods then also keep each node's histograms as they recurse,
+    // so that a child's histograms are either counted from its rows or (for
+    // the larger child) computed as its parent's minus its sibling's.
+    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree,
+                                                     const FeatureMatrix& training_rows,
+                                                     RowRange indices);
+    std::tuple<int, double, double> FindBestRandomSplit(const hrf::Tree& tree,
+                                                        const FeatureMatrix& training_rows,
+                                                        RowRange indices);
+    std::tuple<SplitErrorCode, double, double> FindBestSplit(const FeatureMatrix& training_rows,
+                                                             RowRange indices,
+                                                             int global_dim_index,
+                                                             int n_splits=DEFAULT_N_SPLITS);
+    
+    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree, const FeatureMatrix& training_rows);
+    std::tuple<int, double, double> FindBestRandomSplit(const hrf::Tree& tree, const FeatureMatrix& training_rows);
+    std::tuple<SplitErrorCode, double, double> FindBestSplit(const FeatureMatrix& training_rows, int global_dim_index, int n_splits=DEFAULT_N_SPLITS);
     
     // Train the passed tree by recursively splitting the tree into child Trees.
     // This algorithm will search each dimension in the Tree's target_features_ for
     // the best (highest expected information) split in any dimension.
-    void TrainBestDim(hrf::Tree& tree, const TrainingRows& training_rows);
+    void TrainBestDim(hrf::Tree& tree, const FeatureMatrix& training_rows);
     
     // Train the passed tree by recursively splitting the tree into child Trees.
     // This algorithm will pick a random dimension from the Tree's target_features_
@@ -54,7 +129,169 @@ namespace trainer {
     // TrainBestDim (because it only searches on dimension for a good split) and
     // may be a better regularizer (because won't exclusively split on the 'good'
     // dimensions, all dimensions will be used eventually).
-    void TrainRandDim(hrf::Tree& tree, const TrainingRows& training_rows);
+    void TrainRandDim(hrf::Tree& tree, const FeatureMatrix& training_rows);
+    
+    typedef std::function<void(hrf::Tree&, const FeatureMatrix&, RowIndices)> SampleTrainerFn;
+    
+    // Same as TrainBestDim/TrainRandDim, but only train on the rows of
+    // training_rows listed in sample (e.g. a bootstrap sample drawn by
+    // TreeCreator). sample must be in increasing order, but may list a row
+    // more than once, in which case it counts once for each time it's
+    // listed. The tree's depth and leaf-size limits, and the work done, go
+    // by sample.size() rather than training_rows.size().
+    //
+    // Training reorders the indices in place, so sample is taken by value:
+    // move it in if it isn't needed afterwards.
+    void TrainBestDimSample(hrf::Tree& tree, const FeatureMatrix& training_rows, RowIndices sample);
+    void TrainRandDimSample(hrf::Tree& tree, const FeatureMatrix& training_rows, RowIndices sample);
+    
+    // Every row index of a FeatureMatrix, sorted by each feature in turn, for
+    // the exact split search (see TrainBestDimExact). The sorting is by far
+    // the most expensive part of that search, so it's done once for the
+    // whole training set, and every tree trained on it starts from a copy.
+    // Takes an int per row per feature.
+    class FeatureOrders {
+    private:
+        std::size_t n_rows_;
+        std::vector<int> rows_; // NUM_FEATURES orders of n_rows_ each
+        
+    public:
+        // training_rows must store every feature (i.e. not be a projection)
+        explicit FeatureOrders(const FeatureMatrix& training_rows);
+        
+        std::size_t size() const { return n_rows_; }
+        
+        // The rows in increasing order of the specified feature's stored
+        // values. NaNs come first, and equal values are in row order.
+        RowRange Rows(int feature) const;
+    };
+    
+    // Same as TrainBestDim/TrainRandDim, but try every possible split of each
+    // node instead of DEFAULT_N_SPLITS random ones, so every split is the best
+    // there is on its dimension. orders must be training_rows' (or those of a
+    // FeatureMatrix of the same rows).
+    //
+    // The tree copies the orders of its target_features_, and keeps each
+    // node's rows as a subrange of every one of them. A split partitions
+    // each of the node's subranges stably (as TrainBestDim partitions its
+    // one index array), so every node's rows stay sorted in every dimension
+    // without ever being sorted again. Then a single sweep down a dimension's
+    // rows, keeping running label counts, tries the split between every pair
+    // of neighbouring distinct values: O(n) per node per dimension.
+    //
+    // With BINNED8_FEATURES the histogram search already tries every split
+    // between two bins, so these give the same trees as TrainBestDim and
+    // (for the same Seed) TrainRandDim, only more slowly.
+    void TrainBestDimExact(hrf::Tree& tree, const FeatureMatrix& training_rows, const FeatureOrders& orders);
+    void TrainRandDimExact(hrf::Tree& tree, const FeatureMatrix& training_rows, const FeatureOrders& orders);
+    
+    typedef std::function<void(const std::vector<hrf::Tree*>&, const FeatureMatrix&)> BatchTrainerFn;
+    
+    // Default number of trees TreeCreator::MakeTreesBatched trains together
+    const int DEFAULT_BATCH_TREES = 16;
+    
+    // Same as calling TrainBestDim/TrainRandDim on each of trees, but with
+    // BINNED8_FEATURES the trees are grown together, one level at a time.
+    // Each level takes a single pass over the training rows, in order: each
+    // node on the last level partitions its rows between its children (by
+    // its split), and, as in TrainXDim, only the smaller child's rows are
+    // counted into histograms; the larger child's come from subtraction.
+    // That pass is what lets TrainXDimStreamed read the rows a chunk at a
+    // time. Each tree keeps the rows of each node on its current level (at
+    // most an int per row), plus the nodes' histograms, so the batch should
+    // be kept to tens of trees.
+    //
+    // The rows are visited a level at a time rather than a node at a time,
+    // so a node's rows aren't still in cache when its children are trained:
+    // on the ~200k-row training set this is about 1.5x slower than TrainXDim.
+    //
+    // Other storages need each node's rows to try split points, so with
+    // those the trees are just trained one after the other.
+    //
+    // TrainBestDimBatch gives the same trees as TrainBestDim.
+    // TrainRandDimBatch picks its random dimensions in a different order to
+    // TrainRandDim (breadth first, across the whole batch), so it gives
+    // different (but equally random) trees for a given Seed.
+    void TrainBestDimBatch(const std::vector<hrf::Tree*>& trees, const FeatureMatrix& training_rows);
+    void TrainRandDimBatch(const std::vector<hrf::Tree*>& trees, const FeatureMatrix& training_rows);
+    
+    typedef std::function<bool(const std::vector<hrf::Tree*>&, StreamedTrainingSet&)> StreamedTrainerFn;
+    
+    // Default number of trees MakeTreesStreamed trains per pass over the
+    // training rows
+    const int DEFAULT_STREAMED_TREES = 8;
+    
+    // Same as TrainBestDimBatch/TrainRandDimBatch, but for a training set
+    // too big to fit in memory: each level of the batch is one pass over
+    // training_rows' chunks, reading just the columns the batch's trees use.
+    // All that's kept in memory between passes is each tree's current level
+    // of nodes, with their histograms and the indices of their rows (if
+    // they're still to be split): at most 4 * trees.size() bytes per row,
+    // shrinking as rows reach leaves, plus up to half that again while a
+    // level's smaller children are being filled. Chunks whose rows have all
+    // reached leaves aren't read again.
+    //
+    // The trees are the same as TrainXDimBatch gives on a BINNED8_FEATURES
+    // FeatureMatrix of every row with the same bins (for the same Seed).
+    //
+    // Returns false if a chunk couldn't be read (see
+    // StreamedTrainingSet::LoadChunk), in which case the trees are left
+    // part-trained and shouldn't be used.
+    bool TrainBestDimStreamed(const std::vector<hrf::Tree*>& trees, StreamedTrainingSet& training_rows);
+    bool TrainRandDimStreamed(const std::vector<hrf::Tree*>& trees, StreamedTrainingSet& training_rows);
+    
+    // Counts of the work done by the TrainXDim functions, summed over every
+    // tree trained (on any thread) since the last ResetTrainStats.
+    //
+    // Each node's label counts are passed down from its parent's split
+    // rather than re-counted from its rows; label_rows_saved_ is how many
+    // row visits that avoided.
+    struct TrainStats {
+        long long nodes_;            // nodes trained (internal and leaves)
+        long long node_rows_;        // sum of those nodes' row counts
+        long long label_rows_saved_; // rows whose labels weren't re-counted
+    };
+    TrainStats GetTrainStats();
+    void ResetTrainStats();
+    
+    // Default min_task_rows for the TrainXDimParallel functions: below this,
+    // a subtree is too cheap to be worth handing to another thread.
+    const int DEFAULT_MIN_TASK_ROWS = 10000;
+    
+    // Same as FindBestSplitDim, but if indices has more than min_task_rows
+    // rows, each dimension is searched as a separate task on pool. Either
+    // way, each dimension draws its random candidate splits from its own
+    // stream, keyed from the calling thread's generator, so the result is
+    // the same as FindBestSplitDim's.
+    std::tuple<int, double, double> FindBestSplitDim(const hrf::Tree& tree,
+                                                     const FeatureMatrix& training_rows,
+                                                     RowRange indices,
+                                                     bkp::TaskPool& pool,
+                                                     int min_task_rows=DEFAULT_MIN_TASK_ROWS);
+    
+    // Same as TrainBestDim/TrainRandDim, but for growing one large tree on
+    // many cores (TreeCreator::MakeTreesParallel only trains separate trees in
+    // parallel). Once a node has more than min_task_rows rows, its two
+    // children are trained as separate tasks on pool, which idle workers
+    // steal; smaller nodes are trained serially by whichever thread reached
+    // them. The split search of such a node is also split up between
+    // pool's threads: TrainBestDimParallel searches each dimension as a
+    // separate task (as FindBestSplitDim with a pool does), and with
+    // BINNED8_FEATURES each dimension's histograms are counted as separate
+    // tasks. Otherwise the root node, which has the most rows of all, would
+    // be searched on a single thread while the rest of the pool waits.
+    //
+    // Note: random numbers come from whichever thread trains each node, so
+    // TrainRandDimParallel (and TrainBestDimParallel, unless training_rows
+    // uses BINNED8_FEATURES) doesn't give repeatable trees for a given Seed.
+    void TrainBestDimParallel(hrf::Tree& tree,
+                              const FeatureMatrix& training_rows,
+                              bkp::TaskPool& pool,
+                              int min_task_rows=DEFAULT_MIN_TASK_ROWS);
+    void TrainRandDimParallel(hrf::Tree& tree,
+                              const FeatureMatrix& training_rows,
+                              bkp::TaskPool& pool,
+                              int min_task_rows=DEFAULT_MIN_TASK_ROWS);
 }
 }
 
@@ -0,0 +1,170 @@
+//
+//  BinaryCacheTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "BinaryCache.h"
+#include "FileWrapper.h"
+#include "Mock.h"
+
+using hrf::HiggsCsvRow;
+using hrf::HiggsTrainingCsvRow;
+
+// helper fn: make a training row whose features are all event_id + dim,
+// except feature 3 which is missing (NaN)
+HiggsTrainingCsvRow MakeCacheRow(int event_id, char label) {
+    std::array<double, HiggsCsvRow::NUM_FEATURES> data;
+    for (int dim=0; dim<HiggsCsvRow::NUM_FEATURES; ++dim) {
+        data[dim] = event_id + dim;
+    }
+    data[3] = std::numeric_limits<double>::quiet_NaN();
+    return HiggsTrainingCsvRow(event_id, std::move(data), event_id * 0.25, label);
+}
+
+TEST(BinaryCacheTests, TrainingRoundTrip) {
+    mock::TempFile temp_file("binary_cache_test.hrfbin");
+    const char* filename = temp_file.Path();
+    
+    // odd row count so the EventId column needs padding
+    std::vector<const HiggsTrainingCsvRow> rows;
+    for (int i=0; i<7; ++i) {
+        rows.push_back(MakeCacheRow(100 + i, (i % 2 == 0) ? 's' : 'b'));
+    }
+    ASSERT_EQ(true, hrf::WriteBinaryCache(filename, rows, 12345));
+    
+    hrf::BinaryCacheFile cache;
+    ASSERT_EQ(true, cache.Open(filename));
+    EXPECT_EQ(7, cache.size());
+    EXPECT_EQ(true, cache.HasLabels());
+    EXPECT_EQ(12345, cache.SourceSize());
+    EXPECT_EQ(102, cache.EventIds()[2]);
+    EXPECT_EQ(102 + 5, cache.Feature(5)[2]);
+    EXPECT_TRUE(std::isnan(cache.Feature(3)[2]));
+    EXPECT_EQ(102 * 0.25, cache.Weights()[2]);
+    EXPECT_EQ('s', cache.Labels()[2]);
+    cache.Close();
+    
+    std::vector<const HiggsTrainingCsvRow> loaded;
+    ASSERT_EQ(true, hrf::ReadBinaryCache(filename, 12345, loaded));
+    ASSERT_EQ(rows.size(), loaded.size());
+    for (std::size_t i=0; i<rows.size(); ++i) {
+        EXPECT_EQ(rows[i].EventId_, loaded[i].EventId_);
+        EXPECT_EQ(rows[i].Weight_, loaded[i].Weight_);
+        EXPECT_EQ(rows[i].Label_, loaded[i].Label_);
+        EXPECT_EQ(rows[i].data_[0], loaded[i].data_[0]);
+        EXPECT_TRUE(std::isnan(loaded[i].data_[3]));
+    }
+    
+    // a cache made from a different-sized csv file should be rejected
+    EXPECT_EQ(false, hrf::ReadBinaryCache(filename, 54321, loaded));
+}
+
+// A writer fed a row at a time, in blocks smaller than the file, writes
+// exactly the same file as WriteBinaryCache
+TEST(BinaryCacheTests, Writer) {
+    mock::TempFile temp_file("binary_cache_test_writer.hrfbin");
+    const char* filename = temp_file.Path();
+    mock::TempFile whole_temp_file("binary_cache_test_writer_whole.hrfbin");
+    const char* whole_filename = whole_temp_file.Path();
+    
+    std::vector<const HiggsTrainingCsvRow> rows;
+    for (int i=0; i<11; ++i) {
+        rows.push_back(MakeCacheRow(i, (i % 3 == 0) ? 's' : 'b'));
+    }
+    ASSERT_EQ(true, hrf::WriteBinaryCache(whole_filename, rows, 99));
+    
+    hrf::BinaryCacheWriter writer;
+    ASSERT_EQ(true, writer.Open(filename, rows.size(), true, 99, 4));
+    for (const HiggsTrainingCsvRow& row : rows) {
+        ASSERT_EQ(true, writer.Add(row));
+    }
+    ASSERT_EQ(true, writer.Close());
+    
+    bkp::FileWrapper written, whole;
+    ASSERT_EQ(true, written.Open(filename, "rb"));
+    ASSERT_EQ(true, whole.Open(whole_filename, "rb"));
+    ASSERT_EQ(whole.Size(), written.Size());
+    std::vector<char> written_bytes(written.Size()), whole_bytes(whole.Size());
+    ASSERT_EQ(written_bytes.size(), written.Read(written_bytes.data(), 1, written_bytes.size()));
+    ASSERT_EQ(whole_bytes.size(), whole.Read(whole_bytes.data(), 1, whole_bytes.size()));
+    EXPECT_EQ(whole_bytes, written_bytes);
+}
+
+// A writer given the wrong number of rows fails, and leaves no file behind
+TEST(BinaryCacheTests, WriterRowCount) {
+    mock::TempFile temp_file("binary_cache_test_writer_count.hrfbin");
+    const char* filename = temp_file.Path();
+    bkp::FileWrapper file;
+    
+    hrf::BinaryCacheWriter too_few;
+    ASSERT_EQ(true, too_few.Open(filename, 3, true, 0, 2));
+    EXPECT_EQ(true, too_few.Add(MakeCacheRow(1, 's')));
+    EXPECT_EQ(true, too_few.Add(MakeCacheRow(2, 'b')));
+    EXPECT_EQ(false, too_few.Close());
+    EXPECT_EQ(false, file.Open(filename, "rb"));
+    EXPECT_EQ(false, file.Open(std::string(filename) + ".tmp", "rb"));
+    
+    hrf::BinaryCacheWriter too_many;
+    ASSERT_EQ(true, too_many.Open(filename, 1, false, 0));
+    EXPECT_EQ(true, too_many.Add(HiggsCsvRow(MakeCacheRow(1, 's'))));
+    EXPECT_EQ(false, too_many.Add(HiggsCsvRow(MakeCacheRow(2, 'b'))));
+    EXPECT_EQ(false, too_many.Close());
+    EXPECT_EQ(false, file.Open(filename, "rb"));
+}
+
+TEST(BinaryCacheTests, TestRowsHaveNoLabels) {
+    mock::TempFile temp_file("binary_cache_test_nolabels.hrfbin");
+    const char* filename = temp_file.Path();
+    
+    std::vector<const HiggsCsvRow> rows;
+    rows.push_back(HiggsCsvRow(MakeCacheRow(5, 'b')));
+    ASSERT_EQ(true, hrf::WriteBinaryCache(filename, rows, 0));
+    
+    std::vector<const HiggsCsvRow> loaded;
+    ASSERT_EQ(true, hrf::ReadBinaryCache(filename, 0, loaded));
+    ASSERT_EQ(1, loaded.size());
+    EXPECT_EQ(5, loaded[0].EventId_);
+    
+    // can't load training rows from a file without labels
+    std::vector<const HiggsTrainingCsvRow> training;
+    EXPECT_EQ(false, hrf::ReadBinaryCache(filename, 0, training));
+}
+
+// Flipping a single byte of the data should make the checksum fail
+TEST(BinaryCacheTests, DetectsCorruption) {
+    mock::TempFile temp_file("binary_cache_test_corrupt.hrfbin");
+    const char* filename = temp_file.Path();
+    
+    std::vector<const HiggsTrainingCsvRow> rows;
+    rows.push_back(MakeCacheRow(1, 's'));
+    rows.push_back(MakeCacheRow(2, 'b'));
+    ASSERT_EQ(true, hrf::WriteBinaryCache(filename, rows, 0));
+    
+    {
+        FILE* f = fopen(filename, "r+b");
+        ASSERT_NE(nullptr, f);
+        fseek(f, sizeof(hrf::BinaryCacheHeader) + 16, SEEK_SET);
+        fputc(0x7f, f);
+        fclose(f);
+    }
+    
+    hrf::BinaryCacheFile cache;
+    EXPECT_EQ(false, cache.Open(filename));
+    EXPECT_EQ(false, cache.IsOpen());
+}
+
+TEST(BinaryCacheTests, MissingFile) {
+    hrf::BinaryCacheFile cache;
+    EXPECT_EQ(false, cache.Open("this_file_does_not_exist.hrfbin"));
+    EXPECT_EQ(false, hrf::IsBinaryCacheFresh("this_file_does_not_exist.csv",
+                                             "this_file_does_not_exist.hrfbin"));
+}
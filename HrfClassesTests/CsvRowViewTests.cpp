@@ -0,0 +1,138 @@
+//
+//  CsvRowViewTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <string>
+#include <cmath>
+
+#include "CsvRowView.h"
+#include "HiggsCsvRow.h"
+
+// helper fn: split a single csv line into a csv_row the same way
+// the csv_parser library would (no quoting, ',' separated)
+csv_row SplitLine(const std::string& line) {
+    csv_row result;
+    std::string::size_type begin = 0;
+    while (true) {
+        auto comma = line.find(',', begin);
+        if (comma == std::string::npos) {
+            result.push_back(line.substr(begin));
+            return result;
+        }
+        result.push_back(line.substr(begin, comma - begin));
+        begin = comma + 1;
+    }
+}
+
+// two real rows from training.csv
+const std::string TRAINING_LINE_1 = "100000,138.47,51.655,97.827,27.98,0.91,124.711,2.666,3.064,41.928,197.76,1.582,1.396,0.2,32.638,1.017,0.381,51.626,2.273,-2.414,16.824,-0.277,258.733,2,67.435,2.15,0.444,46.062,1.24,-2.475,113.497,0.00265331133733,s";
+const std::string TRAINING_LINE_2 = "100001,160.937,68.768,103.235,48.146,-999.0,-999.0,-999.0,3.473,2.078,125.157,0.879,1.414,-999.0,42.014,2.039,-3.011,36.918,0.501,0.103,44.704,-1.916,164.546,1,46.226,0.725,1.158,-999.0,-999.0,-999.0,46.226,2.23358448717,b";
+
+TEST(CsvRowViewTests, Tokenize) {
+    std::string buffer = "a,bb,,ccc\nd\r\n";
+    const char* cursor = buffer.data();
+    const char* end = cursor + buffer.size();
+
+    hrf::CsvRowView row;
+    ASSERT_EQ(true, row.Parse(cursor, end));
+    ASSERT_EQ(4, row.size());
+    EXPECT_EQ("a", std::string(row.FieldBegin(0), row.FieldEnd(0)));
+    EXPECT_EQ("bb", std::string(row.FieldBegin(1), row.FieldEnd(1)));
+    EXPECT_EQ("", std::string(row.FieldBegin(2), row.FieldEnd(2)));
+    EXPECT_EQ("ccc", std::string(row.FieldBegin(3), row.FieldEnd(3)));
+
+    // second line has a windows line ending, which should be stripped
+    ASSERT_EQ(true, row.Parse(cursor, end));
+    ASSERT_EQ(1, row.size());
+    EXPECT_EQ("d", std::string(row.FieldBegin(0), row.FieldEnd(0)));
+
+    EXPECT_EQ(end, cursor);
+    EXPECT_EQ(false, row.Parse(cursor, end));
+}
+
+// last line of a file may not end with a newline
+TEST(CsvRowViewTests, NoTrailingNewline) {
+    std::string buffer = "1,2.5,s";
+    const char* cursor = buffer.data();
+    const char* end = cursor + buffer.size();
+
+    hrf::CsvRowView row;
+    ASSERT_EQ(true, row.Parse(cursor, end));
+    ASSERT_EQ(3, row.size());
+    EXPECT_EQ(1, row.GetInt(0));
+    EXPECT_EQ(2.5, row.GetDouble(1));
+    EXPECT_EQ('s', row.GetChar(2));
+    EXPECT_EQ(false, row.Parse(cursor, end));
+}
+
+// Rows built from a CsvRowView must be identical to rows built from
+// the csv_parser library's csv_row
+TEST(CsvRowViewTests, MatchesCsvRow) {
+    std::string buffer = TRAINING_LINE_1 + "\n" + TRAINING_LINE_2 + "\n";
+    const char* cursor = buffer.data();
+    const char* end = cursor + buffer.size();
+
+    for (const std::string& line : {TRAINING_LINE_1, TRAINING_LINE_2}) {
+        hrf::CsvRowView view;
+        ASSERT_EQ(true, view.Parse(cursor, end));
+        ASSERT_EQ(hrf::HiggsTrainingCsvRow::NUM_CSV_COLUMNS, view.size());
+
+        hrf::HiggsTrainingCsvRow expected(SplitLine(line));
+        hrf::HiggsTrainingCsvRow actual(view);
+
+        EXPECT_EQ(expected.EventId_, actual.EventId_);
+        EXPECT_EQ(expected.Weight_, actual.Weight_);
+        EXPECT_EQ(expected.Label_, actual.Label_);
+        for (int i=0; i<hrf::HiggsCsvRow::NUM_FEATURES; ++i) {
+            if (std::isnan(expected.data_[i])) {
+                EXPECT_TRUE(std::isnan(actual.data_[i]));
+            }
+            else {
+                EXPECT_EQ(expected.data_[i], actual.data_[i]);
+            }
+        }
+    }
+}
+
+// -999.0 marks a missing value and should be turned into NaN
+TEST(CsvRowViewTests, MissingValues) {
+    std::string buffer = TRAINING_LINE_2;
+    const char* cursor = buffer.data();
+
+    hrf::CsvRowView view;
+    ASSERT_EQ(true, view.Parse(cursor, cursor + buffer.size()));
+
+    hrf::HiggsCsvRow row(view);
+    EXPECT_EQ(100001, row.EventId_);
+    EXPECT_EQ(160.937, row.data_[0]);
+    EXPECT_TRUE(std::isnan(row.data_[4]));
+    EXPECT_TRUE(std::isnan(row.data_[28]));
+}
+
+// Fields that aren't numbers shouldn't stop the accessors, but should be
+// reported by BadField(), which is reset by the next Parse
+TEST(CsvRowViewTests, BadField) {
+    std::string buffer = "12,3.5x,abc\n7,8,9\n";
+    const char* cursor = buffer.data();
+    const char* end = cursor + buffer.size();
+    
+    hrf::CsvRowView row;
+    ASSERT_EQ(true, row.Parse(cursor, end));
+    EXPECT_EQ(-1, row.BadField());
+    EXPECT_EQ(12, row.GetInt(0));
+    EXPECT_EQ(-1, row.BadField());
+    EXPECT_TRUE(std::isnan(row.GetDouble(1)));
+    EXPECT_EQ(1, row.BadField());
+    EXPECT_EQ(0, row.GetInt(2));
+    EXPECT_EQ(1, row.BadField()); // still the first bad field
+    
+    ASSERT_EQ(true, row.Parse(cursor, end));
+    EXPECT_EQ(-1, row.BadField());
+    EXPECT_EQ(8.0, row.GetDouble(1, -999.0));
+    EXPECT_EQ(-1, row.BadField());
+}
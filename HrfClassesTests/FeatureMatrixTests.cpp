@@ -0,0 +1,435 @@
+//
+//  FeatureMatrixTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+
+#include "FeatureMatrix.h"
+#include "Tree.h"
+#include "TreeTrainer.h"
+#include "AmsCalculator.h"
+#include "TreeCreator.h"
+#include "ScoreAverager.h"
+#include "Classifier.h"
+#include "RandUtils.h"
+#include "Mock.h"
+
+// check that each row's values end up in the right place in the columns
+TEST(FeatureMatrixTests, Layout) {
+
+    auto rows = mock::MockRows({true, false, true, false},
+                               {1.0, 2.0, 3.0, 4.0});
+    hrf::FeatureMatrix matrix(rows);
+
+    ASSERT_EQ(rows.size(), matrix.size());
+    ASSERT_TRUE(matrix.HasLabels());
+
+    for (std::size_t row_index=0; row_index<rows.size(); ++row_index) {
+        auto& row = rows[row_index];
+        EXPECT_EQ(row.EventId_, matrix.EventIds()[row_index]);
+        EXPECT_EQ(row.Weight_, matrix.Weights()[row_index]);
+        EXPECT_EQ(row.Label_, matrix.Labels()[row_index]);
+        EXPECT_EQ(row.Label_ == 's', matrix.IsSignal()[row_index] == 1);
+
+        for (int dim=0; dim<hrf::FeatureMatrix::NUM_FEATURES; ++dim) {
+            EXPECT_EQ(row.data_[dim], matrix.Column(dim)[row_index]);
+            EXPECT_EQ(row.data_[dim], matrix.Get(row_index, dim));
+        }
+    }
+}
+
+TEST(FeatureMatrixTests, Unlabeled) {
+
+    auto rows = mock::MockRows(3);
+    hrf::FeatureMatrix matrix(rows);
+
+    ASSERT_EQ(3, matrix.size());
+    EXPECT_FALSE(matrix.HasLabels());
+    for (std::size_t row_index=0; row_index<rows.size(); ++row_index) {
+        EXPECT_EQ(rows[row_index].EventId_, matrix.EventIds()[row_index]);
+        EXPECT_EQ(rows[row_index].data_[7], matrix.Get(row_index, 7));
+    }
+}
+
+// only NaNs in the requested columns should count, and the FeatureMatrix
+// version should agree with the row version
+TEST(FeatureMatrixTests, HasNan) {
+
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+    std::vector<const hrf::HiggsCsvRow> data_vector({
+        hrf::HiggsCsvRow(1, mock::PartialData({1.0, 2.0, 3.0})),
+        hrf::HiggsCsvRow(2, mock::PartialData({NaN, 2.0, 3.0})),
+        hrf::HiggsCsvRow(3, mock::PartialData({1.0, 2.0, NaN})),
+        hrf::HiggsCsvRow(4, mock::PartialData({1.0, NaN, 3.0}))
+    });
+    bkp::MaskedVector<const hrf::HiggsCsvRow> rows(std::move(data_vector));
+    hrf::FeatureMatrix matrix(rows);
+
+    std::vector<int> cols({0, 2});
+    std::vector<bool> expected({false, true, true, false});
+
+    EXPECT_EQ(expected, hrf::HasNan(matrix, cols));
+    EXPECT_EQ(expected, hrf::HasNan(rows, cols));
+}
+
+// a trained tree should give the same scores whether it's scoring rows or
+// a FeatureMatrix
+TEST(FeatureMatrixTests, TreeScoreMatchesRows) {
+
+    const int N_ROWS = 500;
+    std::vector<hrf::HiggsTrainingCsvRow> train_vector;
+    for (int i=0; i<N_ROWS; ++i) {
+        bool is_signal = (i % 3 == 0);
+        train_vector.push_back(hrf::HiggsTrainingCsvRow(i,
+                                                        mock::PartialDataRandFill({is_signal ? 1.0 : 0.0}),
+                                                        1.0,
+                                                        is_signal ? 's' : 'b'));
+    }
+    bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> train_rows(
+        std::vector<const hrf::HiggsTrainingCsvRow>(train_vector.begin(), train_vector.end())
+    );
+    hrf::FeatureMatrix train_matrix(train_rows);
+
+    hrf::Tree t(std::vector<int>({0, 1, 2}),
+                mock::shared_vector({0.0, 0.0, 0.0}),
+                mock::shared_vector({1.0, 1.0, 1.0}));
+    hrf::trainer::TrainBestDim(t, train_matrix);
+    ASSERT_EQ(2, t.children_.size());
+
+    auto test_rows = hrf::ConvertRows(train_rows);
+    auto row_scores = t.Score(test_rows);
+    auto matrix_scores = t.Score(hrf::FeatureMatrix(test_rows));
+
+    ASSERT_EQ(row_scores.size(), matrix_scores.size());
+    for (std::size_t i=0; i<row_scores.size(); ++i) {
+        EXPECT_EQ(row_scores.s_scores_[i], matrix_scores.s_scores_[i]);
+        EXPECT_EQ(row_scores.b_scores_[i], matrix_scores.b_scores_[i]);
+    }
+}
+
+TEST(FeatureMatrixTests, AmsMatchesRows) {
+
+    auto rows = mock::MockRows({true, false, true, false, true},
+                               {1.0, 2.0, 3.0, 4.0, 5.0});
+    std::vector<char> predicted({'s', 's', 'b', 'b', 's'});
+
+    EXPECT_EQ(hrf::CalcAms(predicted, rows),
+              hrf::CalcAms(predicted, hrf::FeatureMatrix(rows)));
+}
+
+// reduced-precision values should round-trip to within their precision, and
+// NaNs should stay NaN
+TEST(FeatureMatrixTests, ReducedPrecisionStorage) {
+
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+    std::vector<const hrf::HiggsCsvRow> data_vector({
+        hrf::HiggsCsvRow(1, mock::PartialData({-10.0, 1.0/3.0, NaN})),
+        hrf::HiggsCsvRow(2, mock::PartialData({0.1, 2.0/3.0, 5.0})),
+        hrf::HiggsCsvRow(3, mock::PartialData({10.0, 1.0, 5.0}))
+    });
+    bkp::MaskedVector<const hrf::HiggsCsvRow> rows(std::move(data_vector));
+
+    hrf::FeatureMatrix doubles(rows);
+    hrf::FeatureMatrix floats(rows, hrf::FLOAT_FEATURES);
+    hrf::FeatureMatrix quantized(rows, hrf::QUANTIZED16_FEATURES);
+
+    EXPECT_EQ(hrf::FLOAT_FEATURES, floats.Storage());
+    EXPECT_EQ(hrf::QUANTIZED16_FEATURES, quantized.Storage());
+    EXPECT_EQ(doubles.FeatureBytes(), 2 * floats.FeatureBytes());
+    EXPECT_EQ(doubles.FeatureBytes(), 4 * quantized.FeatureBytes());
+
+    for (std::size_t row_index=0; row_index<rows.size(); ++row_index) {
+        for (int dim=0; dim<2; ++dim) {
+            double val = rows[row_index].data_[dim];
+            EXPECT_EQ(static_cast<float>(val), floats.Get(row_index, dim));
+            EXPECT_NEAR(val, quantized.Get(row_index, dim), 20.0 / 65534);
+        }
+    }
+
+    // column min and max are exact
+    EXPECT_EQ(-10.0, quantized.Get(0, 0));
+    EXPECT_EQ(10.0, quantized.Get(2, 0));
+
+    // column 2 has one NaN, and its other values are all equal
+    EXPECT_TRUE(std::isnan(floats.Get(0, 2)));
+    EXPECT_TRUE(std::isnan(quantized.Get(0, 2)));
+    EXPECT_EQ(5.0, quantized.Get(1, 2));
+    EXPECT_EQ(hrf::HasNan(doubles, {2}), hrf::HasNan(quantized, {2}));
+}
+
+// comparing a stored value to a view's Threshold should always give the same
+// answer as comparing the decoded value to the split
+TEST(FeatureMatrixTests, Thresholds) {
+
+    hrf::QuantizedColumnView quantized = { nullptr, -3.0, 7.0 / 65534 };
+    hrf::FloatColumnView floats = { nullptr };
+
+    auto splits = bkp::random::RandDoubles(1000, -4.0, 5.0);
+    splits.push_back(-3.0);
+    splits.push_back(4.0);
+    for (double split : splits) {
+        std::uint32_t threshold = quantized.Threshold(split);
+        for (std::uint32_t code=0; code<=hrf::QuantizedColumnView::MAX_CODE; code += 97) {
+            std::uint16_t v = static_cast<std::uint16_t>(code);
+            EXPECT_EQ(quantized.Decode(v) >= split, v >= threshold);
+        }
+        // the codes either side of the threshold are the ones most likely to be wrong
+        for (std::uint32_t code=std::max(threshold, 2u)-1; code<=std::min(threshold, 65535u); ++code) {
+            std::uint16_t v = static_cast<std::uint16_t>(code);
+            EXPECT_EQ(quantized.Decode(v) >= split, v >= threshold);
+        }
+
+        float float_threshold = floats.Threshold(split);
+        float below = std::nextafter(float_threshold, -std::numeric_limits<float>::infinity());
+        EXPECT_GE(float_threshold, split);
+        EXPECT_LT(below, split);
+    }
+}
+
+// Binned columns with few distinct values keep every value exactly; columns
+// with many get 255 bins of about the same size
+TEST(FeatureMatrixTests, BinnedStorage) {
+
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    const int N_ROWS = 2550;
+
+    std::vector<hrf::HiggsCsvRow> data_vector;
+    for (int i=0; i<N_ROWS; ++i) {
+        data_vector.push_back(hrf::HiggsCsvRow(i, mock::PartialData({
+            static_cast<double>(i % 4),        // 4 distinct values
+            i * 0.5,                           // every value distinct
+            (i % 10 == 0) ? NaN : -1.0 * i
+        })));
+    }
+    bkp::MaskedVector<const hrf::HiggsCsvRow> rows(
+        std::vector<const hrf::HiggsCsvRow>(data_vector.begin(), data_vector.end())
+    );
+    hrf::FeatureMatrix binned(rows, hrf::BINNED8_FEATURES);
+
+    EXPECT_EQ(hrf::BINNED8_FEATURES, binned.Storage());
+    EXPECT_EQ(hrf::FeatureMatrix(rows).FeatureBytes(), 8 * binned.FeatureBytes());
+
+    const hrf::BinnedColumnView few = binned.View<hrf::BinnedColumnView>(0);
+    const hrf::BinnedColumnView many = binned.View<hrf::BinnedColumnView>(1);
+    const hrf::BinnedColumnView with_nans = binned.View<hrf::BinnedColumnView>(2);
+    int bin_sizes[hrf::BinnedColumnView::NUM_CODES] = { 0 };
+    for (int i=0; i<N_ROWS; ++i) {
+        EXPECT_EQ(i % 4 + 1, few.data_[i]);
+        EXPECT_EQ(i % 4, binned.Get(i, 0));
+
+        // values decode to the bottom of their bin
+        const std::uint8_t code = many.data_[i];
+        EXPECT_LE(many.lower_bounds_[code], i * 0.5);
+        EXPECT_GE(many.upper_bounds_[code], i * 0.5);
+        ++bin_sizes[code];
+
+        EXPECT_EQ(i % 10 == 0, with_nans.IsNan(with_nans.data_[i]));
+    }
+    for (int code=1; code<hrf::BinnedColumnView::NUM_CODES; ++code) {
+        EXPECT_EQ(N_ROWS / 255, bin_sizes[code]);
+    }
+    EXPECT_EQ(0, bin_sizes[hrf::BinnedColumnView::NAN_CODE]);
+
+    // a split between two bins separates them exactly
+    for (int code=2; code<hrf::BinnedColumnView::NUM_CODES; ++code) {
+        double split = many.SplitBelow(code);
+        EXPECT_GT(split, many.upper_bounds_[code - 1]);
+        EXPECT_LT(split, many.lower_bounds_[code]);
+        EXPECT_EQ(code, many.Threshold(split));
+    }
+    EXPECT_EQ(1, many.Threshold(-5.0));
+    EXPECT_EQ(hrf::BinnedColumnView::NUM_CODES, many.Threshold(N_ROWS));
+}
+
+// a projection holds just the requested rows (repeats included) of the
+// requested features, encoded the same way as the source, and a tree trained
+// on a projection of all its features and rows is the same as one trained on
+// the source
+TEST(FeatureMatrixTests, Project) {
+
+    const int N_ROWS = 400;
+    std::vector<hrf::HiggsTrainingCsvRow> train_vector;
+    for (int i=0; i<N_ROWS; ++i) {
+        bool is_signal = (i % 3 == 0);
+        train_vector.push_back(hrf::HiggsTrainingCsvRow(i,
+                                                        mock::PartialDataRandFill({is_signal ? 1.0 : 0.0, i * 0.25}),
+                                                        1.0 + i,
+                                                        is_signal ? 's' : 'b'));
+    }
+    bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> train_rows(
+        std::vector<const hrf::HiggsTrainingCsvRow>(train_vector.begin(), train_vector.end())
+    );
+    const std::vector<int> features({7, 1, 0});
+    const std::vector<int> sample({5, 0, 0, 399, 12});
+
+    hrf::FeatureMatrix projection;
+    for (auto storage : {hrf::DOUBLE_FEATURES, hrf::FLOAT_FEATURES,
+                         hrf::QUANTIZED16_FEATURES, hrf::BINNED8_FEATURES}) {
+        hrf::FeatureMatrix source(train_rows, storage);
+        projection.Project(source, features, sample);
+
+        ASSERT_EQ(sample.size(), projection.size());
+        EXPECT_EQ(storage, projection.Storage());
+        EXPECT_TRUE(projection.HasLabels());
+        EXPECT_EQ(features.size() * sample.size() * source.FeatureBytes(),
+                  hrf::FeatureMatrix::NUM_FEATURES * N_ROWS * projection.FeatureBytes());
+        for (std::size_t i=0; i<sample.size(); ++i) {
+            EXPECT_EQ(source.EventIds()[sample[i]], projection.EventIds()[i]);
+            EXPECT_EQ(source.Weights()[sample[i]], projection.Weights()[i]);
+            EXPECT_EQ(source.Labels()[sample[i]], projection.Labels()[i]);
+            EXPECT_EQ(source.IsSignal()[sample[i]], projection.IsSignal()[i]);
+            for (int feature : features) {
+                EXPECT_EQ(source.Get(sample[i], feature), projection.Get(i, feature));
+            }
+        }
+    }
+
+    hrf::FeatureMatrix source(train_rows, hrf::BINNED8_FEATURES);
+    std::vector<int> all_rows(N_ROWS);
+    for (int i=0; i<N_ROWS; ++i) {
+        all_rows[i] = i;
+    }
+    projection.Project(source, features, all_rows);
+    hrf::Tree source_tree(std::vector<int>(features),
+                          mock::shared_vector({0.0, 0.0, 0.0}),
+                          mock::shared_vector({1.0, 100.0, 1.0}));
+    hrf::Tree projection_tree(std::vector<int>(features),
+                              mock::shared_vector({0.0, 0.0, 0.0}),
+                              mock::shared_vector({1.0, 100.0, 1.0}));
+    hrf::trainer::TrainBestDim(source_tree, source);
+    hrf::trainer::TrainBestDim(projection_tree, projection);
+    ASSERT_EQ(2, source_tree.children_.size());
+
+    auto source_scores = source_tree.Score(source);
+    auto projection_scores = projection_tree.Score(source);
+    ASSERT_EQ(source_scores.size(), projection_scores.size());
+    for (int i=0; i<N_ROWS; ++i) {
+        EXPECT_EQ(source_scores.s_scores_[i], projection_scores.s_scores_[i]);
+        EXPECT_EQ(source_scores.b_scores_[i], projection_scores.b_scores_[i]);
+    }
+}
+
+// Rows given as columns are encoded exactly as the encoding FeatureMatrix
+// encodes them, for just the given features
+TEST(FeatureMatrixTests, EncodeColumns) {
+
+    const int N_ROWS = 300;
+    std::vector<hrf::HiggsTrainingCsvRow> train_vector;
+    for (int i=0; i<N_ROWS; ++i) {
+        bool is_signal = (i % 4 == 0);
+        train_vector.push_back(hrf::HiggsTrainingCsvRow(i,
+                                                        mock::PartialDataRandFill({i * 0.5, -1.0 * i}),
+                                                        2.0 * i,
+                                                        is_signal ? 's' : 'b'));
+    }
+    bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> train_rows(
+        std::vector<const hrf::HiggsTrainingCsvRow>(train_vector.begin(), train_vector.end())
+    );
+    const hrf::FeatureMatrix doubles(train_rows);
+    const std::vector<int> features({4, 0});
+    const std::vector<const double*> feature_columns({doubles.Column(4), doubles.Column(0)});
+
+    hrf::FeatureMatrix encoded;
+    for (auto storage : {hrf::DOUBLE_FEATURES, hrf::FLOAT_FEATURES,
+                         hrf::QUANTIZED16_FEATURES, hrf::BINNED8_FEATURES}) {
+        hrf::FeatureMatrix encoding(train_rows, storage);
+        encoded.EncodeColumns(encoding,
+                              features,
+                              feature_columns,
+                              N_ROWS,
+                              doubles.EventIds(),
+                              doubles.Weights(),
+                              doubles.Labels());
+
+        ASSERT_EQ(N_ROWS, encoded.size());
+        EXPECT_EQ(storage, encoded.Storage());
+        EXPECT_TRUE(encoded.HasLabels());
+        EXPECT_EQ(features.size() * encoding.FeatureBytes(),
+                  hrf::FeatureMatrix::NUM_FEATURES * encoded.FeatureBytes());
+        for (int i=0; i<N_ROWS; ++i) {
+            EXPECT_EQ(encoding.EventIds()[i], encoded.EventIds()[i]);
+            EXPECT_EQ(encoding.Weights()[i], encoded.Weights()[i]);
+            EXPECT_EQ(encoding.IsSignal()[i], encoded.IsSignal()[i]);
+            for (int feature : features) {
+                EXPECT_EQ(encoding.Get(i, feature), encoded.Get(i, feature));
+            }
+        }
+    }
+
+    // a chunk of the rows, without labels
+    hrf::FeatureMatrix encoding(train_rows, hrf::BINNED8_FEATURES);
+    const std::vector<const double*> chunk_columns({doubles.Column(4) + 100, doubles.Column(0) + 100});
+    encoded.EncodeColumns(encoding, features, chunk_columns, 50, doubles.EventIds() + 100, nullptr, nullptr);
+    ASSERT_EQ(50, encoded.size());
+    EXPECT_FALSE(encoded.HasLabels());
+    for (int i=0; i<50; ++i) {
+        EXPECT_EQ(100 + i, encoded.EventIds()[i]);
+        EXPECT_EQ(encoding.Get(100 + i, 0), encoded.Get(i, 0));
+    }
+}
+
+// Accuracy comparison: a forest trained on reduced-precision features should
+// classify a held-out validation set almost exactly like one trained on
+// doubles. (AMS itself is too noisy on a set this small to compare directly;
+// main.cpp's COMPARE_FEATURE_STORAGE does that on the real data.)
+TEST(FeatureMatrixTests, ReducedPrecisionAccuracy) {
+
+    // signal is shifted up in the first two dimensions
+    auto make_rows = [](int n) {
+        std::vector<hrf::HiggsTrainingCsvRow> result;
+        for (int i=0; i<n; ++i) {
+            bool is_signal = bkp::random::RandInt(3) == 0;
+            double shift = is_signal ? 0.5 : 0.0;
+            result.push_back(hrf::HiggsTrainingCsvRow(i,
+                                                      mock::PartialDataRandFill({
+                                                          bkp::random::RandDouble(0.0, 1.0) + shift,
+                                                          bkp::random::RandDouble(0.0, 1.0) + shift
+                                                      }),
+                                                      1.0,
+                                                      is_signal ? 's' : 'b'));
+        }
+        return bkp::MaskedVector<const hrf::HiggsTrainingCsvRow>(
+            std::vector<const hrf::HiggsTrainingCsvRow>(result.begin(), result.end())
+        );
+    };
+    auto train_rows = make_rows(3000);
+    auto validation_rows = make_rows(3000);
+    auto validation_rows_downcasted = hrf::ConvertRows(validation_rows);
+
+    auto classify = [&](hrf::FeatureStorage storage) {
+        bkp::random::Seed(42);
+        hrf::TreeCreator tree_creator(hrf::FeatureMatrix(train_rows, storage),
+                                      hrf::trainer::TrainRandDim,
+                                      2);
+        hrf::Classifier classifier(std::unique_ptr<hrf::IScorer>(
+            new hrf::ScoreAverager(tree_creator.MakeTrees(100))
+        ));
+        return classifier.Classify(validation_rows_downcasted, false);
+    };
+    auto accuracy = [&](const std::vector<char>& predictions) {
+        int correct = 0;
+        for (std::size_t i=0; i<predictions.size(); ++i) {
+            correct += (predictions[i] == validation_rows[i].Label_);
+        }
+        return static_cast<double>(correct) / predictions.size();
+    };
+
+    double double_accuracy = accuracy(classify(hrf::DOUBLE_FEATURES));
+    double float_accuracy = accuracy(classify(hrf::FLOAT_FEATURES));
+    double quantized_accuracy = accuracy(classify(hrf::QUANTIZED16_FEATURES));
+    double binned_accuracy = accuracy(classify(hrf::BINNED8_FEATURES));
+
+    EXPECT_GT(double_accuracy, 0.7);
+    EXPECT_NEAR(double_accuracy, float_accuracy, 0.02);
+    EXPECT_NEAR(double_accuracy, quantized_accuracy, 0.02);
+    EXPECT_NEAR(double_accuracy, binned_accuracy, 0.02);
+}
@@ -9,6 +9,11 @@
 #include "Mock.h"
 #include "RandUtils.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <unistd.h>
+
 namespace mock {
     
     // private helper fn: create NUM_FEATURES random data points
@@ -115,4 +120,18 @@ namespace mock {
         
         return result;
     }
-}
\ No newline at end of file
+    
+    TempFile::TempFile(const std::string& name) {
+        char dir_template[] = "/tmp/hrf_test_XXXXXX";
+        if (mkdtemp(dir_template) == nullptr) {
+            throw std::runtime_error("Couldn't create a temp directory for " + name);
+        }
+        dir_ = dir_template;
+        path_ = dir_ + "/" + name;
+    }
+    
+    TempFile::~TempFile() {
+        std::remove(path_.c_str());
+        rmdir(dir_.c_str());
+    }
+}
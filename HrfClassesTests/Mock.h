@@ -10,6 +10,7 @@
 #define __RandomForest____MockRows__
 
 #include <vector>
+#include <string>
 
 #include "HiggsCsvRow.h"
 #include "MaskedVector.h"
@@ -54,6 +55,25 @@ namespace mock {
     std::shared_ptr<const std::vector<T>> shared_vector(std::initializer_list<T> values) {
         return std::make_shared<const std::vector<T>>(values);
     }
+    
+    // A file name that no other test (or test run) uses: name, in a new
+    // directory under /tmp. The file isn't created; whatever the test writes
+    // there, and the directory, are removed when the TempFile goes out of
+    // scope, including when an ASSERT returns from the test early.
+    class TempFile {
+    private:
+        std::string dir_;
+        std::string path_;
+        
+    public:
+        explicit TempFile(const std::string& name);
+        ~TempFile();
+        
+        TempFile(const TempFile&) = delete;
+        TempFile& operator=(const TempFile&) = delete;
+        
+        const char* Path() const { return path_.c_str(); }
+    };
 }
 
 #endif /* defined(__RandomForest____MockRows__) */
@@ -0,0 +1,212 @@
+//
+//  ParserTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cmath>
+
+#include "Parser.h"
+#include "FileWrapper.h"
+#include "BinaryCache.h"
+#include "RandUtils.h"
+
+using bkp::MaskedVector;
+using hrf::HiggsTrainingCsvRow;
+
+// helper fn: write a fake training.csv with n_rows rows to 'filename'.
+// Every 7th feature value is the -999.0 "missing" marker.
+void WriteTrainingCsv(const char* filename, int n_rows) {
+    bkp::FileWrapper out;
+    ASSERT_EQ(true, out.Open(filename, "w"));
+    out.Printf("EventId");
+    for (int i=0; i<HiggsTrainingCsvRow::NUM_FEATURES; ++i) {
+        out.Printf(",F%d", i);
+    }
+    out.Printf(",Weight,Label\n");
+    
+    for (int row=0; row<n_rows; ++row) {
+        out.Printf("%d", 100000 + row);
+        for (int i=0; i<HiggsTrainingCsvRow::NUM_FEATURES; ++i) {
+            if ((row + i) % 7 == 0) {
+                out.Printf(",-999.0");
+            }
+            else {
+                out.Printf(",%.3f", row * 0.5 + i);
+            }
+        }
+        out.Printf(",%.6f,%c\n", row * 0.001, (row % 3 == 0) ? 's' : 'b');
+    }
+}
+
+// Parallel parsing must give exactly the same rows, in exactly the same
+// order, as serial parsing
+TEST(ParserTests, ParallelMatchesSerial) {
+    const char* filename = "parser_test_training.csv";
+    const int N_ROWS = 3000; // big enough to be split into several chunks
+    WriteTrainingCsv(filename, N_ROWS);
+    
+    MaskedVector<const HiggsTrainingCsvRow> serial = hrf::LoadTrainingData(filename, false, false);
+    MaskedVector<const HiggsTrainingCsvRow> parallel = hrf::LoadTrainingData(filename, true, false);
+    
+    ASSERT_EQ(N_ROWS, serial.size());
+    ASSERT_EQ(N_ROWS, parallel.size());
+    
+    for (int row=0; row<N_ROWS; ++row) {
+        const HiggsTrainingCsvRow& s = serial[row];
+        const HiggsTrainingCsvRow& p = parallel[row];
+        
+        ASSERT_EQ(100000 + row, s.EventId_);
+        ASSERT_EQ(s.EventId_, p.EventId_);
+        EXPECT_EQ(s.Weight_, p.Weight_);
+        EXPECT_EQ(s.Label_, p.Label_);
+        for (int i=0; i<HiggsTrainingCsvRow::NUM_FEATURES; ++i) {
+            if (std::isnan(s.data_[i])) {
+                EXPECT_TRUE(std::isnan(p.data_[i]));
+            }
+            else {
+                EXPECT_EQ(s.data_[i], p.data_[i]);
+            }
+        }
+    }
+    
+    remove(filename);
+}
+
+// A file with only a header should load as an empty vector in either mode
+TEST(ParserTests, HeaderOnly) {
+    const char* filename = "parser_test_empty.csv";
+    WriteTrainingCsv(filename, 0);
+    
+    EXPECT_EQ(0, hrf::LoadTrainingData(filename, false, false).size());
+    EXPECT_EQ(0, hrf::LoadTrainingData(filename, true, false).size());
+    
+    remove(filename);
+}
+
+// The first load should write a binary cache, and the second load should
+// read it back and give the same rows
+TEST(ParserTests, BinaryCache) {
+    const char* filename = "parser_test_cached.csv";
+    const std::string cache_filename = hrf::BinaryCacheName(filename);
+    const int N_ROWS = 100;
+    WriteTrainingCsv(filename, N_ROWS);
+    remove(cache_filename.c_str());
+    
+    MaskedVector<const HiggsTrainingCsvRow> parsed = hrf::LoadTrainingData(filename, false);
+    ASSERT_EQ(true, hrf::IsBinaryCacheFresh(filename, cache_filename));
+    
+    hrf::BinaryCacheFile cache;
+    ASSERT_EQ(true, cache.Open(cache_filename));
+    EXPECT_EQ(N_ROWS, cache.size());
+    cache.Close();
+    
+    MaskedVector<const HiggsTrainingCsvRow> cached = hrf::LoadTrainingData(filename, false);
+    ASSERT_EQ(N_ROWS, cached.size());
+    for (int row=0; row<N_ROWS; ++row) {
+        EXPECT_EQ(parsed[row].EventId_, cached[row].EventId_);
+        EXPECT_EQ(parsed[row].Weight_, cached[row].Weight_);
+        EXPECT_EQ(parsed[row].Label_, cached[row].Label_);
+        for (int i=0; i<HiggsTrainingCsvRow::NUM_FEATURES; ++i) {
+            if (std::isnan(parsed[row].data_[i])) {
+                EXPECT_TRUE(std::isnan(cached[row].data_[i]));
+            }
+            else {
+                EXPECT_EQ(parsed[row].data_[i], cached[row].data_[i]);
+            }
+        }
+    }
+    
+    remove(cache_filename.c_str());
+    remove(filename);
+}
+
+// max_rows_ alone should just give the first max_rows_ rows
+TEST(ParserTests, RowLimit) {
+    const char* filename = "parser_test_limit.csv";
+    WriteTrainingCsv(filename, 100);
+    
+    hrf::LoadOptions options;
+    options.use_cache_ = false;
+    options.max_rows_ = 10;
+    MaskedVector<const HiggsTrainingCsvRow> rows = hrf::LoadTrainingData(filename, options);
+    
+    ASSERT_EQ(10, rows.size());
+    for (int row=0; row<10; ++row) {
+        EXPECT_EQ(100000 + row, rows[row].EventId_);
+        EXPECT_DOUBLE_EQ(row * 0.001, rows[row].Weight_);
+    }
+    
+    remove(filename);
+}
+
+// The same seed should give the same sample, whether the rows come from the
+// csv file or from the binary cache
+TEST(ParserTests, SampleReproducible) {
+    const char* filename = "parser_test_sampled.csv";
+    const std::string cache_filename = hrf::BinaryCacheName(filename);
+    const int N_ROWS = 1000;
+    WriteTrainingCsv(filename, N_ROWS);
+    remove(cache_filename.c_str());
+    
+    hrf::LoadOptions options;
+    options.use_cache_ = false;
+    options.sample_fraction_ = 0.25;
+    
+    bkp::random::Seed(7);
+    MaskedVector<const HiggsTrainingCsvRow> first = hrf::LoadTrainingData(filename, options);
+    bkp::random::Seed(7);
+    MaskedVector<const HiggsTrainingCsvRow> second = hrf::LoadTrainingData(filename, options);
+    
+    // write the cache with a full load, then sample from it
+    hrf::LoadTrainingData(filename, false);
+    ASSERT_EQ(true, hrf::IsBinaryCacheFresh(filename, cache_filename));
+    options.use_cache_ = true;
+    bkp::random::Seed(7);
+    MaskedVector<const HiggsTrainingCsvRow> cached = hrf::LoadTrainingData(filename, options);
+    
+    ASSERT_EQ(250, first.size());
+    ASSERT_EQ(first.size(), second.size());
+    ASSERT_EQ(first.size(), cached.size());
+    for (std::size_t row=0; row<first.size(); ++row) {
+        EXPECT_EQ(first[row].EventId_, second[row].EventId_);
+        EXPECT_EQ(first[row].EventId_, cached[row].EventId_);
+        EXPECT_EQ(first[row].Weight_, cached[row].Weight_);
+        if (row > 0) {
+            EXPECT_LT(first[row-1].EventId_, first[row].EventId_); // file order
+        }
+    }
+    
+    remove(cache_filename.c_str());
+    remove(filename);
+}
+
+// Stratified sampling keeps the file's mix of labels: 1/3 of the rows in
+// WriteTrainingCsv's files are signal
+TEST(ParserTests, StratifiedSample) {
+    const char* filename = "parser_test_stratified.csv";
+    WriteTrainingCsv(filename, 3000);
+    
+    hrf::LoadOptions options;
+    options.use_cache_ = false;
+    options.sample_fraction_ = 0.1;
+    options.stratify_ = true;
+    
+    for (int seed=0; seed<5; ++seed) {
+        bkp::random::Seed(seed);
+        MaskedVector<const HiggsTrainingCsvRow> rows = hrf::LoadTrainingData(filename, options);
+        
+        int n_signal = 0;
+        for (const HiggsTrainingCsvRow& row : rows) {
+            n_signal += (row.Label_ == 's');
+        }
+        EXPECT_EQ(300, rows.size());
+        EXPECT_EQ(100, n_signal);
+    }
+    
+    remove(filename);
+}
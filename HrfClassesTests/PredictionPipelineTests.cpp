@@ -0,0 +1,112 @@
+//
+//  PredictionPipelineTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/iterator/counting_iterator.hpp>
+
+#include "PredictionPipeline.h"
+#include "Parser.h"
+#include "MappedFile.h"
+#include "FileWrapper.h"
+
+// An IScorer whose predictions depend on the row: s_score is feature 0,
+// b_score is a constant. Lets us check that every row's prediction lands
+// next to the right EventId.
+class FirstFeatureScorer : public hrf::IScorer {
+public:
+    virtual hrf::ScoreResult Score(const bkp::MaskedVector<const hrf::HiggsCsvRow>& data, bool /*parallel*/=false) {
+        std::vector<double> s_scores, b_scores;
+        for (const hrf::HiggsCsvRow& row : data) {
+            s_scores.push_back(row.data_[0]);
+            b_scores.push_back(50.0);
+        }
+        return hrf::ScoreResult(std::move(s_scores), std::move(b_scores));
+    }
+};
+
+// helper fn: write a fake test.csv with n_rows rows to 'filename'
+void WriteTestCsv(const char* filename, int n_rows) {
+    bkp::FileWrapper out;
+    ASSERT_EQ(true, out.Open(filename, "w"));
+    out.Printf("EventId");
+    for (int i=0; i<hrf::HiggsCsvRow::NUM_FEATURES; ++i) {
+        out.Printf(",F%d", i);
+    }
+    out.Printf("\n");
+    
+    for (int row=0; row<n_rows; ++row) {
+        out.Printf("%d", 350000 + row);
+        for (int i=0; i<hrf::HiggsCsvRow::NUM_FEATURES; ++i) {
+            out.Printf(",%d", (row * 37 + i) % 100);
+        }
+        out.Printf("\n");
+    }
+}
+
+// helper fn: read a whole file into a string
+std::string ReadWholeFile(const char* filename) {
+    bkp::MappedFile f;
+    if (!f.Open(filename)) {
+        return "";
+    }
+    return std::string(f.data(), f.size());
+}
+
+// Streaming must write exactly the same file as loading everything,
+// classifying everything and then calling WritePredictions. Use a small
+// batch size and queue so that the input is split into many batches and
+// the bounded queues actually fill up.
+TEST(PredictionPipelineTests, MatchesWritePredictions) {
+    const char* in_filename = "pipeline_test_in.csv";
+    const char* expected_filename = "pipeline_test_expected.csv";
+    const char* actual_filename = "pipeline_test_actual.csv";
+    const int N_ROWS = 1000;
+    WriteTestCsv(in_filename, N_ROWS);
+    
+    hrf::Classifier classifier(std::unique_ptr<hrf::IScorer>(new FirstFeatureScorer()), 1.0);
+    
+    auto test_data = hrf::LoadTestData(in_filename, false, false);
+    auto predictions = classifier.Classify(test_data, false);
+    std::vector<int> confidences(boost::counting_iterator<int>(0),
+                                 boost::counting_iterator<int>(N_ROWS));
+    ASSERT_EQ(true, hrf::WritePredictions(expected_filename, test_data, predictions, confidences));
+    
+    hrf::PipelineOptions options;
+    options.batch_size_ = 64;
+    options.queue_capacity_ = 2;
+    options.parallel_ = false;
+    ASSERT_EQ(true, hrf::StreamPredictions(classifier, in_filename, actual_filename, options));
+    
+    std::string expected = ReadWholeFile(expected_filename);
+    std::string actual = ReadWholeFile(actual_filename);
+    EXPECT_NE(std::string::npos, expected.find(",s\n")); // make sure the test is meaningful
+    EXPECT_NE(std::string::npos, expected.find(",b\n"));
+    EXPECT_EQ(expected, actual);
+    
+    remove(in_filename);
+    remove(expected_filename);
+    remove(actual_filename);
+}
+
+// An input with no rows should still produce a file with a header
+TEST(PredictionPipelineTests, HeaderOnly) {
+    const char* in_filename = "pipeline_test_empty.csv";
+    const char* out_filename = "pipeline_test_empty_out.csv";
+    WriteTestCsv(in_filename, 0);
+    
+    hrf::Classifier classifier(std::unique_ptr<hrf::IScorer>(new FirstFeatureScorer()), 1.0);
+    ASSERT_EQ(true, hrf::StreamPredictions(classifier, in_filename, out_filename));
+    EXPECT_EQ("EventId,RankOrder,Class\n", ReadWholeFile(out_filename));
+    
+    remove(in_filename);
+    remove(out_filename);
+}
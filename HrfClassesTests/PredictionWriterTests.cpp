@@ -0,0 +1,87 @@
+//
+//  PredictionWriterTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <climits>
+#include <string>
+
+#include "PredictionWriter.h"
+#include "MappedFile.h"
+
+// helper fn: read a whole file into a string
+std::string ReadWriterOutput(const char* filename) {
+    bkp::MappedFile f;
+    if (!f.Open(filename)) {
+        return "";
+    }
+    return std::string(f.data(), f.size());
+}
+
+// helper fn: write n_rows rows (including some awkward numbers) with a
+// PredictionWriter, and return what printf would have written for them
+std::string WriteRows(hrf::PredictionWriter& writer, int n_rows) {
+    std::string expected = "EventId,RankOrder,Class\n";
+    char line[64];
+    for (int i=0; i<n_rows; ++i) {
+        int event_id = 350000 + i * 7919;
+        int rank_order = i;
+        if (i == 1) { event_id = 0; rank_order = -1; }
+        if (i == 2) { event_id = INT_MAX; rank_order = INT_MIN; }
+        if (i == 3) { event_id = -10; rank_order = 1000000000; }
+        char prediction = (i % 3 == 0) ? 's' : 'b';
+
+        EXPECT_EQ(true, writer.Write(event_id, rank_order, prediction));
+        snprintf(line, sizeof(line), "%d,%d,%c\n", event_id, rank_order, prediction);
+        expected += line;
+    }
+    return expected;
+}
+
+// The output must match printf exactly. Use a tiny buffer so that it gets
+// flushed many times.
+TEST(PredictionWriterTests, MatchesPrintf) {
+    const char* filename = "prediction_writer_test.csv";
+
+    hrf::PredictionWriter writer;
+    ASSERT_EQ(true, writer.Open(filename, false, 100));
+    std::string expected = WriteRows(writer, 1000);
+    ASSERT_EQ(true, writer.Close());
+
+    EXPECT_EQ(expected, ReadWriterOutput(filename));
+    remove(filename);
+}
+
+TEST(PredictionWriterTests, Background) {
+    const char* filename = "prediction_writer_test_bg.csv";
+
+    hrf::PredictionWriter writer;
+    ASSERT_EQ(true, writer.Open(filename, true, 100));
+    std::string expected = WriteRows(writer, 1000);
+    ASSERT_EQ(true, writer.Close());
+
+    EXPECT_EQ(expected, ReadWriterOutput(filename));
+    remove(filename);
+}
+
+TEST(PredictionWriterTests, HeaderOnly) {
+    const char* filename = "prediction_writer_test_empty.csv";
+    {
+        hrf::PredictionWriter writer;
+        ASSERT_EQ(true, writer.Open(filename, true));
+        // let the destructor close it
+    }
+    EXPECT_EQ("EventId,RankOrder,Class\n", ReadWriterOutput(filename));
+    remove(filename);
+}
+
+TEST(PredictionWriterTests, OpenFailure) {
+    hrf::PredictionWriter writer;
+    EXPECT_EQ(false, writer.Open("no_such_directory/predictions.csv"));
+    EXPECT_EQ(false, writer.Close());
+}
@@ -129,3 +129,78 @@ TEST(ScoreAveragerTests, BasicParallel) {
         EXPECT_DOUBLE_EQ(expected_gmeans.b_scores_[i], result.b_scores_[i]);
     }
 }
+
+// helper class: an IScorer that counts how many times it's been asked to
+// Score something
+class CountingScorer : public hrf::IScorer {
+private:
+    std::unique_ptr<hrf::ScoreCacher> scorer_;
+public:
+    int n_scored_;
+    
+    CountingScorer(std::unique_ptr<hrf::ScoreCacher> scorer) :
+    scorer_(std::move(scorer)),
+    n_scored_(0)
+    { }
+    
+    virtual hrf::ScoreResult Score(const bkp::MaskedVector<const hrf::HiggsCsvRow>& data, bool parallel=false) {
+        ++n_scored_;
+        return scorer_->Score(data, parallel);
+    }
+};
+
+// helper fn: wrap some IScorers up as an IScorerVector
+hrf::ScoreAverager::IScorerVector make_batch(std::initializer_list<hrf::IScorer*> models) {
+    std::vector<std::unique_ptr<hrf::IScorer>> batch;
+    for (hrf::IScorer* model : models) {
+        batch.push_back(std::unique_ptr<hrf::IScorer>(model));
+    }
+    return hrf::ScoreAverager::IScorerVector(
+        new std::vector<std::unique_ptr<hrf::IScorer>>(std::move(batch))
+    );
+}
+
+// Grow a ScoreAverager one batch of sub-models at a time, keeping a
+// ScoreSums up to date as it goes: each sub-model only scores the data once,
+// and the result matches averaging them all at once
+TEST(ScoreAveragerTests, Grow) {
+    
+    const int N_ROWS = 3;
+    
+    for (bool parallel : {false, true}) {
+        // owned by averager, once they've been added
+        auto score_1 = new CountingScorer(make_scorer({1.0, 1.5, 2.0},
+                                                      {10.0, 15.0, 20.0}));
+        auto score_2 = new CountingScorer(make_scorer({2.0, 4.0, 6.0},
+                                                      {1.0, 3.0, 5.0}));
+        auto score_3 = new CountingScorer(make_scorer({3.14, 1.59, 2.65},
+                                                      {3.58, 9.79, 1.23}));
+        
+        hrf::ScoreAverager averager;
+        hrf::ScoreSums sums;
+        averager.Accumulate(mock::MockRows(N_ROWS), sums, parallel);
+        EXPECT_EQ(0, sums.n_models_);
+        
+        averager.AddModels(make_batch({score_1}));
+        averager.Accumulate(mock::MockRows(N_ROWS), sums, parallel);
+        EXPECT_EQ(1, sums.n_models_);
+        EXPECT_DOUBLE_EQ(1.5, sums.Mean().s_scores_[1]);
+        
+        averager.AddModels(make_batch({score_2, score_3}));
+        averager.Accumulate(mock::MockRows(N_ROWS), sums, parallel);
+        ASSERT_EQ(3, averager.size());
+        EXPECT_EQ(3, sums.n_models_);
+        EXPECT_EQ(1, score_1->n_scored_);
+        EXPECT_EQ(1, score_2->n_scored_);
+        EXPECT_EQ(1, score_3->n_scored_);
+        
+        auto result = sums.Mean();
+        auto all_at_once = averager.Score(mock::MockRows(N_ROWS), parallel);
+        for (int i=0; i<N_ROWS; ++i) {
+            EXPECT_DOUBLE_EQ(all_at_once.s_scores_[i], result.s_scores_[i]);
+            EXPECT_DOUBLE_EQ(all_at_once.b_scores_[i], result.b_scores_[i]);
+        }
+        EXPECT_DOUBLE_EQ(gmean(1.5, 4.0, 1.59), result.s_scores_[1]);
+        EXPECT_DOUBLE_EQ(gmean(20.0, 5.0, 1.23), result.b_scores_[2]);
+    }
+}
@@ -0,0 +1,170 @@
+//
+//  SplitKernelsTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+#include "SplitKernels.h"
+#include "RandUtils.h"
+
+using hrf::trainer::CountAboveKernel;
+using hrf::trainer::SCALAR_KERNEL;
+using hrf::trainer::AVX2_KERNEL;
+using hrf::trainer::AVX512_KERNEL;
+
+// helper fn: the kernels that can run on this machine
+std::vector<CountAboveKernel> SupportedKernels() {
+    std::vector<CountAboveKernel> result;
+    for (CountAboveKernel kernel : { SCALAR_KERNEL, AVX2_KERNEL, AVX512_KERNEL }) {
+        if (hrf::trainer::IsKernelSupported(kernel)) {
+            result.push_back(kernel);
+        }
+    }
+    return result;
+}
+
+// helper fn: random 0/1 signal flags
+std::vector<unsigned char> RandomSignal(std::size_t n) {
+    std::vector<unsigned char> result(n);
+    for (std::size_t i=0; i<n; ++i) {
+        result[i] = static_cast<unsigned char>(bkp::random::RandInt(0, 1));
+    }
+    return result;
+}
+
+// helper fn: count with every supported kernel (including lengths that
+// aren't a multiple of the block size, and thresholds at, between and
+// outside the values) and check they all agree with the scalar kernel
+template<class TValue, class TThreshold>
+void ExpectKernelsAgree(const std::vector<TValue>& vals,
+                        const std::vector<unsigned char>& is_signal,
+                        const std::vector<TThreshold>& thresholds)
+{
+    for (std::size_t n : { vals.size(), vals.size() - 1, vals.size() - 63, std::size_t(5), std::size_t(0) }) {
+        for (TThreshold threshold : thresholds) {
+            int n_expected, s_expected;
+            hrf::trainer::CountAbove(vals.data(), is_signal.data(), n, threshold, n_expected, s_expected, SCALAR_KERNEL);
+            for (CountAboveKernel kernel : SupportedKernels()) {
+                int n_above = -1;
+                int s_above = -1;
+                hrf::trainer::CountAbove(vals.data(), is_signal.data(), n, threshold, n_above, s_above, kernel);
+                EXPECT_EQ(n_expected, n_above) << "kernel " << kernel << ", n " << n;
+                EXPECT_EQ(s_expected, s_above) << "kernel " << kernel << ", n " << n;
+            }
+        }
+    }
+}
+
+TEST(SplitKernelsTests, ScalarCounts) {
+    const double vals[] = { 1.0, NAN, 3.0, 2.0, -1.0 };
+    const unsigned char is_signal[] = { 1, 1, 0, 1, 1 };
+    int n_above, s_above;
+    hrf::trainer::CountAbove(vals, is_signal, 5, 2.0, n_above, s_above, SCALAR_KERNEL);
+    EXPECT_EQ(2, n_above);
+    EXPECT_EQ(1, s_above);
+}
+
+TEST(SplitKernelsTests, BestKernelSupported) {
+    EXPECT_EQ(true, hrf::trainer::IsKernelSupported(SCALAR_KERNEL));
+    EXPECT_EQ(true, hrf::trainer::IsKernelSupported(hrf::trainer::BestCountAboveKernel()));
+}
+
+TEST(SplitKernelsTests, DoubleKernelsAgree) {
+    bkp::random::Seed(14);
+    const std::size_t n = 1000;
+    std::vector<double> vals = bkp::random::RandDoubles(n, -10.0, 10.0);
+    for (std::size_t i=0; i<n; i+=7) {
+        vals[i] = NAN;
+    }
+    vals[3] = 2.5;
+    std::vector<double> thresholds = { 2.5, 0.0, -100.0, 100.0, -std::numeric_limits<double>::infinity() };
+    ExpectKernelsAgree(vals, RandomSignal(n), thresholds);
+}
+
+TEST(SplitKernelsTests, FloatKernelsAgree) {
+    bkp::random::Seed(15);
+    const std::size_t n = 1000;
+    std::vector<float> vals(n);
+    for (std::size_t i=0; i<n; ++i) {
+        vals[i] = (i % 5 == 0) ? NAN : static_cast<float>(bkp::random::RandDouble(-10.0, 10.0));
+    }
+    vals[3] = 2.5f;
+    std::vector<float> thresholds = { 2.5f, 0.0f, -100.0f, 100.0f, -std::numeric_limits<float>::infinity() };
+    ExpectKernelsAgree(vals, RandomSignal(n), thresholds);
+}
+
+TEST(SplitKernelsTests, QuantizedKernelsAgree) {
+    bkp::random::Seed(16);
+    const std::size_t n = 1000;
+    std::vector<std::uint16_t> vals(n);
+    for (std::size_t i=0; i<n; ++i) {
+        // include 0 (the NaN code) and the largest codes, which catch
+        // signed comparisons
+        vals[i] = static_cast<std::uint16_t>(bkp::random::RandInt(0, 0xffff));
+    }
+    vals[3] = 0;
+    vals[4] = 0xffff;
+    vals[5] = 0x8000;
+    std::vector<std::uint32_t> thresholds = { 1, 0x7fff, 0x8000, 0x8001, 0xffff, 0x10000 };
+    ExpectKernelsAgree(vals, RandomSignal(n), thresholds);
+}
+
+// Microbenchmark: how long each kernel takes to count a node-sized column.
+// Run with --gtest_also_run_disabled_tests.
+TEST(SplitKernelsTests, DISABLED_Benchmark) {
+    const std::size_t n = 250000;
+    const int n_reps = 200;
+    bkp::random::Seed(17);
+    std::vector<double> doubles = bkp::random::RandDoubles(n, -10.0, 10.0);
+    std::vector<float> floats(doubles.begin(), doubles.end());
+    std::vector<std::uint16_t> codes(n);
+    for (std::size_t i=0; i<n; ++i) {
+        codes[i] = static_cast<std::uint16_t>(bkp::random::RandInt(1, 0xffff));
+    }
+    std::vector<unsigned char> is_signal = RandomSignal(n);
+
+    for (CountAboveKernel kernel : SupportedKernels()) {
+        const char* name = (kernel == SCALAR_KERNEL) ? "scalar" : (kernel == AVX2_KERNEL) ? "avx2" : "avx512";
+        int n_above, s_above;
+        long long checksum = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int rep=0; rep<n_reps; ++rep) {
+            hrf::trainer::CountAbove(doubles.data(), is_signal.data(), n, rep * 0.1 - 10.0, n_above, s_above, kernel);
+            checksum += n_above + s_above;
+        }
+        auto double_time = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int rep=0; rep<n_reps; ++rep) {
+            hrf::trainer::CountAbove(floats.data(), is_signal.data(), n, rep * 0.1f - 10.0f, n_above, s_above, kernel);
+            checksum += n_above + s_above;
+        }
+        auto float_time = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int rep=0; rep<n_reps; ++rep) {
+            hrf::trainer::CountAbove(codes.data(), is_signal.data(), n, rep * 300u, n_above, s_above, kernel);
+            checksum += n_above + s_above;
+        }
+        auto quantized_time = std::chrono::steady_clock::now() - start;
+
+        typedef std::chrono::duration<double, std::micro> micros;
+        printf("%-7s double %7.1fus  float %7.1fus  quantized16 %7.1fus per %d rows (checksum %lld)\n",
+               name,
+               micros(double_time).count() / n_reps,
+               micros(float_time).count() / n_reps,
+               micros(quantized_time).count() / n_reps,
+               static_cast<int>(n),
+               checksum);
+    }
+}
@@ -0,0 +1,110 @@
+//
+//  StreamedTrainingSetTests.cpp
+//  RandomForest++
+//
+//  Created by Brian Putnam on 11/10/14.
+//  Copyright (c) 2014 Brian Putnam. All rights reserved.
+//
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "StreamedTrainingSet.h"
+#include "BinaryCache.h"
+#include "FileWrapper.h"
+#include "Mock.h"
+
+using hrf::HiggsTrainingCsvRow;
+
+// helper fn: n random training rows, every third one signal
+std::vector<const HiggsTrainingCsvRow> StreamedRows(int n) {
+    std::vector<const HiggsTrainingCsvRow> rows;
+    for (int i=0; i<n; ++i) {
+        rows.push_back(HiggsTrainingCsvRow(i,
+                                           mock::PartialDataRandFill({i * 0.1}),
+                                           1.0 + i,
+                                           (i % 3 == 0) ? 's' : 'b'));
+    }
+    return rows;
+}
+
+// Each chunk holds its own rows, binned exactly as a BINNED8_FEATURES
+// FeatureMatrix of every row would bin them (when the bins are chosen from
+// every row), whatever order the chunks are read in
+TEST(StreamedTrainingSetTests, Chunks) {
+    mock::TempFile temp_file("streamed_training_set_test.hrfbin");
+    const char* filename = temp_file.Path();
+    const int N_ROWS = 23;
+    auto rows = StreamedRows(N_ROWS);
+    ASSERT_EQ(true, hrf::WriteBinaryCache(filename, rows, 0));
+    const hrf::FeatureMatrix all_rows(bkp::MaskedVector<const HiggsTrainingCsvRow>(std::move(rows)),
+                                      hrf::BINNED8_FEATURES);
+    
+    hrf::StreamedTrainingSet training_set;
+    ASSERT_EQ(true, training_set.Open(filename, 10));
+    EXPECT_EQ(N_ROWS, training_set.size());
+    ASSERT_EQ(3, training_set.NumChunks());
+    EXPECT_EQ(0, training_set.Encoding().size());
+    
+    // the scratch file of bins is already deleted
+    bkp::FileWrapper codes;
+    EXPECT_EQ(false, codes.Open(std::string(filename) + ".codes", "rb"));
+    
+    const std::vector<int> features({7, 0});
+    hrf::FeatureMatrix chunk;
+    for (int c=2; c>=0; --c) {
+        ASSERT_EQ(true, training_set.LoadChunk(c, features, chunk));
+        ASSERT_EQ((c < 2) ? 10 : 3, chunk.size());
+        EXPECT_EQ(hrf::BINNED8_FEATURES, chunk.Storage());
+        for (std::size_t i=0; i<chunk.size(); ++i) {
+            const int row = c * 10 + static_cast<int>(i);
+            EXPECT_EQ(row, chunk.EventIds()[i]);
+            EXPECT_EQ(all_rows.Weights()[row], chunk.Weights()[i]);
+            EXPECT_EQ(all_rows.IsSignal()[row], chunk.IsSignal()[i]);
+            for (int feature : features) {
+                EXPECT_EQ(all_rows.Get(row, feature), chunk.Get(i, feature));
+            }
+        }
+    }
+}
+
+// With a smaller bin sample, the bins are chosen from every nth row
+TEST(StreamedTrainingSetTests, BinSample) {
+    mock::TempFile temp_file("streamed_training_set_sample_test.hrfbin");
+    const char* filename = temp_file.Path();
+    ASSERT_EQ(true, hrf::WriteBinaryCache(filename, StreamedRows(20), 0));
+    
+    hrf::StreamedTrainingSet training_set;
+    ASSERT_EQ(true, training_set.Open(filename, 8, 5));
+    
+    // feature 0 is i * 0.1, so rows 0, 4, 8, 12 and 16 give one bin each
+    const hrf::BinnedColumnView view = training_set.Encoding().View<hrf::BinnedColumnView>(0);
+    EXPECT_DOUBLE_EQ(0.0, view.lower_bounds_[1]);
+    EXPECT_DOUBLE_EQ(0.4, view.lower_bounds_[2]);
+    EXPECT_DOUBLE_EQ(1.6, view.lower_bounds_[5]);
+    EXPECT_TRUE(std::isinf(view.lower_bounds_[6]));
+    
+    // rows between the sampled ones go in the bin below them
+    hrf::FeatureMatrix chunk;
+    ASSERT_EQ(true, training_set.LoadChunk(1, std::vector<int>({0}), chunk));
+    ASSERT_EQ(8, chunk.size());
+    EXPECT_DOUBLE_EQ(0.8, chunk.Get(0, 0)); // row 8
+    EXPECT_DOUBLE_EQ(0.8, chunk.Get(3, 0)); // row 11
+    EXPECT_DOUBLE_EQ(1.2, chunk.Get(4, 0)); // row 12
+}
+
+// Files that don't exist, or have no labels, can't be trained on
+TEST(StreamedTrainingSetTests, OpenFailure) {
+    hrf::StreamedTrainingSet training_set;
+    EXPECT_EQ(false, training_set.Open("this_file_does_not_exist.hrfbin"));
+    
+    mock::TempFile temp_file("streamed_training_set_nolabels_test.hrfbin");
+    const char* filename = temp_file.Path();
+    std::vector<const hrf::HiggsCsvRow> rows;
+    rows.push_back(hrf::HiggsCsvRow(1, mock::PartialDataRandFill({})));
+    ASSERT_EQ(true, hrf::WriteBinaryCache(filename, rows, 0));
+    EXPECT_EQ(false, training_set.Open(filename));
+}
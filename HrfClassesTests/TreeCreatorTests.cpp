@@ -7,10 +7,15 @@
 //
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 
 #include "TreeCreator.h"
+#include "BinaryCache.h"
 #include "Mock.h"
 #include "TreeTrainer.h"
+#include "RandUtils.h"
 
 // helper method: factored out because this was repeated a couple different times
 bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> DefaultTrainingSet() {
@@ -84,4 +89,256 @@ TEST(TreeCreatorTests, Parallel) {
         ASSERT_NE(nullptr, tree_ptr);
         EXPECT_GT(tree_ptr->children_.size(), 0);
     }
-}
\ No newline at end of file
+}
+
+// MakeTreesBatched makes the right number of trained trees, including a
+// final batch smaller than the others
+TEST(TreeCreatorTests, Batched) {
+    
+    hrf::TreeCreator tree_factory(hrf::FeatureMatrix(DefaultTrainingSet(), hrf::BINNED8_FEATURES),
+                                  hrf::trainer::TrainBestDim,
+                                  3);
+    auto forest = tree_factory.MakeTreesBatched(37, hrf::trainer::TrainBestDimBatch, 16);
+    
+    ASSERT_NE(nullptr, forest.get());
+    ASSERT_EQ(37, forest->size());
+    for (auto& iscorer_uptr : *forest) {
+        hrf::Tree* tree_ptr = dynamic_cast<hrf::Tree*>(iscorer_uptr.get());
+        ASSERT_NE(nullptr, tree_ptr);
+        EXPECT_GT(tree_ptr->children_.size(), 0);
+    }
+}
+
+// Stratified subsamples have exactly the requested number of each Label,
+// and InBag records which rows each tree was trained on
+TEST(TreeCreatorTests, Subsample) {
+    
+    hrf::TreeSampleOptions sample_options;
+    sample_options.method_ = hrf::SUBSAMPLE;
+    sample_options.sample_fraction_ = 0.6;
+    sample_options.stratify_ = true;
+    hrf::TreeCreator tree_factory(DefaultTrainingSet(),
+                                  hrf::trainer::TrainBestDimSample,
+                                  3,
+                                  sample_options);
+    auto forest = tree_factory.MakeTrees(20);
+    
+    // 3 's' rows and 2 'b' rows: round(0.6*3) = 2 and round(0.6*2) = 1
+    const bool is_signal[] = { true, true, false, true, false };
+    ASSERT_EQ(20, tree_factory.InBag().size());
+    for (const std::vector<bool>& in_bag : tree_factory.InBag()) {
+        ASSERT_EQ(5, in_bag.size());
+        int s_count = 0;
+        int b_count = 0;
+        for (int i=0; i<5; ++i) {
+            if (in_bag[i]) {
+                ++(is_signal[i] ? s_count : b_count);
+            }
+        }
+        EXPECT_EQ(2, s_count);
+        EXPECT_EQ(1, b_count);
+    }
+}
+
+// Every bootstrap-sampled tree is trained, and each keeps its in-bag rows;
+// trees trained on every row keep none
+TEST(TreeCreatorTests, Bootstrap) {
+    
+    const int N_TREES = 1009; // enough for a few trees per parallel job
+    
+    hrf::TreeSampleOptions sample_options;
+    sample_options.method_ = hrf::BOOTSTRAP;
+    sample_options.stratify_ = true;
+    hrf::TreeCreator tree_factory(DefaultTrainingSet(),
+                                  hrf::trainer::TrainBestDimSample,
+                                  3,
+                                  sample_options);
+    auto forest = tree_factory.MakeTreesParallel(N_TREES);
+    
+    ASSERT_EQ(N_TREES, forest->size());
+    ASSERT_EQ(N_TREES, tree_factory.InBag().size());
+    for (int i=0; i<N_TREES; ++i) {
+        hrf::Tree* tree_ptr = dynamic_cast<hrf::Tree*>((*forest)[i].get());
+        ASSERT_NE(nullptr, tree_ptr);
+        EXPECT_GT(tree_ptr->children_.size(), 0);
+        
+        const std::vector<bool>& in_bag = tree_factory.InBag()[i];
+        ASSERT_EQ(5, in_bag.size());
+        EXPECT_GE(std::count(in_bag.begin(), in_bag.end(), true), 2);
+    }
+    
+    hrf::TreeCreator all_rows_factory(DefaultTrainingSet(),
+                                      hrf::trainer::TrainBestDimSample,
+                                      3,
+                                      hrf::TreeSampleOptions());
+    all_rows_factory.MakeTrees(3);
+    ASSERT_EQ(3, all_rows_factory.InBag().size());
+    EXPECT_EQ(0, all_rows_factory.InBag()[0].size());
+}
+
+// With stratify_, a training set with only one Label has an empty stratum,
+// which is skipped rather than drawn from
+TEST(TreeCreatorTests, EmptyStratum) {
+    
+    const hrf::SampleMethod methods[] = { hrf::BOOTSTRAP, hrf::SUBSAMPLE };
+    for (hrf::SampleMethod method : methods) {
+        std::vector<const hrf::HiggsTrainingCsvRow> data_vector;
+        for (int i=0; i<4; ++i) {
+            data_vector.push_back(hrf::HiggsTrainingCsvRow(i, mock::PartialDataRandFill({i * 1.0, i * 10.0, i * 100.0}),
+                                                           1.0, 'b'));
+        }
+        hrf::TreeSampleOptions sample_options;
+        sample_options.method_ = method;
+        sample_options.sample_fraction_ = 0.5;
+        sample_options.stratify_ = true;
+        hrf::TreeCreator tree_factory(bkp::MaskedVector<const hrf::HiggsTrainingCsvRow>(std::move(data_vector)),
+                                      hrf::trainer::TrainBestDimSample,
+                                      3,
+                                      sample_options);
+        auto forest = tree_factory.MakeTrees(5);
+        
+        // round(0.5*4) = 2 draws from the 'b' stratum, none from the 's' one
+        ASSERT_EQ(5, tree_factory.InBag().size());
+        for (const std::vector<bool>& in_bag : tree_factory.InBag()) {
+            ASSERT_EQ(4, in_bag.size());
+            const long n_in_bag = std::count(in_bag.begin(), in_bag.end(), true);
+            EXPECT_GE(n_in_bag, method == hrf::BOOTSTRAP ? 1 : 2);
+            EXPECT_LE(n_in_bag, 2);
+        }
+    }
+}
+
+// Trees with small samples are trained on a projection holding just their
+// sample's rows, with their in-bag rows still indexing the full training set,
+// unless the storage is one that's never projected
+TEST(TreeCreatorTests, ProjectedSample) {
+    
+    hrf::TreeSampleOptions sample_options;
+    sample_options.method_ = hrf::SUBSAMPLE;
+    sample_options.sample_fraction_ = 0.25;
+    sample_options.stratify_ = true;
+    
+    // 8 's' rows and 4 'b' rows
+    std::vector<const hrf::HiggsTrainingCsvRow> data_vector;
+    for (int i=0; i<12; ++i) {
+        data_vector.push_back(hrf::HiggsTrainingCsvRow(i, mock::PartialDataRandFill({i * 1.0, i * 10.0, i * 100.0}),
+                                                       1.0, (i % 3 == 0) ? 'b' : 's'));
+    }
+    const bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> training_set(std::move(data_vector));
+    
+    std::vector<std::size_t> matrix_sizes;
+    auto trainer = [&matrix_sizes](hrf::Tree& tree,
+                                   const hrf::FeatureMatrix& training_rows,
+                                   const hrf::trainer::RowIndices& sample)
+    {
+        matrix_sizes.push_back(training_rows.size());
+        for (int row_index : sample) {
+            for (int feature : *tree.target_features_) {
+                EXPECT_FALSE(std::isnan(training_rows.Get(row_index, feature)));
+            }
+        }
+        hrf::trainer::TrainBestDimSample(tree, training_rows, sample);
+    };
+    
+    // round(0.25*8) = 2 and round(0.25*4) = 1
+    hrf::TreeCreator tree_factory(training_set, trainer, 3, sample_options);
+    auto forest = tree_factory.MakeTrees(10);
+    ASSERT_EQ(10, matrix_sizes.size());
+    for (int i=0; i<10; ++i) {
+        EXPECT_EQ(3, matrix_sizes[i]);
+        EXPECT_EQ(3, std::count(tree_factory.InBag()[i].begin(), tree_factory.InBag()[i].end(), true));
+        hrf::Tree* tree_ptr = dynamic_cast<hrf::Tree*>((*forest)[i].get());
+        ASSERT_NE(nullptr, tree_ptr);
+        EXPECT_GT(tree_ptr->children_.size(), 0);
+    }
+    
+    matrix_sizes.clear();
+    hrf::TreeCreator binned_factory(hrf::FeatureMatrix(training_set, hrf::BINNED8_FEATURES), trainer, 3, sample_options);
+    binned_factory.MakeTrees(3);
+    EXPECT_EQ(std::vector<std::size_t>(3, 12), matrix_sizes);
+}
+
+// Every tree is made in its own random stream, so for a given Seed the
+// serial and parallel methods make exactly the same forest
+TEST(TreeCreatorTests, ParallelMatchesSerial) {
+    
+    const int N_TREES = 23;
+    
+    hrf::TreeSampleOptions sample_options;
+    sample_options.method_ = hrf::BOOTSTRAP;
+    auto make_creator = [&]() {
+        return std::unique_ptr<hrf::TreeCreator>(new hrf::TreeCreator(DefaultTrainingSet(),
+                                                                      hrf::trainer::TrainRandDimSample,
+                                                                      2,
+                                                                      sample_options));
+    };
+    
+    bkp::random::Seed(17);
+    auto serial_creator = make_creator();
+    auto serial_forest = serial_creator->MakeTrees(N_TREES);
+    
+    bkp::random::Seed(17);
+    auto parallel_creator = make_creator();
+    auto parallel_forest = parallel_creator->MakeTreesParallel(N_TREES);
+    
+    hrf::FeatureMatrix data(DefaultTrainingSet());
+    ASSERT_EQ(N_TREES, parallel_forest->size());
+    EXPECT_EQ(serial_creator->InBag(), parallel_creator->InBag());
+    for (int i=0; i<N_TREES; ++i) {
+        hrf::Tree* serial_tree = dynamic_cast<hrf::Tree*>((*serial_forest)[i].get());
+        hrf::Tree* parallel_tree = dynamic_cast<hrf::Tree*>((*parallel_forest)[i].get());
+        ASSERT_NE(nullptr, parallel_tree);
+        EXPECT_EQ(*serial_tree->target_features_, *parallel_tree->target_features_);
+        
+        auto serial_scores = serial_tree->Score(data);
+        auto parallel_scores = parallel_tree->Score(data);
+        for (std::size_t row=0; row<data.size(); ++row) {
+            EXPECT_EQ(serial_scores.s_scores_[row], parallel_scores.s_scores_[row]);
+            EXPECT_EQ(serial_scores.b_scores_[row], parallel_scores.b_scores_[row]);
+        }
+    }
+    
+    // the next trees get new streams
+    auto more_trees = serial_creator->MakeTrees(N_TREES);
+    EXPECT_NE(serial_creator->InBag(), parallel_creator->InBag());
+}
+
+// MakeTreesStreamed makes the right number of trained trees, including a
+// final pass with fewer trees than the others, over the range of the bins
+TEST(TreeCreatorTests, Streamed) {
+    
+    mock::TempFile temp_file("tree_creator_streamed_test.hrfbin");
+    const char* filename = temp_file.Path();
+    auto training_set = DefaultTrainingSet();
+    std::vector<const hrf::HiggsTrainingCsvRow> row_vector;
+    for (std::size_t i=0; i<training_set.size(); ++i) {
+        row_vector.push_back(training_set[i]);
+    }
+    ASSERT_EQ(true, hrf::WriteBinaryCache(filename, row_vector, 0));
+    hrf::StreamedTrainingSet streamed;
+    ASSERT_EQ(true, streamed.Open(filename, 2));
+    
+    auto forest = hrf::MakeTreesStreamed(streamed, hrf::trainer::TrainRandDimStreamed, 3, 11, 4);
+    
+    ASSERT_NE(nullptr, forest.get());
+    ASSERT_EQ(11, forest->size());
+    for (auto& iscorer_uptr : *forest) {
+        hrf::Tree* tree_ptr = dynamic_cast<hrf::Tree*>(iscorer_uptr.get());
+        ASSERT_NE(nullptr, tree_ptr);
+        EXPECT_GT(tree_ptr->children_.size(), 0);
+        
+        // five rows, so each distinct value has its own bin, and the
+        // corners are the range of every feature's values
+        ASSERT_EQ(hrf::HiggsCsvRow::NUM_FEATURES, tree_ptr->min_corner_->size());
+        for (int feature=0; feature<hrf::HiggsCsvRow::NUM_FEATURES; ++feature) {
+            double min_val = training_set[0].data_[feature];
+            double max_val = training_set[0].data_[feature];
+            for (std::size_t i=1; i<training_set.size(); ++i) {
+                min_val = std::min(min_val, training_set[i].data_[feature]);
+                max_val = std::max(max_val, training_set[i].data_[feature]);
+            }
+            EXPECT_EQ(min_val, (*tree_ptr->min_corner_)[feature]);
+            EXPECT_EQ(max_val, (*tree_ptr->max_corner_)[feature]);
+        }
+    }
+}
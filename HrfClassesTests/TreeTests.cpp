@@ -7,8 +7,11 @@
 //
 
 #include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
 
 #include "Tree.h"
+#include "FeatureMatrix.h"
 #include "Mock.h"
 
 TEST(TreeTests, Volume) {
@@ -92,4 +95,43 @@ TEST(TreeTests, SplitTest) {
         EXPECT_EQ(expected_score.s_scores_[i], score.s_scores_[i]);
         EXPECT_EQ(expected_score.b_scores_[i], score.b_scores_[i]);
     }
+}
+
+// rows with a NaN in any of the tree's features (not just the one it splits
+// on) aren't scored, and are left as NaN for other trees to score; NaNs in
+// other features don't matter. Regression test: HasNan used to miss every
+// NaN, so these rows were sent down to the lower child instead.
+TEST(TreeTests, NanRows) {
+    
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    
+    hrf::Tree t(std::vector<int>({0, 1, 2}),
+                mock::shared_vector({1.0, 10.0, 100.0}),
+                mock::shared_vector({5.0, 50.0, 500.0}));
+    t.Split(0, 3.0);
+    t.children_[0].SetScore(10.0, 20.0);
+    t.children_[1].SetScore(30.0, 40.0);
+    
+    std::vector<const hrf::HiggsCsvRow> data_vector({
+        hrf::HiggsCsvRow(1, mock::PartialData({1.0, 10.0, 100.0})),
+        hrf::HiggsCsvRow(2, mock::PartialData({NaN, 20.0, 200.0})),
+        hrf::HiggsCsvRow(3, mock::PartialData({4.0, 30.0, NaN})),
+        hrf::HiggsCsvRow(4, mock::PartialData({4.0, 40.0, 400.0, 0.0, 0.0, NaN}))
+    });
+    bkp::MaskedVector<const hrf::HiggsCsvRow> data(std::move(data_vector));
+    
+    std::vector<hrf::ScoreResult> scores;
+    scores.push_back(t.Score(data));
+    scores.push_back(t.Score(hrf::FeatureMatrix(data)));
+    for (hrf::ScoreResult& score : scores) {
+        ASSERT_EQ(4, score.size());
+        EXPECT_EQ(30.0, score.s_scores_[0]);
+        EXPECT_EQ(40.0, score.b_scores_[0]);
+        EXPECT_TRUE(std::isnan(score.s_scores_[1]));
+        EXPECT_TRUE(std::isnan(score.b_scores_[1]));
+        EXPECT_TRUE(std::isnan(score.s_scores_[2]));
+        EXPECT_TRUE(std::isnan(score.b_scores_[2]));
+        EXPECT_EQ(10.0, score.s_scores_[3]);
+        EXPECT_EQ(20.0, score.b_scores_[3]);
+    }
 }
\ No newline at end of file
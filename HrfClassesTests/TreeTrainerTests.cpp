@@ -7,9 +7,15 @@
 //
 
 #include <gtest/gtest.h>
+#include <functional>
+#include <limits>
+#include <cmath>
+#include <cstdio>
 
 #include "TreeTrainer.h"
+#include "BinaryCache.h"
 #include "Mock.h"
+#include "RandUtils.h"
 
 
 TEST(TreeTrainerTests, Entropy) {
@@ -99,6 +105,209 @@ TEST(TreeTrainerTests, FindBestSplit) {
     
 }
 
+// FindBestSplit evaluates all of its candidate splits in one pass; check it
+// against trying each split separately, for each storage (including NaNs)
+TEST(TreeTrainerTests, FindBestSplitManyThresholds) {
+    
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    const int N_SPLITS = 64;
+    
+    std::vector<hrf::HiggsTrainingCsvRow> data_vector;
+    for (int i=0; i<500; ++i) {
+        bool is_signal = bkp::random::RandInt(2) == 0;
+        double val = bkp::random::RandDouble(0.0, 1.0) + (is_signal ? 0.2 : 0.0);
+        data_vector.push_back(hrf::HiggsTrainingCsvRow(i,
+                                                       mock::PartialData({ (i % 17 == 0) ? NaN : val }),
+                                                       1.0,
+                                                       is_signal ? 's' : 'b'));
+    }
+    bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> training_set(
+        std::vector<const hrf::HiggsTrainingCsvRow>(data_vector.begin(), data_vector.end())
+    );
+    
+    const hrf::FeatureStorage storages[] = {
+        hrf::DOUBLE_FEATURES,
+        hrf::FLOAT_FEATURES,
+        hrf::QUANTIZED16_FEATURES
+    };
+    for (hrf::FeatureStorage storage : storages) {
+        hrf::FeatureMatrix matrix(training_set, storage);
+        
+        bkp::random::Seed(3);
+        hrf::trainer::SplitErrorCode error;
+        double split, entropy;
+        std::tie(error, split, entropy) = hrf::trainer::FindBestSplit(matrix, 0, N_SPLITS);
+        ASSERT_EQ(hrf::trainer::SplitErrorCode::NO_ERROR, error);
+        
+        // brute force, with the same random splits
+        double dim_min = std::numeric_limits<double>::max();
+        double dim_max = std::numeric_limits<double>::lowest();
+        int s_count = 0;
+        for (std::size_t row=0; row<matrix.size(); ++row) {
+            s_count += matrix.IsSignal()[row];
+            double val = matrix.Get(row, 0);
+            if (!std::isnan(val)) {
+                dim_min = std::min(dim_min, val);
+                dim_max = std::max(dim_max, val);
+            }
+        }
+        int b_count = static_cast<int>(matrix.size()) - s_count;
+        
+        bkp::random::Seed(3);
+        auto splits = bkp::random::RandDoubles(N_SPLITS, dim_min, dim_max);
+        double expected_split = NaN;
+        double expected_entropy = 0.0;
+        for (double candidate : splits) {
+            int s_above = 0;
+            int b_above = 0;
+            for (std::size_t row=0; row<matrix.size(); ++row) {
+                if (matrix.Get(row, 0) >= candidate) {
+                    (matrix.IsSignal()[row] ? s_above : b_above) += 1;
+                }
+            }
+            double prob_above = static_cast<double>(s_above + b_above) / matrix.size();
+            double info = hrf::trainer::CalcEntropy(s_count, b_count) -
+                (prob_above * hrf::trainer::CalcEntropy(s_above, b_above) +
+                 (1.0 - prob_above) * hrf::trainer::CalcEntropy(s_count - s_above, b_count - b_above));
+            if (info > expected_entropy + 1e-12) {
+                expected_entropy = info;
+                expected_split = candidate;
+            }
+        }
+        
+        EXPECT_EQ(expected_split, split);
+        EXPECT_NEAR(expected_entropy, entropy, 1e-12);
+    }
+}
+
+// With binned features, every boundary between bins is tried, so the best
+// split is found exactly: halfway between the signal and background values
+TEST(TreeTrainerTests, HistogramSplit) {
+    
+    std::vector<const hrf::HiggsTrainingCsvRow> data_vector({
+        hrf::HiggsTrainingCsvRow(1, mock::PartialData({1.0, 10.0, 100.0}),
+                                 1.0, 's'),
+        hrf::HiggsTrainingCsvRow(2, mock::PartialData({2.0, 20.0, 200.0}),
+                                 2.0, 's'),
+        hrf::HiggsTrainingCsvRow(3, mock::PartialData({30.0, 30.0, 300.0}),
+                                 3.0, 'b'),
+        hrf::HiggsTrainingCsvRow(4, mock::PartialData({4.0, 40.0, 400.0}),
+                                 4.0, 's'),
+        hrf::HiggsTrainingCsvRow(5, mock::PartialData({50.0, 50.0, 500.0}),
+                                 5.0, 'b')
+    });
+    bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> training_set(std::move(data_vector));
+    hrf::FeatureMatrix binned(training_set, hrf::BINNED8_FEATURES);
+    
+    hrf::trainer::SplitErrorCode error;
+    double split, entropy;
+    std::tie(error, split, entropy) = hrf::trainer::FindBestSplit(binned, 0);
+    
+    EXPECT_EQ(hrf::trainer::SplitErrorCode::NO_ERROR, error);
+    EXPECT_EQ(17.0, split);
+    EXPECT_DOUBLE_EQ(hrf::trainer::CalcEntropy(3, 2), entropy);
+    
+    // only one (occupied) bin left: nothing to split
+    std::tie(error, split, entropy) = hrf::trainer::FindBestSplit(binned, hrf::trainer::RowIndices({0, 1}), 3);
+    EXPECT_EQ(hrf::trainer::SplitErrorCode::ZERO_WIDTH_DIM, error);
+}
+
+// helper fn: expect two trees to have exactly the same splits and scores
+void ExpectSameTree(const hrf::Tree& expected, const hrf::Tree& actual) {
+    ASSERT_EQ(expected.children_.size(), actual.children_.size());
+    if (expected.children_.size() == 0) {
+        EXPECT_EQ(expected.SDensity(), actual.SDensity());
+        EXPECT_EQ(expected.BDensity(), actual.BDensity());
+        return;
+    }
+    EXPECT_EQ(expected.split_dim_, actual.split_dim_);
+    EXPECT_EQ(expected.split_val_, actual.split_val_);
+    ExpectSameTree(expected.children_[0], actual.children_[0]);
+    ExpectSameTree(expected.children_[1], actual.children_[1]);
+}
+
+typedef std::function<void(const hrf::Tree&, const hrf::trainer::RowIndices&)> NodeVisitor;
+
+// helper fn: call visit(node, indices) on 'node' and every node below it,
+// parents first, where 'indices' are the rows of 'matrix' that reach the node
+void ForEachNode(const hrf::Tree& node,
+                 const hrf::FeatureMatrix& matrix,
+                 const hrf::trainer::RowIndices& indices,
+                 const NodeVisitor& visit)
+{
+    visit(node, indices);
+    if (node.children_.size() == 0) {
+        return;
+    }
+    
+    int global_dim = (*node.target_features_)[node.split_dim_];
+    hrf::trainer::RowIndices upper, lower;
+    for (int row_index : indices) {
+        if (matrix.Get(row_index, global_dim) >= node.split_val_) {
+            upper.push_back(row_index);
+        }
+        else {
+            lower.push_back(row_index);
+        }
+    }
+    ForEachNode(node.children_[0], matrix, upper, visit);
+    ForEachNode(node.children_[1], matrix, lower, visit);
+}
+
+// helper fn: ForEachNode over every row of 'matrix', starting at the root
+void ForEachNode(const hrf::Tree& root, const hrf::FeatureMatrix& matrix, const NodeVisitor& visit) {
+    hrf::trainer::RowIndices all_rows;
+    for (std::size_t i=0; i<matrix.size(); ++i) {
+        all_rows.push_back(i);
+    }
+    ForEachNode(root, matrix, all_rows, visit);
+}
+
+// Histogram training computes most nodes' histograms by subtraction rather
+// than by counting rows; check that every node of the tree still got the same
+// split as a fresh FindBestSplitDim on the node's rows
+TEST(TreeTrainerTests, HistogramSubtraction) {
+    
+    std::vector<hrf::HiggsTrainingCsvRow> data_vector;
+    for (int i=0; i<2000; ++i) {
+        bool is_signal = bkp::random::RandInt(2) == 0;
+        double shift = is_signal ? 0.3 : 0.0;
+        data_vector.push_back(hrf::HiggsTrainingCsvRow(i,
+                                                       mock::PartialDataRandFill({
+                                                           bkp::random::RandDouble(0.0, 1.0) + shift,
+                                                           bkp::random::RandDouble(0.0, 1.0) - shift,
+                                                           static_cast<double>(bkp::random::RandInt(3))
+                                                       }),
+                                                       1.0,
+                                                       is_signal ? 's' : 'b'));
+    }
+    bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> training_set(
+        std::vector<const hrf::HiggsTrainingCsvRow>(data_vector.begin(), data_vector.end())
+    );
+    hrf::FeatureMatrix binned(training_set, hrf::BINNED8_FEATURES);
+    
+    hrf::Tree t(std::vector<int>({0, 1, 2}),
+                mock::shared_vector({-0.3, -0.3, 0.0}),
+                mock::shared_vector({1.3, 1.0, 2.0}));
+    hrf::trainer::TrainBestDim(t, binned);
+    ASSERT_EQ(2, t.children_.size());
+    
+    int n_internal = 0;
+    ForEachNode(t, binned, [&](const hrf::Tree& node, const hrf::trainer::RowIndices& indices) {
+        if (node.children_.size() == 0) {
+            return;
+        }
+        ++n_internal;
+        
+        int local_dim;
+        double split, entropy;
+        std::tie(local_dim, split, entropy) = hrf::trainer::FindBestSplitDim(node, binned, indices);
+        EXPECT_EQ(local_dim, node.split_dim_);
+        EXPECT_EQ(split, node.split_val_);
+    });
+    EXPECT_GT(n_internal, 3);
+}
+
 template<typename T>
 std::unique_ptr<T> MoveToUniquePtr(T&& move_from) {
     return std::unique_ptr<T>(new T(std::move(move_from)));
@@ -276,3 +485,376 @@ TEST(TreeTrainerTests, GlobalLocalDimSwap) {
 
 
 
+
+// helper fn: 2000 random rows over 3 features, signal shifted up on the
+// first and down on the second
+bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> ShiftedRandomRows() {
+    std::vector<hrf::HiggsTrainingCsvRow> data_vector;
+    for (int i=0; i<2000; ++i) {
+        bool is_signal = bkp::random::RandInt(2) == 0;
+        double shift = is_signal ? 0.3 : 0.0;
+        data_vector.push_back(hrf::HiggsTrainingCsvRow(i,
+                                                       mock::PartialDataRandFill({
+                                                           bkp::random::RandDouble(0.0, 1.0) + shift,
+                                                           bkp::random::RandDouble(0.0, 1.0) - shift,
+                                                           static_cast<double>(bkp::random::RandInt(3))
+                                                       }),
+                                                       1.0,
+                                                       is_signal ? 's' : 'b'));
+    }
+    return bkp::MaskedVector<const hrf::HiggsTrainingCsvRow>(
+        std::vector<const hrf::HiggsTrainingCsvRow>(data_vector.begin(), data_vector.end())
+    );
+}
+
+// Histogram best-dim training doesn't use random numbers, so training the
+// subtrees as parallel tasks must give exactly the same tree
+TEST(TreeTrainerTests, ParallelMatchesSerial) {
+    hrf::FeatureMatrix binned(ShiftedRandomRows(), hrf::BINNED8_FEATURES);
+    
+    hrf::Tree serial(std::vector<int>({0, 1, 2}),
+                     mock::shared_vector({-0.3, -0.3, 0.0}),
+                     mock::shared_vector({1.3, 1.0, 2.0}));
+    hrf::trainer::TrainBestDim(serial, binned);
+    ASSERT_EQ(2, serial.children_.size());
+    
+    bkp::TaskPool pool(4);
+    hrf::Tree parallel(std::vector<int>({0, 1, 2}),
+                       mock::shared_vector({-0.3, -0.3, 0.0}),
+                       mock::shared_vector({1.3, 1.0, 2.0}));
+    hrf::trainer::TrainBestDimParallel(parallel, binned, pool, 50);
+    
+    ExpectSameTree(serial, parallel);
+}
+
+// Searching each dimension as a separate task must find exactly the same
+// split as the serial search, and use up the same random numbers, including
+// when a dimension is skipped for having zero width (so draws no splits)
+TEST(TreeTrainerTests, ParallelSplitDim) {
+    auto rows = ShiftedRandomRows();
+    
+    // the third feature only takes the values 0, 1 and 2
+    hrf::trainer::RowIndices all_rows, zero_width_rows;
+    for (std::size_t i=0; i<rows.size(); ++i) {
+        all_rows.push_back(i);
+        if (rows[i].data_[2] == 1.0) {
+            zero_width_rows.push_back(i);
+        }
+    }
+    
+    const hrf::FeatureStorage storages[] = {
+        hrf::DOUBLE_FEATURES,
+        hrf::FLOAT_FEATURES,
+        hrf::QUANTIZED16_FEATURES,
+        hrf::BINNED8_FEATURES
+    };
+    bkp::TaskPool pool(4);
+    for (hrf::FeatureStorage storage : storages) {
+        hrf::FeatureMatrix matrix(rows, storage);
+        hrf::Tree t(std::vector<int>({2, 0, 1}),
+                    mock::shared_vector({0.0, -0.3, -0.3}),
+                    mock::shared_vector({2.0, 1.3, 1.0}));
+        
+        for (const hrf::trainer::RowIndices* indices : {&all_rows, &zero_width_rows}) {
+            bkp::random::Seed(11);
+            auto serial = hrf::trainer::FindBestSplitDim(t, matrix, *indices);
+            int serial_next = bkp::random::RandInt(1000000);
+            
+            bkp::random::Seed(11);
+            auto parallel = hrf::trainer::FindBestSplitDim(t, matrix, *indices, pool, 0);
+            int parallel_next = bkp::random::RandInt(1000000);
+            
+            EXPECT_NE(-1, std::get<0>(serial));
+            EXPECT_EQ(serial, parallel);
+            EXPECT_EQ(serial_next, parallel_next);
+        }
+    }
+}
+
+// Trees trained in parallel must still be consistent: every leaf's
+// densities come from exactly the training rows that fall in it
+TEST(TreeTrainerTests, ParallelRandDim) {
+    hrf::FeatureMatrix training_rows(ShiftedRandomRows());
+    
+    bkp::TaskPool pool(4);
+    hrf::Tree t(std::vector<int>({0, 1, 2}),
+                mock::shared_vector({-0.3, -0.3, 0.0}),
+                mock::shared_vector({1.3, 1.0, 2.0}));
+    hrf::trainer::TrainRandDimParallel(t, training_rows, pool, 50);
+    ASSERT_EQ(2, t.children_.size());
+    
+    int n_leaf_rows = 0;
+    ForEachNode(t, training_rows, [&](const hrf::Tree& node, const hrf::trainer::RowIndices& indices) {
+        if (node.children_.size() == 0) {
+            int s_count = 0;
+            for (int row_index : indices) {
+                s_count += training_rows.IsSignal()[row_index];
+            }
+            int b_count = static_cast<int>(indices.size()) - s_count;
+            EXPECT_DOUBLE_EQ(s_count / node.volume_, node.SDensity());
+            EXPECT_DOUBLE_EQ(b_count / node.volume_, node.BDensity());
+            n_leaf_rows += indices.size();
+        }
+    });
+    EXPECT_EQ(training_rows.size(), n_leaf_rows);
+}
+
+// Every node's label counts are passed down from its parent's split, so the
+// only label scan is the root's: TrainStats must count each node once, and
+// every internal node's rows as saved
+TEST(TreeTrainerTests, TrainStats) {
+    hrf::FeatureMatrix training_rows(ShiftedRandomRows());
+    hrf::Tree t(std::vector<int>({0, 1, 2}),
+                mock::shared_vector({-0.3, -0.3, 0.0}),
+                mock::shared_vector({1.3, 1.0, 2.0}));
+    
+    hrf::trainer::ResetTrainStats();
+    hrf::trainer::TrainRandDim(t, training_rows);
+    hrf::trainer::TrainStats stats = hrf::trainer::GetTrainStats();
+    ASSERT_EQ(2, t.children_.size());
+    
+    long long n_nodes = 0;
+    long long n_node_rows = 0;
+    long long n_internal_rows = 0;
+    ForEachNode(t, training_rows, [&](const hrf::Tree& node, const hrf::trainer::RowIndices& indices) {
+        ++n_nodes;
+        n_node_rows += indices.size();
+        if (node.children_.size() != 0) {
+            n_internal_rows += indices.size();
+        }
+    });
+    
+    EXPECT_EQ(n_nodes, stats.nodes_);
+    EXPECT_EQ(n_node_rows, stats.node_rows_);
+    EXPECT_EQ(n_internal_rows, stats.label_rows_saved_);
+    
+    hrf::trainer::ResetTrainStats();
+    EXPECT_EQ(0, hrf::trainer::GetTrainStats().nodes_);
+}
+
+// Growing a batch of histogram trees level by level must give exactly the
+// same trees as training them one at a time (best-dim training doesn't use
+// random numbers), including trees over different features
+TEST(TreeTrainerTests, BatchMatchesSerial) {
+    hrf::FeatureMatrix binned(ShiftedRandomRows(), hrf::BINNED8_FEATURES);
+    const std::vector<std::vector<int>> tree_features = { {0, 1, 2}, {1}, {2, 0}, {0, 1, 2}, {3, 1} };
+    
+    std::vector<std::unique_ptr<hrf::Tree>> serial, batched;
+    std::vector<hrf::Tree*> batch;
+    for (const std::vector<int>& features : tree_features) {
+        auto min_corner = std::make_shared<const std::vector<double>>(features.size(), -1.0);
+        auto max_corner = std::make_shared<const std::vector<double>>(features.size(), 3.0);
+        serial.push_back(std::unique_ptr<hrf::Tree>(new hrf::Tree(std::vector<int>(features), min_corner, max_corner)));
+        batched.push_back(std::unique_ptr<hrf::Tree>(new hrf::Tree(std::vector<int>(features), min_corner, max_corner)));
+        batch.push_back(batched.back().get());
+    }
+    
+    hrf::trainer::ResetTrainStats();
+    for (auto& tree : serial) {
+        hrf::trainer::TrainBestDim(*tree, binned);
+    }
+    hrf::trainer::TrainStats serial_stats = hrf::trainer::GetTrainStats();
+    
+    hrf::trainer::ResetTrainStats();
+    hrf::trainer::TrainBestDimBatch(batch, binned);
+    hrf::trainer::TrainStats batch_stats = hrf::trainer::GetTrainStats();
+    
+    for (std::size_t i=0; i<serial.size(); ++i) {
+        ASSERT_EQ(2, serial[i]->children_.size());
+        ExpectSameTree(*serial[i], *batched[i]);
+    }
+    EXPECT_EQ(serial_stats.nodes_, batch_stats.nodes_);
+    EXPECT_EQ(serial_stats.node_rows_, batch_stats.node_rows_);
+}
+
+// Training on a sample of the rows must give the same tree as training on a
+// FeatureMatrix of just those rows
+TEST(TreeTrainerTests, TrainOnSample) {
+    auto all_rows = ShiftedRandomRows();
+    std::vector<bool> is_sampled(all_rows.size());
+    hrf::trainer::RowIndices sample;
+    for (std::size_t i=0; i<all_rows.size(); ++i) {
+        is_sampled[i] = (i % 3 != 0);
+        if (is_sampled[i]) {
+            sample.push_back(i);
+        }
+    }
+    hrf::FeatureMatrix training_rows(all_rows);
+    hrf::FeatureMatrix sampled_rows(all_rows.Filter(is_sampled));
+    
+    hrf::Tree expected(std::vector<int>({0, 1, 2}),
+                       mock::shared_vector({-0.3, -0.3, 0.0}),
+                       mock::shared_vector({1.3, 1.0, 2.0}));
+    bkp::random::Seed(19);
+    hrf::trainer::TrainBestDim(expected, sampled_rows);
+    ASSERT_EQ(2, expected.children_.size());
+    
+    hrf::Tree actual(std::vector<int>({0, 1, 2}),
+                     mock::shared_vector({-0.3, -0.3, 0.0}),
+                     mock::shared_vector({1.3, 1.0, 2.0}));
+    bkp::random::Seed(19);
+    hrf::trainer::TrainBestDimSample(actual, training_rows, sample);
+    
+    ExpectSameTree(expected, actual);
+}
+
+// Streaming a batch of trees' training rows from disk a chunk at a time
+// must give exactly the same trees as the in-memory batch trainer, for both
+// best-dim and (for the same Seed) random-dim training
+TEST(TreeTrainerTests, StreamedMatchesBatch) {
+    mock::TempFile temp_file("tree_trainer_streamed_test.hrfbin");
+    const char* filename = temp_file.Path();
+    auto rows = ShiftedRandomRows();
+    std::vector<const hrf::HiggsTrainingCsvRow> row_vector;
+    for (std::size_t i=0; i<rows.size(); ++i) {
+        row_vector.push_back(rows[i]);
+    }
+    ASSERT_EQ(true, hrf::WriteBinaryCache(filename, row_vector, 0));
+    hrf::FeatureMatrix binned(rows, hrf::BINNED8_FEATURES);
+    hrf::StreamedTrainingSet streamed;
+    ASSERT_EQ(true, streamed.Open(filename, 300)); // 7 chunks, the last one short
+    
+    const std::vector<std::vector<int>> tree_features = { {0, 1, 2}, {1}, {2, 0}, {3, 1} };
+    for (bool best_dim : {true, false}) {
+        std::vector<std::unique_ptr<hrf::Tree>> batched, streamed_trees;
+        std::vector<hrf::Tree*> batch, streamed_batch;
+        for (const std::vector<int>& features : tree_features) {
+            auto min_corner = std::make_shared<const std::vector<double>>(features.size(), -1.0);
+            auto max_corner = std::make_shared<const std::vector<double>>(features.size(), 3.0);
+            batched.push_back(std::unique_ptr<hrf::Tree>(new hrf::Tree(std::vector<int>(features), min_corner, max_corner)));
+            streamed_trees.push_back(std::unique_ptr<hrf::Tree>(new hrf::Tree(std::vector<int>(features), min_corner, max_corner)));
+            batch.push_back(batched.back().get());
+            streamed_batch.push_back(streamed_trees.back().get());
+        }
+        
+        hrf::trainer::ResetTrainStats();
+        bkp::random::Seed(23);
+        if (best_dim) {
+            hrf::trainer::TrainBestDimBatch(batch, binned);
+        }
+        else {
+            hrf::trainer::TrainRandDimBatch(batch, binned);
+        }
+        hrf::trainer::TrainStats batch_stats = hrf::trainer::GetTrainStats();
+        
+        hrf::trainer::ResetTrainStats();
+        bkp::random::Seed(23);
+        if (best_dim) {
+            ASSERT_EQ(true, hrf::trainer::TrainBestDimStreamed(streamed_batch, streamed));
+        }
+        else {
+            ASSERT_EQ(true, hrf::trainer::TrainRandDimStreamed(streamed_batch, streamed));
+        }
+        hrf::trainer::TrainStats streamed_stats = hrf::trainer::GetTrainStats();
+        
+        for (std::size_t i=0; i<batched.size(); ++i) {
+            ASSERT_EQ(2, batched[i]->children_.size());
+            ExpectSameTree(*batched[i], *streamed_trees[i]);
+        }
+        EXPECT_EQ(batch_stats.nodes_, streamed_stats.nodes_);
+        EXPECT_EQ(batch_stats.node_rows_, streamed_stats.node_rows_);
+    }
+}
+
+// Each feature's order has its NaNs first, then its values in increasing
+// order, with equal values in row order
+TEST(TreeTrainerTests, FeatureOrders) {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    std::vector<const hrf::HiggsTrainingCsvRow> data_vector({
+        hrf::HiggsTrainingCsvRow(0, mock::PartialData({3.0, 1.0}), 1.0, 's'),
+        hrf::HiggsTrainingCsvRow(1, mock::PartialData({NaN, 1.0}), 1.0, 'b'),
+        hrf::HiggsTrainingCsvRow(2, mock::PartialData({1.0, 0.0}), 1.0, 's'),
+        hrf::HiggsTrainingCsvRow(3, mock::PartialData({3.0, NaN}), 1.0, 'b'),
+        hrf::HiggsTrainingCsvRow(4, mock::PartialData({2.0, 1.0}), 1.0, 's')
+    });
+    hrf::FeatureMatrix matrix(bkp::MaskedVector<const hrf::HiggsTrainingCsvRow>(std::move(data_vector)));
+    
+    hrf::trainer::FeatureOrders orders(matrix);
+    ASSERT_EQ(5, orders.size());
+    const hrf::trainer::RowRange by_0 = orders.Rows(0);
+    const hrf::trainer::RowRange by_1 = orders.Rows(1);
+    EXPECT_EQ(std::vector<int>({1, 2, 4, 0, 3}), std::vector<int>(by_0.begin(), by_0.end()));
+    EXPECT_EQ(std::vector<int>({3, 2, 0, 1, 4}), std::vector<int>(by_1.begin(), by_1.end()));
+}
+
+// The exact search finds a split that separates the labels perfectly, even
+// when it's a narrow gap that random candidate splits would almost always
+// miss, for each storage (NaNs go below the split)
+TEST(TreeTrainerTests, ExactSplit) {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    std::vector<hrf::HiggsTrainingCsvRow> data_vector;
+    for (int i=0; i<110; ++i) {
+        double val = (i < 100) ? static_cast<double>(i) : NaN;
+        data_vector.push_back(hrf::HiggsTrainingCsvRow(i,
+                                                       mock::PartialDataRandFill({ val, bkp::random::RandDouble(0.0, 1.0) }),
+                                                       1.0,
+                                                       (i >= 37 && i < 100) ? 's' : 'b'));
+    }
+    bkp::MaskedVector<const hrf::HiggsTrainingCsvRow> training_set(
+        std::vector<const hrf::HiggsTrainingCsvRow>(data_vector.begin(), data_vector.end())
+    );
+    
+    const hrf::FeatureStorage storages[] = {
+        hrf::DOUBLE_FEATURES,
+        hrf::FLOAT_FEATURES,
+        hrf::QUANTIZED16_FEATURES
+    };
+    for (hrf::FeatureStorage storage : storages) {
+        hrf::FeatureMatrix matrix(training_set, storage);
+        hrf::trainer::FeatureOrders orders(matrix);
+        
+        hrf::Tree tree(std::vector<int>({1, 0}),
+                       mock::shared_vector({0.0, 0.0}),
+                       mock::shared_vector({1.0, 99.0}));
+        hrf::trainer::TrainBestDimExact(tree, matrix, orders);
+        
+        ASSERT_EQ(2, tree.children_.size());
+        EXPECT_EQ(1, tree.split_dim_); // local dim of feature 0
+        EXPECT_NEAR(36.5, tree.split_val_, 0.01);
+        EXPECT_EQ(0, tree.children_[0].children_.size());
+        EXPECT_EQ(0, tree.children_[1].children_.size());
+        EXPECT_EQ(0.0, tree.children_[0].BDensity());
+        EXPECT_EQ(0.0, tree.children_[1].SDensity());
+    }
+}
+
+// With BINNED8_FEATURES, the exact search tries the same splits as the
+// histogram search, in the same order, so it must give exactly the same
+// trees, for both best-dim and (for the same Seed) random-dim training
+TEST(TreeTrainerTests, ExactMatchesHistogram) {
+    hrf::FeatureMatrix binned(ShiftedRandomRows(), hrf::BINNED8_FEATURES);
+    hrf::trainer::FeatureOrders orders(binned);
+    
+    for (bool best_dim : {true, false}) {
+        hrf::Tree histogram(std::vector<int>({0, 1, 2}),
+                            mock::shared_vector({-0.3, -0.3, 0.0}),
+                            mock::shared_vector({1.3, 1.0, 2.0}));
+        hrf::trainer::ResetTrainStats();
+        bkp::random::Seed(29);
+        if (best_dim) {
+            hrf::trainer::TrainBestDim(histogram, binned);
+        }
+        else {
+            hrf::trainer::TrainRandDim(histogram, binned);
+        }
+        hrf::trainer::TrainStats histogram_stats = hrf::trainer::GetTrainStats();
+        ASSERT_EQ(2, histogram.children_.size());
+        
+        hrf::Tree exact(std::vector<int>({0, 1, 2}),
+                        mock::shared_vector({-0.3, -0.3, 0.0}),
+                        mock::shared_vector({1.3, 1.0, 2.0}));
+        hrf::trainer::ResetTrainStats();
+        bkp::random::Seed(29);
+        if (best_dim) {
+            hrf::trainer::TrainBestDimExact(exact, binned, orders);
+        }
+        else {
+            hrf::trainer::TrainRandDimExact(exact, binned, orders);
+        }
+        hrf::trainer::TrainStats exact_stats = hrf::trainer::GetTrainStats();
+        
+        ExpectSameTree(histogram, exact);
+        EXPECT_EQ(histogram_stats.nodes_, exact_stats.nodes_);
+        EXPECT_EQ(histogram_stats.node_rows_, exact_stats.node_rows_);
+    }
+}
\ No newline at end of file
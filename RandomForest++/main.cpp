@@ -13,6 +13,7 @@
 #include <limits>
 #include <string>
 #include <cstdlib>
+#include <cassert>
 
 #include <boost/iterator/counting_iterator.hpp>
 
@@ -26,6 +27,7 @@
 #include "ScoreCacher.h"
 #include "Classifier.h"
 #include "AmsCalculator.h"
+#include "PredictionPipeline.h"
 
 using bkp::MaskedVector;
 using hrf::HiggsCsvRow;
@@ -37,10 +39,30 @@ const double COLS_PER_MODEL = 3;
 const int NUM_TREES = 2500;
 const bool USE_SCORE_CACHER = true;
 const std::string OUTFILE = "/Users/bkputnam/Desktop/hrf_output.csv";
+const bool STREAM_TEST_DATA = true; // parse/score/write test.csv in batches instead of all at once
+const hrf::FeatureStorage FEATURE_STORAGE = hrf::DOUBLE_FEATURES; // precision of the training FeatureMatrix (BINNED8_FEATURES trains with histogram splits)
+const hrf::SampleMethod TREE_SAMPLE_METHOD = hrf::ALL_ROWS; // BOOTSTRAP or SUBSAMPLE to train each tree on its own random sample of the training rows
+const double TREE_SAMPLE_FRACTION = 1.0; // size of each tree's sample, as a fraction of the training rows
+const bool TRAIN_LEVEL_WISE = false; // grow batches of trees together one level at a time (see trainer::TrainRandDimBatch; needs BINNED8_FEATURES and ALL_ROWS, and not EXACT_SPLITS)
+const bool EXACT_SPLITS = false; // try every split of each node, from rows presorted once (see trainer::TrainRandDimExact; every tree gets every row)
+const bool COMPARE_FEATURE_STORAGE = false; // print validation AMS of a small forest trained with each FeatureStorage
+const int NUM_COMPARISON_TREES = 250;
+const bool COMPARE_FOREST_SIZES = false; // print validation AMS as one forest grows through each of FOREST_SIZES trees
+const int FOREST_SIZES[] = { 250, 500, 1000, 2500, 5000 };
+const double TRAINING_SAMPLE_FRACTION = 1.0; // e.g. 0.1 to iterate on a stratified 10% of training.csv
 
 void PlayWinSound();
 void PlayFailSound();
 void PlayDingSound();
+double TuneCutoff(hrf::Classifier& classifier,
+                  hrf::AmsCalculator& ams_calculator,
+                  const MaskedVector<const HiggsCsvRow>& validation_set,
+                  double& best_cutoff,
+                  double& best_exponent);
+void CompareFeatureStorage(const MaskedVector<const HiggsTrainingCsvRow>& train_set,
+                           const MaskedVector<const HiggsTrainingCsvRow>& validation_set);
+void CompareForestSizes(const MaskedVector<const HiggsTrainingCsvRow>& train_set,
+                        const MaskedVector<const HiggsTrainingCsvRow>& validation_set);
 
 int main(int argc, const char * argv[]) {
     
@@ -49,7 +71,11 @@ int main(int argc, const char * argv[]) {
     StartTimer("Running RandomForest++"); // global timer
     
     StartTimer("Loading training data");
-    MaskedVector<const HiggsTrainingCsvRow> alltraindata = hrf::LoadTrainingData();
+    hrf::LoadOptions load_options;
+    load_options.parallel_ = PARALLEL;
+    load_options.sample_fraction_ = TRAINING_SAMPLE_FRACTION;
+    load_options.stratify_ = true;
+    MaskedVector<const HiggsTrainingCsvRow> alltraindata = hrf::LoadTrainingData("data/training.csv", load_options);
     EndTimer();
     
     StartTimer("Splitting into validation and training sets");
@@ -61,44 +87,71 @@ int main(int argc, const char * argv[]) {
     const auto train_set_downcasted = hrf::ConvertRows(*train_set);
     EndTimer();
     
+    if (COMPARE_FEATURE_STORAGE) {
+        CompareFeatureStorage(*train_set, validation_set);
+    }
+    if (COMPARE_FOREST_SIZES) {
+        CompareForestSizes(*train_set, validation_set);
+    }
+    
     StartTimer("Training " + std::to_string(NUM_TREES) + " trees");
-    hrf::TreeCreator tree_creator(*train_set,
-                                  hrf::trainer::TrainRandDim,
-                                  COLS_PER_MODEL);
+    hrf::trainer::ResetTrainStats();
+    hrf::TreeSampleOptions sample_options;
+    sample_options.method_ = TREE_SAMPLE_METHOD;
+    sample_options.sample_fraction_ = TREE_SAMPLE_FRACTION;
+    sample_options.stratify_ = true;
+    hrf::FeatureMatrix train_matrix(*train_set, FEATURE_STORAGE);
+    std::unique_ptr<hrf::TreeCreator> tree_creator;
+    if (EXACT_SPLITS) {
+        // sorted once, for every tree (the TreeCreator's copy of
+        // train_matrix has the same rows), so there's no per-tree sample
+        assert(TREE_SAMPLE_METHOD == hrf::ALL_ROWS);
+        auto orders = std::make_shared<const hrf::trainer::FeatureOrders>(train_matrix);
+        tree_creator.reset(new hrf::TreeCreator(std::move(train_matrix),
+                                                [orders](hrf::Tree& tree, const hrf::FeatureMatrix& rows) {
+                                                    hrf::trainer::TrainRandDimExact(tree, rows, *orders);
+                                                },
+                                                COLS_PER_MODEL));
+    }
+    else {
+        tree_creator.reset(new hrf::TreeCreator(std::move(train_matrix),
+                                                hrf::trainer::TrainRandDimSample,
+                                                COLS_PER_MODEL,
+                                                sample_options));
+    }
     hrf::ScoreAverager::IScorerVector trees;
-    if (PARALLEL) {
-        trees = tree_creator.MakeTreesParallel(NUM_TREES);
+    if (TRAIN_LEVEL_WISE) {
+        // the batch trainer replaces the TreeCreator's trainer, and trains
+        // every tree on every row
+        assert(!EXACT_SPLITS);
+        assert(TREE_SAMPLE_METHOD == hrf::ALL_ROWS);
+        trees = tree_creator->MakeTreesBatched(NUM_TREES, hrf::trainer::TrainRandDimBatch);
+    }
+    else if (PARALLEL) {
+        trees = tree_creator->MakeTreesParallel(NUM_TREES);
     }
     else {
-        trees = tree_creator.MakeTrees(NUM_TREES);
+        trees = tree_creator->MakeTrees(NUM_TREES);
     }
     std::unique_ptr<hrf::IScorer> forest(new hrf::ScoreAverager(std::move(trees)));
     EndTimer();
+    hrf::trainer::TrainStats train_stats = hrf::trainer::GetTrainStats();
+    std::cout << "\t\tNodes: " << train_stats.nodes_
+              << " (" << train_stats.node_rows_ << " node rows, "
+              << train_stats.label_rows_saved_ << " label re-counts avoided)" << std::endl;
     
     StartTimer("Creating and tuning classifier");
-    const double NaN = std::numeric_limits<double>::quiet_NaN();
-    const double MIN_EXPONENT = -1.0;
-    const double MAX_EXPONENT = 1.0;
-    const double EXPONENT_STEP = 0.1;
-    double best_cutoff = NaN;
-    double best_exponent = NaN;
-    double best_score = std::numeric_limits<double>::lowest();
+    double best_cutoff, best_exponent;
     if (USE_SCORE_CACHER) {
         forest = std::unique_ptr<hrf::ScoreCacher>(new hrf::ScoreCacher(std::move(forest)));
     }
     hrf::Classifier classifier(std::move(forest));
     hrf::AmsCalculator ams_calculator(validation_set);
-    for (double exponent=MIN_EXPONENT; exponent<=MAX_EXPONENT; exponent+=EXPONENT_STEP) {
-        double cutoff = std::exp(exponent);
-        classifier.cutoff_ = cutoff;
-        double score = ams_calculator.CalcAms(classifier.Classify(validation_set_downcasted, PARALLEL));
-        
-        if (score > best_score) {
-            best_score = score;
-            best_exponent = exponent;
-            best_cutoff = cutoff;
-        }
-    }
+    double best_score = TuneCutoff(classifier,
+                                   ams_calculator,
+                                   validation_set_downcasted,
+                                   best_cutoff,
+                                   best_exponent);
     EndTimer();
     if (USE_SCORE_CACHER) {
         // reset classifier to use forest directly, instead of wrapping it in a ScoreCacher
@@ -119,19 +172,30 @@ int main(int argc, const char * argv[]) {
         return 0;
     }
     
-    StartTimer("Loading Test Data");
-    auto test_data = hrf::LoadTestData();
-    EndTimer();
-    
-    StartTimer("Scoring Test Data");
-    auto predictions = classifier.Classify(test_data, PARALLEL);
-    EndTimer();
-    
-    StartTimer("Writing Output");
-    std::vector<int> confidences(boost::counting_iterator<int>(0),
-                                 boost::counting_iterator<int>(static_cast<int>(test_data.size())));
-    hrf::WritePredictions(OUTFILE, test_data, predictions, confidences);
-    EndTimer();
+    if (STREAM_TEST_DATA) {
+        StartTimer("Scoring Test Data (streaming)");
+        hrf::PipelineOptions pipeline_options;
+        pipeline_options.parallel_ = PARALLEL;
+        if (!hrf::StreamPredictions(classifier, "data/test.csv", OUTFILE, pipeline_options)) {
+            std::cout << "\t\tFailed to write " << OUTFILE << std::endl;
+        }
+        EndTimer();
+    }
+    else {
+        StartTimer("Loading Test Data");
+        auto test_data = hrf::LoadTestData(PARALLEL);
+        EndTimer();
+        
+        StartTimer("Scoring Test Data");
+        auto predictions = classifier.Classify(test_data, PARALLEL);
+        EndTimer();
+        
+        StartTimer("Writing Output");
+        std::vector<int> confidences(boost::counting_iterator<int>(0),
+                                     boost::counting_iterator<int>(static_cast<int>(test_data.size())));
+        hrf::WritePredictions(OUTFILE, test_data, predictions, confidences, PARALLEL);
+        EndTimer();
+    }
     
     EndTimer(); // end global timer
     
@@ -139,6 +203,119 @@ int main(int argc, const char * argv[]) {
     return 0;
 }
 
+// Try a range of cutoffs on classifier, and leave it set to the one with the
+// best AMS on validation_set. Returns that AMS, and also stores the cutoff
+// (and its log) in best_cutoff and best_exponent.
+double TuneCutoff(hrf::Classifier& classifier,
+                  hrf::AmsCalculator& ams_calculator,
+                  const MaskedVector<const HiggsCsvRow>& validation_set,
+                  double& best_cutoff,
+                  double& best_exponent)
+{
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    const double MIN_EXPONENT = -1.0;
+    const double MAX_EXPONENT = 1.0;
+    const double EXPONENT_STEP = 0.1;
+    best_cutoff = NaN;
+    best_exponent = NaN;
+    double best_score = std::numeric_limits<double>::lowest();
+    for (double exponent=MIN_EXPONENT; exponent<=MAX_EXPONENT; exponent+=EXPONENT_STEP) {
+        double cutoff = std::exp(exponent);
+        classifier.cutoff_ = cutoff;
+        double score = ams_calculator.CalcAms(classifier.Classify(validation_set, PARALLEL));
+        
+        if (score > best_score) {
+            best_score = score;
+            best_exponent = exponent;
+            best_cutoff = cutoff;
+        }
+    }
+    classifier.cutoff_ = best_cutoff;
+    return best_score;
+}
+
+// Train a small forest from the same seed with each FeatureStorage, and
+// print how much memory its features took and its best validation AMS, to
+// check how much accuracy the reduced-precision modes give up.
+void CompareFeatureStorage(const MaskedVector<const HiggsTrainingCsvRow>& train_set,
+                           const MaskedVector<const HiggsTrainingCsvRow>& validation_set)
+{
+    StartTimer("Comparing feature storage modes");
+    const auto validation_set_downcasted = hrf::ConvertRows(validation_set);
+    hrf::AmsCalculator ams_calculator(validation_set);
+    
+    const hrf::FeatureStorage storages[] = {
+        hrf::DOUBLE_FEATURES,
+        hrf::FLOAT_FEATURES,
+        hrf::QUANTIZED16_FEATURES,
+        hrf::BINNED8_FEATURES
+    };
+    const char* names[] = { "double", "float", "quantized16", "binned8 (histogram splits)" };
+    
+    for (int i=0; i<4; ++i) {
+        hrf::FeatureMatrix matrix(train_set, storages[i]);
+        std::size_t feature_bytes = matrix.FeatureBytes();
+        
+        bkp::random::Seed(42);
+        hrf::TreeCreator tree_creator(std::move(matrix),
+                                      hrf::trainer::TrainRandDim,
+                                      COLS_PER_MODEL);
+        auto trees = PARALLEL ? tree_creator.MakeTreesParallel(NUM_COMPARISON_TREES) :
+                                tree_creator.MakeTrees(NUM_COMPARISON_TREES);
+        hrf::Classifier classifier(std::unique_ptr<hrf::IScorer>(new hrf::ScoreAverager(std::move(trees))));
+        
+        double best_cutoff, best_exponent;
+        double score = TuneCutoff(classifier,
+                                  ams_calculator,
+                                  validation_set_downcasted,
+                                  best_cutoff,
+                                  best_exponent);
+        std::cout << "\t\t" << names[i] << ": "
+                  << feature_bytes / (1024 * 1024) << " MB of features, "
+                  << "best validation score " << score << std::endl;
+    }
+    EndTimer();
+}
+
+// Grow one forest through each of FOREST_SIZES trees, printing its best
+// validation AMS at each size. Each step only trains and scores the trees
+// it adds; the validation log scores of the trees before them are kept in a
+// ScoreSums.
+void CompareForestSizes(const MaskedVector<const HiggsTrainingCsvRow>& train_set,
+                        const MaskedVector<const HiggsTrainingCsvRow>& validation_set)
+{
+    StartTimer("Comparing forest sizes");
+    const auto validation_set_downcasted = hrf::ConvertRows(validation_set);
+    hrf::AmsCalculator ams_calculator(validation_set);
+    
+    bkp::random::Seed(42);
+    hrf::TreeCreator tree_creator(hrf::FeatureMatrix(train_set, FEATURE_STORAGE),
+                                  hrf::trainer::TrainRandDim,
+                                  COLS_PER_MODEL);
+    hrf::ScoreAverager forest;
+    hrf::ScoreSums validation_sums;
+    
+    for (int n_trees : FOREST_SIZES) {
+        int n_new_trees = n_trees - static_cast<int>(forest.size());
+        forest.AddModels(PARALLEL ? tree_creator.MakeTreesParallel(n_new_trees) :
+                                    tree_creator.MakeTrees(n_new_trees));
+        forest.Accumulate(validation_set_downcasted, validation_sums, PARALLEL);
+        
+        std::unique_ptr<hrf::ScoreResult> validation_scores(new hrf::ScoreResult(validation_sums.Mean()));
+        hrf::Classifier classifier(std::unique_ptr<hrf::IScorer>(new hrf::ScoreCacher(std::move(validation_scores))));
+        
+        double best_cutoff, best_exponent;
+        double score = TuneCutoff(classifier,
+                                  ams_calculator,
+                                  validation_set_downcasted,
+                                  best_cutoff,
+                                  best_exponent);
+        std::cout << "\t\t" << n_trees << " trees: "
+                  << "best validation score " << score << std::endl;
+    }
+    EndTimer();
+}
+
 void PlaySound(std::string filename) {
     if (system(nullptr)) {
         system(("afplay data/" + filename).c_str());